@@ -60,10 +60,10 @@ set(SRC
     src/CanadianTidesgui.cpp
     src/CanadianTidesgui_impl.cpp
     src/CanadianTidesgui_impl.h
-	src/NavFunc.cpp
-	src/NavFunc.h
 	src/tidetable.cpp
 	src/tidetable.h
+	src/tideoverlay.cpp
+	src/tideoverlay.h
 	src/gl_private.h
 	src/pidc.cpp
 	src/pidc.h
@@ -0,0 +1,95 @@
+# ~~~
+# Summary:      GUI-free core library: data, network, prediction and index code
+# Copyright (c) 2020-2021 Mike Rossiter
+# License:      GPLv3+
+# ~~~
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+# Defines canadiantides_core, a static library without wxWidgets or the
+# plugin api. The plugin links it, and so do the headless tools/, which
+# include this file on their own. Expects ocpn::jsoncpp and ocpn::tinyxml.
+
+if (TARGET canadiantides_core)
+  return ()
+endif ()
+
+set(_core_dir ${CMAKE_CURRENT_LIST_DIR}/../src)
+
+add_library(canadiantides_core STATIC
+  ${_core_dir}/NavFunc.cpp
+  ${_core_dir}/NavFunc.h
+  ${_core_dir}/harmonics.cpp
+  ${_core_dir}/harmonics.h
+  ${_core_dir}/tidealmanac.cpp
+  ${_core_dir}/tidealmanac.h
+  ${_core_dir}/tidecatalog.cpp
+  ${_core_dir}/tidecatalog.h
+  ${_core_dir}/tidecurrents.cpp
+  ${_core_dir}/tidecurrents.h
+  ${_core_dir}/tidedeparture.cpp
+  ${_core_dir}/tidedeparture.h
+  ${_core_dir}/tideexpiry.cpp
+  ${_core_dir}/tideexpiry.h
+  ${_core_dir}/tideextrema.cpp
+  ${_core_dir}/tideextrema.h
+  ${_core_dir}/tidefetch.cpp
+  ${_core_dir}/tidefetch.h
+  ${_core_dir}/tidefield.cpp
+  ${_core_dir}/tidefield.h
+  ${_core_dir}/tidegeo.cpp
+  ${_core_dir}/tidegeo.h
+  ${_core_dir}/tidehover.cpp
+  ${_core_dir}/tidehover.h
+  ${_core_dir}/tidelevels.cpp
+  ${_core_dir}/tidelevels.h
+  ${_core_dir}/tideobs.cpp
+  ${_core_dir}/tideobs.h
+  ${_core_dir}/tidepager.cpp
+  ${_core_dir}/tidepager.h
+  ${_core_dir}/tidepool.cpp
+  ${_core_dir}/tidepool.h
+  ${_core_dir}/tidequery.cpp
+  ${_core_dir}/tidequery.h
+  ${_core_dir}/tideroute.cpp
+  ${_core_dir}/tideroute.h
+  ${_core_dir}/tidesearch.cpp
+  ${_core_dir}/tidesearch.h
+  ${_core_dir}/tideseries.cpp
+  ${_core_dir}/tideseries.h
+  ${_core_dir}/tidestations.cpp
+  ${_core_dir}/tidestations.h
+  ${_core_dir}/tidetime.cpp
+  ${_core_dir}/tidetime.h
+  ${_core_dir}/tidetrace.cpp
+  ${_core_dir}/tidetrace.h
+  ${_core_dir}/tideworker.cpp
+  ${_core_dir}/tideworker.h
+)
+set_target_properties(canadiantides_core PROPERTIES POSITION_INDEPENDENT_CODE ON)
+target_include_directories(canadiantides_core PUBLIC ${_core_dir})
+
+find_package(Threads REQUIRED)
+target_link_libraries(canadiantides_core
+  PUBLIC ocpn::jsoncpp ocpn::tinyxml Threads::Threads
+)
+
+# In-memory downloads, see src/tidefetch.cpp. Without libcurl the plugin
+# falls back to OCPN_downloadFile().
+if (NOT QT_ANDROID)
+  find_package(CURL)
+endif ()
+if (CURL_FOUND)
+  target_include_directories(canadiantides_core PRIVATE ${CURL_INCLUDE_DIRS})
+  target_link_libraries(canadiantides_core PUBLIC ${CURL_LIBRARIES})
+  target_compile_definitions(canadiantides_core PRIVATE CANADIANTIDES_USE_CURL)
+endif ()
+
+find_package(ZLIB)
+if (ZLIB_FOUND)
+  target_link_libraries(canadiantides_core PUBLIC ZLIB::ZLIB)
+  target_compile_definitions(canadiantides_core PRIVATE CANADIANTIDES_USE_ZLIB)
+endif ()
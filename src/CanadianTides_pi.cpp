@@ -37,6 +37,9 @@
 
 #include <wx/stdpaths.h>
 
+#include "tidefetch.h"
+#include "tidetrace.h"
+
 
 
 class CanadianTides_pi;
@@ -145,6 +148,15 @@ int CanadianTides_pi::Init(void)
 	(new wxMenuItem(&dummy_menu, -1, _("Select Canadian Tidal Station")), this);
 	SetCanvasContextMenuItemViz(m_position_menu_id, false);
 
+	m_watch_menu_id = AddCanvasContextMenuItem
+		(new wxMenuItem(&dummy_menu, -1, _("Watch/Unwatch Observed Water Level")), this);
+	SetCanvasContextMenuItemViz(m_watch_menu_id, false);
+
+	m_trace_menu_id = -1;
+	if (!m_trace_file.IsEmpty())
+		m_trace_menu_id = AddCanvasContextMenuItem
+			(new wxMenuItem(&dummy_menu, -1, _("Start/Stop CanadianTides Trace")), this);
+
      m_pDialog = NULL;	 
 	
 	
@@ -152,6 +164,8 @@ int CanadianTides_pi::Init(void)
       return (WANTS_OVERLAY_CALLBACK |
               WANTS_OPENGL_OVERLAY_CALLBACK |		      
 		      WANTS_CURSOR_LATLON      |
+              WANTS_NMEA_EVENTS         |
+              WANTS_PLUGIN_MESSAGING    |
               WANTS_TOOLBAR_CALLBACK    |
               INSTALLS_TOOLBAR_TOOL     |
               WANTS_CONFIG            
@@ -176,6 +190,9 @@ bool CanadianTides_pi::DeInit(void)
 			SetToolbarItemState( m_leftclick_tool_id, m_bShowCanadianTides );
 
       }	
+
+    if (TideTraceEnabled())
+        ToggleTrace();
     
     SaveConfig();
     
@@ -246,6 +263,7 @@ void CanadianTides_pi::OnToolbarToolCallback(int id)
            
 		    m_pDialog = new Dlg(*this, m_parent_window);
             m_pDialog->plugin = this;
+            m_pDialog->m_apiBaseUrl = m_api_base_url;
             m_pDialog->Move(wxPoint(m_route_dialog_x, m_route_dialog_y));
 
 			wxFileName fn;
@@ -321,6 +339,10 @@ bool CanadianTides_pi::LoadConfig(void)
       {
             pConf->SetPath ( _T( "/Settings/CanadianTides_pi" ) );
 			 pConf->Read ( _T( "ShowCanadianTidesIcon" ), &m_bCanadianTidesShowIcon, 1 );
+			 // Allows pointing the plugin at a local IWLS stand-in, see tools/iwls_replay.cpp
+			 pConf->Read ( _T( "ApiBaseUrl" ), &m_api_base_url, IWLS_API_BASE_URL );
+			 // Adds a context menu item recording a Chrome trace to this file, see src/tidetrace.h
+			 pConf->Read ( _T( "TraceFile" ), &m_trace_file, wxEmptyString );
            
             m_route_dialog_x =  pConf->Read ( _T ( "DialogPosX" ), 20L );
             m_route_dialog_y =  pConf->Read ( _T ( "DialogPosY" ), 20L );
@@ -343,6 +365,8 @@ bool CanadianTides_pi::SaveConfig(void)
       {
             pConf->SetPath ( _T ( "/Settings/CanadianTides_pi" ) );
 			pConf->Write ( _T ( "ShowCanadianTidesIcon" ), m_bCanadianTidesShowIcon );
+			pConf->Write ( _T ( "ApiBaseUrl" ), m_api_base_url );
+			pConf->Write ( _T ( "TraceFile" ), m_trace_file );
           
             pConf->Write ( _T ( "DialogPosX" ),   m_route_dialog_x );
             pConf->Write ( _T ( "DialogPosY" ),   m_route_dialog_y );
@@ -353,6 +377,22 @@ bool CanadianTides_pi::SaveConfig(void)
             return false;
 }
 
+void CanadianTides_pi::ToggleTrace(void)
+{
+	if (!TideTraceEnabled()) {
+		TideTraceStart();
+		wxLogMessage(_T("CanadianTides: tracing started"));
+		return;
+	}
+
+	TideTraceStop();
+	std::string error;
+	if (TideTraceWrite(std::string(m_trace_file.mb_str()), error))
+		wxLogMessage(_T("CanadianTides: trace written to ") + m_trace_file);
+	else
+		wxLogMessage(_T("CanadianTides: ") + wxString(error.c_str(), wxConvUTF8));
+}
+
 bool CanadianTides_pi::RenderOverlay(wxDC &dc, PlugIn_ViewPort *vp)
 {
 	if (!m_pDialog)
@@ -380,6 +420,11 @@ bool CanadianTides_pi::RenderGLOverlay(wxGLContext *pcontext, PlugIn_ViewPort *v
 
 void CanadianTides_pi::OnContextMenuItemCallback(int id)
 {
+	if (id == m_trace_menu_id) {
+		ToggleTrace();
+		return;
+	}
+
 	if (!m_pDialog)
 		return;
 	
@@ -387,11 +432,45 @@ void CanadianTides_pi::OnContextMenuItemCallback(int id)
 		m_cursor_lat = GetCursorLat();
 		m_cursor_lon = GetCursorLon();
 		m_pDialog->getPort(m_cursor_lat, m_cursor_lon);
-	}	
+	}
+	else if (id == m_watch_menu_id) {
+		m_cursor_lat = GetCursorLat();
+		m_cursor_lon = GetCursorLon();
+		m_pDialog->WatchObservedLevels(m_cursor_lat, m_cursor_lon);
+	}
 }
 
 void CanadianTides_pi::SetCursorLatLon(double lat, double lon)
 {
 	m_cursor_lat = lat;
 	m_cursor_lon = lon;
+	if (m_pDialog)
+		m_pDialog->SetHoverLatLon(lat, lon);
+}
+
+void CanadianTides_pi::SetPositionFix(PlugIn_Position_Fix &pfix)
+{
+	if (pfix.Lat != pfix.Lat || pfix.Lon != pfix.Lon)
+		return;
+
+	m_ship_lat = pfix.Lat;
+	m_ship_lon = pfix.Lon;
+	if (m_pDialog)
+		m_pDialog->SetOwnShip(m_ship_lat, m_ship_lon);
+}
+
+void CanadianTides_pi::SetPluginMessage(wxString &message_id, wxString &message_body)
+{
+	if (message_id != TIDE_QUERY_MESSAGE)
+		return;
+
+	if (m_pDialog) {
+		m_pDialog->SubmitQuery(message_body);
+		return;
+	}
+
+	// Station data is loaded with the dialog
+	wxString id(TIDE_QUERY_REPLY_MESSAGE);
+	wxString body("{\"error\":\"CanadianTides is not open\"}");
+	SendPluginMessage(id, body);
 }
@@ -87,6 +87,8 @@ public:
 //    The override PlugIn Methods
 	void OnContextMenuItemCallback(int id);
 	void SetCursorLatLon(double lat, double lon);
+	void SetPositionFix(PlugIn_Position_Fix &pfix);
+	void SetPluginMessage(wxString &message_id, wxString &message_body);
 
 
 //    Other public methods
@@ -101,6 +103,8 @@ public:
 	  double GetCursorLat(void) { return m_cursor_lat; }
 	  
 	  int m_position_menu_id;
+	  int m_watch_menu_id;
+	  int m_trace_menu_id;
 
 private:
       
@@ -116,6 +120,7 @@ private:
       wxWindow          *m_parent_window;
       bool              LoadConfig(void);
       bool              SaveConfig(void);
+      void              ToggleTrace(void);
       Dlg               *m_pDialog;
       int               m_route_dialog_x, m_route_dialog_y,m_route_dialog_width,m_route_dialog_height;
       int               m_display_width, m_display_height;      
@@ -124,6 +129,8 @@ private:
       double m_ship_lon,m_ship_lat;
 
 	  bool             m_bCanadianTidesShowIcon;
+	  wxString         m_api_base_url;
+	  wxString         m_trace_file;
 	  bool             m_bShowCanadianTides;
 	  wxBitmap         m_panelBitmap;
 };
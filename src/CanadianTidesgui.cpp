@@ -40,7 +40,7 @@ DlgDef::DlgDef( wxWindow* parent, wxWindowID id, const wxString& title, const wx
 
 	bSizer5->Add( m_staticText9, 0, wxALL, 5 );
 
-	wxString m_choice3Choices[] = { _("1"), _("2"), _("3"), _("4"), _("5"), _("6"), _("7") };
+	wxString m_choice3Choices[] = { _("1"), _("2"), _("3"), _("4"), _("5"), _("6"), _("7"), _("14"), _("30"), _("60"), _("90") };
 	int m_choice3NChoices = sizeof( m_choice3Choices ) / sizeof( wxString );
 	m_choice3 = new wxChoice( this, wxID_ANY, wxDefaultPosition, wxDefaultSize, m_choice3NChoices, m_choice3Choices, 0 );
 	m_choice3->SetSelection( 0 );
@@ -30,17 +30,30 @@
 #include "wx/dir.h"
 #include "CanadianTides_pi.h"
 
+#include <wx/dirdlg.h>
+#include <wx/filedlg.h>
 #include <wx/ffile.h>
 #include <wx/filefn.h>
 #include <wx/textfile.h>
 #include <wx/url.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <wx/glcanvas.h>
 #include <wx/graphics.h>
 #include "qtstylesheet.h"
 
 #include "bbox.h"
 #include "pidc.h"
+#include "tidefetch.h"
+#include "tidepager.h"
+#include "tideobs.h"
+#include "tidealmanac.h"
+#include "tidetime.h"
+#include "tideoverlay.h"
+#include "tidetrace.h"
 
 #ifdef __OCPN__ANDROID__
 wxWindow *g_Window;
@@ -123,15 +136,627 @@ Dlg::Dlg(CanadianTides_pi &_CanadianTides_pi, wxWindow* parent)
     Connect( wxEVT_MOTION, wxMouseEventHandler( Dlg::OnMouseEvent ) );
 #endif
 
+	m_expiry = new TideExpiryTrimmer(m_savedPorts);
 	LoadTidalEventsFromXml();
-	RemoveOldDownloads();
+	m_expiryGeneration = m_expiry->Generation();
+	m_expiry->Start();
+	m_expiryTimer.SetOwner(this, ID_EXPIRY_TIMER);
+	Connect(ID_EXPIRY_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnExpiryTimer));
+	m_expiryTimer.Start(60000);
 
 	b_clearAllIcons = true;
 	b_clearSavedIcons = true;
+
+	m_hwlwGeneration = 0;
+	tidetable = NULL;
+	m_vp = NULL;
+	m_viewScale = 0;
+	m_apiBaseUrl = IWLS_API_BASE_URL;
+
+	m_closing = false;
+	m_obsPoller = NULL;
+	m_obsGeneration = 0;
+	m_obsTimer.SetOwner(this, ID_OBS_TIMER);
+	Connect(ID_OBS_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnObsTimer));
+	m_playTimer.SetOwner(this, ID_PLAY_TIMER);
+	Connect(ID_PLAY_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnPlayTimer));
+	m_hoverTimer.SetOwner(this, ID_HOVER_TIMER);
+	Connect(ID_HOVER_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnHoverTimer));
+	m_hoverVpValid = false;
+	m_hoverShown = false;
+	m_hoverTag = 0;
+	m_queryTimer.SetOwner(this, ID_QUERY_TIMER);
+	Connect(ID_QUERY_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnQueryTimer));
+	m_queries.Start();
+	m_workTimer.SetOwner(this, ID_WORK_TIMER);
+	Connect(ID_WORK_TIMER, wxEVT_TIMER, wxTimerEventHandler(Dlg::OnWorkTimer));
+	m_worker.Start();
+
+	m_currentBase = 0;
+	m_currentTime = 0;
+	m_currentsGeneration = 0;
+	m_currentsLoading = false;
+	CreateCurrentControls();
+	CreateAlmanacControls();
+	m_route = NULL;
+	CreateRouteControls();
+	m_ownNext.t = 0;
+	CreateOwnShipControls();
+	m_fieldStale = true;
+	m_fieldTime = -1;
+	m_levelsStale = true;
+	m_queryStale = true;
+
+	wxString s = wxFileName::GetPathSeparator();
+	TideLoadHarmonics((StandardPath() + s + "harmonics.xml").ToStdString(), m_harmonics);
+}
+
+void Dlg::CreateCurrentControls()
+{
+	wxStaticBoxSizer* sbSizerCurrents;
+	sbSizerCurrents = new wxStaticBoxSizer(new wxStaticBox(this, wxID_ANY, _("Tidal Currents")), wxVERTICAL);
+
+	m_cbShowCurrents = new wxCheckBox(sbSizerCurrents->GetStaticBox(), wxID_ANY, _("Show current arrows"));
+	m_cbShowCurrents->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerCurrents->Add(m_cbShowCurrents, 0, wxALL, 5);
+
+	// Quarter hours over the next two days
+	m_sliderTime = new wxSlider(sbSizerCurrents->GetStaticBox(), wxID_ANY, 0, 0, 48 * 4);
+	sbSizerCurrents->Add(m_sliderTime, 0, wxALL | wxEXPAND, 5);
+
+	m_stCurrentTime = new wxStaticText(sbSizerCurrents->GetStaticBox(), wxID_ANY, _("Time: now"));
+	m_stCurrentTime->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerCurrents->Add(m_stCurrentTime, 0, wxALL | wxEXPAND, 5);
+
+	m_cbShowField = new wxCheckBox(sbSizerCurrents->GetStaticBox(), wxID_ANY, _("Show height field"));
+	m_cbShowField->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerCurrents->Add(m_cbShowField, 0, wxALL, 5);
+
+	wxBoxSizer *levelSizer = new wxBoxSizer(wxHORIZONTAL);
+	m_cbShowLevels = new wxCheckBox(sbSizerCurrents->GetStaticBox(), wxID_ANY, _("Show station heights"));
+	m_cbShowLevels->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	levelSizer->Add(m_cbShowLevels, 1, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+	m_bPlay = new wxButton(sbSizerCurrents->GetStaticBox(), wxID_ANY, _("Play"));
+	levelSizer->Add(m_bPlay, 0, wxALL, 5);
+	sbSizerCurrents->Add(levelSizer, 0, wxEXPAND, 0);
+
+	GetSizer()->Add(sbSizerCurrents, 0, wxEXPAND, 5);
+	Layout();
+	GetSizer()->Fit(this);
+
+	m_cbShowCurrents->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(Dlg::OnShowCurrents), NULL, this);
+	m_cbShowField->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(Dlg::OnShowField), NULL, this);
+	m_cbShowLevels->Connect(wxEVT_COMMAND_CHECKBOX_CLICKED, wxCommandEventHandler(Dlg::OnShowLevels), NULL, this);
+	m_bPlay->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(Dlg::OnPlay), NULL, this);
+	m_sliderTime->Connect(wxEVT_SCROLL_THUMBTRACK, wxScrollEventHandler(Dlg::OnTimeSlider), NULL, this);
+	m_sliderTime->Connect(wxEVT_SCROLL_CHANGED, wxScrollEventHandler(Dlg::OnTimeSlider), NULL, this);
+}
+
+void Dlg::CreateAlmanacControls()
+{
+	wxStaticBoxSizer* sbSizerAlmanac;
+	sbSizerAlmanac = new wxStaticBoxSizer(new wxStaticBox(this, wxID_ANY, _("Tide Almanac")), wxHORIZONTAL);
+
+	m_spinAlmanacYear = new wxSpinCtrl(sbSizerAlmanac->GetStaticBox(), wxID_ANY, wxEmptyString,
+		wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 2000, 2100, wxDateTime::GetCurrentYear());
+	sbSizerAlmanac->Add(m_spinAlmanacYear, 0, wxALL, 5);
+
+	wxString formats[] = { _("CSV"), _("JSON") };
+	m_choiceAlmanacFormat = new wxChoice(sbSizerAlmanac->GetStaticBox(), wxID_ANY,
+		wxDefaultPosition, wxDefaultSize, 2, formats);
+	m_choiceAlmanacFormat->SetSelection(0);
+	sbSizerAlmanac->Add(m_choiceAlmanacFormat, 0, wxALL, 5);
+
+	wxButton *bExport = new wxButton(sbSizerAlmanac->GetStaticBox(), wxID_ANY, _("Export..."));
+	sbSizerAlmanac->Add(bExport, 0, wxALL, 5);
+
+	GetSizer()->Add(sbSizerAlmanac, 0, wxEXPAND, 5);
+	Layout();
+	GetSizer()->Fit(this);
+
+	bExport->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(Dlg::OnExportAlmanac), NULL, this);
+}
+
+void Dlg::OnExportAlmanac(wxCommandEvent& event)
+{
+	TideStationSnapshot saved = m_savedPorts.Get();
+	if (saved->Empty()) {
+		wxMessageBox(_("No saved stations. Please select the stations to include first"));
+		return;
+	}
+
+	wxDirDialog dirdlg(this, _("Folder for the tide tables"), wxGetHomeDir());
+	if (dirdlg.ShowModal() != wxID_OK)
+		return;
+
+	TideAlmanacRequest request;
+	for (size_t i = 0; i < saved->Size(); i++) {
+		TideAlmanacStation station;
+		station.id = saved->Id(i);
+		station.name = saved->Name(i);
+		request.stations.push_back(station);
+	}
+	request.year = m_spinAlmanacYear->GetValue();
+	request.format = m_choiceAlmanacFormat->GetSelection() == 1 ? TAF_JSON : TAF_CSV;
+	request.outputDir = dirdlg.GetPath().ToStdString();
+	request.baseUrl = m_apiBaseUrl.ToStdString();
+	if (TideFetchAvailable())
+		request.fetch = TideUrlFetcher(10, &m_closing);
+
+	// The job works from its own copy, as a refit may replace m_harmonics
+	// while it runs
+	std::shared_ptr<std::map<std::string, TideHarmonics> > harmonics =
+		std::make_shared<std::map<std::string, TideHarmonics> >(m_harmonics);
+	m_worker.Submit([request, harmonics]() -> TideWorker::Finish {
+		TideAlmanacRequest r = request;
+		r.harmonics = harmonics.get();
+		std::shared_ptr<TideAlmanacResult> result = std::make_shared<TideAlmanacResult>();
+		int written = TideWriteAlmanac(r, *result);
+		int total = (int)r.stations.size();
+		return [written, total, result]() {
+			wxString msg = wxString::Format(_("%d of %d tide tables written."), written, total);
+			for (size_t i = 0; i < result->errors.size(); i++)
+				msg += "\n" + wxString(result->errors[i].c_str(), wxConvUTF8);
+			wxMessageBox(msg);
+		};
+	});
+
+	if (!m_workTimer.IsRunning())
+		m_workTimer.Start(200);
+}
+
+void Dlg::CreateRouteControls()
+{
+	wxStaticBoxSizer* sbSizerRoute;
+	sbSizerRoute = new wxStaticBoxSizer(new wxStaticBox(this, wxID_ANY, _("Route Tides")), wxHORIZONTAL);
+
+	wxButton *bLoad = new wxButton(sbSizerRoute->GetStaticBox(), wxID_ANY, _("Load route..."));
+	sbSizerRoute->Add(bLoad, 0, wxALL, 5);
+
+	m_spinRouteSpeed = new wxSpinCtrlDouble(sbSizerRoute->GetStaticBox(), wxID_ANY, wxEmptyString,
+		wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0.5, 40, 6, 0.5);
+	sbSizerRoute->Add(m_spinRouteSpeed, 0, wxALL, 5);
+
+	wxStaticText *stKnots = new wxStaticText(sbSizerRoute->GetStaticBox(), wxID_ANY, _("knots"));
+	stKnots->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerRoute->Add(stKnots, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+
+	GetSizer()->Add(sbSizerRoute, 0, wxEXPAND, 5);
+
+	wxStaticBoxSizer* sbSizerDepart;
+	sbSizerDepart = new wxStaticBoxSizer(new wxStaticBox(this, wxID_ANY, _("Departure Window")), wxHORIZONTAL);
+
+	wxStaticText *stMin = new wxStaticText(sbSizerDepart->GetStaticBox(), wxID_ANY, _("Min height (m)"));
+	stMin->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerDepart->Add(stMin, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+	m_spinRouteMinHeight = new wxSpinCtrlDouble(sbSizerDepart->GetStaticBox(), wxID_ANY, wxEmptyString,
+		wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, -5, 20, 1, 0.1);
+	sbSizerDepart->Add(m_spinRouteMinHeight, 0, wxALL, 5);
+
+	wxStaticText *stFoul = new wxStaticText(sbSizerDepart->GetStaticBox(), wxID_ANY, _("Max foul current (kn, 0 = any)"));
+	stFoul->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerDepart->Add(stFoul, 0, wxALL | wxALIGN_CENTER_VERTICAL, 5);
+	m_spinRouteFoul = new wxSpinCtrlDouble(sbSizerDepart->GetStaticBox(), wxID_ANY, wxEmptyString,
+		wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 10, 0, 0.5);
+	sbSizerDepart->Add(m_spinRouteFoul, 0, wxALL, 5);
+
+	wxButton *bDepart = new wxButton(sbSizerDepart->GetStaticBox(), wxID_ANY, _("Find..."));
+	sbSizerDepart->Add(bDepart, 0, wxALL, 5);
+
+	GetSizer()->Add(sbSizerDepart, 0, wxEXPAND, 5);
+	Layout();
+	GetSizer()->Fit(this);
+
+	bLoad->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(Dlg::OnLoadRoute), NULL, this);
+	bDepart->Connect(wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler(Dlg::OnFindDeparture), NULL, this);
+	m_spinRouteSpeed->Connect(wxEVT_COMMAND_SPINCTRLDOUBLE_UPDATED, wxSpinDoubleEventHandler(Dlg::OnRouteSpeed), NULL, this);
+}
+
+// Stations that can be predicted offline, placed from whichever list knows them.
+void Dlg::GetRouteStations(std::vector<TideRouteStation> &stations)
+{
+	TideStationSnapshot ports = m_ports.Get();
+	TideStationSnapshot saved = m_savedPorts.Get();
+
+	stations.clear();
+	for (std::map<std::string, TideHarmonics>::const_iterator it = m_harmonics.begin(); it != m_harmonics.end(); ++it) {
+		const TideStationStore *store = ports.get();
+		int i = store->Find(it->first);
+		if (i < 0) {
+			store = saved.get();
+			i = store->Find(it->first);
+		}
+		if (i < 0)
+			continue;
+
+		TideRouteStation station;
+		station.id = it->first;
+		station.name = store->Name(i);
+		station.lat = store->Lat(i);
+		station.lon = store->Lon(i);
+		station.harmonics = it->second;
+		stations.push_back(station);
+	}
+}
+
+void Dlg::OnLoadRoute(wxCommandEvent& event)
+{
+	wxFileDialog filedlg(this, _("Select a GPX route"), wxEmptyString, wxEmptyString,
+		_("GPX files (*.gpx)|*.gpx"), wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+	if (filedlg.ShowModal() != wxID_OK)
+		return;
+
+	std::vector<TideRoutePoint> points;
+	std::string error;
+	if (!TideLoadGpxRoute(std::string(filedlg.GetPath().mb_str()), points, error)) {
+		wxMessageBox(wxString(error.c_str(), wxConvUTF8));
+		return;
+	}
+
+	std::vector<TideRouteStation> stations;
+	GetRouteStations(stations);
+	if (stations.empty()) {
+		wxMessageBox(_("No stations with offline predictions yet. Please download tides for stations along the route first"));
+		return;
+	}
+
+	m_gpx_path = filedlg.GetPath();
+	rte_start = wxString(points.front().name.c_str(), wxConvUTF8);
+	rte_end = wxString(points.back().name.c_str(), wxConvUTF8);
+
+	if (!m_route)
+		m_route = new TideRouteEvaluator();
+	m_route->SetStations(stations);
+	m_route->SetRoute(points);
+
+	ShowRouteTides();
+}
+
+void Dlg::OnRouteSpeed(wxSpinDoubleEvent& event)
+{
+	if (m_route && !m_route->Points().empty())
+		ShowRouteTides();
+}
+
+void Dlg::ShowRouteTides()
+{
+	m_route->Evaluate(time(NULL), m_spinRouteSpeed->GetValue());
+
+	const std::vector<TideRouteSample> &samples = m_route->Samples();
+	const std::vector<TideRoutePoint> &points = m_route->Points();
+	const std::vector<TideRouteStation> &stations = m_route->Stations();
+
+	std::shared_ptr<TideStationStore> shown = std::make_shared<TideStationStore>();
+	size_t i = shown->Add("", std::string(m_gpx_path.mb_str(wxConvUTF8)), 0, 0);
+
+	std::vector<TideStationEvent> events(samples.size());
+	for (size_t k = 0; k < samples.size(); k++) {
+		const TideRouteSample &s = samples[k];
+		std::string label = s.waypoint >= 0 ? points[s.waypoint].name
+			: "  " + points[s.leg].name + " +" + std::to_string((int)(s.distNm + 0.5)) + "nm";
+		if (s.station >= 0)
+			label += " (" + stations[s.station].name + ")";
+
+		events[k].t = s.eta;
+		events[k].height = (float)s.height;
+		events[k].type = shown->Intern(label);
+	}
+	shown->SetEvents(i, events);
+
+	GetTideTable(_("Route"));
+	wxString label = rte_start + " - " + rte_end + _("      (Times are UTC)  ") + _(" (Height in metres)");
+	tidetable->itemStaticBoxSizer14Static->SetLabel(label);
+	tidetable->m_bDelete->Hide();
+	tidetable->m_bDeleteAll->Hide();
+
+	ShowEvents(shown, (int)i);
+}
+
+void Dlg::OnFindDeparture(wxCommandEvent& event)
+{
+	if (!m_route || m_route->Points().empty()) {
+		wxMessageBox(_("Please load a route first"));
+		return;
+	}
+
+	TideDepartureRequest request;
+	request.from = time(NULL);
+	request.to = request.from + 7 * 86400;
+	request.step = 600;
+	request.speedKn = m_spinRouteSpeed->GetValue();
+	request.minHeight = m_spinRouteMinHeight->GetValue();
+	request.maxFoulKn = m_spinRouteFoul->GetValue() > 0 ? m_spinRouteFoul->GetValue() : NAN;
+	request.currents = NULL;
+
+	if (std::isnan(request.maxFoulKn)) {
+		FindDepartures(request);
+		return;
+	}
+
+	// Each waypoint reads the closest current station
+	TideStationSnapshot currents = m_currentPorts.Get();
+	const std::vector<TideRoutePoint> &points = m_route->Points();
+	std::vector<std::string> ids;
+	request.currentStations.resize(points.size());
+	for (size_t w = 0; w < points.size(); w++) {
+		double best = 5;
+		for (size_t i = 0; i < currents->Size(); i++) {
+			double d = TideDistanceNm(points[w].lat, points[w].lon, currents->Lat(i), currents->Lon(i));
+			if (d <= best) {
+				best = d;
+				request.currentStations[w] = currents->Id(i);
+			}
+		}
+		if (!request.currentStations[w].empty()
+			&& std::find(ids.begin(), ids.end(), request.currentStations[w]) == ids.end())
+			ids.push_back(request.currentStations[w]);
+	}
+
+	// The currents must last until the latest departure arrives
+	double distNm = 0;
+	const std::vector<TideRouteSample> &samples = m_route->Samples();
+	for (size_t k = 0; k < samples.size(); k++)
+		distNm = std::max(distNm, samples[k].distNm);
+	time_t to = request.to + (time_t)(distNm * 3600.0 / request.speedKn) + 3600;
+
+	std::vector<int> kinds;
+	kinds.push_back(TSK_WCS);
+	kinds.push_back(TSK_WCD);
+	std::string baseUrl = m_apiBaseUrl.ToStdString();
+
+	if (!TideFetchAvailable()) {
+		TideSeriesStore store;
+		TideFetchSeries(baseUrl, ids, kinds, request.from, to, UiFetcher(), 1, store);
+		request.currents = &store;
+		FindDepartures(request);
+		return;
+	}
+
+	m_stUKDownloadInfo->SetLabel(_("Loading currents along the route..."));
+	m_worker.Submit([this, request, baseUrl, ids, kinds, to]() -> TideWorker::Finish {
+		std::shared_ptr<TideSeriesStore> store = std::make_shared<TideSeriesStore>();
+		TideFetchSeries(baseUrl, ids, kinds, request.from, to, TideUrlFetcher(10, &m_closing), 6, *store);
+		return [this, request, store]() {
+			TideDepartureRequest r = request;
+			r.currents = store.get();
+			FindDepartures(r);
+		};
+	});
+
+	if (!m_workTimer.IsRunning())
+		m_workTimer.Start(200);
+}
+
+void Dlg::FindDepartures(const TideDepartureRequest &request)
+{
+	if (!m_route || m_route->Points().empty())
+		return;
+
+	std::vector<TideDepartureWindow> windows;
+	std::vector<int> missing;
+	{
+		wxBusyCursor wait;
+		TideFindDepartureWindows(*m_route, request, windows, missing);
+	}
+
+	const std::vector<TideRoutePoint> &points = m_route->Points();
+	if (!missing.empty()) {
+		wxString msg = _("No tide or current data to check the limits at:\n");
+		for (size_t i = 0; i < missing.size(); i++)
+			if ((size_t)missing[i] < points.size())
+				msg += "\n" + wxString(points[missing[i]].name.c_str(), wxConvUTF8);
+		wxMessageBox(msg, _("Departure Window"));
+		return;
+	}
+
+	if (windows.empty()) {
+		wxMessageBox(_("No departure in the next 7 days meets the limits"));
+		return;
+	}
+
+	wxString msg = rte_start + " - " + rte_end + _("  (Times are UTC)\n");
+	for (size_t i = 0; i < windows.size() && i < 5; i++) {
+		const TideDepartureWindow &w = windows[i];
+		msg += "\n" + FormatEventTime(w.begin) + "  -" + FormatEventTime(w.end);
+		msg += "\n      " + _("best") + FormatEventTime(w.best);
+		if (!std::isnan(w.margin))
+			msg += wxString::Format(_(", %4.2f m to spare"), w.margin);
+	}
+	wxMessageBox(msg, _("Departure Window"));
+}
+
+void Dlg::CreateOwnShipControls()
+{
+	wxStaticBoxSizer* sbSizerShip;
+	sbSizerShip = new wxStaticBoxSizer(new wxStaticBox(this, wxID_ANY, _("Own Ship")), wxVERTICAL);
+
+	m_stOwnShip = new wxStaticText(sbSizerShip->GetStaticBox(), wxID_ANY, _("No position fix"));
+	m_stOwnShip->SetForegroundColour(wxSystemSettings::GetColour(wxSYS_COLOUR_WINDOWTEXT));
+	sbSizerShip->Add(m_stOwnShip, 0, wxALL | wxEXPAND, 5);
+
+	GetSizer()->Add(sbSizerShip, 0, wxEXPAND, 5);
+	Layout();
+	GetSizer()->Fit(this);
+}
+
+// First high or low after now: offline harmonics, then saved events, then
+// a downloaded prediction series.
+bool Dlg::FindNextTidalEvent(const std::string &id, time_t now, TideExtremum &next)
+{
+	std::vector<TideExtremum> extrema;
+	std::map<std::string, TideHarmonics>::iterator it = m_harmonics.find(id);
+	if (it != m_harmonics.end()) {
+		TideHarmonicCurve curve(it->second);
+		TideFindExtrema(curve, now, now + 26 * 3600, 900, extrema);
+	}
+
+	if (extrema.empty()) {
+		TideStationSnapshot saved = m_savedPorts.Get();
+		int i = saved->Find(id);
+		if (i >= 0)
+			TideSavedExtrema(*saved, i, now + 1, std::numeric_limits<time_t>::max(), extrema);
+
+		const TideSeries *series = m_levelSeries.Find(id, TSK_WLP);
+		if (extrema.empty() && series && series->End() > now) {
+			TideSeriesCurve curve(*series);
+			TideFindExtrema(curve, std::max(now, series->Begin()), series->End(), 900, extrema);
+		}
+	}
+
+	for (size_t k = 0; k < extrema.size(); k++)
+		if (extrema[k].t > now) {
+			next = extrema[k];
+			return true;
+		}
+	return false;
+}
+
+// Called for every position fix, so the common case must stay cheap: the
+// tracker keeps its answer until the ship leaves its validity circle, and
+// the next event is only looked up again once it has passed.
+void Dlg::SetOwnShip(double lat, double lon)
+{
+	TideStationSnapshot ports = m_ports.Get();
+	if (ports->Empty())
+		ports = m_savedPorts.Get();
+
+	int i = m_ownShip.Update(ports, lat, lon);
+	if (i < 0)
+		return;
+
+	time_t now = time(NULL);
+	if (m_ownStation != ports->Id(i) || (m_ownNext.t && m_ownNext.t <= now)) {
+		m_ownStation = ports->Id(i);
+		m_ownNext.t = 0;
+		FindNextTidalEvent(m_ownStation, now, m_ownNext);
+	}
+
+	wxString label = wxString::Format(_("Nearest: %s (%.1f nm)"),
+		wxString(ports->Name(i), wxConvUTF8), m_ownShip.Distance());
+	if (m_ownNext.t)
+		label += wxString::Format(_("\nNext %s: %s  %4.2f m"),
+			m_ownNext.high ? _("High") : _("Low"), FormatEventTime(m_ownNext.t), m_ownNext.height);
+	else
+		label += _("\nNo prediction available");
+
+	if (label != m_stOwnShip->GetLabel())
+		m_stOwnShip->SetLabel(label);
+}
+
+// Mouse moves only record the position. The lookup runs at most every
+// 100 ms from a one-shot timer, and the chart is repainted only when the
+// station under the cursor changes.
+void Dlg::SetHoverLatLon(double lat, double lon)
+{
+	m_hoverLat = lat;
+	m_hoverLon = lon;
+	if (!m_hoverTimer.IsRunning())
+		m_hoverTimer.Start(100, wxTIMER_ONE_SHOT);
+}
+
+void Dlg::OnHoverTimer(wxTimerEvent& event)
+{
+	if (!m_hoverVpValid)
+		return;
+
+	wxPoint p;
+	GetCanvasPixLL(&m_hoverVp, &p, m_hoverLat, m_hoverLon);
+
+	uint32_t tag = 0;
+	bool found = m_hoverGrid.Find(p.x, p.y, tag);
+	const TideStationSnapshot &store = m_hoverStores[tag >> 31];
+	size_t i = tag & 0x7fffffffu;
+	if (found && (!store || i >= store->Size()))
+		found = false;
+
+	if (found == m_hoverShown && (!found || tag == m_hoverTag))
+		return;
+
+	m_hoverShown = found;
+	m_hoverTag = tag;
+	if (found) {
+		m_hoverStationLat = store->Lat(i);
+		m_hoverStationLon = store->Lon(i);
+		m_hoverName = wxString(store->Name(i), wxConvUTF8);
+
+		TideExtremum next;
+		if (FindNextTidalEvent(store->Id(i), time(NULL), next))
+			m_hoverEvent = wxString::Format(_("Next %s: %s  %4.2f m"),
+				next.high ? _("High") : _("Low"), FormatEventTime(next.t), next.height);
+		else
+			m_hoverEvent = _("No prediction available");
+	}
+	RequestRefresh(m_parent);
+}
+
+void Dlg::DrawHoverTip(PlugIn_ViewPort *BBox)
+{
+	wxPoint p;
+	GetCanvasPixLL(BBox, &p, m_hoverStationLat, m_hoverStationLon);
+
+	wxCoord w1, h1, w2, h2;
+	m_dc->GetTextExtent(m_hoverName, &w1, &h1);
+	m_dc->GetTextExtent(m_hoverEvent, &w2, &h2);
+
+	int x = p.x + m_stationBitmap.GetWidth() + 4;
+	int y = p.y + m_stationBitmap.GetHeight() + 4;
+	m_dc->SetPen(wxPen(wxColour(80, 80, 80), 1));
+	m_dc->SetBrush(wxBrush(wxColour(255, 255, 225)));
+	m_dc->DrawRectangle(x, y, std::max(w1, w2) + 8, h1 + h2 + 6);
+	m_dc->SetTextForeground(*wxBLACK);
+	m_dc->DrawText(m_hoverName, x + 4, y + 3);
+	m_dc->DrawText(m_hoverEvent, x + 4, y + 3 + h1);
+}
+
+// Requests from other plugins are answered on the query thread against
+// snapshots; harmonics and series are only copied again once they change.
+void Dlg::SubmitQuery(const wxString &request)
+{
+	if (m_queryStale) {
+		m_queryHarmonics = std::make_shared<TideHarmonicsMap>(m_harmonics);
+		m_querySeries = std::make_shared<TideSeriesStore>(m_levelSeries);
+		m_queryStale = false;
+	}
+
+	TideQueryData data;
+	data.ports = m_ports.Get();
+	data.saved = m_savedPorts.Get();
+	data.currents = m_currentPorts.Get();
+	data.harmonics = m_queryHarmonics;
+	data.series = m_querySeries;
+	m_queries.Submit(std::string(request.mb_str(wxConvUTF8)), data);
+
+	if (!m_queryTimer.IsRunning())
+		m_queryTimer.Start(20);
+}
+
+void Dlg::OnQueryTimer(wxTimerEvent& event)
+{
+	std::string reply;
+	while (m_queries.TakeReply(reply)) {
+		wxString id(TIDE_QUERY_REPLY_MESSAGE);
+		wxString body(reply.c_str(), wxConvUTF8);
+		SendPluginMessage(id, body);
+	}
+	if (m_queries.Pending() == 0)
+		m_queryTimer.Stop();
 }
 
 Dlg::~Dlg()
 {
+	// Cuts short any download still running for the poller or the worker
+	m_closing = true;
+	m_obsTimer.Stop();
+	m_expiryTimer.Stop();
+	m_playTimer.Stop();
+	m_hoverTimer.Stop();
+	m_queryTimer.Stop();
+	m_queries.Stop();
+	m_workTimer.Stop();
+	m_worker.Stop();
+	delete m_expiry;
+	delete m_route;
+	delete m_obsPoller;
 }
 
 #ifdef __OCPN__ANDROID__ 
@@ -183,7 +808,9 @@ void Dlg::SetViewPort(PlugIn_ViewPort *vp)
 
 bool Dlg::RenderOverlay(piDC &dc, PlugIn_ViewPort &vp)
 {
+	TIDE_TRACE_SCOPE("RenderOverlay");
 	m_dc = &dc;	
+	m_viewScale = vp.view_scale_ppm;
 
 	if (!dc.GetDC()) {
 		if (!glQueried) {
@@ -204,18 +831,41 @@ bool Dlg::RenderOverlay(piDC &dc, PlugIn_ViewPort &vp)
 
 	wxFont font(12, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
 	m_dc->SetFont(font);
+
+	if (m_cbShowField->IsChecked())
+		DrawHeightField(&vp);
+
+	m_hoverGrid.Reset(vp.pix_width, vp.pix_height, 24);
+	m_hoverStores[0] = m_ports.Get();
+	m_hoverStores[1] = m_savedPorts.Get();
+	m_hoverVp = vp;
+	m_hoverVpValid = true;
 	
 	if (!b_clearAllIcons) {
-		if (myports.size() != 0) {
+		if (!m_ports.Get()->Empty()) {
 			DrawAllStationIcons(&vp, false, false, false);
 		}
 	}
 
 	if (!b_clearSavedIcons) {
-		if (mySavedPorts.size() != 0) {
+		if (!m_savedPorts.Get()->Empty()) {
 			DrawAllSavedStationIcons(&vp, false, false, false);
 		}
 	}
+
+	if (m_obsPoller && !m_watchedPorts.empty()) {
+		DrawObservedLevels(&vp);
+	}
+
+	if (m_cbShowLevels->IsChecked() && !m_ports.Get()->Empty())
+		DrawStationLevels(&vp);
+
+	if (m_cbShowCurrents->IsChecked() && !m_currentPorts.Get()->Empty()) {
+		DrawCurrentArrows(&vp);
+	}
+
+	if (m_hoverShown)
+		DrawHoverTip(&vp);
 	
     return true;
 }
@@ -224,7 +874,8 @@ void Dlg::DrawAllStationIcons(PlugIn_ViewPort *BBox, bool bRebuildSelList,
 	bool bforce_redraw_icons, bool bdraw_mono_for_mask)
 {	
 	
-	if (myports.size() == 0) return;
+	TideStationSnapshot ports = m_ports.Get();
+	if (ports->Empty()) return;
 
 	wxColour text_color;
     GetGlobalColor( _T ("UINFD" ), &text_color );
@@ -245,117 +896,99 @@ void Dlg::DrawAllStationIcons(PlugIn_ViewPort *BBox, bool bRebuildSelList,
         
     }
 	
-	double plat = 0.0;
-	double plon = 0.0;
-	myPort outPort;
-	
-	for (std::list<myPort>::iterator it = myports.begin(); it != myports.end(); it++) {
-		
-		plat = (*it).coordLat;
-		plon = (*it).coordLon;
-		outPort.Name = (*it).Name;
-		int pixxc, pixyc;
-		wxPoint cpoint;
-
-		wxBoundingBox LLBBox( BBox->lon_min, BBox->lat_min , BBox->lon_max, BBox->lat_max );
-		if (LLBBox.PointInBox(plon, plat, 0)) {
-			GetCanvasPixLL(BBox, &cpoint, plat, plon);
-			pixxc = cpoint.x;
-			pixyc = cpoint.y;
-
-#ifdef __OCPN__ANDROID__
-
-			int x = pixxc;
-			int y = pixyc;
-			int w = 20;
-			int h = 20;	
-
-			if (m_dc) {
-				wxColour myColour = wxColour("YELLOW");
-				DrawLine(pixxc, pixyc, pixxc + 20, pixyc + 20, myColour, 4);
-					
-				// draw bounding rectangle //
-				DrawLine(x, y, x + w, y, myColour, 2);
-				DrawLine(x + w, y, x + w, y + h, myColour, 2);
-				DrawLine(x + w, y + h, x, y + h, myColour, 2);
-				DrawLine(x, y + h, x, y, myColour, 2);
-			}
-#else
-			m_dc->DrawBitmap(m_stationBitmap, pixxc, pixyc, false);
-#endif
-			int textShift = -15;
-
-			if (!m_dc) {
-
-				//DrawGLLabels(this, m_pdc, BBox,
-					//DrawGLTextString(outPort.Name), plat, plon, textShift);
-			}
-			else {			
-				wxString name = outPort.Name;
-				m_dc->DrawText(name, pixxc, pixyc + textShift);
-			}
-		}
-	}
+	TideDrawStations(*m_dc, *BBox, *ports, m_stationBitmap, false, TOP_ALL, &m_hoverGrid);
 }
 
 void Dlg::DrawAllSavedStationIcons(PlugIn_ViewPort *BBox, bool bRebuildSelList,
 	bool bforce_redraw_icons, bool bdraw_mono_for_mask)
 {
-	if (mySavedPorts.size() == 0) return;
+	TideStationSnapshot saved = m_savedPorts.Get();
+	if (saved->Empty()) return;
 	
-	double plat = 0.0;
-	double plon = 0.0;
-	myPort outPort;
-
-	for (list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-
-		plat = (*it).coordLat;
-		plon = (*it).coordLon;
-		outPort.Name = (*it).Name;
+	TideDrawStations(*m_dc, *BBox, *saved, m_stationBitmap, true, TOP_ALL, &m_hoverGrid, 0x80000000u);
+}
 
-		int pixxc, pixyc;
-		wxPoint cpoint;
+void Dlg::DrawObservedLevels(PlugIn_ViewPort *BBox)
+{
+	wxBoundingBox LLBBox(BBox->lon_min, BBox->lat_min, BBox->lon_max, BBox->lat_max);
 
-		wxBoundingBox LLBBox( BBox->lon_min, BBox->lat_min , BBox->lon_max, BBox->lat_max );
-		if (LLBBox.PointInBox(plon, plat, 0)) {
+	for (std::map<wxString, myPort>::iterator it = m_watchedPorts.begin(); it != m_watchedPorts.end(); it++) {
+		double plat = it->second.coordLat;
+		double plon = it->second.coordLon;
 
-			GetCanvasPixLL(BBox, &cpoint, plat, plon);
-			pixxc = cpoint.x;
-			pixyc = cpoint.y;
+		if (!LLBBox.PointInBox(plon, plat, 0))
+			continue;
 
-#ifdef __OCPN__ANDROID__
+		wxString label;
+		TideResidual latest;
+		if (!m_obsPoller->Latest(it->first.ToStdString(), latest))
+			label = _("Observed: waiting");
+		else if (std::isnan(latest.residual))
+			label = wxString::Format(_("Observed %4.2f m"), latest.observed);
+		else
+			label = wxString::Format(_("Observed %4.2f m  Surge %+4.2f m"), latest.observed, latest.residual);
 
-			int x = pixxc;
-			int y = pixyc;
-			int w = 20;
-			int h = 20;		
-
-			if (m_dc) {
-				wxColour myColour = wxColour("YELLOW");
-				DrawLine(pixxc, pixyc, pixxc + 20, pixyc + 20, myColour, 4);
-					
-				// draw bounding rectangle //
-				DrawLine(x, y, x + w, y, myColour, 2);
-				DrawLine(x + w, y, x + w, y + h, myColour, 2);
-				DrawLine(x + w, y + h, x, y + h, myColour, 2);
-				DrawLine(x, y + h, x, y, myColour, 2);
-			}
-#else
-			m_dc->DrawBitmap(m_stationBitmap, pixxc, pixyc, true);
-#endif
+		wxPoint cpoint;
+		GetCanvasPixLL(BBox, &cpoint, plat, plon);
+		m_dc->DrawText(label, cpoint.x, cpoint.y + 20);
+	}
+}
 
-			int textShift = -15;
+void Dlg::DrawCurrentArrows(PlugIn_ViewPort *BBox)
+{
+	wxBoundingBox LLBBox(BBox->lon_min, BBox->lat_min, BBox->lon_max, BBox->lat_max);
+
+	// Series pointers are looked up again only when the stations or the
+	// loaded series change
+	TideStationSnapshot currents = m_currentPorts.Get();
+	if (currents != m_currentResolved) {
+		TideResolveCurrents(m_currentSeries, *currents, m_currentResolvedSeries);
+		m_currentResolved = currents;
+	}
 
-			if (!m_dc) {
+	m_currentIndex.clear();
+	m_currentPx.clear();
+	m_currentPy.clear();
+	for (size_t i = 0; i < currents->Size(); i++) {
+		double plat = currents->Lat(i);
+		double plon = currents->Lon(i);
+		if (!LLBBox.PointInBox(plon, plat, 0))
+			continue;
+		wxPoint cpoint;
+		GetCanvasPixLL(BBox, &cpoint, plat, plon);
+		m_currentIndex.push_back((uint32_t)i);
+		m_currentPx.push_back(cpoint.x);
+		m_currentPy.push_back(cpoint.y);
+	}
 
-				//DrawGLLabels(this, m_pdc, BBox,
-					//DrawGLTextString(outPort.Name), plat, plon, textShift);
-			}
-			else {
-				m_dc->DrawText(outPort.Name, pixxc, pixyc + textShift);
-			}
+	TideArrowStyle style;
+	style.pixelsPerKnot = 12;
+	style.minLength = 8;
+	style.maxLength = 60;
+	style.headFraction = 0.3f;
+
+	TideBuildCurrentArrows(m_currentResolvedSeries, m_currentIndex, m_currentPx, m_currentPy,
+		m_currentTime, BBox->rotation, style, m_currentArrows);
+
+	// One pen per speed band rather than per arrow
+	const float bandLimit[3] = { 1.0f, 3.0f, 1e9f };
+	const wxColour bandColour[3] = { wxColour(0, 160, 0), wxColour(230, 160, 0), wxColour(200, 0, 0) };
+
+	wxPoint pts[5];
+	float lower = -1e9f;
+	for (int band = 0; band < 3; band++) {
+		m_dc->SetPen(wxPen(bandColour[band], 2));
+		for (size_t i = 0; i < m_currentArrows.size(); i++) {
+			const TideCurrentArrow &a = m_currentArrows[i];
+			float s = fabs(a.speed);
+			if (s < lower || s >= bandLimit[band])
+				continue;
+			for (int k = 0; k < 5; k++)
+				pts[k] = wxPoint((int)a.x[k], (int)a.y[k]);
+			m_dc->DrawLines(5, pts);
 		}
-	}	
+		lower = bandLimit[band];
+	}
 }
 
 void Dlg::DrawLine(double x1, double y1, double x2, double y2,
@@ -395,24 +1028,22 @@ void Dlg::Addpoint(TiXmlElement* Route, wxString ptlat, wxString ptlon, wxString
 }
 
 void Dlg::OnDownload(wxCommandEvent& event) {
+	TIDE_TRACE_SCOPE("OnDownload");
 
 	b_clearSavedIcons = false;
 	b_clearAllIcons = false;
 
-	myports.clear();
-	myPort outPort;
+	m_ports.Publish(std::make_shared<TideStationStore>());
 
 	int region = m_choice31->GetSelection();
 	wxString choiceRegion = m_choice31->GetString(region);
 
-	wxString urlString = "https://api-iwls.dfo-mpo.gc.ca/api/v1/stations?chs-region-code=" + choiceRegion + "&&time-series-code=wlp-hilo";
+	wxString urlString(TideStationsUrl(m_apiBaseUrl.ToStdString(),
+		choiceRegion.ToStdString(), TideSeriesCode(TSK_WLP_HILO)).c_str(), wxConvUTF8);
 	wxURI url(urlString);
 
-	wxString tmp_file = wxFileName::CreateTempFileName(""); 
-
-	_OCPN_DLStatus ret = OCPN_downloadFile(url.BuildURI(), tmp_file,
-		"CanadianTides", "", wxNullBitmap, this, OCPN_DLDS_AUTO_CLOSE,
-		10);
+	std::string message_body;
+	_OCPN_DLStatus ret = DownloadToString(url.BuildURI(), message_body);
 
 	if (ret == OCPN_DL_ABORTED) {
 
@@ -431,174 +1062,455 @@ void Dlg::OnDownload(wxCommandEvent& event) {
 		m_stUKDownloadInfo->SetLabel(_("Success"));
 	}
 
-    wxString message_body;
-	wxFFile fileData;
-	fileData.Open(tmp_file, wxT("r"));
-	fileData.ReadAll(&message_body);
-
-	Json::Reader reader;
-
-	wxString message_id;
-	
-	Json::Value value;
+	std::shared_ptr<TideStationStore> ports = std::make_shared<TideStationStore>();
 	string errors;
-
-	bool parsingSuccessful = reader.parse((std::string)message_body, value);
-	
-	wxString error = _("No tidal stations found");
-
-	if (!parsingSuccessful) {
+	if (!TideParseStationList(message_body.data(), message_body.data() + message_body.size(),
+		*ports, TSF_NONE, errors)) {
 		wxMessageBox("error");
-		wxLogMessage(error);
+		wxLogMessage(_("No tidal stations found"));
 		return;
 	}
+	m_ports.Publish(ports);
 
-	if (parsingSuccessful) {
-		//wxMessageBox("success");
-		//wxString ids = value[0]["id"].asString();		
-	}
-
-	for (auto it = value.begin(); it != value.end(); ++it) {
-           
-		   wxString ids = (*it)["id"].asString();  
-		   outPort.Id = ids;
-		   wxString myname = (*it)["officialName"].asString();
-		   outPort.Name = myname;
-		   double myLat = (*it)["latitude"].asDouble();
-		   outPort.coordLat = myLat;
-		   double myLon = (*it)["longitude"].asDouble();
-		   outPort.coordLon = myLon;
-		   myports.push_back(outPort);
-    }
+	DownloadCurrentStations(choiceRegion);
 
 	SetCanvasContextMenuItemViz(plugin->m_position_menu_id, true);
-	fileData.Close();
+	SetCanvasContextMenuItemViz(plugin->m_watch_menu_id, true);
 
 	b_clearSavedIcons = true;
 	b_clearAllIcons = false;
 
 	RequestRefresh(m_parent);
-	value.clear();
 
 }
 
-void Dlg::OnGetSavedTides(wxCommandEvent& event) {
+_OCPN_DLStatus Dlg::DownloadToString(const wxString &urlString, std::string &body)
+{
+	body.clear();
 
-	wxString portName;
-	wxString sId;
+	if (TideFetchAvailable()) {
+		TideFetchResult res = TideFetchUrl(urlString.ToStdString(), 10);
+		if (res.status != TF_OK) {
+			wxLogMessage(_("CanadianTides") + wxString(": ") + wxString(res.error.c_str(), wxConvUTF8));
+			return OCPN_DL_FAILED;
+		}
+		body.swap(res.body);
+		return OCPN_DL_NO_ERROR;
+	}
 
-	double myLat, myLon;
-	myLat = 0;
-	myLon = 0;
+	// No in-memory transport in this build: go through the core downloader,
+	// but read the file back into memory and remove it straight away.
+	wxString tmp_file = wxFileName::CreateTempFileName("");
 
-	if (mySavedPorts.size() != 0) {
-		mySavedPorts.clear();
-	}
-	
-	LoadTidalEventsFromXml();
+	_OCPN_DLStatus ret = OCPN_downloadFile(urlString, tmp_file,
+		"CanadianTides", "", wxNullBitmap, this, OCPN_DLDS_AUTO_CLOSE,
+		10);
 
-	if (mySavedPorts.size() == 0) {
-		wxMessageBox(_("No locations are available, please download and select a tidal station"));
-		return;
+	if (ret == OCPN_DL_NO_ERROR) {
+		wxFFile fileData(tmp_file, wxT("rb"));
+		if (fileData.IsOpened()) {
+			body.resize((size_t)fileData.Length());
+			if (!body.empty())
+				body.resize(fileData.Read(&body[0], body.size()));
+			fileData.Close();
+		}
+		if (!TideGunzip(body))
+			ret = OCPN_DL_FAILED;
 	}
 
-	RequestRefresh(m_parent);  //put the saved port icons back
+	if (wxFileExists(tmp_file))
+		wxRemoveFile(tmp_file);
 
-	b_usingSavedPorts = true;
+	return ret;
+}
 
+void Dlg::DownloadCurrentStations(const wxString &region)
+{
+	TIDE_TRACE_SCOPE("DownloadCurrentStations");
+	m_currentPorts.Publish(std::make_shared<TideStationStore>());
+	m_currentSeries.Clear();
+	m_currentResolved.reset();
+	m_currentBase = 0;
+	// Drops whatever an earlier LoadCurrents() is still fetching
+	m_currentsGeneration++;
+	m_currentsLoading = false;
+
+	wxString urlString(TideStationsUrl(m_apiBaseUrl.ToStdString(),
+		region.ToStdString(), TideSeriesCode(TSK_WCS)).c_str(), wxConvUTF8);
+
+	std::string body;
+	if (DownloadToString(urlString, body) != OCPN_DL_NO_ERROR)
+		return;
 
-	GetTidalEventDialog* GetPortDialog = new GetTidalEventDialog(this, -1, _("Select the Location"), wxPoint(200, 200), wxSize(300, 200), 		wxRESIZE_BORDER);
+	std::shared_ptr<TideStationStore> currents = std::make_shared<TideStationStore>();
+	std::string error;
+	if (!TideParseStationList(body.data(), body.data() + body.size(), *currents, TSF_CURRENTS, error))
+		return;
+	m_currentPorts.Publish(currents);
 
-	GetPortDialog->dialogText->InsertColumn(0, "", 0, wxLIST_AUTOSIZE);
-	GetPortDialog->dialogText->SetColumnWidth(0, 290);
-	GetPortDialog->dialogText->InsertColumn(1, "", 0, wxLIST_AUTOSIZE);
-	GetPortDialog->dialogText->SetColumnWidth(1, 0);
-	GetPortDialog->dialogText->DeleteAllItems();
+	// Arrows for a fresh station list need fresh data
+	if (m_cbShowCurrents->IsChecked())
+		LoadCurrents();
+}
 
-	int in = 0;
-	wxString routeName = "";
-	for (list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
+// With libcurl the series download on m_worker into a store of their
+// own, which replaces m_currentSeries once complete.
+void Dlg::LoadCurrents()
+{
+	TideStationSnapshot currents = m_currentPorts.Get();
+	if (currents->Empty())
+		return;
 
-		portName = (*it).Name;
+	// Start on a quarter hour so the slider steps land on data points
+	time_t now = time(NULL);
+	time_t base = now - now % 900;
 
-		sId = (*it).Id;
-		myLat = (*it).coordLat;
-		myLon = (*it).coordLon;
-		
-		GetPortDialog->dialogText->InsertItem(in, "", -1);
-		GetPortDialog->dialogText->SetItem(in, 0, portName);
-		in++;
-	}
-	this->Fit();
-	this->Refresh();
+	std::vector<std::string> ids;
+	for (size_t i = 0; i < currents->Size(); i++)
+		ids.push_back(currents->Id(i));
 
-	long si = -1;
-	long itemIndex = -1;
+	std::vector<int> kinds;
+	kinds.push_back(TSK_WCS);
+	kinds.push_back(TSK_WCD);
 
+	m_stUKDownloadInfo->SetLabel(_("Loading currents..."));
+	m_stUKDownloadInfo->Update();
 
-	wxString portId;
+	unsigned generation = ++m_currentsGeneration;
+	std::string baseUrl = m_apiBaseUrl.ToStdString();
 
-	wxListItem     row_info;
-	wxString       cell_contents_string = wxEmptyString;
-	bool foundPort = false;
+	if (!TideFetchAvailable()) {
+		TideSeriesStore store;
+		int loaded = TideFetchSeries(baseUrl, ids, kinds, base, base + 48 * 3600, UiFetcher(), 1, store);
+		CurrentsLoaded(generation, base, loaded, store);
+		return;
+	}
 
-	
-	b_clearSavedIcons = false;
-	b_clearAllIcons = true;	
+	m_currentsLoading = true;
+	m_worker.Submit([this, baseUrl, ids, kinds, base, generation]() -> TideWorker::Finish {
+		std::shared_ptr<TideSeriesStore> store = std::make_shared<TideSeriesStore>();
+		int loaded = TideFetchSeries(baseUrl, ids, kinds, base, base + 48 * 3600,
+			TideUrlFetcher(10, &m_closing), 6, *store);
+		return [this, generation, base, loaded, store]() {
+			CurrentsLoaded(generation, base, loaded, *store);
+		};
+	});
+
+	if (!m_workTimer.IsRunning())
+		m_workTimer.Start(200);
+}
 
-	GetParent()->Refresh();
+// Downloads through OpenCPN, for builds without libcurl. Shows a progress
+// dialog, so only for the UI thread.
+TideFetchFn Dlg::UiFetcher()
+{
+	return [this](const std::string &url, std::string &body, std::string &err) {
+		if (DownloadToString(url, body) == OCPN_DL_NO_ERROR)
+			return true;
+		err = "Download failed";
+		return false;
+	};
+}
 
-	if (GetPortDialog->ShowModal() != wxID_OK) {
-		// Do nothing
-	}
-	else {
+void Dlg::CurrentsLoaded(unsigned generation, time_t base, int loaded, TideSeriesStore &store)
+{
+	if (generation != m_currentsGeneration)
+		return;
 
-		for (;;) {
-			itemIndex = GetPortDialog->dialogText->GetNextItem(itemIndex,
-				wxLIST_NEXT_ALL,
-				wxLIST_STATE_SELECTED);
+	m_currentsLoading = false;
+	m_currentSeries.Swap(store);
+	m_currentResolved.reset();
+	m_currentBase = base;
+	m_stUKDownloadInfo->SetLabel(wxString::Format(_("Currents: %d stations"), loaded / 2));
 
-			if (itemIndex == -1) break;
+	UpdateCurrentTimeLabel();
+	RequestRefresh(m_parent);
+}
 
-			// Got the selected item index
-			if (GetPortDialog->dialogText->IsSelected(itemIndex)) {
-				si = itemIndex;
-				foundPort = true;
-				break;
-			}
-		}
+void Dlg::UpdateCurrentTimeLabel()
+{
+	m_currentTime = m_currentBase + (time_t)m_sliderTime->GetValue() * 900;
+	wxDateTime dt(m_currentTime);
+	m_stCurrentTime->SetLabel(_("Time: ") + dt.Format("%a %d-%b-%Y %H:%M", wxDateTime::UTC) + " UTC");
+}
 
-		if (foundPort) {
-
-			// Set what row it is (m_itemId is a member of the regular wxListCtrl class)
-			row_info.m_itemId = si;
-			// Set what column of that row we want to query for information.
-			row_info.m_col = 0;
-			// Set text mask
-			row_info.m_mask = wxLIST_MASK_TEXT;
-
-			// Get the info and store it in row_info variable.
-			GetPortDialog->dialogText->GetItem(row_info);
-			// Extract the text out that cell
-			cell_contents_string = row_info.m_text;
-
-			for (list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-				wxString portName = (*it).Name;
-				portId = (*it).Id;
-				if (portName == cell_contents_string) {
-					OnShowSavedPortTides(portId);
-				}
-			}
+void Dlg::OnShowCurrents(wxCommandEvent& event)
+{
+	if (m_cbShowCurrents->IsChecked()) {
+		if (m_currentPorts.Get()->Empty()) {
+			wxMessageBox(_("No current stations found. Please download the locations"));
+			m_cbShowCurrents->SetValue(false);
+			return;
 		}
+		if (!m_currentsLoading && time(NULL) - m_currentBase > 3600)
+			LoadCurrents();
 	}
-
-	GetParent()->Refresh();
-
+	RequestRefresh(m_parent);
 }
 
-void Dlg::DoRemovePortIcons(wxCommandEvent& event) {
-			
-	b_clearSavedIcons = false;
+void Dlg::OnShowField(wxCommandEvent& event)
+{
+	if (m_cbShowField->IsChecked()) {
+		LoadFieldStations();
+		if (m_fieldPredictors.empty()) {
+			wxMessageBox(_("No stations with offline predictions yet. Please download tides for a few stations first"));
+			m_cbShowField->SetValue(false);
+			return;
+		}
+		EnsureTimeBase();
+	}
+	RequestRefresh(m_parent);
+}
+
+// The time slider is shared with the currents, which set its start when
+// they load.
+void Dlg::EnsureTimeBase()
+{
+	if (!m_currentBase) {
+		time_t now = time(NULL);
+		m_currentBase = now - now % 900;
+		UpdateCurrentTimeLabel();
+	}
+}
+
+void Dlg::OnShowLevels(wxCommandEvent& event)
+{
+	if (m_cbShowLevels->IsChecked())
+		EnsureTimeBase();
+	else if (m_playTimer.IsRunning()) {
+		m_playTimer.Stop();
+		m_bPlay->SetLabel(_("Play"));
+	}
+	RequestRefresh(m_parent);
+}
+
+void Dlg::OnPlay(wxCommandEvent& event)
+{
+	if (m_playTimer.IsRunning()) {
+		m_playTimer.Stop();
+		m_bPlay->SetLabel(_("Play"));
+		return;
+	}
+	if (!m_cbShowLevels->IsChecked()) {
+		m_cbShowLevels->SetValue(true);
+		EnsureTimeBase();
+	}
+	m_bPlay->SetLabel(_("Pause"));
+	m_playTimer.Start(33);
+}
+
+void Dlg::OnPlayTimer(wxTimerEvent& event)
+{
+	int v = m_sliderTime->GetValue() + 1;
+	m_sliderTime->SetValue(v > m_sliderTime->GetMax() ? 0 : v);
+	UpdateCurrentTimeLabel();
+	RequestRefresh(m_parent);
+}
+
+// Binds every catalogue station to its series or harmonics. The buffers
+// sized here are all that playback uses.
+void Dlg::LoadLevelSources()
+{
+	m_levelsPorts = m_ports.Get();
+
+	std::vector<const TideSeries *> series(m_levelsPorts->Size());
+	std::vector<const TideHarmonics *> harmonics(m_levelsPorts->Size());
+	for (size_t i = 0; i < m_levelsPorts->Size(); i++) {
+		std::string id = m_levelsPorts->Id(i);
+		series[i] = m_levelSeries.Find(id, TSK_WLP);
+		std::map<std::string, TideHarmonics>::const_iterator it = m_harmonics.find(id);
+		harmonics[i] = it != m_harmonics.end() ? &it->second : NULL;
+	}
+	m_levels.SetSources(series, harmonics);
+
+	m_levelVisible.clear();
+	m_levelVisible.reserve(m_levelsPorts->Size());
+	m_levelPx.clear();
+	m_levelPx.reserve(m_levelsPorts->Size());
+	m_levelsStale = false;
+}
+
+void Dlg::DrawStationLevels(PlugIn_ViewPort *BBox)
+{
+	if (m_levelsStale || m_levelsPorts != m_ports.Get())
+		LoadLevelSources();
+
+	const TideStationStore &ports = *m_levelsPorts;
+	const double *lats = ports.Lats();
+	const double *lons = ports.Lons();
+	wxBoundingBox LLBBox(BBox->lon_min, BBox->lat_min, BBox->lon_max, BBox->lat_max);
+
+	m_levelVisible.clear();
+	m_levelPx.clear();
+	for (size_t i = 0; i < ports.Size(); i++) {
+		if (!LLBBox.PointInBox(lons[i], lats[i], 0))
+			continue;
+		wxPoint cpoint;
+		GetCanvasPixLL(BBox, &cpoint, lats[i], lons[i]);
+		m_levelVisible.push_back((uint32_t)i);
+		m_levelPx.push_back(cpoint);
+	}
+
+	m_levels.Evaluate(m_currentTime, m_levelVisible.data(), m_levelVisible.size());
+
+	const wxColour rising(0, 140, 0), falling(200, 0, 0);
+	wxPoint tri[3];
+	for (size_t k = 0; k < m_levelVisible.size(); k++) {
+		size_t i = m_levelVisible[k];
+		double h = m_levels.Height(i);
+		if (std::isnan(h))
+			continue;
+
+		int x = m_levelPx[k].x + 22, y = m_levelPx[k].y + 2;
+		int up = m_levels.Trend(i);
+		m_dc->SetPen(wxPen(up > 0 ? rising : falling, 1));
+		m_dc->SetBrush(wxBrush(up > 0 ? rising : falling));
+		tri[0] = wxPoint(x, y + (up > 0 ? 10 : 2));
+		tri[1] = wxPoint(x + 8, y + (up > 0 ? 10 : 2));
+		tri[2] = wxPoint(x + 4, y + (up > 0 ? 2 : 10));
+		m_dc->DrawPolygon(3, tri);
+		m_dc->DrawText(wxString::Format("%4.2f m", h), x + 11, y - 2);
+	}
+}
+
+void Dlg::LoadFieldStations()
+{
+	std::vector<TideRouteStation> stations;
+	GetRouteStations(stations);
+
+	std::vector<double> lat, lon;
+	m_fieldPredictors.clear();
+	for (size_t i = 0; i < stations.size(); i++) {
+		lat.push_back(stations[i].lat);
+		lon.push_back(stations[i].lon);
+		m_fieldPredictors.push_back(TidePredictor(stations[i].harmonics));
+	}
+	m_field.SetStations(lat, lon);
+	m_fieldStale = false;
+	m_fieldTime = -1;
+}
+
+void Dlg::DrawHeightField(PlugIn_ViewPort *BBox)
+{
+	if (m_fieldStale)
+		LoadFieldStations();
+
+	// Live heights move a few centimetres a minute, so only predict again
+	// when the minute or the slider changes
+	time_t t = m_currentBase ? m_currentTime : time(NULL) / 60 * 60;
+	if (t != m_fieldTime) {
+		m_fieldTime = t;
+		m_fieldHeights.resize(m_fieldPredictors.size());
+		m_fieldLo = 1e9;
+		m_fieldHi = -1e9;
+		for (size_t i = 0; i < m_fieldPredictors.size(); i++) {
+			m_fieldHeights[i] = m_fieldPredictors[i].Height(t);
+			m_fieldLo = std::min(m_fieldLo, m_fieldHeights[i]);
+			m_fieldHi = std::max(m_fieldHi, m_fieldHeights[i]);
+		}
+		m_field.SetHeights(m_fieldHeights);
+	}
+
+	// About 24 pixel cells, on power of two sizes so a small zoom keeps the cache
+	double deg = 24 / BBox->view_scale_ppm / 111120.0;
+	deg = pow(2.0, floor(log(deg) / log(2.0) + 0.5));
+	m_field.SetCellSize(deg, floor(BBox->clat));
+
+	const std::vector<TideFieldCell> &cells = m_field.Update(BBox->lat_min, BBox->lat_max, BBox->lon_min, BBox->lon_max);
+
+	// Band and corners of each cell once, then the cells bucketed by band
+	// so each band sets its brush once
+	const int bands = 16;
+	double span = m_fieldHi > m_fieldLo ? m_fieldHi - m_fieldLo : 1;
+	size_t start[bands + 1] = { 0 };
+	m_fieldBand.assign(cells.size(), -1);
+	m_fieldPx.resize(4 * cells.size());
+	for (size_t i = 0; i < cells.size(); i++) {
+		const TideFieldCell &c = cells[i];
+		if (std::isnan(c.value))
+			continue;
+		int b = (int)((c.value - m_fieldLo) / span * bands);
+		b = std::min(std::max(b, 0), bands - 1);
+		m_fieldBand[i] = b;
+		start[b + 1]++;
+		wxPoint *pts = &m_fieldPx[4 * i];
+		GetCanvasPixLL(BBox, &pts[0], c.lat, c.lon);
+		GetCanvasPixLL(BBox, &pts[1], c.lat, c.lon + m_field.CellWidth());
+		GetCanvasPixLL(BBox, &pts[2], c.lat + m_field.CellHeight(), c.lon + m_field.CellWidth());
+		GetCanvasPixLL(BBox, &pts[3], c.lat + m_field.CellHeight(), c.lon);
+	}
+	for (int b = 0; b < bands; b++)
+		start[b + 1] += start[b];
+	m_fieldOrder.resize(start[bands]);
+	size_t next[bands];
+	std::copy(start, start + bands, next);
+	for (size_t i = 0; i < cells.size(); i++)
+		if (m_fieldBand[i] >= 0)
+			m_fieldOrder[next[m_fieldBand[i]]++] = (uint32_t)i;
+
+	m_dc->SetPen(*wxTRANSPARENT_PEN);
+	for (int band = 0; band < bands; band++) {
+		if (start[band] == start[band + 1])
+			continue;
+		double f = (band + 0.5) / bands;
+		m_dc->SetBrush(wxBrush(wxColour((unsigned char)(255 * f), (unsigned char)(90 + 60 * (1 - fabs(2 * f - 1))),
+			(unsigned char)(255 * (1 - f)), 90)));
+		for (size_t k = start[band]; k < start[band + 1]; k++)
+			m_dc->DrawPolygon(4, &m_fieldPx[4 * m_fieldOrder[k]]);
+	}
+}
+
+void Dlg::OnTimeSlider(wxScrollEvent& event)
+{
+	UpdateCurrentTimeLabel();
+	RequestRefresh(m_parent);
+}
+
+void Dlg::OnGetSavedTides(wxCommandEvent& event) {
+
+	LoadTidalEventsFromXml();
+
+	TideStationSnapshot saved = m_savedPorts.Get();
+	TideStationSnapshot ports = m_ports.Get();
+	if (saved->Empty() && ports->Empty()) {
+		wxMessageBox(_("No locations are available, please download and select a tidal station"));
+		return;
+	}
+
+	RequestRefresh(m_parent);  //put the saved port icons back
+
+	b_usingSavedPorts = true;
+
+	GetTidalEventDialog GetPortDialog(this, -1, _("Select the Location"), wxPoint(200, 200), wxSize(300, 360), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
+	GetPortDialog.SetStations(saved, ports);
+
+	b_clearSavedIcons = false;
+	b_clearAllIcons = true;	
+
+	GetParent()->Refresh();
+
+	if (GetPortDialog.ShowModal() == wxID_OK) {
+		bool fromSaved;
+		int i = GetPortDialog.GetSelection(fromSaved);
+		if (i >= 0) {
+			const TideStationStore &store = fromSaved ? *saved : *ports;
+			if (m_viewScale > 0)
+				JumpToPosition(store.Lat(i), store.Lon(i), m_viewScale);
+
+			if (fromSaved)
+				OnShowSavedPortTides(wxString(store.Id(i), wxConvUTF8));
+			else
+				getPort(store.Lat(i), store.Lon(i));
+		}
+	}
+
+	GetParent()->Refresh();
+
+}
+
+void Dlg::DoRemovePortIcons(wxCommandEvent& event) {
+			
+	b_clearSavedIcons = false;
 	b_clearAllIcons = true;
 	RequestRefresh(m_parent);
 	
@@ -615,103 +1527,227 @@ void Dlg::DoRemoveAllPortIcons(wxCommandEvent& event) {
 
 void Dlg::getHWLW(string id)
 {
+	TIDE_TRACE_SCOPE("getHWLW");
 
-	myevents.clear();
-	TidalEvent outTidalEvent;
+	m_events.clear();
 
 	int daysAhead = m_choice3->GetSelection();
 	wxString choiceDays = m_choice3->GetString(daysAhead);
-	
-
-	string duration = "?duration=";
-	string urlDays = choiceDays.ToStdString();
 
-	wxDateTime now = wxDateTime::Now();	
-	wxDateTime nowUTC = now.ToUTC();
+	long myDays = wxAtoi(choiceDays);
+	time_t span = (time_t)myDays * 86400;
+	string code = "wlp-hilo";
 
-	wxString snow = nowUTC.FormatISOCombined() + "Z";
-	//wxMessageBox(snow);
+	// Keep a partially failed download only if it is for the same request
+	// and recent enough to still be useful; otherwise start afresh.
+	if (m_pager && (!m_pager->Matches(id, code, span) ||
+		time(NULL) - m_pager->Created() > 3600))
+		m_pager.reset();
+
+	std::shared_ptr<TidePager> pager;
+	pager.swap(m_pager);
+	if (!pager) {
+		time_t now = time(NULL);
+		pager = std::make_shared<TidePager>(m_apiBaseUrl.ToStdString(), id, code, now, now + span, 7);
+	}
 
-	long myDays = wxAtoi(choiceDays);
-	wxTimeSpan d_ts = wxTimeSpan::Days(myDays) ;
-	wxDateTime nowPlus = nowUTC.Add(d_ts);
+	// A newer selection supersedes this one
+	unsigned generation = ++m_hwlwGeneration;
 
-	wxString snowplus = nowPlus.FormatISOCombined() + "Z";
-	//wxMessageBox(snowplus);
+	if (!TideFetchAvailable()) {
+		// OCPN_downloadFile shows a dialog, so stay on this thread
+		pager->Run(UiFetcher(), [this, generation](int done, int total, const TideChunk &chunk) {
+			HWLWProgress(generation, done, total, chunk.state);
+		}, 1);
+		HWLWLoaded(generation, id, span, pager);
+		return;
+	}
 
-	string tidalevents = "/data?time-series-code=";
-	string code = "wlp-hilo";
-	string fromDate = "&&from=";
-	string toDate = "&&to=";
+	// The chunks download on m_worker; progress and the result come back
+	// as steps run on this thread
+	m_worker.Submit([this, generation, id, span, pager]() -> TideWorker::Finish {
+		pager->Run(TideUrlFetcher(10, &m_closing), [this, generation](int done, int total, const TideChunk &chunk) {
+			TideChunkState state = chunk.state;
+			m_worker.Post([this, generation, done, total, state]() {
+				HWLWProgress(generation, done, total, state);
+			});
+		}, 3);
+		return [this, generation, id, span, pager]() {
+			HWLWLoaded(generation, id, span, pager);
+		};
+	});
+
+	if (!m_workTimer.IsRunning())
+		m_workTimer.Start(200);
+}
 
-	wxString urlString = "https://api-iwls.dfo-mpo.gc.ca/api/v1/stations/" + id + tidalevents + code + fromDate + snow + toDate + snowplus;
-	wxURI url(urlString);
+void Dlg::HWLWProgress(unsigned generation, int done, int total, TideChunkState state)
+{
+	if (generation != m_hwlwGeneration)
+		return;
+	wxString label = state == TCS_DONE ? _("OK") : _("Failed");
+	m_stUKDownloadInfo->SetLabel(wxString::Format(_("Downloading %d/%d: "), done, total) + label);
+	m_stUKDownloadInfo->Update();
+}
 
-	wxString tmp_file = wxFileName::CreateTempFileName(""); 
+void Dlg::HWLWLoaded(unsigned generation, const string &id, time_t span,
+	const std::shared_ptr<TidePager> &pager)
+{
+	if (generation != m_hwlwGeneration)
+		return;
 
-	_OCPN_DLStatus ret = OCPN_downloadFile(url.BuildURI(), tmp_file,
-		"", "", wxNullBitmap, this, OCPN_DLDS_AUTO_CLOSE,
-		10);
+	if (!pager->IsComplete()) {
+		m_pager = pager;
+		m_stUKDownloadInfo->SetLabel(_("Failed"));
+		if (ShowPredictedTides(id, span))
+			return;
+		wxMessageBox(wxString::Format(_("%d of %d downloads failed.\n\nSelect the station again to resume."),
+			pager->FailedCount(), pager->ChunkCount()));
+		return;
+	}
 
-	wxString myjson;
-	wxFFile fileData;
-	fileData.Open(tmp_file, wxT("r"));
-	fileData.ReadAll(&myjson);
+	m_stUKDownloadInfo->SetLabel(_("Success"));
 
-	// construct the JSON root object
 	Json::Value  root2;
-	// construct a JSON parser
-	Json::Reader reader2;
-	wxString error = "Unable to parse json";
+	std::string errors;
 
-	if (!reader2.parse((std::string)myjson, root2)) {
-		wxLogMessage(error);
+	if (!pager->Stitch(root2, errors)) {
+		wxLogMessage(_("CanadianTides") + wxString(": ") + wxString(errors.c_str(), wxConvUTF8));
 		return;
 	}
 
-	for (auto it = root2.begin(); it != root2.end(); ++it) {	
+	TideEventsFromJson(root2, m_eventLabels, m_events);
 
-		string qcFlagCode = (*it)["qcFlagCode"].asString();
+	SavePortTidalEvents(m_events, id);
+	SaveTidalEventsToXml(m_savedPorts.Get());
+	b_HideButtons = true;
+	OnShow();
 
-		if (qcFlagCode == "1" || qcFlagCode == "2" ) {
-			outTidalEvent.EventType = qcFlagCode;
+	UpdateHarmonics(id);
+}
 
-			string datetime = (*it)["eventDate"].asString();
-			wxString mydatetime(datetime.c_str(), wxConvUTF8);
-			outTidalEvent.DateTime = ProcessDate(mydatetime);
+// The fetch and fit run on m_worker; the finish step stores the result
+// back on the UI thread.
+void Dlg::UpdateHarmonics(const string &id)
+{
+	const time_t refitAge = 30 * 86400;
+	time_t now = time(NULL);
 
-			double height = (*it)["value"].asDouble();
-			wxString myheight(wxString::Format("%4.2f", height));
-			outTidalEvent.Height = myheight;
-		}
-		else {
-			outTidalEvent.EventType = qcFlagCode;
-			outTidalEvent.DateTime ="n/a";
-			outTidalEvent.Height = "n/a";
-		}
+	std::map<std::string, TideHarmonics>::iterator it = m_harmonics.find(id);
+	if (it != m_harmonics.end() && now - it->second.fitted < refitAge)
+		return;
 
+	if (!TideFetchAvailable() || !m_fitting.insert(id).second)
+		return;
 
-		myevents.push_back(outTidalEvent);
+	std::string baseUrl = m_apiBaseUrl.ToStdString();
+	std::string name = m_titlePortName.ToStdString();
+	m_worker.Submit([this, id, name, baseUrl, now, refitAge]() -> TideWorker::Finish {
+		// A month of hourly predictions separates the main constituents.
+		// The last week is ahead of now, so the series itself can stand
+		// in for the fit when that fails.
+		TideSeriesStore store;
+		std::vector<std::string> ids(1, id);
+		std::vector<int> kinds(1, TSK_WLP);
+		TideFetchSeries(baseUrl, ids, kinds, now - refitAge + 7 * 86400,
+			now + 7 * 86400, TideUrlFetcher(10, &m_closing), 3, store);
+
+		TideSeries &series = store.Get(id, TSK_WLP);
+		TideHarmonics h;
+		h.stationId = id;
+		h.name = name;
+		std::string error = "No predictions downloaded";
+		bool fitted = !series.Empty() && TideFitHarmonics(series.Samples(), h, error);
+
+		std::shared_ptr<std::vector<TideSample> > samples = std::make_shared<std::vector<TideSample> >();
+		series.TrimBefore(now - 86400);
+		series.Swap(*samples);
+
+		return [this, id, h, fitted, error, samples]() {
+			HarmonicsFitted(id, h, fitted, error, *samples);
+		};
+	});
+
+	if (!m_workTimer.IsRunning())
+		m_workTimer.Start(200);
+}
 
+void Dlg::HarmonicsFitted(const string &id, const TideHarmonics &h, bool fitted,
+	const string &error, std::vector<TideSample> &samples)
+{
+	m_fitting.erase(id);
 
-    }
-	
-	for (std::list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end();) {
+	if (!samples.empty()) {
+		m_levelSeries.Get(id, TSK_WLP).Swap(samples);
+		m_levelsStale = true;
+		m_queryStale = true;
+	}
 
-		if ((*it).Id == id) {
-			mySavedPorts.erase(it);
-		}
-		else {
-			++it;
-		}
+	if (!fitted) {
+		wxLogMessage(_("CanadianTides") + wxString(": ") + wxString(error.c_str(), wxConvUTF8));
+		return;
 	}
 
-	mySavedPort = SavePortTidalEvents(myevents, id);
-	mySavedPorts.push_back(mySavedPort);
+	m_harmonics[id] = h;
+	m_fieldStale = true;
+	m_levelsStale = true;
+	m_queryStale = true;
+	m_ownStation.clear();
+	wxString s = wxFileName::GetPathSeparator();
+	TideSaveHarmonics((StandardPath() + s + "harmonics.xml").ToStdString(), m_harmonics);
+	RequestRefresh(m_parent);
+}
+
+void Dlg::OnWorkTimer(wxTimerEvent& event)
+{
+	m_worker.RunFinished();
+	if (m_worker.Pending() == 0)
+		m_workTimer.Stop();
+}
+
+bool Dlg::ShowPredictedTides(const string &id, time_t span)
+{
+	TideCurve *curve = NULL;
+	time_t start = time(NULL);
+	time_t end = start + span;
+
+	std::map<std::string, TideHarmonics>::iterator it = m_harmonics.find(id);
+	const TideSeries *series = m_levelSeries.Find(id, TSK_WLP);
+	if (it != m_harmonics.end())
+		curve = new TideHarmonicCurve(it->second);
+	else if (series && series->End() > start) {
+		curve = new TideSeriesCurve(*series);
+		start = std::max(start, series->Begin());
+		end = std::min(end, series->End());
+	}
+	else
+		return false;
+
+	std::vector<TideExtremaJob> jobs(1);
+	jobs[0].stationId = id;
+	jobs[0].curve = curve;
+	jobs[0].from = start;
+	jobs[0].to = end;
+	TideSolveExtrema(jobs, 0);
+	delete curve;
+
+	uint32_t high = m_eventLabels.Intern(std::string(_("High").mb_str(wxConvUTF8)));
+	uint32_t low = m_eventLabels.Intern(std::string(_("Low").mb_str(wxConvUTF8)));
+
+	m_events.clear();
+	const std::vector<TideExtremum> &extrema = jobs[0].extrema;
+	for (size_t i = 0; i < extrema.size(); i++) {
+		TideStationEvent ev;
+		ev.t = extrema[i].t;
+		ev.height = (float)extrema[i].height;
+		ev.type = extrema[i].high ? high : low;
+		m_events.push_back(ev);
+	}
 
-	SaveTidalEventsToXml(mySavedPorts);
+	m_stUKDownloadInfo->SetLabel(_("Offline prediction"));
 	b_HideButtons = true;
 	OnShow();
+	return true;
 }
 
 void Dlg::OnTest(wxString thePort)
@@ -720,140 +1756,173 @@ void Dlg::OnTest(wxString thePort)
 	RemoveSavedPort(thePort);
 }
 
-void Dlg::OnShow(void)
+bool Dlg::FindPort(const wxString &portId, myPort &port)
 {
-		tidetable = new TideTable(this, 7000, _("Tides"), wxPoint(200, 200), wxSize(-1, -1), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
-		wxString label = m_titlePortName + _("      (Times are UTC)  ") + _(" (Height in metres)");
-		tidetable->itemStaticBoxSizer14Static->SetLabel(label);
+	std::string id = portId.ToStdString();
+	TideStationSnapshot stores[2] = { m_ports.Get(), m_savedPorts.Get() };
+
+	for (int k = 0; k < 2; k++) {
+		int i = stores[k]->Find(id);
+		if (i < 0)
+			continue;
+		port.Id = portId;
+		port.Name = wxString(stores[k]->Name(i), wxConvUTF8);
+		port.coordLat = stores[k]->Lat(i);
+		port.coordLon = stores[k]->Lon(i);
+		return true;
+	}
+	return false;
+}
 
-		if (b_HideButtons) {
-			tidetable->m_bDelete->Hide();
-			tidetable->m_bDeleteAll->Hide();
-		}
-		
-		//tidetable->theDialog = this;
+void Dlg::WatchObservedLevels(double m_lat, double m_lon)
+{
+	if (!TideFetchAvailable()) {
+		wxMessageBox(_("Observed water levels are not available in this build"));
+		return;
+	}
 
-		wxString Event;
-		wxString EventDT;
-		wxString EventHeight;
+	wxString m_portId;
+	if (!m_ports.Get()->Empty())
+		m_portId = getPortId(m_lat, m_lon);
+	else
+		m_portId = getSavedPortId(m_lat, m_lon);
 
+	myPort port;
+	if (!FindPort(m_portId, port))
+		return;
 
-		if (myevents.empty()) {
-			wxMessageBox(_("No tidal data found. Please use right click to select the Canadian tidal station"));
-			return;
-		}
+	if (!m_obsPoller) {
+		m_obsPoller = new TideObservationPoller(m_apiBaseUrl.ToStdString(), TideUrlFetcher(10, &m_closing));
+		m_obsPoller->Start();
+	}
 
-		int in = 0;
+	std::string id = m_portId.ToStdString();
 
-		for (std::list<TidalEvent>::iterator it = myevents.begin();
-			it != myevents.end(); it++) {
+	if (m_obsPoller->IsWatched(id)) {
+		m_obsPoller->Unwatch(id);
+		m_watchedPorts.erase(m_portId);
+	}
+	else {
+		m_watchedPorts[m_portId] = port;
+		m_obsPoller->Watch(id);
+	}
 
-			Event = (*it).EventType;
-			EventDT = (*it).DateTime;
-			EventHeight = (*it).Height;
+	if (m_watchedPorts.empty())
+		m_obsTimer.Stop();
+	else if (!m_obsTimer.IsRunning())
+		m_obsTimer.Start(5000);
 
-			tidetable->m_wpList->InsertItem(in, "", -1);
-			tidetable->m_wpList->SetItem(in, 0, EventDT);
-			tidetable->m_wpList->SetItem(in, 1, Event);
-			tidetable->m_wpList->SetItem(in, 2, EventHeight);
+	RequestRefresh(m_parent);
+}
 
-			in++;
+void Dlg::OnObsTimer(wxTimerEvent& event)
+{
+	if (!m_obsPoller)
+		return;
+
+	// The poller runs on its own thread; only repaint when it has news
+	unsigned generation = m_obsPoller->Generation();
+	if (generation != m_obsGeneration) {
+		m_obsGeneration = generation;
+		RequestRefresh(m_parent);
+	}
+}
+
+// The trimmer drops stale events on its own thread; what it left is
+// written back so a restart does not load them again.
+void Dlg::OnExpiryTimer(wxTimerEvent& event)
+{
+	unsigned generation = m_expiry->Generation();
+	if (generation == m_expiryGeneration)
+		return;
 
+	m_expiryGeneration = generation;
+	SaveTidalEventsToXml(m_savedPorts.Get());
+	RequestRefresh(m_parent);
+}
+
+void Dlg::OnShow(void)
+{
+		if (m_events.empty()) {
+			wxMessageBox(_("No tidal data found. Please use right click to select the Canadian tidal station"));
+			return;
 		}
 
-		AutoSizeHeader(tidetable->m_wpList);
-		tidetable->Fit();
-		tidetable->Layout();
-		tidetable->Show();
+		GetTideTable(_("Tides"));
+		wxString label = m_titlePortName + _("      (Times are UTC)  ") + _(" (Height in metres)");
+		tidetable->itemStaticBoxSizer14Static->SetLabel(label);
 
-		tidetable->theDialog = this;
-		
-		
+		tidetable->m_bDelete->Show(!b_HideButtons);
+		tidetable->m_bDeleteAll->Show(!b_HideButtons);
 
+		// The list reads straight from a store, so give the scratch events one
+		std::shared_ptr<TideStationStore> shown = std::make_shared<TideStationStore>();
+		size_t i = shown->Add("", std::string(m_titlePortName.mb_str(wxConvUTF8)), 0, 0);
+		shown->SetEvents(i, m_events, m_eventLabels);
+		ShowEvents(shown, (int)i);
 }
 
 void Dlg::OnShowSavedPortTides(wxString thisPortId) {
 	
-	if (mySavedPorts.empty()) {
+	TideStationSnapshot saved = m_savedPorts.Get();
+	if (saved->Empty()) {
 		wxMessageBox(_("No tidal data found. Please download the locations \n and use right click to select the Canadian tidal station"));
 		return;
 	}
 
-	tidetable = new TideTable(this, 7000, _("Locations Saved"), wxPoint(200, 200), wxSize(-1, -1), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
-
-	wxString Event;
-	wxString EventDT;
-	wxString EventHeight;
-
+	GetTideTable(_("Locations Saved"));
 
 	tidetable->m_bDelete->Show();
 	tidetable->m_bDeleteAll->Show();
-		
-
-	for (std::list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-
-		if ((*it).Id == thisPortId) {
-
-			wxString m_titlePortTides;
-			m_titlePortTides = (*it).Name;
-
-			tidetable->portName = m_titlePortTides;
 
-			wxString label = m_titlePortTides + _("      (Times are UTC)  ") + _(" (Height in metres)");
-			tidetable->itemStaticBoxSizer14Static->SetLabel(label);
-
-			list<TidalEvent> savedevents = (*it).tidalevents;
-
-			int in = 0;
-
-			for (list<TidalEvent>::iterator itt = savedevents.begin(); itt != savedevents.end(); itt++) {
+	int i = saved->Find(thisPortId.ToStdString());
+	if (i < 0) {
+		ShowEvents(saved, -1);
+		return;
+	}
 
-				Event = (*itt).EventType;
-				EventDT = (*itt).DateTime;
-				EventHeight = (*itt).Height;
+	wxString m_titlePortTides(saved->Name(i), wxConvUTF8);
+	tidetable->portName = m_titlePortTides;
 
-				tidetable->m_wpList->InsertItem(in, "", -1);
-				tidetable->m_wpList->SetItem(in, 0, EventDT);
-				tidetable->m_wpList->SetItem(in, 1, Event);
-				tidetable->m_wpList->SetItem(in, 2, EventHeight);
+	wxString label = m_titlePortTides + _("      (Times are UTC)  ") + _(" (Height in metres)");
+	tidetable->itemStaticBoxSizer14Static->SetLabel(label);
 
-				in++;
+	ShowEvents(saved, i);
+}
 
-			}
-		}
+// One table window serves every station; it is hidden rather than
+// destroyed when closed and is refilled in place.
+TideTable *Dlg::GetTideTable(const wxString &title)
+{
+	if (!tidetable) {
+		tidetable = new TideTable(this, 7000, title, wxPoint(200, 200), wxSize(-1, -1), wxDEFAULT_DIALOG_STYLE | wxRESIZE_BORDER);
+		tidetable->theDialog = this;
 	}
+	else
+		tidetable->SetDialogTitle(title);
 
-	AutoSizeHeader(tidetable->m_wpList);
-	tidetable->Fit();
-	tidetable->Layout();
-	tidetable->Show();
-	
-	tidetable->theDialog = this;
-
-	
+	return tidetable;
 }
 
-
-void Dlg::AutoSizeHeader(wxListCtrl *const list_ctrl)
+void Dlg::ShowEvents(const TideStationSnapshot &store, int station)
 {
-	if (list_ctrl)
-	{
-		for (int i = 0; i < list_ctrl->GetColumnCount(); ++i)
-		{
-			list_ctrl->SetColumnWidth(i, wxLIST_AUTOSIZE);
-			const int a_width = list_ctrl->GetColumnWidth(i);
-			list_ctrl->SetColumnWidth(i, wxLIST_AUTOSIZE_USEHEADER);
-			const int h_width = list_ctrl->GetColumnWidth(i);
-			list_ctrl->SetColumnWidth(i, (std::max)(a_width, h_width));
-		}
+	// Refit only when the station changes, so refreshing the same
+	// station does not make the window jump
+	if (tidetable->m_wpList->SetEvents(store, station)) {
+		tidetable->m_wpList->FitColumns();
+		tidetable->Fit();
 	}
+	tidetable->Layout();
+	tidetable->Show();
+	tidetable->Raise();
 }
 
 void Dlg::getPort(double m_lat, double m_lon) {	
 	wxString m_portId;
 
-	if (myports.empty()) {
+	if (m_ports.Get()->Empty()) {
 		wxMessageBox(_("No active tidal stations found. Please download the locations"));
+		return;
 	}
 
 	m_portId = getPortId(m_lat, m_lon);
@@ -863,33 +1932,20 @@ void Dlg::getPort(double m_lat, double m_lon) {
 		return;
 	}
 	
-	bool foundPort = false;
-	
-	if (mySavedPorts.size() != 0) {
-		wxString portName, portId;
-		
-		for (list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-			portName = (*it).Name;
-			portId = (*it).Id;
-		
-			if (m_portId == portId) {
-				
-				int dialog_return_value = wxNO;
-				mdlg = new wxMessageDialog(this, _("In the saved list \n\nOK: Shows the data for this station.\n\n     Updates the data if online"),
-					_("Saved Port"), wxOK_DEFAULT | wxCANCEL | wxICON_WARNING);
-				dialog_return_value = mdlg->ShowModal();
-				switch(dialog_return_value){
-					case wxID_OK :
-					 b_HideButtons = true;
-					 OnShow();
-					 break;	
-					case wxID_CANCEL :						
-					  break;
-				};
-				foundPort = true;
-			}
-		}
-		if (foundPort)return;		
+	if (m_savedPorts.Get()->Find(m_portId.ToStdString()) >= 0) {
+		int dialog_return_value = wxNO;
+		mdlg = new wxMessageDialog(this, _("In the saved list \n\nOK: Shows the data for this station.\n\n     Updates the data if online"),
+			_("Saved Port"), wxOK_DEFAULT | wxCANCEL | wxICON_WARNING);
+		dialog_return_value = mdlg->ShowModal();
+		switch(dialog_return_value){
+			case wxID_OK :
+			 b_HideButtons = true;
+			 OnShow();
+			 break;	
+			case wxID_CANCEL :						
+			  break;
+		};
+		return;
 	}
 	
 	getHWLW(m_portId.ToStdString());
@@ -897,76 +1953,34 @@ void Dlg::getPort(double m_lat, double m_lon) {
 }
 
 wxString Dlg::getPortId(double m_lat, double m_lon) {
+	TIDE_TRACE_SCOPE("getPortId");
 
-	bool foundPort = false;
-	double radius = 0.1;
-	double myDist, myBrng;
-	double plat;
-	double plon;
-	wxString m_portId;
+	TideStationSnapshot ports = m_ports.Get();
+	int i = ports->Nearest(m_lat, m_lon);
+	if (i < 0)
+		return wxEmptyString;
 
-	while (!foundPort) {
-		for (std::list<myPort>::iterator it = myports.begin();	it != myports.end(); it++) {
-				{
-					plat = (*it).coordLat;
-					plon = (*it).coordLon;
-
-					DistanceBearingMercator(plat, plon, m_lat, m_lon, &myDist, &myBrng);
-
-					if (myDist < radius) {
-						m_portId = (*it).Id;
-						m_titlePortName = (*it).Name;
-						foundPort = true;
-						return m_portId;
-					}
-				}
-		}
-		radius += 0.1;
-	}
-	return _("Port not found");
+	m_titlePortName = wxString(ports->Name(i), wxConvUTF8);
+	return wxString(ports->Id(i), wxConvUTF8);
 }
 
 wxString Dlg::getSavedPortId(double m_lat, double m_lon) {
 
-	bool foundPort = false;
-	double radius = 0.1;
-	double myDist, myBrng;
-	double plat;
-	double plon;
-	wxString m_portId;
-
-	if (mySavedPorts.empty()) {
+	TideStationSnapshot saved = m_savedPorts.Get();
+	if (saved->Empty()) {
 		wxMessageBox(_("No tidal stations found. Please download locations when online"));
 		return wxEmptyString;
 	}
 
-	while (!foundPort) {
-		for (std::list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-			{
-				plat = (*it).coordLat;
-				plon = (*it).coordLon;
-
-				DistanceBearingMercator(plat, plon, m_lat, m_lon, &myDist, &myBrng);
-
-				if (myDist < radius) {
-					m_portId = (*it).Id;
-					m_titlePortName = (*it).Name;
-					foundPort = true;
-					return m_portId;
-				}
-			}
-		}
-		radius += 0.1;
-	}
-	return _("Port not found");
+	int i = saved->Nearest(m_lat, m_lon);
+	m_titlePortName = wxString(saved->Name(i), wxConvUTF8);
+	return wxString(saved->Id(i), wxConvUTF8);
 }
 
 
-wxString Dlg::ProcessDate(wxString myLongDate) {
+wxString Dlg::FormatEventTime(time_t t) {
 
-	wxDateTime myDateTime;
-	myDateTime.ParseISOCombined(myLongDate);
-	return myDateTime.Format(" %a %d-%b-%Y   %H:%M");
+	return TideEventList::FormatTime(t);
 
 }
 
@@ -990,41 +2004,33 @@ wxString Dlg::StandardPath()
 }
 
 
-myPort Dlg::SavePortTidalEvents(list<TidalEvent>myevents, string portId)
+void Dlg::SavePortTidalEvents(const std::vector<TideStationEvent> &events, const string &portId)
 {
-	myPort thisPort;
-
-	double plat, plon;
-	plat = 0;
-	plon = 0;
-
-	wxString portName;
-
-	for (std::list<myPort>::iterator it = myports.begin(); it != myports.end(); it++) {
-		{
-			if ((*it).Id == portId) {
-				plat = (*it).coordLat;
-				plon = (*it).coordLon;
-				portName = (*it).Name;
-			}
+	TideStationSnapshot ports = m_ports.Get();
+
+	// Only this station's events are new; the others stay shared with
+	// the previous version
+	m_savedPorts.Update([&](TideStationStore &saved) {
+		int i = saved.Find(portId);
+		if (i < 0) {
+			int p = ports->Find(portId);
+			if (p >= 0)
+				i = (int)saved.Add(portId, ports->Name(p), ports->Lat(p), ports->Lon(p));
+			else
+				i = (int)saved.Add(portId, "", 0, 0);
 		}
-	}
-
-	wxString dtNow = GetDateStringNow();
-
-	thisPort.Name = portName;
-	thisPort.DownloadDate = dtNow;
-	thisPort.Id = portId;
-	thisPort.coordLat = plat;
-	thisPort.coordLon = plon;
-	thisPort.tidalevents = myevents;
-
-	return thisPort;
 
+		// Labels move from the scratch pool into the saved store's own
+		saved.SetDownloaded(i, time(NULL));
+		saved.SetEvents(i, events, m_eventLabels);
+	});
+	m_expiry->Schedule(portId);
 }
 
-void Dlg::SaveTidalEventsToXml(list<myPort>myPorts)
+void Dlg::SaveTidalEventsToXml(const TideStationSnapshot &savedPorts)
 {
+	TIDE_TRACE_SCOPE("SaveTidalEventsToXml");
+	const TideStationStore &saved = *savedPorts;
 
 	wxString tidal_events_path;
 
@@ -1041,7 +2047,7 @@ void Dlg::SaveTidalEventsToXml(list<myPort>myPorts)
 	wxString filename = tidal_events_path + s + "tidalevents.xml";
 
 
-	if (myPorts.size() == 0) {		
+	if (saved.Empty()) {		
 		wxTextFile myXML(filename);
 		if(!myXML.Exists())
 		   return;
@@ -1051,51 +2057,14 @@ void Dlg::SaveTidalEventsToXml(list<myPort>myPorts)
 		return;             		
 	}
 	
-	TiXmlDocument doc;
-	TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "utf-8", "");
-	doc.LinkEndChild(decl);
-
-	TiXmlElement * root = new TiXmlElement("TidalEventDataSet");
-	doc.LinkEndChild(root);
-
-	for (list<myPort>::iterator it = myPorts.begin(); it != myPorts.end(); it++) {
-
-		TiXmlElement *Port = new TiXmlElement("Port");
-		Port->SetAttribute("Name", (*it).Name);
-		Port->SetAttribute("DownloadDate", (*it).DownloadDate);
-		Port->SetAttribute("Id", (*it).Id);
-		Port->SetAttribute("Latitude", wxString::Format("%.5f", (*it).coordLat));
-		Port->SetAttribute("Longitude", wxString::Format("%.5f", (*it).coordLon));
-
-		root->LinkEndChild(Port);
-
-		myevents = (*it).tidalevents;
-
-		for (list<TidalEvent>::iterator it = myevents.begin(); it != myevents.end(); it++) {
-			TiXmlElement *t = new TiXmlElement("TidalEvent");
-
-			t->SetAttribute("Event", (*it).EventType.mb_str());
-			t->SetAttribute("DateTime", (*it).DateTime.mb_str());
-			t->SetAttribute("Height", (*it).Height.mb_str());
-
-			Port->LinkEndChild(t);
-		}
-	}
-	
-	
-	if (!doc.SaveFile(filename))
+	if (!TideSaveEventsXml(filename.ToStdString(), saved, EventsXmlFormat()))
 		wxLogMessage(_("CanadianTides") + wxString(": ") + _("Failed to save xml file: ") + filename);
 }
 
-list<myPort>Dlg::LoadTidalEventsFromXml()
+void Dlg::LoadTidalEventsFromXml()
 {
-	
-	list<myPort>myEmptyPorts;
-
-	myPort thisPort;
-	TidalEvent thisEvent;
-
-	TiXmlDocument doc;
+	TIDE_TRACE_SCOPE("LoadTidalEventsFromXml");
+	m_savedPorts.Publish(std::make_shared<TideStationStore>());
 
 	wxString tidal_events_path;
 
@@ -1107,154 +2076,119 @@ list<myPort>Dlg::LoadTidalEventsFromXml()
 	wxFileName fn;
 	if (!wxDirExists(tidal_events_path)) {
 		fn.Mkdir(tidal_events_path, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
-		return myEmptyPorts;
+		return;
 	}
 	
 	if (!wxFileExists(filename)) {		
-		return myEmptyPorts;
+		return;
 	}
 
-	list<TidalEvent> listEvents;
-
 	SetTitle(_("CA Tidal Events"));
 
-	if (!doc.LoadFile(filename.mb_str())) {
+	std::shared_ptr<TideStationStore> saved = std::make_shared<TideStationStore>();
+	std::string error;
+	if (!TideLoadEventsXml(filename.ToStdString(), *saved, EventsXmlFormat(), error)) {
+		wxLogMessage(_("CanadianTides") + wxString(": ") + wxString(error.c_str(), wxConvUTF8));
 		wxMessageBox(_("No Canadian tide locations available"));
-		return myEmptyPorts;
-	}
-	else {
-		TiXmlHandle root(doc.RootElement());
-
-		if (strcmp(root.Element()->Value(), "TidalEventDataSet"))
-			wxMessageBox(_("Invalid xml file"));
-
-		int count = 0;
-		for (TiXmlElement* e = root.FirstChild().Element(); e; e = e->NextSiblingElement())
-			count++;
-
-		int i = 0;
-		for (TiXmlElement* e = root.FirstChild().Element(); e; e = e->NextSiblingElement(), i++) {
-
-			if (!strcmp(e->Value(), "Port")) {
-				thisPort.Name = e->Attribute("Name");
-				thisPort.DownloadDate = e->Attribute("DownloadDate");
-				thisPort.Id = e->Attribute("Id");
-				thisPort.coordLat = AttributeDouble(e, "Latitude", NAN);
-				thisPort.coordLon = AttributeDouble(e, "Longitude", NAN);
-
-				listEvents.clear();
-
-				for (TiXmlElement* f = e->FirstChildElement(); f; f = f->NextSiblingElement()) {
-					if (!strcmp(f->Value(), "TidalEvent")) {
-						thisEvent.EventType = f->Attribute("Event");
-						thisEvent.DateTime = f->Attribute("DateTime");
-						thisEvent.Height = f->Attribute("Height");
-					}
-					listEvents.push_back(thisEvent);
-				}
-
-				thisPort.tidalevents = listEvents;
-				mySavedPorts.push_back(thisPort);
-			}
-		}
+		return;
 	}
 
-	return mySavedPorts;
-
+	m_savedPorts.Publish(saved);
+	m_expiry->Rebuild();
 }
 
-double Dlg::AttributeDouble(TiXmlElement *e, const char *name, double def)
+// Local-time display forms kept in tidalevents.xml for people reading it.
+TideEventsXmlFormat Dlg::EventsXmlFormat()
 {
-	const char *attr = e->Attribute(name);
-	if (!attr)
-		return def;
-	char *end;
-	double d = strtod(attr, &end);
-	if (end == attr)
-		return def;
-	return d;
-}
-
-wxString Dlg::GetDateStringNow() {
-
-	m_dtNow = wxDateTime::Now();
-	wxString downloadDate = m_dtNow.Format("%Y-%m-%d  %H:%M");
-	return downloadDate;
-
-}
-
-void Dlg::RemoveOldDownloads( ) {
-	
-	if (mySavedPorts.size() == 0) {				
-		return;
-	}
-	
-	wxDateTime dtn, ddt;
-	wxString sdt, sddt;
-	wxTimeSpan DaySpan;
-	DaySpan = wxTimeSpan::Days(7);
-
-	dtn = wxDateTime::Now();
-
-	for (std::list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end(); it++) {
-		sddt = (*it).DownloadDate;
-		ddt.ParseDateTime(sddt);
-		ddt.Add(DaySpan);
-
-		if (dtn > ddt) {
-			mySavedPorts.erase((it));
-		}
-	}
-	
-	SaveTidalEventsToXml(mySavedPorts);
-	GetParent()->Refresh();
-
+	TideEventsXmlFormat format;
+	format.eventTime = [](time_t t) {
+		return std::string(TideEventList::FormatTime(t).mb_str());
+	};
+	format.downloadTime = [](time_t t) {
+		return std::string(wxDateTime(t).Format("%Y-%m-%d  %H:%M").mb_str());
+	};
+	format.parseEventTime = [](const char *s, time_t *t) {
+		wxDateTime dt;
+		if (!dt.ParseFormat(wxString(s, wxConvUTF8), " %a %d-%b-%Y   %H:%M"))
+			return false;
+		*t = dt.FromTimezone(wxDateTime::UTC).GetTicks();
+		return true;
+	};
+	format.parseDownloadTime = [](const char *s, time_t *t) {
+		wxDateTime dt;
+		if (!dt.ParseDateTime(wxString(s, wxConvUTF8)))
+			return false;
+		*t = dt.GetTicks();
+		return true;
+	};
+	return format;
 }
 
 void Dlg::RemoveSavedPort(wxString myStation) {
 		
-	if (mySavedPorts.empty()) {
+	if (m_savedPorts.Get()->Empty()) {
 		wxMessageBox(_("No saved tidal stations. Please load"));
 		return;
 	}
 
-	if (mySavedPorts.size() == 1) {
-		mySavedPorts.clear();
-	}
-	else {
-
-		
-		for (std::list<myPort>::iterator it = mySavedPorts.begin(); it != mySavedPorts.end();) {
-
-			if ((*it).Name == myStation) {
-					
-				mySavedPorts.erase(it);
-				SaveTidalEventsToXml(mySavedPorts);
-				break;
-			}
-			else {
-				it++;
-			}
-		}
-	}
+	std::string name(myStation.mb_str(wxConvUTF8));
+	m_savedPorts.Update([&name](TideStationStore &saved) {
+		int i = saved.FindName(name);
+		if (i >= 0)
+			saved.Remove(i);
+	});
+	SaveTidalEventsToXml(m_savedPorts.Get());
 	
 	GetParent()->Refresh();
 }
 
 void Dlg::RemoveAllSavedPorts() {
 
-	if (mySavedPorts.empty()) {
+	if (m_savedPorts.Get()->Empty()) {
 		wxMessageBox(_("No saved tidal stations. Please load"));
 		return;
 	}
 
-	mySavedPorts.clear();	
-	SaveTidalEventsToXml(mySavedPorts);
+	m_savedPorts.Publish(std::make_shared<TideStationStore>());
+	SaveTidalEventsToXml(m_savedPorts.Get());
 
 	GetParent()->Refresh();
 }
 
 
+TideSearchList::TideSearchList(wxWindow *parent, wxWindowID id)
+	: wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize,
+		wxLC_NO_HEADER | wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_VIRTUAL)
+{
+	InsertColumn(0, "");
+}
+
+void TideSearchList::SetStations(const TideStationSnapshot &store, const std::vector<uint32_t> &rows)
+{
+	m_store = store;
+	m_rows = rows;
+	SetItemCount((long)m_rows.size());
+	Refresh();
+
+	if (!m_rows.empty())
+		SetItemState(0, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+}
+
+int TideSearchList::GetStation(long item) const
+{
+	if (item < 0 || (size_t)item >= m_rows.size())
+		return -1;
+	return (int)m_rows[item];
+}
+
+wxString TideSearchList::OnGetItemText(long item, long column) const
+{
+	int i = GetStation(item);
+	if (i < 0)
+		return wxEmptyString;
+	return wxString(m_store->Name(i), wxConvUTF8);
+}
+
 GetTidalEventDialog::GetTidalEventDialog(wxWindow * parent, wxWindowID id, const wxString & title,
 	const wxPoint & position, const wxSize & size, long style)
 	: wxDialog(parent, id, title, position, size, style)
@@ -1266,6 +2200,24 @@ GetTidalEventDialog::GetTidalEventDialog(wxWindow * parent, wxWindowID id, const
 	m_pListSizer = new wxStaticBoxSizer(itemStaticBoxSizer14Static, wxVERTICAL);
 	itemBoxSizer1->Add(m_pListSizer, 2, wxEXPAND | wxALL, 1);
 
+	wxString sets[] = { _("Saved"), _("All stations") };
+	m_choiceSet = new wxChoice(this, wxID_ANY, wxDefaultPosition, wxDefaultSize, 2, sets);
+	m_choiceSet->SetSelection(0);
+	m_pListSizer->Add(m_choiceSet, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 6);
+
+	m_searchText = new wxTextCtrl(this, wxID_ANY, wxEmptyString);
+	m_searchText->SetHint(_("Search by name"));
+	m_pListSizer->Add(m_searchText, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 6);
+
+	dialogText = new TideSearchList(this, wxID_ANY);
+	dialogText->SetMinSize(wxSize(size.GetWidth() - 20, size.GetHeight() - 130));
+	m_pListSizer->Add(dialogText, 1, wxEXPAND | wxALL, 6);
+
+	wxFont *pVLFont = wxTheFontList->FindOrCreateFont(12, wxFONTFAMILY_SWISS, wxNORMAL, wxFONTWEIGHT_NORMAL,
+		FALSE, wxString("Arial"));
+	dialogText->SetFont(*pVLFont);
+	dialogText->SetColumnWidth(0, size.GetWidth() - 30);
+
 	wxBoxSizer* itemBoxSizerBottom = new wxBoxSizer(wxHORIZONTAL);
 	itemBoxSizer1->Add(itemBoxSizerBottom, 0, wxALIGN_RIGHT | wxALL, 5);
 
@@ -1274,21 +2226,48 @@ GetTidalEventDialog::GetTidalEventDialog(wxWindow * parent, wxWindowID id, const
 	itemBoxSizerBottom->Add(m_OKButton, 0, wxALIGN_CENTER_VERTICAL | wxALL, 1);
 	m_OKButton->SetDefault();
 
+	m_searchText->Connect(wxEVT_COMMAND_TEXT_UPDATED, wxCommandEventHandler(GetTidalEventDialog::OnSearch), NULL, this);
+	m_choiceSet->Connect(wxEVT_COMMAND_CHOICE_SELECTED, wxCommandEventHandler(GetTidalEventDialog::OnSearch), NULL, this);
+	dialogText->Connect(wxEVT_COMMAND_LIST_ITEM_ACTIVATED, wxListEventHandler(GetTidalEventDialog::OnActivate), NULL, this);
 
-	wxString dimensions = wxT(""), s;
-	wxPoint p;
-	wxSize  sz;
+	Fit();
+	m_searchText->SetFocus();
+}
 
-	sz.SetWidth(size.GetWidth() - 20);
-	sz.SetHeight(size.GetHeight() - 70);
+void GetTidalEventDialog::SetStations(const TideStationSnapshot &saved, const TideStationSnapshot &catalogue)
+{
+	m_stores[0] = saved;
+	m_stores[1] = catalogue;
+	m_index[0].Build(*saved);
+	m_index[1].Build(*catalogue);
+
+	if (saved->Empty() && !catalogue->Empty())
+		m_choiceSet->SetSelection(1);
+	Refilter();
+}
 
-	p.x = 6; p.y = 2;
+int GetTidalEventDialog::GetSelection(bool &saved) const
+{
+	saved = m_choiceSet->GetSelection() == 0;
+	return dialogText->GetStation(dialogText->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED));
+}
 
-	dialogText = new wxListView(this, wxID_ANY, p, sz, wxLC_NO_HEADER | wxLC_REPORT | wxLC_SINGLE_SEL, wxDefaultValidator, wxT(""));
-	m_pListSizer->Add(dialogText, 1, wxEXPAND | wxALL, 6);
+void GetTidalEventDialog::OnSearch(wxCommandEvent & event)
+{
+	Refilter();
+}
 
-	wxFont *pVLFont = wxTheFontList->FindOrCreateFont(12, wxFONTFAMILY_SWISS, wxNORMAL, wxFONTWEIGHT_NORMAL,
-		FALSE, wxString("Arial"));
-	dialogText->SetFont(*pVLFont);
+void GetTidalEventDialog::OnActivate(wxListEvent & event)
+{
+	EndModal(wxID_OK);
+}
+
+void GetTidalEventDialog::Refilter()
+{
+	int set = m_choiceSet->GetSelection() == 1 ? 1 : 0;
+	if (!m_stores[set])
+		return;
 
+	std::string query(m_searchText->GetValue().mb_str(wxConvUTF8));
+	dialogText->SetStations(m_stores[set], m_index[set].Filter(query));
 }
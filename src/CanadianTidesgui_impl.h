@@ -38,6 +38,10 @@
 #include "tidetable.h"
 #include "tinyxml.h"
 #include "wx/stdpaths.h"
+#include "wx/timer.h"
+#include "wx/checkbox.h"
+#include "wx/slider.h"
+#include "wx/spinctrl.h"
 #include "wx/msgdlg.h"
 
 #include "json/reader.h"
@@ -48,8 +52,29 @@
 
 #include "TexFont.h"
 
-
+#include "tideseries.h"
+#include "tidecurrents.h"
+#include "harmonics.h"
+#include "tideextrema.h"
+#include "tidestations.h"
+#include "tidecatalog.h"
+#include "tidesearch.h"
+#include "tideexpiry.h"
+#include "tideroute.h"
+#include "tidedeparture.h"
+#include "tidefield.h"
+#include "tidelevels.h"
+#include "tidehover.h"
+#include "tidequery.h"
+#include "tidefetch.h"
+#include "tidepager.h"
+#include "tideworker.h"
+
+
+#include <atomic>
 #include <map>
+#include <memory>
+#include <set>
 #include <list>
 #include <vector>
 
@@ -60,30 +85,29 @@
 #include "gl_private.h"
 #endif
 
+#define ID_OBS_TIMER  8100
+#define ID_PLAY_TIMER 8101
+#define ID_HOVER_TIMER 8102
+#define ID_QUERY_TIMER 8103
+#define ID_WORK_TIMER 8104
+#define ID_EXPIRY_TIMER 8105
+
 class PlugIn_ViewPort;
 class wxBoundingBox;
 class piDC;
 
 using namespace std;
 
-struct TidalEvent
-{
-	wxString EventType;
-	wxString DateTime;
-	wxString Height;
-};
-
 struct myPort
 {
 	wxString Name;
-	wxString DownloadDate;
 	wxString Id;
 	double coordLat;
 	double coordLon;
-	list<TidalEvent>tidalevents;
 };
 
 class CanadianTides_pi;
+class TideObservationPoller;
 class Position;
 class TideTable;
 
@@ -107,20 +131,21 @@ public:
 			
 		CanadianTides_pi *plugin; 
 
+		wxString m_apiBaseUrl;
+
 		wxString rte_start;
 	    wxString rte_end;
 	
 		void getPort(double m_lat, double m_lon);
 		wxString m_default_configuration_path;
-		void AutoSizeHeader(wxListCtrl *const list_ctrl);
 
 		CanadianTides_pi &m_CanadianTides_pi;
 		wxString StandardPath();
 
-		list<myPort>myports;
-		list<myPort>mySavedPorts;
-
-		myPort mySavedPort;
+		// Published as immutable snapshots, see TideStationModel
+		TideStationModel m_ports;
+		TideStationModel m_savedPorts;
+		TideStationModel m_currentPorts;
 
 		void SetViewPort(PlugIn_ViewPort *vp);
 		bool RenderOverlay(piDC &dc, PlugIn_ViewPort &vp);
@@ -144,8 +169,12 @@ public:
 		bool b_clearAllIcons;
 		void OnShow(void);
 		void OnTest(wxString thePort);
+		void WatchObservedLevels(double m_lat, double m_lon);
 		void RemoveSavedPort(wxString myStation);
 		void RemoveAllSavedPorts();
+		void SetOwnShip(double lat, double lon);
+		void SetHoverLatLon(double lat, double lon);
+		void SubmitQuery(const wxString &request);
 
 		wxMessageDialog* mdlg;
 		
@@ -159,24 +188,38 @@ private:
 	
 	
 	wxString m_titlePortName;
+	double m_viewScale;
 	
-	list<TidalEvent>myevents;
-	list<TidalEvent>mySavedEvents;
-
-	myPort SavePortTidalEvents(list<TidalEvent>myevents, string portId);
-	void SaveTidalEventsToXml(list<myPort>myPorts);
-
-	list<myPort> LoadTidalEventsFromXml();
-
-	double AttributeDouble(TiXmlElement *e, const char *name, double def);
-	wxString GetDateStringNow();
-	void RemoveOldDownloads();
+	std::vector<TideStationEvent> m_events;
+	TideStringPool m_eventLabels;
+
+	void SavePortTidalEvents(const std::vector<TideStationEvent> &events, const string &portId);
+	void SaveTidalEventsToXml(const TideStationSnapshot &savedPorts);
+	void LoadTidalEventsFromXml();
+	TideTable *GetTideTable(const wxString &title);
+	void ShowEvents(const TideStationSnapshot &store, int station);
+
+	static TideEventsXmlFormat EventsXmlFormat();
+	TideExpiryTrimmer *m_expiry;
+	wxTimer      m_expiryTimer;
+	unsigned     m_expiryGeneration;
+	void OnExpiryTimer(wxTimerEvent& event);
 	
 
 	void getHWLW(string id);
+	void HWLWProgress(unsigned generation, int done, int total, TideChunkState state);
+	void HWLWLoaded(unsigned generation, const string &id, time_t span,
+		const std::shared_ptr<TidePager> &pager);
+	unsigned     m_hwlwGeneration;
+	std::map<std::string, TideHarmonics> m_harmonics;
+	void UpdateHarmonics(const string &id);
+	void HarmonicsFitted(const string &id, const TideHarmonics &h, bool fitted,
+		const string &error, std::vector<TideSample> &samples);
+	bool ShowPredictedTides(const string &id, time_t span);
+	_OCPN_DLStatus DownloadToString(const wxString &urlString, std::string &body);
 	wxString getPortId(double m_lat, double m_lon);
 	wxString getSavedPortId(double m_lat, double m_lon);
-	wxString ProcessDate(wxString myLongDate);
+	wxString FormatEventTime(time_t t);
 	
 	void OnShowSavedPortTides(wxString thisPortId);
 	void OnClose( wxCloseEvent& event );
@@ -186,8 +229,126 @@ private:
     bool error_found;
     bool dbg;
 
+	std::shared_ptr<TidePager> m_pager;   // a partial download to resume
+
+	std::atomic<bool> m_closing;
+	TideObservationPoller *m_obsPoller;
+	std::map<wxString, myPort> m_watchedPorts;
+	wxTimer      m_obsTimer;
+	unsigned     m_obsGeneration;
+	void OnObsTimer(wxTimerEvent& event);
+	void DrawObservedLevels(PlugIn_ViewPort *BBox);
+	bool FindPort(const wxString &portId, myPort &port);
+
+	// Water levels outlive a reload of the current stations
+	TideSeriesStore m_levelSeries;
+	TideSeriesStore m_currentSeries;
+
+	wxCheckBox  *m_cbShowCurrents;
+	wxSlider    *m_sliderTime;
+	wxStaticText *m_stCurrentTime;
+	time_t       m_currentBase;
+	time_t       m_currentTime;
+	TideStationSnapshot m_currentResolved;
+	std::vector<TideCurrentSeries> m_currentResolvedSeries;
+	std::vector<uint32_t> m_currentIndex;
+	std::vector<float> m_currentPx;
+	std::vector<float> m_currentPy;
+	std::vector<TideCurrentArrow> m_currentArrows;
+
+	void CreateCurrentControls();
+	void DownloadCurrentStations(const wxString &region);
+	void LoadCurrents();
+	void CurrentsLoaded(unsigned generation, time_t base, int loaded, TideSeriesStore &store);
+	TideFetchFn UiFetcher();
+	unsigned     m_currentsGeneration;
+	bool         m_currentsLoading;
+	void UpdateCurrentTimeLabel();
+	void OnShowCurrents(wxCommandEvent& event);
+	void OnTimeSlider(wxScrollEvent& event);
+	void DrawCurrentArrows(PlugIn_ViewPort *BBox);
+
+	wxCheckBox  *m_cbShowField;
+	TideHeightField m_field;
+	std::vector<TidePredictor> m_fieldPredictors;
+	bool         m_fieldStale;
+	time_t       m_fieldTime;
+	std::vector<double> m_fieldHeights;
+	double       m_fieldLo, m_fieldHi;
+	std::vector<int> m_fieldBand;
+	std::vector<uint32_t> m_fieldOrder;
+	std::vector<wxPoint> m_fieldPx;
+	void OnShowField(wxCommandEvent& event);
+	void LoadFieldStations();
+	void DrawHeightField(PlugIn_ViewPort *BBox);
+	void EnsureTimeBase();
+
+	wxCheckBox  *m_cbShowLevels;
+	wxButton    *m_bPlay;
+	wxTimer      m_playTimer;
+	TideLevelBatch m_levels;
+	TideStationSnapshot m_levelsPorts;
+	bool         m_levelsStale;
+	std::vector<uint32_t> m_levelVisible;
+	std::vector<wxPoint> m_levelPx;
+	void OnShowLevels(wxCommandEvent& event);
+	void OnPlay(wxCommandEvent& event);
+	void OnPlayTimer(wxTimerEvent& event);
+	void LoadLevelSources();
+	void DrawStationLevels(PlugIn_ViewPort *BBox);
+
+	wxSpinCtrl  *m_spinAlmanacYear;
+	wxChoice    *m_choiceAlmanacFormat;
+	void CreateAlmanacControls();
+	void OnExportAlmanac(wxCommandEvent& event);
+
+	TideRouteEvaluator *m_route;
+	wxSpinCtrlDouble *m_spinRouteSpeed;
+	wxSpinCtrlDouble *m_spinRouteMinHeight;
+	wxSpinCtrlDouble *m_spinRouteFoul;
+	void CreateRouteControls();
+	void GetRouteStations(std::vector<TideRouteStation> &stations);
+	void OnLoadRoute(wxCommandEvent& event);
+	void OnRouteSpeed(wxSpinDoubleEvent& event);
+	void ShowRouteTides();
+	void OnFindDeparture(wxCommandEvent& event);
+	void FindDepartures(const TideDepartureRequest &request);
+
+	wxStaticText *m_stOwnShip;
+	TideNearestTracker m_ownShip;
+	std::string  m_ownStation;
+	TideExtremum m_ownNext;     // t is 0 when nothing is known
+	void CreateOwnShipControls();
+	bool FindNextTidalEvent(const std::string &id, time_t now, TideExtremum &next);
+
+	// Station icons of the last frame, for the hover tip
+	TideHoverGrid m_hoverGrid;
+	TideStationSnapshot m_hoverStores[2];   // catalogue, saved
+	PlugIn_ViewPort m_hoverVp;
+	bool         m_hoverVpValid;
+	double       m_hoverLat, m_hoverLon;
+	wxTimer      m_hoverTimer;
+	bool         m_hoverShown;
+	uint32_t     m_hoverTag;
+	double       m_hoverStationLat, m_hoverStationLon;
+	wxString     m_hoverName;
+	wxString     m_hoverEvent;
+	void OnHoverTimer(wxTimerEvent& event);
+	void DrawHoverTip(PlugIn_ViewPort *BBox);
+
+	TideQueryService m_queries;
+	wxTimer      m_queryTimer;
+	bool         m_queryStale;
+	std::shared_ptr<const TideHarmonicsMap> m_queryHarmonics;
+	std::shared_ptr<const TideSeriesStore> m_querySeries;
+	void OnQueryTimer(wxTimerEvent& event);
+
+	TideWorker   m_worker;
+	wxTimer      m_workTimer;
+	std::set<std::string> m_fitting;
+	void OnWorkTimer(wxTimerEvent& event);
+
 	wxString     m_gpx_path;	
-	wxDateTime m_dtNow;
 
 	wxFont *pTCFont;
 	wxColour m_text_color;
@@ -209,6 +370,23 @@ public:
 
 };
 
+// Station names shown straight from a snapshot, in the order given.
+class TideSearchList : public wxListCtrl
+{
+public:
+	TideSearchList(wxWindow *parent, wxWindowID id);
+
+	void SetStations(const TideStationSnapshot &store, const std::vector<uint32_t> &rows);
+	int GetStation(long item) const;
+
+protected:
+	wxString OnGetItemText(long item, long column) const;
+
+private:
+	TideStationSnapshot m_store;
+	std::vector<uint32_t> m_rows;
+};
+
 class GetTidalEventDialog : public wxDialog
 {
 public:
@@ -218,18 +396,27 @@ public:
 		const wxSize & size = wxDefaultSize,
 		long style = wxDEFAULT_DIALOG_STYLE);
 
-	wxListView * dialogText;
-	wxString GetText();
+	void SetStations(const TideStationSnapshot &saved, const TideStationSnapshot &catalogue);
+	// Index of the chosen station, or -1. saved tells which set it is in.
+	int GetSelection(bool &saved) const;
+
+	wxTextCtrl *m_searchText;
+	wxChoice *m_choiceSet;
+	TideSearchList * dialogText;
 
 	wxStaticBoxSizer* m_pListSizer;
-	wxScrolledWindow *itemDialog1;
 	wxStaticBox* itemStaticBoxSizer14Static;
 
 	wxButton*     m_OKButton;
 
 private:
 
-	void OnOk(wxCommandEvent & event);
+	void OnSearch(wxCommandEvent & event);
+	void OnActivate(wxListEvent & event);
+	void Refilter();
+
+	TideStationSnapshot m_stores[2];
+	TideSearchIndex m_index[2];
 
 };
 
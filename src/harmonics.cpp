@@ -0,0 +1,586 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "harmonics.h"
+#include "tidetime.h"
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+
+#include "tinyxml.h"
+
+enum NodalType {
+	NODAL_NONE = 0,
+	NODAL_M2,
+	NODAL_M2_2,   // M2 squared: M4, MN4, 2MS6
+	NODAL_M2_3,   // M6
+	NODAL_M3,
+	NODAL_O1,
+	NODAL_K1,
+	NODAL_K2,
+	NODAL_J1,
+	NODAL_OO1,
+	NODAL_MF,
+	NODAL_MM
+};
+
+struct ConstituentDef
+{
+	const char *name;
+	int d[6];      // Doodson multipliers of tau, s, h, p, N', p1
+	int phase90;   // extra phase in quarter turns
+	NodalType nodal;
+};
+
+// In order of priority for the Rayleigh selection: the fit keeps the
+// earlier of two constituents the record is too short to separate.
+static const ConstituentDef s_defs[] = {
+	{ "M2",   { 2,  0,  0,  0, 0, 0 },  0, NODAL_M2 },
+	{ "S2",   { 2,  2, -2,  0, 0, 0 },  0, NODAL_NONE },
+	{ "K1",   { 1,  1,  0,  0, 0, 0 },  1, NODAL_K1 },
+	{ "O1",   { 1, -1,  0,  0, 0, 0 }, -1, NODAL_O1 },
+	{ "N2",   { 2, -1,  0,  1, 0, 0 },  0, NODAL_M2 },
+	{ "M4",   { 4,  0,  0,  0, 0, 0 },  0, NODAL_M2_2 },
+	{ "K2",   { 2,  2,  0,  0, 0, 0 },  0, NODAL_K2 },
+	{ "P1",   { 1,  1, -2,  0, 0, 0 }, -1, NODAL_NONE },
+	{ "Q1",   { 1, -2,  0,  1, 0, 0 }, -1, NODAL_O1 },
+	{ "MS4",  { 4,  2, -2,  0, 0, 0 },  0, NODAL_M2 },
+	{ "MN4",  { 4, -1,  0,  1, 0, 0 },  0, NODAL_M2_2 },
+	{ "M6",   { 6,  0,  0,  0, 0, 0 },  0, NODAL_M2_3 },
+	{ "2N2",  { 2, -2,  0,  2, 0, 0 },  0, NODAL_M2 },
+	{ "NU2",  { 2, -1,  2, -1, 0, 0 },  0, NODAL_M2 },
+	{ "MU2",  { 2, -2,  2,  0, 0, 0 },  0, NODAL_M2 },
+	{ "L2",   { 2,  1,  0, -1, 0, 0 },  2, NODAL_M2 },
+	{ "J1",   { 1,  2,  0, -1, 0, 0 },  1, NODAL_J1 },
+	{ "OO1",  { 1,  3,  0,  0, 0, 0 },  1, NODAL_OO1 },
+	{ "2MS6", { 6,  2, -2,  0, 0, 0 },  0, NODAL_M2_2 },
+	{ "M3",   { 3,  0,  0,  0, 0, 0 },  0, NODAL_M3 },
+	{ "MF",   { 0,  2,  0,  0, 0, 0 },  0, NODAL_MF },
+	{ "MM",   { 0,  1,  0, -1, 0, 0 },  0, NODAL_MM },
+	{ "2Q1",  { 1, -3,  0,  2, 0, 0 }, -1, NODAL_O1 },
+	{ "T2",   { 2,  2, -3,  0, 0, 1 },  0, NODAL_NONE },
+	{ "S4",   { 4,  4, -4,  0, 0, 0 },  0, NODAL_NONE },
+	{ "SSA",  { 0,  0,  2,  0, 0, 0 },  0, NODAL_NONE },
+	{ "SA",   { 0,  0,  1,  0, 0, 0 },  0, NODAL_NONE },
+};
+
+static const int NDEFS = sizeof(s_defs) / sizeof(s_defs[0]);
+
+// Constituents too close to a larger neighbour for a short record. When
+// the record cannot separate them they are inferred from that neighbour:
+// equilibrium amplitude ratio, same phase lag. K2 and P1 need half a year
+// to resolve, T2 a whole one.
+struct InferenceDef
+{
+	const char *name;
+	const char *reference;
+	double ratio;
+};
+
+static const InferenceDef s_inferred[] = {
+	{ "K2", "S2", 0.2717 },
+	{ "P1", "K1", 0.3309 },
+	{ "T2", "S2", 0.0592 },
+};
+
+// Mean longitudes (degrees) and their rates per Julian century
+static const double S0 = 218.3164477, S1 = 481267.88123421;  // moon
+static const double H0 = 280.46646, H1 = 36000.76983;        // sun
+static const double P0 = 83.3532465, P1 = 4069.0137287;      // lunar perigee
+static const double N0 = 125.04452, N1 = -1934.136261;       // lunar node
+static const double PS0 = 282.93735, PS1 = 1.71946;          // solar perigee
+
+static const double HOURS_PER_CENTURY = 36525.0 * 24.0;
+
+static double Speed(const ConstituentDef &c)
+{
+	double ds = S1 / HOURS_PER_CENTURY;
+	double dh = H1 / HOURS_PER_CENTURY;
+	double dp = P1 / HOURS_PER_CENTURY;
+	double dn = -N1 / HOURS_PER_CENTURY;    // N' = -N
+	double dps = PS1 / HOURS_PER_CENTURY;
+	double dtau = 15.0 + dh - ds;
+	return c.d[0] * dtau + c.d[1] * ds + c.d[2] * dh + c.d[3] * dp + c.d[4] * dn + c.d[5] * dps;
+}
+
+static double Centuries(time_t t)
+{
+	return ((double)t / 86400.0 + 2440587.5 - 2451545.0) / 36525.0;
+}
+
+static void Nodal(NodalType type, double N, double *f, double *u)
+{
+	double c1 = cos(N), c2 = cos(2 * N), c3 = cos(3 * N);
+	double s1 = sin(N), s2 = sin(2 * N), s3 = sin(3 * N);
+
+	double fm2 = 1.0004 - 0.0373 * c1 + 0.0002 * c2;
+	double um2 = -2.14 * s1;
+
+	switch (type) {
+	case NODAL_M2: *f = fm2; *u = um2; break;
+	case NODAL_M2_2: *f = fm2 * fm2; *u = 2 * um2; break;
+	case NODAL_M2_3: *f = fm2 * fm2 * fm2; *u = 3 * um2; break;
+	case NODAL_M3: *f = pow(fm2, 1.5); *u = 1.5 * um2; break;
+	case NODAL_O1:
+		*f = 1.0089 + 0.1871 * c1 - 0.0147 * c2 + 0.0014 * c3;
+		*u = 10.80 * s1 - 1.34 * s2 + 0.19 * s3;
+		break;
+	case NODAL_K1:
+		*f = 1.0060 + 0.1150 * c1 - 0.0088 * c2 + 0.0006 * c3;
+		*u = -8.86 * s1 + 0.68 * s2 - 0.07 * s3;
+		break;
+	case NODAL_K2:
+		*f = 1.0241 + 0.2863 * c1 + 0.0083 * c2 - 0.0015 * c3;
+		*u = -17.74 * s1 + 0.68 * s2 - 0.04 * s3;
+		break;
+	case NODAL_J1:
+		*f = 1.1029 + 0.1676 * c1 - 0.0170 * c2 + 0.0016 * c3;
+		*u = -12.94 * s1 + 1.34 * s2 - 0.19 * s3;
+		break;
+	case NODAL_OO1:
+		*f = 1.1027 + 0.6504 * c1 + 0.0317 * c2 - 0.0014 * c3;
+		*u = -36.68 * s1 + 4.02 * s2 - 0.57 * s3;
+		break;
+	case NODAL_MF:
+		*f = 1.0429 + 0.4135 * c1 - 0.0040 * c2;
+		*u = -23.74 * s1 + 2.68 * s2 - 0.38 * s3;
+		break;
+	case NODAL_MM:
+		*f = 1.0 - 0.1300 * c1 + 0.0013 * c2;
+		*u = 0;
+		break;
+	default:
+		*f = 1.0;
+		*u = 0.0;
+		break;
+	}
+}
+
+/*
+ * Year factors: V0 at 1 January 00:00 UTC, f and u at mid-year, and the
+ * angular speeds, for every constituent in the table.
+ */
+struct YearFactors
+{
+	time_t epoch;
+	time_t end;
+	double f[NDEFS];
+	double vu[NDEFS];     // V0 + u, radians
+	double speed[NDEFS];  // radians per second
+};
+
+static std::mutex s_yearMutex;
+static std::map<int, YearFactors> s_years;
+
+static const YearFactors &GetYearFactors(int year)
+{
+	std::lock_guard<std::mutex> lock(s_yearMutex);
+
+	std::map<int, YearFactors>::iterator it = s_years.find(year);
+	if (it != s_years.end())
+		return it->second;
+
+	YearFactors &yf = s_years[year];
+	yf.epoch = TideMakeTimeUTC(year, 1, 1, 0, 0, 0);
+	yf.end = TideMakeTimeUTC(year + 1, 1, 1, 0, 0, 0);
+
+	double T = Centuries(yf.epoch);
+	double s = S0 + S1 * T;
+	double h = H0 + H1 * T;
+	double p = P0 + P1 * T;
+	double N = N0 + N1 * T;
+	double ps = PS0 + PS1 * T;
+	double tau = 180.0 + h - s;   // lunar time at Greenwich midnight
+
+	double Nmid = (N0 + N1 * Centuries(yf.epoch + (yf.end - yf.epoch) / 2)) * TIDE_DEG2RAD;
+
+	for (int i = 0; i < NDEFS; i++) {
+		const ConstituentDef &c = s_defs[i];
+		double v0 = c.d[0] * tau + c.d[1] * s + c.d[2] * h + c.d[3] * p - c.d[4] * N + c.d[5] * ps + 90.0 * c.phase90;
+		double f, u;
+		Nodal(c.nodal, Nmid, &f, &u);
+		yf.f[i] = f;
+		yf.vu[i] = fmod(v0 + u, 360.0) * TIDE_DEG2RAD;
+		yf.speed[i] = Speed(c) * TIDE_DEG2RAD / 3600.0;
+	}
+
+	return yf;
+}
+
+static int YearOf(time_t t)
+{
+	int y, mo, d, h, mi, s;
+	TideSplitUTC(t, &y, &mo, &d, &h, &mi, &s);
+	return y;
+}
+
+int TideConstituentCount() { return NDEFS; }
+
+const char *TideConstituentName(int index)
+{
+	return index >= 0 && index < NDEFS ? s_defs[index].name : "";
+}
+
+int TideConstituentIndex(const std::string &name)
+{
+	for (int i = 0; i < NDEFS; i++) {
+		if (name == s_defs[i].name)
+			return i;
+	}
+	return -1;
+}
+
+double TideConstituentSpeed(int index)
+{
+	return index >= 0 && index < NDEFS ? Speed(s_defs[index]) : 0.0;
+}
+
+// Solves the symmetric system a x = b in place by Gaussian elimination.
+static bool Solve(std::vector<double> &a, std::vector<double> &b, int n)
+{
+	for (int col = 0; col < n; col++) {
+		int pivot = col;
+		for (int r = col + 1; r < n; r++) {
+			if (fabs(a[r * n + col]) > fabs(a[pivot * n + col]))
+				pivot = r;
+		}
+		if (fabs(a[pivot * n + col]) < 1e-12)
+			return false;
+		if (pivot != col) {
+			for (int k = 0; k < n; k++)
+				std::swap(a[col * n + k], a[pivot * n + k]);
+			std::swap(b[col], b[pivot]);
+		}
+		for (int r = col + 1; r < n; r++) {
+			double m = a[r * n + col] / a[col * n + col];
+			if (m == 0)
+				continue;
+			for (int k = col; k < n; k++)
+				a[r * n + k] -= m * a[col * n + k];
+			b[r] -= m * b[col];
+		}
+	}
+	for (int r = n - 1; r >= 0; r--) {
+		double sum = b[r];
+		for (int k = r + 1; k < n; k++)
+			sum -= a[r * n + k] * b[k];
+		b[r] = sum / a[r * n + r];
+	}
+	return true;
+}
+
+bool TideFitHarmonics(const std::vector<TideSample> &samples, TideHarmonics &harmonics, std::string &error)
+{
+	if (samples.size() < 48) {
+		error = "Not enough samples";
+		return false;
+	}
+
+	double hours = (double)(samples.back().t - samples.front().t) / 3600.0;
+	if (hours < 48) {
+		error = "Record shorter than two days";
+		return false;
+	}
+
+	// Rayleigh criterion, with Z0 as a zero-frequency term. Constituents
+	// left out that have an inference rule ride on their reference's
+	// columns; the seasonal SA and SSA are simply dropped.
+	std::vector<int> chosen;
+	std::vector<double> speeds(1, 0.0);
+	for (int i = 0; i < NDEFS; i++) {
+		double w = Speed(s_defs[i]);
+		bool resolvable = true;
+		for (size_t j = 0; j < speeds.size(); j++) {
+			if (fabs(w - speeds[j]) * hours < 360.0) {
+				resolvable = false;
+				break;
+			}
+		}
+		if (resolvable) {
+			chosen.push_back(i);
+			speeds.push_back(w);
+		}
+	}
+
+	std::vector<int> inferred;        // constituent index
+	std::vector<size_t> inferredFrom; // position in chosen
+	std::vector<double> inferredRatio;
+	for (size_t k = 0; k < sizeof(s_inferred) / sizeof(s_inferred[0]); k++) {
+		int i = TideConstituentIndex(s_inferred[k].name);
+		int ref = TideConstituentIndex(s_inferred[k].reference);
+		if (std::find(chosen.begin(), chosen.end(), i) != chosen.end())
+			continue;
+		std::vector<int>::iterator it = std::find(chosen.begin(), chosen.end(), ref);
+		if (it == chosen.end())
+			continue;
+		inferred.push_back(i);
+		inferredFrom.push_back(it - chosen.begin());
+		inferredRatio.push_back(s_inferred[k].ratio);
+	}
+
+	const int n = 1 + 2 * (int)chosen.size();
+	std::vector<double> ata(n * n, 0.0);
+	std::vector<double> atb(n, 0.0);
+	std::vector<double> row(n);
+
+	int year = 0;
+	const YearFactors *yf = NULL;
+
+	for (size_t k = 0; k < samples.size(); k++) {
+		const TideSample &s = samples[k];
+		if (!yf || s.t < yf->epoch || s.t >= yf->end) {
+			year = YearOf(s.t);
+			yf = &GetYearFactors(year);
+		}
+		double dt = (double)(s.t - yf->epoch);
+
+		row[0] = 1.0;
+		for (size_t c = 0; c < chosen.size(); c++) {
+			int i = chosen[c];
+			double arg = yf->speed[i] * dt + yf->vu[i];
+			row[1 + 2 * c] = yf->f[i] * cos(arg);
+			row[2 + 2 * c] = yf->f[i] * sin(arg);
+		}
+		for (size_t k = 0; k < inferred.size(); k++) {
+			int i = inferred[k];
+			double arg = yf->speed[i] * dt + yf->vu[i];
+			double amp = inferredRatio[k] * yf->f[i];
+			row[1 + 2 * inferredFrom[k]] += amp * cos(arg);
+			row[2 + 2 * inferredFrom[k]] += amp * sin(arg);
+		}
+
+		for (int r = 0; r < n; r++) {
+			atb[r] += row[r] * s.v;
+			for (int q = r; q < n; q++)
+				ata[r * n + q] += row[r] * row[q];
+		}
+	}
+
+	for (int r = 0; r < n; r++) {
+		for (int q = 0; q < r; q++)
+			ata[r * n + q] = ata[q * n + r];
+	}
+
+	if (!Solve(ata, atb, n)) {
+		error = "Singular harmonic fit";
+		return false;
+	}
+
+	harmonics.z0 = atb[0];
+	harmonics.fitted = time(NULL);
+	harmonics.constituents.clear();
+	for (size_t c = 0; c < chosen.size(); c++) {
+		double a = atb[1 + 2 * c];
+		double b = atb[2 + 2 * c];
+		TideConstituent tc;
+		tc.index = chosen[c];
+		tc.amplitude = sqrt(a * a + b * b);
+		tc.phase = fmod(atan2(b, a) / TIDE_DEG2RAD + 360.0, 360.0);
+		harmonics.constituents.push_back(tc);
+	}
+	for (size_t k = 0; k < inferred.size(); k++) {
+		TideConstituent tc = harmonics.constituents[inferredFrom[k]];
+		tc.index = inferred[k];
+		tc.amplitude *= inferredRatio[k];
+		harmonics.constituents.push_back(tc);
+	}
+
+	return true;
+}
+
+TidePredictor::TidePredictor(const TideHarmonics &harmonics)
+	: m_harmonics(harmonics), m_year(0), m_epoch(0), m_yearEnd(0)
+{
+}
+
+void TidePredictor::PrepareYear(int year)
+{
+	const YearFactors &yf = GetYearFactors(year);
+	size_t n = m_harmonics.constituents.size();
+
+	m_year = year;
+	m_epoch = yf.epoch;
+	m_yearEnd = yf.end;
+	m_amp.resize(n);
+	m_speed.resize(n);
+	m_phase.resize(n);
+
+	for (size_t c = 0; c < n; c++) {
+		const TideConstituent &tc = m_harmonics.constituents[c];
+		m_amp[c] = yf.f[tc.index] * tc.amplitude;
+		m_speed[c] = yf.speed[tc.index];
+		m_phase[c] = yf.vu[tc.index] - tc.phase * TIDE_DEG2RAD;
+	}
+}
+
+void TidePredictor::PrepareFor(time_t t)
+{
+	if (m_year == 0 || t < m_epoch || t >= m_yearEnd)
+		PrepareYear(YearOf(t));
+}
+
+double TidePredictor::Height(time_t t)
+{
+	PrepareFor(t);
+	double dt = (double)(t - m_epoch);
+	double h = m_harmonics.z0;
+	for (size_t c = 0; c < m_amp.size(); c++)
+		h += m_amp[c] * cos(m_speed[c] * dt + m_phase[c]);
+	return h;
+}
+
+double TidePredictor::Rate(time_t t)
+{
+	PrepareFor(t);
+	double dt = (double)(t - m_epoch);
+	double r = 0;
+	for (size_t c = 0; c < m_amp.size(); c++)
+		r -= m_amp[c] * m_speed[c] * sin(m_speed[c] * dt + m_phase[c]);
+	return r * 3600.0;
+}
+
+void TidePredictor::Heights(time_t start, int step, size_t n, double *out)
+{
+	const size_t nc = m_harmonics.constituents.size();
+	// Re-seed the recurrence now and then so rounding cannot accumulate
+	const size_t RESEED = 256;
+
+	std::vector<double> c(nc), s(nc), dc(nc), ds(nc);
+
+	size_t k = 0;
+	while (k < n) {
+		time_t t = start + (time_t)k * step;
+		PrepareFor(t);
+
+		// Samples left before the year (and so the factors) change
+		size_t left = (size_t)((m_yearEnd - t + step - 1) / step);
+		size_t seg = std::min(n - k, std::min(left, RESEED));
+
+		double dt = (double)(t - m_epoch);
+		for (size_t i = 0; i < nc; i++) {
+			double a = m_speed[i] * dt + m_phase[i];
+			c[i] = cos(a);
+			s[i] = sin(a);
+			dc[i] = cos(m_speed[i] * step);
+			ds[i] = sin(m_speed[i] * step);
+		}
+
+		const double *amp = m_amp.data();
+		double *pc = c.data();
+		double *ps = s.data();
+		const double *pdc = dc.data();
+		const double *pds = ds.data();
+
+		for (size_t j = 0; j < seg; j++) {
+			double h = m_harmonics.z0;
+			for (size_t i = 0; i < nc; i++)
+				h += amp[i] * pc[i];
+			out[k + j] = h;
+
+			for (size_t i = 0; i < nc; i++) {
+				double cn = pc[i] * pdc[i] - ps[i] * pds[i];
+				ps[i] = ps[i] * pdc[i] + pc[i] * pds[i];
+				pc[i] = cn;
+			}
+		}
+		k += seg;
+	}
+}
+
+bool TideLoadHarmonics(const std::string &filename, std::map<std::string, TideHarmonics> &sets)
+{
+	TiXmlDocument doc;
+	if (!doc.LoadFile(filename.c_str()))
+		return false;
+
+	TiXmlElement *root = doc.RootElement();
+	if (!root || strcmp(root->Value(), "HarmonicDataSet"))
+		return false;
+
+	for (TiXmlElement *e = root->FirstChildElement("Station"); e; e = e->NextSiblingElement("Station")) {
+		TideHarmonics h;
+		const char *id = e->Attribute("Id");
+		if (!id)
+			continue;
+		h.stationId = id;
+		h.name = e->Attribute("Name") ? e->Attribute("Name") : "";
+		h.z0 = 0;
+		e->QueryDoubleAttribute("Z0", &h.z0);
+		h.fitted = 0;
+		if (e->Attribute("Fitted"))
+			TideParseISO(e->Attribute("Fitted"), &h.fitted);
+
+		for (TiXmlElement *c = e->FirstChildElement("Constituent"); c; c = c->NextSiblingElement("Constituent")) {
+			TideConstituent tc;
+			tc.index = TideConstituentIndex(c->Attribute("Name") ? c->Attribute("Name") : "");
+			if (tc.index < 0)
+				continue;
+			tc.amplitude = 0;
+			tc.phase = 0;
+			c->QueryDoubleAttribute("Amplitude", &tc.amplitude);
+			c->QueryDoubleAttribute("Phase", &tc.phase);
+			h.constituents.push_back(tc);
+		}
+		sets[h.stationId] = h;
+	}
+	return true;
+}
+
+bool TideSaveHarmonics(const std::string &filename, const std::map<std::string, TideHarmonics> &sets)
+{
+	TiXmlDocument doc;
+	doc.LinkEndChild(new TiXmlDeclaration("1.0", "utf-8", ""));
+
+	TiXmlElement *root = new TiXmlElement("HarmonicDataSet");
+	doc.LinkEndChild(root);
+
+	char buf[32];
+	for (std::map<std::string, TideHarmonics>::const_iterator it = sets.begin(); it != sets.end(); ++it) {
+		const TideHarmonics &h = it->second;
+		TiXmlElement *st = new TiXmlElement("Station");
+		st->SetAttribute("Id", h.stationId.c_str());
+		st->SetAttribute("Name", h.name.c_str());
+		snprintf(buf, sizeof(buf), "%.4f", h.z0);
+		st->SetAttribute("Z0", buf);
+		st->SetAttribute("Fitted", TideFormatISO(h.fitted).c_str());
+		root->LinkEndChild(st);
+
+		for (size_t c = 0; c < h.constituents.size(); c++) {
+			TiXmlElement *ce = new TiXmlElement("Constituent");
+			ce->SetAttribute("Name", TideConstituentName(h.constituents[c].index));
+			snprintf(buf, sizeof(buf), "%.4f", h.constituents[c].amplitude);
+			ce->SetAttribute("Amplitude", buf);
+			snprintf(buf, sizeof(buf), "%.2f", h.constituents[c].phase);
+			ce->SetAttribute("Phase", buf);
+			st->LinkEndChild(ce);
+		}
+	}
+
+	return doc.SaveFile(filename.c_str());
+}
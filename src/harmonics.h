@@ -0,0 +1,112 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _HARMONICS_H_
+#define _HARMONICS_H_
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tideseries.h"
+
+/*
+ * Offline tide prediction from harmonic constituents.
+ *
+ *   h(t) = Z0 + sum f_i A_i cos(w_i (t - t0) + V0_i + u_i - g_i)
+ *
+ * A and g (amplitude and Greenwich phase lag) belong to the station. The
+ * node factor f, nodal angle u and equilibrium argument V0 depend only on
+ * the year and are computed once per year. IWLS does not publish
+ * constituents, so they are fitted by least squares to a downloaded wlp
+ * series and cached next to the saved ports.
+ */
+
+struct TideConstituent
+{
+	int index;         // into the built-in constituent table
+	double amplitude;  // metres
+	double phase;      // Greenwich phase lag, degrees
+};
+
+struct TideHarmonics
+{
+	std::string stationId;
+	std::string name;
+	double z0;
+	time_t fitted;     // when the fit was made
+	std::vector<TideConstituent> constituents;
+};
+
+typedef std::map<std::string, TideHarmonics> TideHarmonicsMap;
+
+int TideConstituentCount();
+const char *TideConstituentName(int index);
+int TideConstituentIndex(const std::string &name);
+// Angular speed in degrees per hour.
+double TideConstituentSpeed(int index);
+
+// Least-squares fit of the constituents resolvable over the span of
+// samples (Rayleigh criterion). Needs at least about two days of data.
+// Below half a year K2 and P1 are inferred from S2 and K1, and T2 below a
+// year; SA and SSA need a year and are otherwise left out.
+bool TideFitHarmonics(const std::vector<TideSample> &samples, TideHarmonics &harmonics, std::string &error);
+
+class TidePredictor
+{
+public:
+	explicit TidePredictor(const TideHarmonics &harmonics);
+
+	double Height(time_t t);
+	// First derivative in metres per hour.
+	double Rate(time_t t);
+
+	// n heights from start every step seconds. Uses a phasor recurrence
+	// over contiguous arrays rather than a cos() per term per sample.
+	void Heights(time_t start, int step, size_t n, double *out);
+
+private:
+	void PrepareYear(int year);
+	void PrepareFor(time_t t);
+
+	TideHarmonics m_harmonics;
+
+	int m_year;
+	time_t m_epoch;
+	time_t m_yearEnd;
+	// Per constituent for m_year: f*A, speed in rad/s, phase at m_epoch
+	std::vector<double> m_amp;
+	std::vector<double> m_speed;
+	std::vector<double> m_phase;
+};
+
+// Reads or writes a harmonics.xml file, keyed by station id.
+bool TideLoadHarmonics(const std::string &filename, std::map<std::string, TideHarmonics> &sets);
+bool TideSaveHarmonics(const std::string &filename, const std::map<std::string, TideHarmonics> &sets);
+
+#endif
@@ -0,0 +1,197 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidealmanac.h"
+#include "tideextrema.h"
+#include "tidepager.h"
+#include "tidepool.h"
+#include "tidetime.h"
+
+#include <fstream>
+#include <mutex>
+
+#include "json/writer.h"
+
+class AlmanacWriter
+{
+public:
+	AlmanacWriter(std::ofstream &out, TideAlmanacFormat format, const TideAlmanacStation &station, int year)
+		: m_out(out), m_format(format), m_first(true)
+	{
+		if (m_format == TAF_CSV)
+			m_out << "station_id,station_name,time_utc,type,height_m\n";
+		else
+			m_out << "{\"stationId\":" << Json::valueToQuotedString(station.id.c_str())
+				<< ",\"name\":" << Json::valueToQuotedString(station.name.c_str())
+				<< ",\"year\":" << year << ",\"events\":[";
+		m_prefix = m_format == TAF_CSV ? Quote(station.id) + "," + Quote(station.name) + "," : "";
+	}
+
+	void Write(const std::vector<TideExtremum> &extrema)
+	{
+		char height[32];
+		for (size_t i = 0; i < extrema.size(); i++) {
+			const TideExtremum &e = extrema[i];
+			snprintf(height, sizeof(height), "%.3f", e.height);
+			if (m_format == TAF_CSV)
+				m_out << m_prefix << TideFormatISO(e.t) << (e.high ? ",high," : ",low,") << height << "\n";
+			else {
+				m_out << (m_first ? "\n" : ",\n") << "{\"time\":\"" << TideFormatISO(e.t)
+					<< "\",\"type\":\"" << (e.high ? "high" : "low") << "\",\"height\":" << height << "}";
+			}
+			m_first = false;
+		}
+	}
+
+	void Finish()
+	{
+		if (m_format == TAF_JSON)
+			m_out << "\n]}\n";
+	}
+
+private:
+	static std::string Quote(const std::string &s)
+	{
+		if (s.find_first_of(",\"\n") == std::string::npos)
+			return s;
+		std::string q = "\"";
+		for (size_t i = 0; i < s.size(); i++) {
+			if (s[i] == '"')
+				q += '"';
+			q += s[i];
+		}
+		return q + "\"";
+	}
+
+	std::ofstream &m_out;
+	TideAlmanacFormat m_format;
+	std::string m_prefix;
+	bool m_first;
+};
+
+// wlp-hilo does not label its events: a high is above its neighbours.
+static void ClassifyHiLo(const std::vector<TideSample> &samples, std::vector<TideExtremum> &extrema)
+{
+	for (size_t i = 0; i < samples.size(); i++) {
+		TideExtremum e;
+		e.t = samples[i].t;
+		e.height = samples[i].v;
+		if (i > 0)
+			e.high = samples[i].v > samples[i - 1].v;
+		else
+			e.high = samples.size() > 1 && samples[i].v > samples[i + 1].v;
+		extrema.push_back(e);
+	}
+}
+
+static bool WriteStation(const TideAlmanacRequest &request, const TideAlmanacStation &station,
+	std::string &filename, std::string &error)
+{
+	const TideHarmonics *harmonics = NULL;
+	if (request.harmonics) {
+		std::map<std::string, TideHarmonics>::const_iterator it = request.harmonics->find(station.id);
+		if (it != request.harmonics->end())
+			harmonics = &it->second;
+	}
+	if (!harmonics && !request.fetch) {
+		error = station.id + ": no harmonics cached";
+		return false;
+	}
+
+	filename = request.outputDir + "/" + station.id + "-" + std::to_string(request.year)
+		+ (request.format == TAF_CSV ? ".csv" : ".json");
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	if (!out) {
+		error = filename + ": cannot create";
+		return false;
+	}
+
+	AlmanacWriter writer(out, request.format, station, request.year);
+	TideHarmonicCurve *curve = harmonics ? new TideHarmonicCurve(*harmonics) : NULL;
+	std::vector<TideExtremum> extrema;
+	bool ok = true;
+
+	for (int month = 1; month <= 12 && ok; month++) {
+		time_t from = TideMakeTimeUTC(request.year, month, 1, 0, 0, 0);
+		time_t to = month == 12 ? TideMakeTimeUTC(request.year + 1, 1, 1, 0, 0, 0)
+			: TideMakeTimeUTC(request.year, month + 1, 1, 0, 0, 0);
+
+		extrema.clear();
+		if (curve)
+			TideFindExtrema(*curve, from, to, 900, extrema);
+		else {
+			TidePager pager(request.baseUrl, station.id, "wlp-hilo", from, to);
+			Json::Value events;
+			if (!pager.Run(request.fetch, TideChunkProgressFn(), 1) || !pager.Stitch(events, error)) {
+				if (error.empty())
+					error = station.id + ": download failed";
+				ok = false;
+				break;
+			}
+			std::vector<TideSample> samples;
+			TideSamplesFromJson(events, samples);
+			ClassifyHiLo(samples, extrema);
+		}
+		writer.Write(extrema);
+	}
+
+	delete curve;
+	writer.Finish();
+	out.close();
+	if (ok && !out) {
+		error = filename + ": write failed";
+		ok = false;
+	}
+	return ok;
+}
+
+int TideWriteAlmanac(const TideAlmanacRequest &request, TideAlmanacResult &result)
+{
+	std::mutex resultMutex;
+	int written = 0;
+
+	{
+		TideThreadPool pool(request.threads);
+		for (size_t i = 0; i < request.stations.size(); i++) {
+			const TideAlmanacStation &station = request.stations[i];
+			pool.Submit([&request, &station, &result, &resultMutex, &written]() {
+				std::string filename, error;
+				bool ok = WriteStation(request, station, filename, error);
+				std::lock_guard<std::mutex> lock(resultMutex);
+				if (ok) {
+					result.files.push_back(filename);
+					written++;
+				}
+				else
+					result.errors.push_back(error);
+			});
+		}
+		pool.Wait();
+	}
+
+	return written;
+}
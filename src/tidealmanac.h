@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEALMANAC_H_
+#define _TIDEALMANAC_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "harmonics.h"
+#include "tidefetch.h"
+
+/*
+ * Year-long high/low water tables for many stations at once.
+ *
+ * Each station is one task on a work-stealing pool. Events are produced
+ * and written a month at a time, so memory stays bounded whatever the
+ * number of stations. Stations with cached harmonics are computed
+ * locally; the rest are downloaded as wlp-hilo when a fetch is given.
+ */
+
+enum TideAlmanacFormat { TAF_CSV = 0, TAF_JSON };
+
+struct TideAlmanacStation
+{
+	std::string id;
+	std::string name;
+};
+
+struct TideAlmanacRequest
+{
+	TideAlmanacRequest() : year(0), format(TAF_CSV), harmonics(NULL), threads(0) {}
+
+	std::vector<TideAlmanacStation> stations;
+	int year;
+	TideAlmanacFormat format;
+	std::string outputDir;     // one <id>-<year>.csv|json per station
+	const std::map<std::string, TideHarmonics> *harmonics;
+	std::string baseUrl;
+	TideFetchFn fetch;         // empty: skip stations without harmonics
+	int threads;               // 0: one per core
+};
+
+struct TideAlmanacResult
+{
+	std::vector<std::string> files;
+	std::vector<std::string> errors;
+};
+
+// Returns the number of station files written.
+int TideWriteAlmanac(const TideAlmanacRequest &request, TideAlmanacResult &result);
+
+#endif
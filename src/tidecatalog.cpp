@@ -0,0 +1,213 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidecatalog.h"
+#include "tidetime.h"
+#include "tidetrace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json/reader.h"
+#include "tinyxml.h"
+
+std::string TideStationsUrl(const std::string &baseUrl, const std::string &region,
+	const std::string &seriesCode)
+{
+	return baseUrl + "/stations?chs-region-code=" + region + "&time-series-code=" + seriesCode;
+}
+
+bool TideParseStationList(const char *begin, const char *end, TideStationStore &store,
+	unsigned flags, std::string &error)
+{
+	TIDE_TRACE_SCOPE("TideParseStationList");
+	Json::Reader reader;
+	Json::Value value;
+	if (!reader.parse(begin, end, value, false)) {
+		error = reader.getFormattedErrorMessages();
+		return false;
+	}
+	if (!value.isArray()) {
+		error = "station list is not an array";
+		return false;
+	}
+
+	for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+		const Json::Value &s = value[i];
+		store.Add(s["id"].asString(), s["officialName"].asString(),
+			s["latitude"].asDouble(), s["longitude"].asDouble(), flags);
+	}
+	return true;
+}
+
+void TideEventsFromJson(const Json::Value &events, TideStringPool &labels,
+	std::vector<TideStationEvent> &out)
+{
+	TIDE_TRACE_SCOPE("TideEventsFromJson");
+	out.reserve(out.size() + events.size());
+	for (Json::ArrayIndex i = 0; i < events.size(); i++) {
+		const Json::Value &e = events[i];
+		std::string qcFlagCode = e["qcFlagCode"].asString();
+
+		TideStationEvent ev;
+		ev.type = labels.Intern(qcFlagCode);
+		ev.t = 0;
+		ev.height = NAN;
+
+		if (qcFlagCode == "1" || qcFlagCode == "2") {
+			time_t t;
+			if (TideParseISO(e.get("eventDate", "").asString().c_str(), &t))
+				ev.t = t;
+			ev.height = (float)e["value"].asDouble();
+		}
+		out.push_back(ev);
+	}
+}
+
+static double AttributeDouble(TiXmlElement *e, const char *name, double def)
+{
+	const char *attr = e->Attribute(name);
+	if (!attr)
+		return def;
+	char *end;
+	double d = strtod(attr, &end);
+	if (end == attr)
+		return def;
+	return d;
+}
+
+bool TideSaveEventsXml(const std::string &filename, const TideStationStore &saved,
+	const TideEventsXmlFormat &format)
+{
+	TIDE_TRACE_SCOPE("TideSaveEventsXml");
+	TiXmlDocument doc;
+	TiXmlDeclaration* decl = new TiXmlDeclaration("1.0", "utf-8", "");
+	doc.LinkEndChild(decl);
+
+	TiXmlElement * root = new TiXmlElement("TidalEventDataSet");
+	doc.LinkEndChild(root);
+
+	char buf[32];
+	for (size_t i = 0; i < saved.Size(); i++) {
+
+		TiXmlElement *Port = new TiXmlElement("Port");
+		Port->SetAttribute("Name", saved.Name(i));
+		Port->SetAttribute("DownloadDate", format.downloadTime ?
+			format.downloadTime(saved.Downloaded(i)) : TideFormatISO(saved.Downloaded(i)));
+		Port->SetAttribute("Id", saved.Id(i));
+		snprintf(buf, sizeof(buf), "%.5f", saved.Lat(i));
+		Port->SetAttribute("Latitude", buf);
+		snprintf(buf, sizeof(buf), "%.5f", saved.Lon(i));
+		Port->SetAttribute("Longitude", buf);
+
+		root->LinkEndChild(Port);
+
+		const TideStationEvent *events = saved.Events(i);
+		for (size_t k = 0; k < saved.EventCount(i); k++) {
+			const TideStationEvent &ev = events[k];
+			TiXmlElement *t = new TiXmlElement("TidalEvent");
+
+			t->SetAttribute("Event", saved.String(ev.type));
+			if (ev.t) {
+				std::string iso = TideFormatISO((time_t)ev.t);
+				t->SetAttribute("DateTime", format.eventTime ? format.eventTime((time_t)ev.t) : iso);
+				t->SetAttribute("Time", iso);
+			}
+			else
+				t->SetAttribute("DateTime", "n/a");
+			if (ev.height != ev.height)
+				t->SetAttribute("Height", "n/a");
+			else {
+				snprintf(buf, sizeof(buf), "%4.2f", ev.height);
+				t->SetAttribute("Height", buf);
+			}
+
+			Port->LinkEndChild(t);
+		}
+	}
+
+	return doc.SaveFile(filename);
+}
+
+bool TideLoadEventsXml(const std::string &filename, TideStationStore &saved,
+	const TideEventsXmlFormat &format, std::string &error)
+{
+	TIDE_TRACE_SCOPE("TideLoadEventsXml");
+	saved.Clear();
+
+	TiXmlDocument doc;
+	if (!doc.LoadFile(filename)) {
+		error = doc.ErrorDesc();
+		return false;
+	}
+
+	TiXmlElement *root = doc.RootElement();
+	if (!root || strcmp(root->Value(), "TidalEventDataSet")) {
+		error = "Invalid xml file";
+		return false;
+	}
+
+	std::vector<TideStationEvent> events;
+	for (TiXmlElement* e = root->FirstChildElement("Port"); e; e = e->NextSiblingElement("Port")) {
+
+		const char *name = e->Attribute("Name");
+		const char *id = e->Attribute("Id");
+		size_t i = saved.Add(id ? id : "", name ? name : "",
+			AttributeDouble(e, "Latitude", NAN), AttributeDouble(e, "Longitude", NAN));
+
+		time_t downloaded;
+		const char *date = e->Attribute("DownloadDate");
+		if (date && (format.parseDownloadTime ? format.parseDownloadTime(date, &downloaded) :
+			TideParseISO(date, &downloaded)))
+			saved.SetDownloaded(i, downloaded);
+
+		events.clear();
+		for (TiXmlElement* f = e->FirstChildElement("TidalEvent"); f; f = f->NextSiblingElement("TidalEvent")) {
+			TideStationEvent ev;
+			const char *type = f->Attribute("Event");
+			ev.type = saved.Intern(type ? type : "");
+			ev.t = 0;
+			ev.height = (float)AttributeDouble(f, "Height", NAN);
+
+			// Files written before the Time attribute only have the display form
+			time_t t;
+			const char *iso = f->Attribute("Time");
+			const char *display = f->Attribute("DateTime");
+			if (iso && TideParseISO(iso, &t))
+				ev.t = t;
+			else if (display && format.parseEventTime && format.parseEventTime(display, &t))
+				ev.t = t;
+
+			events.push_back(ev);
+		}
+
+		saved.SetEvents(i, events);
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDECATALOG_H_
+#define _TIDECATALOG_H_
+
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "tidestations.h"
+
+/*
+ * IWLS station lists and events, and the tidalevents.xml file the saved
+ * ports live in.
+ */
+
+namespace Json { class Value; }
+
+// IWLS /stations url for a region, limited to stations publishing seriesCode.
+std::string TideStationsUrl(const std::string &baseUrl, const std::string &region,
+	const std::string &seriesCode);
+
+// Adds the stations of an IWLS /stations response to store.
+bool TideParseStationList(const char *begin, const char *end, TideStationStore &store,
+	unsigned flags, std::string &error);
+
+// wlp-hilo events as stitched by TidePager. Events without an accepted
+// quality flag keep their label but have no time or height.
+void TideEventsFromJson(const Json::Value &events, TideStringPool &labels,
+	std::vector<TideStationEvent> &out);
+
+// Display forms of times in tidalevents.xml, which depend on the locale
+// and time zone. Empty functions fall back to ISO 8601 UTC.
+struct TideEventsXmlFormat
+{
+	std::function<std::string(time_t)> eventTime;        // DateTime
+	std::function<std::string(time_t)> downloadTime;     // DownloadDate
+	std::function<bool(const char *, time_t *)> parseEventTime;
+	std::function<bool(const char *, time_t *)> parseDownloadTime;
+};
+
+bool TideSaveEventsXml(const std::string &filename, const TideStationStore &saved,
+	const TideEventsXmlFormat &format);
+// Replaces the contents of saved.
+bool TideLoadEventsXml(const std::string &filename, TideStationStore &saved,
+	const TideEventsXmlFormat &format, std::string &error);
+
+#endif
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidecurrents.h"
+#include "tidegeo.h"
+
+#include <math.h>
+
+void TideResolveCurrents(const TideSeriesStore &store, const TideStationStore &stations,
+	std::vector<TideCurrentSeries> &series)
+{
+	series.resize(stations.Size());
+	std::string id;
+	for (size_t i = 0; i < stations.Size(); i++) {
+		id = stations.Id(i);
+		series[i].speed = store.Find(id, TSK_WCS);
+		series[i].dir = store.Find(id, TSK_WCD);
+	}
+}
+
+void TideBuildCurrentArrows(const std::vector<TideCurrentSeries> &series,
+	const std::vector<uint32_t> &index, const std::vector<float> &px,
+	const std::vector<float> &py, time_t t, double rotation,
+	const TideArrowStyle &style, std::vector<TideCurrentArrow> &arrows)
+{
+	arrows.clear();
+	arrows.reserve(index.size());
+
+	// Barbs sit 25 degrees either side of the shaft
+	const float barbCos = 0.9063f;
+	const float barbSin = 0.4226f;
+
+	for (size_t i = 0; i < index.size(); i++) {
+		const TideSeries *speed = series[index[i]].speed;
+		const TideSeries *dir = series[index[i]].dir;
+		if (!speed || !dir)
+			continue;
+
+		double s, d;
+		if (!speed->Interpolate(t, &s) || !dir->InterpolateAngle(t, &d))
+			continue;
+
+		float len = (float)fabs(s) * style.pixelsPerKnot;
+		if (len < style.minLength)
+			len = style.minLength;
+		if (len > style.maxLength)
+			len = style.maxLength;
+
+		// Bearing is clockwise from north; screen y grows downwards
+		double a = d * TIDE_DEG2RAD + rotation;
+		float ux = (float)sin(a);
+		float uy = (float)-cos(a);
+
+		TideCurrentArrow arrow;
+		arrow.speed = (float)s;
+
+		// Centre the arrow on the station
+		float tx = px[i] - ux * len * 0.5f;
+		float ty = py[i] - uy * len * 0.5f;
+		float hx = px[i] + ux * len * 0.5f;
+		float hy = py[i] + uy * len * 0.5f;
+		float head = len * style.headFraction;
+
+		// Barbs point back along the shaft, rotated either way
+		float bx = -ux * head;
+		float by = -uy * head;
+
+		arrow.x[0] = tx;
+		arrow.y[0] = ty;
+		arrow.x[1] = hx;
+		arrow.y[1] = hy;
+		arrow.x[2] = hx + bx * barbCos - by * barbSin;
+		arrow.y[2] = hy + bx * barbSin + by * barbCos;
+		arrow.x[3] = hx;
+		arrow.y[3] = hy;
+		arrow.x[4] = hx + bx * barbCos + by * barbSin;
+		arrow.y[4] = hy - bx * barbSin + by * barbCos;
+
+		arrows.push_back(arrow);
+	}
+}
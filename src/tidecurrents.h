@@ -0,0 +1,81 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDECURRENTS_H_
+#define _TIDECURRENTS_H_
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "tideseries.h"
+#include "tidestations.h"
+
+/*
+ * Screen geometry for tidal current arrows. All visible stations are done
+ * in one pass over contiguous arrays, so scrubbing the time only costs two
+ * interpolations and a few multiplies per station.
+ */
+
+// Polyline tail, tip, left barb, tip, right barb.
+struct TideCurrentArrow
+{
+	float x[5];
+	float y[5];
+	float speed;
+};
+
+struct TideArrowStyle
+{
+	float pixelsPerKnot;
+	float minLength;
+	float maxLength;
+	float headFraction;
+};
+
+// Speed and direction of one current station, NULL where not loaded.
+struct TideCurrentSeries
+{
+	const TideSeries *speed;
+	const TideSeries *dir;
+};
+
+// One entry per station of stations, by index. The pointers stay valid
+// until store is next changed.
+void TideResolveCurrents(const TideSeriesStore &store, const TideStationStore &stations,
+	std::vector<TideCurrentSeries> &series);
+
+// index, px and py describe the visible current stations, as indices into
+// series already projected to screen pixels. rotation is the viewport
+// rotation in radians. arrows is reused between frames; stations without
+// data at t are skipped.
+void TideBuildCurrentArrows(const std::vector<TideCurrentSeries> &series,
+	const std::vector<uint32_t> &index, const std::vector<float> &px,
+	const std::vector<float> &py, time_t t, double rotation,
+	const TideArrowStyle &style, std::vector<TideCurrentArrow> &arrows);
+
+#endif
@@ -0,0 +1,178 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidedeparture.h"
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct Waypoint
+{
+	time_t offset;             // seconds from departure
+	double course;             // degrees true of the leg being sailed
+	int station;
+	std::vector<double> spare; // height over the minimum, per candidate
+	double tightest;
+	const TideSeries *speed;
+	const TideSeries *direction;
+};
+
+}
+
+void TideFindDepartureWindows(TideRouteEvaluator &route, const TideDepartureRequest &request,
+	std::vector<TideDepartureWindow> &windows, std::vector<int> &missing)
+{
+	windows.clear();
+	missing.clear();
+
+	const std::vector<TideRouteSample> &samples = route.Samples();
+	const std::vector<TideRoutePoint> &points = route.Points();
+	const std::vector<TideRouteStation> &stations = route.Stations();
+	if (request.step <= 0 || request.to < request.from || request.speedKn <= 0 || points.size() < 2)
+		return;
+
+	const size_t n = (size_t)((request.to - request.from) / request.step) + 1;
+	const bool checkHeight = !std::isnan(request.minHeight);
+	const bool checkCurrent = !std::isnan(request.maxFoulKn);
+	if (!checkHeight && !checkCurrent)
+		return;
+
+	std::vector<Waypoint> waypoints;
+	for (size_t i = 0; i < samples.size(); i++) {
+		const TideRouteSample &s = samples[i];
+		if (s.waypoint < 0)
+			continue;
+
+		Waypoint w;
+		w.offset = (time_t)(s.distNm * 3600.0 / request.speedKn + 0.5);
+		size_t from = (size_t)s.waypoint + 1 < points.size() ? s.waypoint : s.waypoint - 1;
+		w.course = TideBearingDeg(points[from].lat, points[from].lon, points[from + 1].lat, points[from + 1].lon);
+		w.station = s.station;
+		w.tightest = HUGE_VAL;
+		w.speed = w.direction = NULL;
+		if (checkCurrent && request.currents && (size_t)s.waypoint < request.currentStations.size()
+			&& !request.currentStations[s.waypoint].empty()) {
+			w.speed = request.currents->Find(request.currentStations[s.waypoint], TSK_WCS);
+			w.direction = request.currents->Find(request.currentStations[s.waypoint], TSK_WCD);
+		}
+		if (checkHeight && s.station >= 0)
+			w.spare.resize(n);
+
+		// A limit that cannot be checked is not met
+		if ((checkHeight && w.spare.empty()) || (checkCurrent && (!w.speed || !w.direction)))
+			missing.push_back(s.waypoint);
+		waypoints.push_back(w);
+	}
+	if (!missing.empty())
+		return;
+
+	// One recurrence per waypoint covers every candidate departure
+	for (size_t i = 0; i < waypoints.size(); i++) {
+		Waypoint *w = &waypoints[i];
+		if (w->spare.empty())
+			continue;
+
+		route.Pool().Submit([w, &stations, &request, n]() {
+			TidePredictor predictor(stations[w->station].harmonics);
+			predictor.Heights(request.from + w->offset, request.step, n, w->spare.data());
+			for (size_t j = 0; j < n; j++) {
+				w->spare[j] -= request.minHeight;
+				w->tightest = std::min(w->tightest, w->spare[j]);
+			}
+		});
+	}
+	route.Pool().Wait();
+
+	// Checking the tightest waypoints first rejects most candidates early
+	std::vector<Waypoint *> order;
+	for (size_t i = 0; i < waypoints.size(); i++)
+		order.push_back(&waypoints[i]);
+	std::stable_sort(order.begin(), order.end(), [](const Waypoint *a, const Waypoint *b) {
+		return a->tightest < b->tightest;
+	});
+
+	std::vector<double> margin(n, NAN);
+	std::vector<char> ok(n, 0);
+	const size_t chunk = 64;
+	for (size_t begin = 0; begin < n; begin += chunk) {
+		size_t end = std::min(n, begin + chunk);
+		route.Pool().Submit([&order, &request, &margin, &ok, begin, end]() {
+			for (size_t j = begin; j < end; j++) {
+				time_t departure = request.from + (time_t)j * request.step;
+				double spare = HUGE_VAL;
+				bool good = true;
+				for (size_t w = 0; w < order.size() && good; w++) {
+					const Waypoint &wp = *order[w];
+					if (!wp.spare.empty()) {
+						spare = std::min(spare, wp.spare[j]);
+						good = wp.spare[j] >= 0;
+					}
+					// An ETA past the end of the current series fails
+					double kn, dir;
+					if (good && wp.speed)
+						good = wp.speed->Interpolate(departure + wp.offset, &kn)
+							&& wp.direction->InterpolateAngle(departure + wp.offset, &dir)
+							&& -kn * cos((dir - wp.course) * TIDE_DEG2RAD) <= request.maxFoulKn;
+				}
+				ok[j] = good;
+				margin[j] = spare == HUGE_VAL ? NAN : spare;
+			}
+		});
+	}
+	route.Pool().Wait();
+
+	for (size_t j = 0; j < n;) {
+		if (!ok[j]) {
+			j++;
+			continue;
+		}
+		TideDepartureWindow window;
+		window.begin = request.from + (time_t)j * request.step;
+		window.best = window.begin;
+		window.margin = margin[j];
+		for (; j < n && ok[j]; j++) {
+			window.end = request.from + (time_t)j * request.step;
+			if (margin[j] > window.margin) {
+				window.margin = margin[j];
+				window.best = window.end;
+			}
+		}
+		windows.push_back(window);
+	}
+
+	std::stable_sort(windows.begin(), windows.end(), [](const TideDepartureWindow &a, const TideDepartureWindow &b) {
+		bool am = !std::isnan(a.margin), bm = !std::isnan(b.margin);
+		if (am != bm)
+			return am;
+		if (am && a.margin != b.margin)
+			return a.margin > b.margin;
+		return a.end - a.begin > b.end - b.begin;
+	});
+}
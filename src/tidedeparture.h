@@ -0,0 +1,81 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEDEPARTURE_H_
+#define _TIDEDEPARTURE_H_
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "tideroute.h"
+#include "tideseries.h"
+
+/*
+ * "When should I leave?" Departures are tried every step seconds across
+ * a window. As every ETA is the departure plus a fixed offset, the
+ * heights each waypoint sees over all departures form one regular series,
+ * computed in a single pass per waypoint. Candidates are then checked in
+ * parallel, waypoint by waypoint, tightest first, stopping at the first
+ * one that fails.
+ */
+
+struct TideDepartureRequest
+{
+	time_t from;
+	time_t to;
+	int step;                  // seconds between candidate departures
+	double speedKn;
+
+	double minHeight;          // tide needed at every waypoint, NaN to ignore
+	double maxFoulKn;          // current allowed against the course, NaN to ignore
+
+	// Current speed and direction series, and for each waypoint of the
+	// route the station to read them from (empty for none)
+	const TideSeriesStore *currents;
+	std::vector<std::string> currentStations;
+};
+
+struct TideDepartureWindow
+{
+	time_t begin;              // first and last good departure
+	time_t end;
+	time_t best;               // departure with the most spare height
+	double margin;             // spare height at best, metres, NaN if unknown
+};
+
+// Contiguous runs of departures meeting every constraint, best first: the
+// largest margin, then the longest window. Uses the route's thread pool.
+// Missing data fails rather than passes. Waypoints (route point indices)
+// without a tide station for minHeight, or without current series for
+// maxFoulKn, are listed in missing and then no window is found. An ETA
+// outside a current series fails that departure. With neither limit set
+// there is nothing to check and no window either.
+void TideFindDepartureWindows(TideRouteEvaluator &route, const TideDepartureRequest &request,
+	std::vector<TideDepartureWindow> &windows, std::vector<int> &missing);
+
+#endif
@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideexpiry.h"
+
+#include <chrono>
+
+TideExpiryTrimmer::TideExpiryTrimmer(TideStationModel &model, time_t keepSecs)
+	: m_model(model), m_keep(keepSecs),
+	m_running(false), m_stop(false), m_wake(false), m_generation(0)
+{
+}
+
+TideExpiryTrimmer::~TideExpiryTrimmer()
+{
+	Stop();
+}
+
+void TideExpiryTrimmer::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running)
+		return;
+	m_stop = false;
+	m_running = true;
+	m_thread = std::thread(&TideExpiryTrimmer::Run, this);
+}
+
+void TideExpiryTrimmer::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+			return;
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+	m_running = false;
+}
+
+// The first second at which the oldest event is older than keep, as
+// TrimDue keeps events up to exactly keep old. Events with no time are
+// stale straight away, as is a station without events.
+time_t TideExpiryTrimmer::DueTime(const TideStationStore &store, size_t i) const
+{
+	size_t count = store.EventCount(i);
+	if (!count)
+		return 1;
+
+	const TideStationEvent *events = store.Events(i);
+	int64_t oldest = events[0].t;
+	for (size_t k = 1; k < count; k++)
+		if (events[k].t < oldest)
+			oldest = events[k].t;
+	return oldest ? (time_t)oldest + m_keep + 1 : 1;
+}
+
+void TideExpiryTrimmer::Push(const std::string &id, time_t due)
+{
+	Entry e;
+	e.due = due;
+	e.id = id;
+	m_heap.push(e);
+	m_due[id] = due;
+}
+
+void TideExpiryTrimmer::Rebuild()
+{
+	TideStationSnapshot store = m_model.Get();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_heap = std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> >();
+		m_due.clear();
+		for (size_t i = 0; i < store->Size(); i++)
+			Push(store->Id(i), DueTime(*store, i));
+		m_wake = true;
+	}
+	m_cv.notify_one();
+}
+
+void TideExpiryTrimmer::Schedule(const std::string &stationId)
+{
+	TideStationSnapshot store = m_model.Get();
+	int i = store->Find(stationId);
+	if (i < 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Push(stationId, DueTime(*store, i));
+		m_wake = true;
+	}
+	m_cv.notify_one();
+}
+
+time_t TideExpiryTrimmer::NextDue() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_heap.empty() ? 0 : m_heap.top().due;
+}
+
+unsigned TideExpiryTrimmer::Generation() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_generation;
+}
+
+size_t TideExpiryTrimmer::TrimDue(time_t now)
+{
+	std::vector<std::string> ids;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		while (!m_heap.empty() && m_heap.top().due <= now) {
+			Entry e = m_heap.top();
+			m_heap.pop();
+			std::map<std::string, time_t>::iterator it = m_due.find(e.id);
+			if (it != m_due.end() && it->second == e.due) {
+				m_due.erase(it);
+				ids.push_back(e.id);
+			}
+		}
+	}
+	if (ids.empty())
+		return 0;
+
+	time_t cutoff = now - m_keep;
+	size_t changed = 0;
+	std::vector<std::pair<std::string, time_t> > next;
+
+	m_model.Update([&](TideStationStore &store) {
+		std::vector<TideStationEvent> kept;
+		for (size_t k = 0; k < ids.size(); k++) {
+			int i = store.Find(ids[k]);
+			if (i < 0)
+				continue;
+
+			size_t count = store.EventCount(i);
+			const TideStationEvent *events = count ? store.Events(i) : NULL;
+			kept.clear();
+			for (size_t e = 0; e < count; e++)
+				if (events[e].t && events[e].t >= cutoff)
+					kept.push_back(events[e]);
+
+			if (kept.empty()) {
+				store.Remove(i);
+				changed++;
+				continue;
+			}
+			if (kept.size() != count) {
+				store.SetEvents(i, kept);
+				changed++;
+			}
+			next.push_back(std::make_pair(ids[k], DueTime(store, i)));
+		}
+	});
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (size_t k = 0; k < next.size(); k++)
+			if (m_due.find(next[k].first) == m_due.end())
+				Push(next[k].first, next[k].second);
+		if (changed)
+			m_generation++;
+	}
+	return changed;
+}
+
+void TideExpiryTrimmer::Run()
+{
+	for (;;) {
+		TrimDue(time(NULL));
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_stop)
+			return;
+		if (m_heap.empty())
+			m_cv.wait(lock, [this]() { return m_stop || m_wake; });
+		else
+			m_cv.wait_until(lock, std::chrono::system_clock::from_time_t(m_heap.top().due),
+				[this]() { return m_stop || m_wake; });
+		if (m_stop)
+			return;
+		m_wake = false;
+	}
+}
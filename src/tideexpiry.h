@@ -0,0 +1,106 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEEXPIRY_H_
+#define _TIDEEXPIRY_H_
+
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tidestations.h"
+
+/*
+ * Background expiry of saved tidal events.
+ *
+ * Every station sits in a min-heap keyed by the time its oldest event
+ * goes stale, so the next piece of work is always at the top. When that
+ * time comes only the past events of that station are dropped; a station
+ * is removed once its coverage has ended and nothing is left. Changes are
+ * published through the TideStationModel like any other edit.
+ */
+
+class TideExpiryTrimmer
+{
+public:
+	// Events are kept for keepSecs after their time.
+	TideExpiryTrimmer(TideStationModel &model, time_t keepSecs = 86400);
+	~TideExpiryTrimmer();
+
+	void Start();
+	void Stop();
+
+	// Re-reads every station, e.g. after the store was reloaded.
+	void Rebuild();
+	// The events of stationId were replaced.
+	void Schedule(const std::string &stationId);
+
+	// Earliest time anything expires, or 0 when nothing is held.
+	time_t NextDue() const;
+	// Trims everything due by now on the calling thread and returns the
+	// number of stations changed.
+	size_t TrimDue(time_t now);
+
+	// Incremented whenever a trim changed the store.
+	unsigned Generation() const;
+
+private:
+	struct Entry
+	{
+		time_t due;
+		std::string id;
+		bool operator>(const Entry &o) const { return due > o.due; }
+	};
+
+	void Push(const std::string &id, time_t due);
+	time_t DueTime(const TideStationStore &store, size_t i) const;
+	void Run();
+
+	TideStationModel &m_model;
+	time_t m_keep;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+	bool m_stop;
+	bool m_wake;
+	unsigned m_generation;
+
+	// Entries replaced by a later Push stay in the heap and are skipped
+	// when their due time no longer matches m_due
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > m_heap;
+	std::map<std::string, time_t> m_due;
+};
+
+#endif
@@ -0,0 +1,233 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideextrema.h"
+
+#include <algorithm>
+#include <atomic>
+#include <math.h>
+#include <thread>
+
+bool TideSeriesCurve::Segment(time_t t, size_t *k) const
+{
+	const std::vector<TideSample> &s = m_series.Samples();
+	if (s.size() < 2 || t < s.front().t || t > s.back().t)
+		return false;
+
+	std::vector<TideSample>::const_iterator it = std::upper_bound(s.begin(), s.end(), t,
+		[](time_t v, const TideSample &x) { return v < x.t; });
+	size_t i = it - s.begin();
+	*k = i == 0 ? 0 : std::min(i - 1, s.size() - 2);
+	return true;
+}
+
+// Tangent at sample k in metres per second, from its neighbours.
+double TideSeriesCurve::Slope(size_t k) const
+{
+	const std::vector<TideSample> &s = m_series.Samples();
+	size_t a = k == 0 ? 0 : k - 1;
+	size_t b = k + 1 < s.size() ? k + 1 : k;
+	return (s[b].v - s[a].v) / (double)(s[b].t - s[a].t);
+}
+
+double TideSeriesCurve::Height(time_t t)
+{
+	size_t k;
+	if (!Segment(t, &k))
+		return NAN;
+
+	const std::vector<TideSample> &s = m_series.Samples();
+	double dt = (double)(s[k + 1].t - s[k].t);
+	double u = (t - s[k].t) / dt;
+	double u2 = u * u, u3 = u2 * u;
+
+	return (2 * u3 - 3 * u2 + 1) * s[k].v + (u3 - 2 * u2 + u) * dt * Slope(k)
+		+ (-2 * u3 + 3 * u2) * s[k + 1].v + (u3 - u2) * dt * Slope(k + 1);
+}
+
+double TideSeriesCurve::Rate(time_t t)
+{
+	size_t k;
+	if (!Segment(t, &k))
+		return 0;
+
+	const std::vector<TideSample> &s = m_series.Samples();
+	double dt = (double)(s[k + 1].t - s[k].t);
+	double u = (t - s[k].t) / dt;
+	double u2 = u * u;
+
+	double dh = (6 * u2 - 6 * u) * s[k].v + (3 * u2 - 4 * u + 1) * dt * Slope(k)
+		+ (-6 * u2 + 6 * u) * s[k + 1].v + (3 * u2 - 2 * u) * dt * Slope(k + 1);
+	return dh / dt * 3600.0;
+}
+
+static time_t Refine(TideCurve &curve, time_t a, double ra, time_t b, double rb)
+{
+	double lo = (double)a, hi = (double)b;
+	double rlo = ra;
+
+	// Start from where the rate would cross zero if it were linear
+	double t = lo + (hi - lo) * ra / (ra - rb);
+
+	for (int iter = 0; iter < 20 && hi - lo > 1.0; iter++) {
+		double r = curve.Rate((time_t)floor(t + 0.5));
+		if (r == 0)
+			break;
+		if ((r > 0) == (rlo > 0)) {
+			lo = t;
+			rlo = r;
+		}
+		else
+			hi = t;
+
+		double d = (curve.Rate((time_t)(t + 30)) - curve.Rate((time_t)(t - 30))) / 60.0;
+		double next = d != 0 ? t - r / d : 0.5 * (lo + hi);
+		if (!(next > lo && next < hi))
+			next = 0.5 * (lo + hi);
+
+		bool done = fabs(next - t) < 1.0;
+		t = next;
+		if (done)
+			break;
+	}
+	return (time_t)floor(t + 0.5);
+}
+
+void TideFindExtrema(TideCurve &curve, time_t from, time_t to, int scanStep,
+	std::vector<TideExtremum> &extrema)
+{
+	if (scanStep <= 0 || to <= from)
+		return;
+
+	time_t a = from;
+	double ra = curve.Rate(a);
+
+	while (a < to) {
+		time_t b = a + scanStep;
+		double rb = curve.Rate(b);
+
+		if ((ra > 0 && rb <= 0) || (ra < 0 && rb >= 0)) {
+			TideExtremum e;
+			e.t = rb == 0 ? b : Refine(curve, a, ra, b, rb);
+			e.height = curve.Height(e.t);
+			e.high = ra > 0;
+			// A zero at b is picked up here, not again from the next bracket
+			if (rb == 0)
+				rb = ra > 0 ? -1e-12 : 1e-12;
+			if (!isnan(e.height))
+				extrema.push_back(e);
+		}
+
+		a = b;
+		ra = rb;
+	}
+}
+
+void TideSavedExtrema(const TideStationStore &saved, size_t i, time_t from, time_t to,
+	std::vector<TideExtremum> &extrema)
+{
+	const TideStationEvent *ev = saved.Events(i);
+	size_t n = saved.EventCount(i);
+	for (size_t k = 0; k < n; k++) {
+		if (ev[k].t < from || ev[k].t > to || ev[k].height != ev[k].height)
+			continue;
+		const TideStationEvent &other = k + 1 < n ? ev[k + 1] : ev[k > 0 ? k - 1 : k];
+		TideExtremum e;
+		e.t = (time_t)ev[k].t;
+		e.height = ev[k].height;
+		e.high = ev[k].height > other.height;
+		extrema.push_back(e);
+	}
+}
+
+size_t TideSolveExtrema(std::vector<TideExtremaJob> &jobs, int maxThreads,
+	time_t chunkSecs, int scanStep)
+{
+	struct Unit
+	{
+		size_t job;
+		time_t from;
+		time_t to;
+		std::vector<TideExtremum> extrema;
+	};
+
+	// Chunks start on the scan grid so every bracket belongs to exactly one
+	std::vector<Unit> units;
+	time_t chunk = chunkSecs - chunkSecs % scanStep;
+	if (chunk <= 0)
+		chunk = scanStep;
+	for (size_t j = 0; j < jobs.size(); j++) {
+		jobs[j].extrema.clear();
+		for (time_t t = jobs[j].from; t < jobs[j].to; t += chunk) {
+			Unit u;
+			u.job = j;
+			u.from = t;
+			u.to = std::min(t + chunk, jobs[j].to);
+			units.push_back(u);
+		}
+	}
+	if (units.empty())
+		return 0;
+
+	std::atomic<size_t> next(0);
+
+	auto worker = [&]() {
+		for (;;) {
+			size_t n = next.fetch_add(1);
+			if (n >= units.size())
+				break;
+
+			Unit &u = units[n];
+			TideCurve *curve = jobs[u.job].curve->Clone();
+			TideFindExtrema(*curve, u.from, u.to, scanStep, u.extrema);
+			delete curve;
+		}
+	};
+
+	int nthreads = maxThreads > 0 ? maxThreads : (int)std::thread::hardware_concurrency();
+	if (nthreads > (int)units.size())
+		nthreads = (int)units.size();
+
+	if (nthreads <= 1)
+		worker();
+	else {
+		std::vector<std::thread> threads;
+		for (int i = 0; i < nthreads; i++)
+			threads.push_back(std::thread(worker));
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	// Units are in job then time order, so appending keeps each job sorted
+	size_t found = 0;
+	for (size_t n = 0; n < units.size(); n++) {
+		std::vector<TideExtremum> &dst = jobs[units[n].job].extrema;
+		dst.insert(dst.end(), units[n].extrema.begin(), units[n].extrema.end());
+		found += units[n].extrema.size();
+	}
+	return found;
+}
@@ -0,0 +1,122 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEEXTREMA_H_
+#define _TIDEEXTREMA_H_
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "harmonics.h"
+#include "tideseries.h"
+#include "tidestations.h"
+
+/*
+ * High and low waters from any continuous height source.
+ *
+ * The rate of rise is sampled on a coarse grid; each sign change brackets
+ * one extremum, which is then refined by Newton iteration on the rate,
+ * falling back to bisection whenever a step leaves the bracket.
+ */
+
+struct TideExtremum
+{
+	time_t t;
+	double height;
+	bool high;
+};
+
+class TideCurve
+{
+public:
+	virtual ~TideCurve() {}
+	// Height in metres and rate of rise in metres per hour.
+	virtual double Height(time_t t) = 0;
+	virtual double Rate(time_t t) = 0;
+	// Curves may cache state, so each worker thread gets its own copy.
+	virtual TideCurve *Clone() const = 0;
+};
+
+class TideHarmonicCurve : public TideCurve
+{
+public:
+	explicit TideHarmonicCurve(const TideHarmonics &harmonics)
+		: m_harmonics(harmonics), m_predictor(harmonics) {}
+
+	double Height(time_t t) { return m_predictor.Height(t); }
+	double Rate(time_t t) { return m_predictor.Rate(t); }
+	TideCurve *Clone() const { return new TideHarmonicCurve(m_harmonics); }
+
+private:
+	TideHarmonics m_harmonics;
+	TidePredictor m_predictor;
+};
+
+// Cubic Hermite interpolation through a sampled series such as a cached
+// wlp download. The series must outlive the curve and any clones.
+class TideSeriesCurve : public TideCurve
+{
+public:
+	explicit TideSeriesCurve(const TideSeries &series) : m_series(series) {}
+
+	double Height(time_t t);
+	double Rate(time_t t);
+	TideCurve *Clone() const { return new TideSeriesCurve(m_series); }
+
+private:
+	bool Segment(time_t t, size_t *k) const;
+	double Slope(size_t k) const;
+
+	const TideSeries &m_series;
+};
+
+// Extrema of curve with the bracketing sign change in [from, to).
+void TideFindExtrema(TideCurve &curve, time_t from, time_t to, int scanStep,
+	std::vector<TideExtremum> &extrema);
+
+// Highs and lows among the saved IWLS events of station i, from <= t <= to.
+// The events carry no type, but they alternate, so a neighbour tells a
+// high from a low.
+void TideSavedExtrema(const TideStationStore &saved, size_t i, time_t from, time_t to,
+	std::vector<TideExtremum> &extrema);
+
+struct TideExtremaJob
+{
+	std::string stationId;
+	const TideCurve *curve;   // cloned per chunk, not owned
+	time_t from;
+	time_t to;
+	std::vector<TideExtremum> extrema;   // result, in time order
+};
+
+// Solves every job, split into chunks of chunkSecs spread over up to
+// maxThreads threads (0 for one per core). Returns the extrema found.
+size_t TideSolveExtrema(std::vector<TideExtremaJob> &jobs, int maxThreads,
+	time_t chunkSecs = 7 * 86400, int scanStep = 900);
+
+#endif
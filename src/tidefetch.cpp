@@ -0,0 +1,224 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidefetch.h"
+#include "tidetrace.h"
+
+#include <mutex>
+
+#ifdef CANADIANTIDES_USE_CURL
+#include <curl/curl.h>
+#endif
+
+#ifdef CANADIANTIDES_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef CANADIANTIDES_USE_CURL
+
+static std::once_flag s_curlInit;
+
+struct WriteTarget
+{
+	CURL *curl;
+	std::string *body;
+	bool sized;
+};
+
+static size_t WriteToString(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	WriteTarget *target = static_cast<WriteTarget *>(userdata);
+	size_t n = size * nmemb;
+
+	if (!target->sized) {
+		// Reserve once from Content-Length so the body is not regrown per chunk
+		target->sized = true;
+#if LIBCURL_VERSION_NUM >= 0x073700
+		curl_off_t len = -1;
+		if (curl_easy_getinfo(target->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len) == CURLE_OK && len > 0)
+			target->body->reserve((size_t)len);
+#endif
+	}
+
+	target->body->append(ptr, n);
+	return n;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+// libcurl calls this about once a second even while the transfer stalls
+static int CheckAbort(void *userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+	const std::atomic<bool> *abort = static_cast<const std::atomic<bool> *>(userdata);
+	return *abort ? 1 : 0;
+}
+#endif
+
+#endif
+
+bool TideFetchAvailable()
+{
+#ifdef CANADIANTIDES_USE_CURL
+	return true;
+#else
+	return false;
+#endif
+}
+
+TideFetchResult TideFetchUrl(const std::string &url, int timeout_secs, bool acceptGzip,
+	const std::atomic<bool> *abort)
+{
+	TIDE_TRACE_SCOPE("TideFetchUrl");
+	TideFetchResult res;
+	res.status = TF_UNSUPPORTED;
+	res.httpCode = 0;
+
+#ifdef CANADIANTIDES_USE_CURL
+	if (abort && *abort) {
+		res.status = TF_FAILED;
+		res.error = "Aborted";
+		return res;
+	}
+
+	std::call_once(s_curlInit, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+	CURL *curl = curl_easy_init();
+	if (!curl) {
+		res.status = TF_FAILED;
+		res.error = "curl_easy_init failed";
+		return res;
+	}
+
+	char errbuf[CURL_ERROR_SIZE];
+	errbuf[0] = 0;
+
+	WriteTarget target;
+	target.curl = curl;
+	target.body = &res.body;
+	target.sized = false;
+
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteToString);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &target);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)timeout_secs);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)timeout_secs * 3);
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "CanadianTides_pi");
+	if (acceptGzip)
+		curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
+#if LIBCURL_VERSION_NUM >= 0x072000
+	if (abort) {
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CheckAbort);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, abort);
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	}
+#endif
+
+	CURLcode rc = curl_easy_perform(curl);
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res.httpCode);
+	curl_easy_cleanup(curl);
+
+	if (rc != CURLE_OK) {
+		res.status = TF_FAILED;
+		res.error = errbuf[0] ? errbuf : curl_easy_strerror(rc);
+		res.body.clear();
+		return res;
+	}
+
+	if (res.httpCode >= 400) {
+		res.status = TF_HTTP_ERROR;
+		res.error = "HTTP " + std::to_string(res.httpCode);
+		return res;
+	}
+
+	if (!TideGunzip(res.body)) {
+		res.status = TF_FAILED;
+		res.error = "Unable to decode gzip body";
+		return res;
+	}
+
+	res.status = TF_OK;
+#else
+	(void)url;
+	(void)timeout_secs;
+	(void)acceptGzip;
+	(void)abort;
+	res.error = "Built without in-memory download support";
+#endif
+	return res;
+}
+
+TideFetchFn TideUrlFetcher(int timeout_secs, const std::atomic<bool> *abort)
+{
+	return [timeout_secs, abort](const std::string &url, std::string &body, std::string &error) {
+		TideFetchResult res = TideFetchUrl(url, timeout_secs, true, abort);
+		body.swap(res.body);
+		error.swap(res.error);
+		return res.status == TF_OK;
+	};
+}
+
+bool TideGunzip(std::string &body)
+{
+	if (body.size() < 2 || (unsigned char)body[0] != 0x1f || (unsigned char)body[1] != 0x8b)
+		return true;
+
+#ifdef CANADIANTIDES_USE_ZLIB
+	z_stream zs;
+	zs.zalloc = Z_NULL;
+	zs.zfree = Z_NULL;
+	zs.opaque = Z_NULL;
+	zs.next_in = (Bytef *)body.data();
+	zs.avail_in = (uInt)body.size();
+
+	// 16 + MAX_WBITS: expect a gzip header rather than raw zlib
+	if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+		return false;
+
+	std::string out;
+	out.reserve(body.size() * 4);
+	char buf[16384];
+	int rc;
+	do {
+		zs.next_out = (Bytef *)buf;
+		zs.avail_out = sizeof(buf);
+		rc = inflate(&zs, Z_NO_FLUSH);
+		if (rc != Z_OK && rc != Z_STREAM_END) {
+			inflateEnd(&zs);
+			return false;
+		}
+		out.append(buf, sizeof(buf) - zs.avail_out);
+	} while (rc != Z_STREAM_END);
+
+	inflateEnd(&zs);
+	body.swap(out);
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEFETCH_H_
+#define _TIDEFETCH_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+/*
+ * In-memory HTTP(S) fetch of IWLS responses.
+ *
+ * The response body is written straight into the caller's buffer, so
+ * nothing touches the disk. Gzip content encoding is requested and decoded
+ * transparently when the library was built with it.
+ */
+
+#define IWLS_API_BASE_URL "https://api-iwls.dfo-mpo.gc.ca/api/v1"
+
+enum TideFetchStatus {
+	TF_OK = 0,
+	TF_FAILED,       // transport error: DNS, connect, timeout...
+	TF_HTTP_ERROR,   // server answered with a status >= 400
+	TF_UNSUPPORTED   // built without an in-memory transport
+};
+
+struct TideFetchResult
+{
+	TideFetchStatus status;
+	long httpCode;
+	std::string body;
+	std::string error;
+};
+
+// Fetches url into body, for code that needs to swap the transport.
+typedef std::function<bool(const std::string &url, std::string &body, std::string &error)> TideFetchFn;
+
+// True when TideFetchUrl() has a working transport in this build.
+bool TideFetchAvailable();
+
+// Setting *abort from another thread ends the transfer within about a
+// second, as TF_FAILED.
+TideFetchResult TideFetchUrl(const std::string &url, int timeout_secs,
+	bool acceptGzip = true, const std::atomic<bool> *abort = NULL);
+
+// TideFetchUrl() wrapped as a TideFetchFn.
+TideFetchFn TideUrlFetcher(int timeout_secs, const std::atomic<bool> *abort = NULL);
+
+// Inflate body in place when it starts with the gzip magic bytes.
+// Returns false only if the body is gzip and could not be decoded.
+bool TideGunzip(std::string &body);
+
+#endif
@@ -0,0 +1,213 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidefield.h"
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double NM_PER_DEG = 60.0;
+
+// Nearest stations kept per cell
+static const size_t MAX_CONTRIBUTORS = 8;
+
+void TideStationGrid::Build(const std::vector<double> &lat, const std::vector<double> &lon, double radiusNm)
+{
+	m_lat = &lat;
+	m_lon = &lon;
+	m_radius = radiusNm;
+	m_cell = std::max(radiusNm / NM_PER_DEG, 1e-3);
+
+	double maxLat = 0;
+	for (size_t i = 0; i < lat.size(); i++)
+		maxLat = std::max(maxLat, fabs(lat[i]));
+	m_lonCell = m_cell / std::max(cos(std::min(maxLat + m_cell, 89.0) * TIDE_DEG2RAD), 0.01);
+
+	m_buckets.clear();
+	for (size_t i = 0; i < lat.size(); i++)
+		m_buckets[Key((long)floor(lon[i] / m_lonCell), (long)floor(lat[i] / m_cell))].push_back((uint32_t)i);
+}
+
+void TideStationGrid::Query(double lat, double lon, std::vector<uint32_t> &out) const
+{
+	out.clear();
+	if (m_buckets.empty())
+		return;
+
+	const double coslat = cos(lat * TIDE_DEG2RAD);
+	long ix = (long)floor(lon / m_lonCell);
+	long iy = (long)floor(lat / m_cell);
+	for (long y = iy - 1; y <= iy + 1; y++) {
+		for (long x = ix - 1; x <= ix + 1; x++) {
+			std::unordered_map<uint64_t, std::vector<uint32_t> >::const_iterator it = m_buckets.find(Key(x, y));
+			if (it == m_buckets.end())
+				continue;
+			for (size_t k = 0; k < it->second.size(); k++) {
+				uint32_t i = it->second[k];
+				double dy = ((*m_lat)[i] - lat) * NM_PER_DEG;
+				double dx = ((*m_lon)[i] - lon) * NM_PER_DEG * coslat;
+				if (dx * dx + dy * dy <= m_radius * m_radius)
+					out.push_back(i);
+			}
+		}
+	}
+}
+
+TideHeightField::TideHeightField()
+	: m_stamp(1), m_radius(30), m_cellLat(0), m_cellLon(0), m_recomputed(0)
+{
+}
+
+void TideHeightField::SetStations(const std::vector<double> &lat, const std::vector<double> &lon, double radiusNm)
+{
+	m_lat = lat;
+	m_lon = lon;
+	m_radius = radiusNm;
+	m_heights.assign(lat.size(), NAN);
+	m_changed.assign(lat.size(), ++m_stamp);
+	m_grid.Build(m_lat, m_lon, radiusNm);
+	m_cells.clear();
+}
+
+void TideHeightField::SetHeights(const std::vector<double> &heights, double tolerance)
+{
+	bool any = false;
+	for (size_t i = 0; i < heights.size() && i < m_heights.size(); i++) {
+		double h = heights[i], old = m_heights[i];
+		if (std::isnan(h) == std::isnan(old) && (std::isnan(h) || fabs(h - old) < tolerance))
+			continue;
+		if (!any) {
+			m_stamp++;
+			any = true;
+		}
+		m_heights[i] = h;
+		m_changed[i] = m_stamp;
+	}
+}
+
+void TideHeightField::SetCellSize(double deg, double refLat)
+{
+	double lonDeg = deg / std::max(cos(refLat * TIDE_DEG2RAD), 0.01);
+	if (deg == m_cellLat && lonDeg == m_cellLon)
+		return;
+	m_cellLat = deg;
+	m_cellLon = lonDeg;
+	m_cells.clear();
+}
+
+void TideHeightField::Prepare(Cell &cell, double lat, double lon)
+{
+	std::vector<uint32_t> near;
+	m_grid.Query(lat, lon, near);
+
+	const double coslat = cos(lat * TIDE_DEG2RAD);
+	std::vector<std::pair<double, uint32_t> > byDist(near.size());
+	for (size_t k = 0; k < near.size(); k++) {
+		double dy = (m_lat[near[k]] - lat) * NM_PER_DEG;
+		double dx = (m_lon[near[k]] - lon) * NM_PER_DEG * coslat;
+		byDist[k] = std::make_pair(dx * dx + dy * dy, near[k]);
+	}
+	if (byDist.size() > MAX_CONTRIBUTORS) {
+		std::partial_sort(byDist.begin(), byDist.begin() + MAX_CONTRIBUTORS, byDist.end());
+		byDist.resize(MAX_CONTRIBUTORS);
+	}
+
+	// 1/d^2 weights, tapered to zero at the radius so cells do not jump as
+	// stations enter or leave reach
+	const double r2 = m_radius * m_radius;
+	cell.stations.clear();
+	cell.weights.clear();
+	for (size_t k = 0; k < byDist.size(); k++) {
+		double d2 = std::max(byDist[k].first, 1e-6);
+		double taper = 1 - byDist[k].first / r2;
+		cell.stations.push_back(byDist[k].second);
+		cell.weights.push_back((float)(taper * taper / d2));
+	}
+	cell.stamp = 0;
+}
+
+const std::vector<TideFieldCell> &TideHeightField::Update(double latMin, double latMax, double lonMin, double lonMax)
+{
+	m_visible.clear();
+	m_recomputed = 0;
+	if (m_cellLat <= 0 || m_lat.empty())
+		return m_visible;
+
+	long x0 = (long)floor(lonMin / m_cellLon), x1 = (long)floor(lonMax / m_cellLon);
+	long y0 = (long)floor(latMin / m_cellLat), y1 = (long)floor(latMax / m_cellLat);
+
+	for (long y = y0; y <= y1; y++) {
+		for (long x = x0; x <= x1; x++) {
+			TideFieldCell out;
+			out.lat = y * m_cellLat;
+			out.lon = x * m_cellLon;
+
+			uint64_t key = ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+			std::unordered_map<uint64_t, Cell>::iterator it = m_cells.find(key);
+			if (it == m_cells.end()) {
+				it = m_cells.insert(std::make_pair(key, Cell())).first;
+				Prepare(it->second, out.lat + m_cellLat / 2, out.lon + m_cellLon / 2);
+			}
+			Cell &cell = it->second;
+
+			bool stale = cell.stamp == 0;
+			for (size_t k = 0; k < cell.stations.size() && !stale; k++)
+				stale = m_changed[cell.stations[k]] > cell.stamp;
+
+			if (stale) {
+				double sum = 0, weight = 0;
+				for (size_t k = 0; k < cell.stations.size(); k++) {
+					double h = m_heights[cell.stations[k]];
+					if (std::isnan(h))
+						continue;
+					sum += cell.weights[k] * h;
+					weight += cell.weights[k];
+				}
+				cell.value = weight > 0 ? (float)(sum / weight) : NAN;
+				cell.stamp = m_stamp;
+				m_recomputed++;
+			}
+
+			out.value = cell.value;
+			m_visible.push_back(out);
+		}
+	}
+
+	// Keep the cache to a few screens' worth
+	if (m_cells.size() > 4 * m_visible.size() + 1024) {
+		for (std::unordered_map<uint64_t, Cell>::iterator it = m_cells.begin(); it != m_cells.end();) {
+			long x = (long)(int32_t)(it->first >> 32), y = (long)(int32_t)(it->first & 0xffffffff);
+			if (x < x0 || x > x1 || y < y0 || y > y1)
+				it = m_cells.erase(it);
+			else
+				++it;
+		}
+	}
+
+	return m_visible;
+}
@@ -0,0 +1,123 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEFIELD_H_
+#define _TIDEFIELD_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Tide heights interpolated between stations onto a grid of cells.
+ *
+ * Cells are fixed in latitude and longitude at a given size, so panning
+ * reuses every cell still in view. Each cell keeps the stations within
+ * reach and their inverse-distance weights, found through a bucket
+ * index. New heights only recompute cells with a station whose height
+ * actually moved.
+ */
+
+// Stations bucketed on a lat/lon grid for radius queries.
+class TideStationGrid
+{
+public:
+	TideStationGrid() : m_cell(1), m_lonCell(1) {}
+
+	void Build(const std::vector<double> &lat, const std::vector<double> &lon, double radiusNm);
+	// Stations within radiusNm of lat, lon, as given to Build.
+	void Query(double lat, double lon, std::vector<uint32_t> &out) const;
+
+private:
+	uint64_t Key(long ix, long iy) const { return ((uint64_t)(uint32_t)ix << 32) | (uint32_t)iy; }
+
+	double m_cell;
+	double m_lonCell;
+	double m_radius;
+	const std::vector<double> *m_lat;
+	const std::vector<double> *m_lon;
+	std::unordered_map<uint64_t, std::vector<uint32_t> > m_buckets;
+};
+
+struct TideFieldCell
+{
+	double lat;        // south west corner
+	double lon;
+	float value;       // NaN with no station in reach
+};
+
+class TideHeightField
+{
+public:
+	TideHeightField();
+
+	// Drops the whole cache.
+	void SetStations(const std::vector<double> &lat, const std::vector<double> &lon,
+		double radiusNm = 30);
+	// Heights now, NaN where unknown. Stations that moved less than
+	// tolerance leave their cells alone.
+	void SetHeights(const std::vector<double> &heights, double tolerance = 0.005);
+	// Cell height in degrees of latitude; the width is scaled by refLat
+	// so cells are square on the chart. Changing either drops the cache.
+	void SetCellSize(double deg, double refLat);
+
+	// Cells covering the box, brought up to date.
+	const std::vector<TideFieldCell> &Update(double latMin, double latMax, double lonMin, double lonMax);
+
+	double CellHeight() const { return m_cellLat; }
+	double CellWidth() const { return m_cellLon; }
+	// Cells whose value was recomputed by the last Update.
+	size_t Recomputed() const { return m_recomputed; }
+
+private:
+	struct Cell
+	{
+		std::vector<uint32_t> stations;
+		std::vector<float> weights;
+		float value;
+		unsigned stamp;
+	};
+
+	void Prepare(Cell &cell, double lat, double lon);
+
+	std::vector<double> m_lat;
+	std::vector<double> m_lon;
+	std::vector<double> m_heights;
+	std::vector<unsigned> m_changed;   // stamp of each station's last change
+	unsigned m_stamp;
+	double m_radius;
+	TideStationGrid m_grid;
+
+	double m_cellLat;
+	double m_cellLon;
+	std::unordered_map<uint64_t, Cell> m_cells;
+	std::vector<TideFieldCell> m_visible;
+	size_t m_recomputed;
+};
+
+#endif
@@ -0,0 +1,46 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <math.h>
+
+double TideDistanceNm(double lat1, double lon1, double lat2, double lon2)
+{
+	double sdlat = sin((lat2 - lat1) * TIDE_DEG2RAD / 2);
+	double sdlon = sin((lon2 - lon1) * TIDE_DEG2RAD / 2);
+	double a = sdlat * sdlat + cos(lat1 * TIDE_DEG2RAD) * cos(lat2 * TIDE_DEG2RAD) * sdlon * sdlon;
+	return 2 * TIDE_EARTH_RADIUS_NM * asin(sqrt(std::min(1.0, a)));
+}
+
+double TideBearingDeg(double lat1, double lon1, double lat2, double lon2)
+{
+	double phi1 = lat1 * TIDE_DEG2RAD, phi2 = lat2 * TIDE_DEG2RAD;
+	double dlon = (lon2 - lon1) * TIDE_DEG2RAD;
+	return atan2(sin(dlon) * cos(phi2), cos(phi1) * sin(phi2) - sin(phi1) * cos(phi2) * cos(dlon)) / TIDE_DEG2RAD;
+}
@@ -0,0 +1,48 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEGEO_H_
+#define _TIDEGEO_H_
+
+/*
+ * Spherical earth helpers shared by the core. NavFunc has the plugin's
+ * older ellipsoidal routines; these are cheap enough for per-station
+ * loops.
+ */
+
+#define TIDE_PI 3.14159265358979323846
+#define TIDE_DEG2RAD (TIDE_PI / 180.0)
+#define TIDE_EARTH_RADIUS_NM 3440.065
+
+// Great circle (haversine) distance in nautical miles. A true metric,
+// which TideNearestTracker's validity radius relies on.
+double TideDistanceNm(double lat1, double lon1, double lat2, double lon2);
+
+// Initial great circle course from 1 to 2, degrees true in (-180, 180].
+double TideBearingDeg(double lat1, double lon1, double lat2, double lon2);
+
+#endif
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidehover.h"
+
+void TideHoverGrid::Reset(int width, int height, int cellPx)
+{
+	m_cell = cellPx > 0 ? cellPx : 1;
+	m_cols = width > 0 ? (width + m_cell - 1) / m_cell : 0;
+	m_rows = height > 0 ? (height + m_cell - 1) / m_cell : 0;
+	m_head.assign((size_t)m_cols * m_rows, -1);
+	m_items.clear();
+}
+
+void TideHoverGrid::Add(int x, int y, uint32_t tag)
+{
+	if (x < 0 || y < 0)
+		return;
+	int cx = x / m_cell, cy = y / m_cell;
+	if (cx >= m_cols || cy >= m_rows)
+		return;
+
+	Item item;
+	item.x = x;
+	item.y = y;
+	item.tag = tag;
+	item.next = m_head[cy * m_cols + cx];
+	m_head[cy * m_cols + cx] = (int32_t)m_items.size();
+	m_items.push_back(item);
+}
+
+bool TideHoverGrid::Find(int x, int y, uint32_t &tag) const
+{
+	if (m_items.empty() || x < -m_cell || y < -m_cell)
+		return false;
+
+	int cx = x >= 0 ? x / m_cell : -1;
+	int cy = y >= 0 ? y / m_cell : -1;
+	long best = (long)m_cell * m_cell + 1;
+	bool found = false;
+
+	for (int gy = cy - 1; gy <= cy + 1; gy++) {
+		if (gy < 0 || gy >= m_rows)
+			continue;
+		for (int gx = cx - 1; gx <= cx + 1; gx++) {
+			if (gx < 0 || gx >= m_cols)
+				continue;
+			for (int32_t k = m_head[gy * m_cols + gx]; k >= 0; k = m_items[k].next) {
+				long dx = m_items[k].x - x, dy = m_items[k].y - y;
+				long d = dx * dx + dy * dy;
+				if (d < best) {
+					best = d;
+					tag = m_items[k].tag;
+					found = true;
+				}
+			}
+		}
+	}
+	return found;
+}
@@ -0,0 +1,69 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEHOVER_H_
+#define _TIDEHOVER_H_
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Station icons as drawn in the last frame, bucketed on a screen grid
+ * whose cells are as large as the hover radius. Finding the icon under
+ * the cursor then only looks at the 3 x 3 cells around it, however many
+ * stations are on the chart. Reset() and Add() reuse their arrays, so a
+ * frame does not allocate once the grid has grown to the canvas.
+ */
+class TideHoverGrid
+{
+public:
+	TideHoverGrid() : m_cols(0), m_rows(0), m_cell(1) {}
+
+	// Forgets all icons and covers a width x height canvas.
+	void Reset(int width, int height, int cellPx);
+	// Icons off the canvas are ignored.
+	void Add(int x, int y, uint32_t tag);
+	// Tag of the icon nearest to x, y within the cell size.
+	bool Find(int x, int y, uint32_t &tag) const;
+
+	size_t Size() const { return m_items.size(); }
+
+private:
+	struct Item
+	{
+		int32_t x, y;
+		uint32_t tag;
+		int32_t next;    // next item in the same cell, or -1
+	};
+
+	int m_cols, m_rows, m_cell;
+	std::vector<int32_t> m_head;   // first item per cell, or -1
+	std::vector<Item> m_items;
+};
+
+#endif
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidelevels.h"
+
+#include <cmath>
+
+// Look-ahead for the trend of a series
+static const time_t TREND_SECS = 600;
+
+void TideLevelBatch::SetSources(const std::vector<const TideSeries *> &series,
+	const std::vector<const TideHarmonics *> &harmonics)
+{
+	size_t n = series.size();
+	m_series = series;
+	m_predictorOf.assign(n, -1);
+	m_predictors.clear();
+	for (size_t i = 0; i < n; i++) {
+		if (m_series[i] && m_series[i]->Empty())
+			m_series[i] = NULL;
+		if (!m_series[i] && i < harmonics.size() && harmonics[i]) {
+			m_predictorOf[i] = (int)m_predictors.size();
+			m_predictors.push_back(TidePredictor(*harmonics[i]));
+		}
+	}
+	m_cursor.assign(n, 0);
+	m_height.assign(n, NAN);
+	m_trend.assign(n, 0);
+}
+
+bool TideLevelBatch::SeriesAt(size_t i, time_t t, double *v)
+{
+	const TideSeries &s = *m_series[i];
+	size_t n = s.Size();
+	if (t < s[0].t || t > s[n - 1].t)
+		return false;
+
+	// Walk from the last position; frames usually move a sample or two
+	size_t &c = m_cursor[i];
+	if (c >= n)
+		c = n - 1;
+	while (c > 0 && s[c].t > t)
+		c--;
+	while (c + 1 < n && s[c + 1].t <= t)
+		c++;
+
+	if (s[c].t == t || c + 1 >= n) {
+		*v = s[c].v;
+		return true;
+	}
+	double f = (double)(t - s[c].t) / (double)(s[c + 1].t - s[c].t);
+	*v = s[c].v + f * (s[c + 1].v - s[c].v);
+	return true;
+}
+
+void TideLevelBatch::Evaluate(time_t t, const uint32_t *stations, size_t n)
+{
+	for (size_t k = 0; k < n; k++) {
+		size_t i = stations[k];
+		if (i >= m_height.size())
+			continue;
+
+		double h = NAN, next;
+		signed char trend = 0;
+		if (m_series[i]) {
+			if (SeriesAt(i, t, &h)) {
+				size_t keep = m_cursor[i];
+				if (SeriesAt(i, t + TREND_SECS, &next))
+					trend = next >= h ? 1 : -1;
+				m_cursor[i] = keep;
+			}
+		}
+		else if (m_predictorOf[i] >= 0) {
+			TidePredictor &p = m_predictors[m_predictorOf[i]];
+			h = p.Height(t);
+			trend = p.Rate(t) >= 0 ? 1 : -1;
+		}
+		m_height[i] = h;
+		m_trend[i] = trend;
+	}
+}
@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDELEVELS_H_
+#define _TIDELEVELS_H_
+
+#include <ctime>
+#include <stdint.h>
+#include <vector>
+
+#include "harmonics.h"
+#include "tideseries.h"
+
+/*
+ * Heights and rising/falling state for many stations at one instant.
+ *
+ * Sources are bound once; every Evaluate() then works in buffers sized
+ * at that point and allocates nothing, so scrubbing or playing back time
+ * costs a few lookups per station per frame. Series are read with a
+ * per-station cursor that follows time as it moves, rather than a fresh
+ * binary search each frame.
+ */
+
+class TideLevelBatch
+{
+public:
+	// Station i reads series[i] when it has samples, else harmonics[i];
+	// either may be NULL. Series must outlive the batch or the next
+	// SetSources().
+	void SetSources(const std::vector<const TideSeries *> &series,
+		const std::vector<const TideHarmonics *> &harmonics);
+
+	size_t Size() const { return m_height.size(); }
+
+	// Evaluates the listed stations at t.
+	void Evaluate(time_t t, const uint32_t *stations, size_t n);
+
+	// NaN and 0 for stations without data at t.
+	double Height(size_t i) const { return m_height[i]; }
+	// +1 rising, -1 falling.
+	int Trend(size_t i) const { return m_trend[i]; }
+
+private:
+	bool SeriesAt(size_t i, time_t t, double *v);
+
+	std::vector<const TideSeries *> m_series;
+	std::vector<int> m_predictorOf;
+	std::vector<TidePredictor> m_predictors;
+	std::vector<size_t> m_cursor;
+	std::vector<double> m_height;
+	std::vector<signed char> m_trend;
+};
+
+#endif
@@ -0,0 +1,242 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideobs.h"
+#include "tidetime.h"
+
+#include <math.h>
+
+// How far back the first poll of a station reaches
+static const time_t FIRST_POLL_BACKFILL = 6 * 3600;
+// Predictions are fetched this far past the newest observation
+static const time_t PREDICTION_LEAD = 3600;
+
+TideObservationPoller::TideObservationPoller(const std::string &baseUrl,
+	const TideFetchFn &fetch, size_t capacity, int intervalSecs)
+	: m_baseUrl(baseUrl), m_fetch(fetch), m_capacity(capacity),
+	m_interval(intervalSecs > 5 ? intervalSecs : 5),
+	m_running(false), m_stop(false), m_wake(false), m_generation(0)
+{
+}
+
+TideObservationPoller::~TideObservationPoller()
+{
+	Stop();
+}
+
+void TideObservationPoller::Watch(const std::string &stationId)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_watched.find(stationId) != m_watched.end())
+			return;
+		m_watched.insert(std::make_pair(stationId, WatchedStation(m_capacity)));
+		m_wake = true;
+	}
+	m_cv.notify_one();
+}
+
+void TideObservationPoller::Unwatch(const std::string &stationId)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_watched.erase(stationId);
+	m_generation++;
+}
+
+bool TideObservationPoller::IsWatched(const std::string &stationId) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_watched.find(stationId) != m_watched.end();
+}
+
+std::vector<std::string> TideObservationPoller::Watched() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<std::string> ids;
+	for (std::map<std::string, WatchedStation>::const_iterator it = m_watched.begin(); it != m_watched.end(); ++it)
+		ids.push_back(it->first);
+	return ids;
+}
+
+void TideObservationPoller::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running)
+		return;
+	m_stop = false;
+	m_running = true;
+	m_thread = std::thread(&TideObservationPoller::Run, this);
+}
+
+void TideObservationPoller::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+			return;
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+	m_running = false;
+}
+
+void TideObservationPoller::PollNow()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_wake = true;
+	}
+	m_cv.notify_one();
+}
+
+unsigned TideObservationPoller::Generation() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_generation;
+}
+
+void TideObservationPoller::Run()
+{
+	for (;;) {
+		std::vector<std::string> ids = Watched();
+		for (size_t i = 0; i < ids.size(); i++) {
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_stop)
+					return;
+			}
+			PollStation(ids[i]);
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait_for(lock, std::chrono::seconds(m_interval), [this]() { return m_stop || m_wake; });
+		if (m_stop)
+			return;
+		m_wake = false;
+	}
+}
+
+std::string TideObservationPoller::DataUrl(const std::string &stationId, TideSeriesKind kind, time_t from, time_t to) const
+{
+	return m_baseUrl + "/stations/" + stationId + "/data?time-series-code=" + TideSeriesCode(kind) +
+		"&from=" + TideFormatISO(from) + "&to=" + TideFormatISO(to);
+}
+
+void TideObservationPoller::PollStation(const std::string &stationId)
+{
+	time_t now = time(NULL);
+	time_t from;
+	time_t predictedEnd;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<std::string, WatchedStation>::const_iterator it = m_watched.find(stationId);
+		if (it == m_watched.end())
+			return;
+		from = it->second.obs.Empty() ? now - FIRST_POLL_BACKFILL : it->second.obs.Last().t + 1;
+		predictedEnd = it->second.predicted.End();
+	}
+
+	if (now - from < 30)
+		return;
+
+	// Network work happens without the lock held
+	std::string body, error;
+	std::vector<TideSample> observed, predicted;
+
+	if (!m_fetch(DataUrl(stationId, TSK_WLO, from, now), body, error))
+		return;
+	if (!TideParseSeries(body.data(), body.data() + body.size(), observed, error) || observed.empty())
+		return;
+
+	if (predictedEnd < observed.back().t) {
+		time_t pfrom = predictedEnd > from ? predictedEnd : from - 900;
+		if (m_fetch(DataUrl(stationId, TSK_WLP, pfrom, now + PREDICTION_LEAD), body, error))
+			TideParseSeries(body.data(), body.data() + body.size(), predicted, error);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, WatchedStation>::iterator it = m_watched.find(stationId);
+	if (it == m_watched.end())
+		return;
+
+	WatchedStation &ws = it->second;
+	for (size_t i = 0; i < observed.size(); i++)
+		ws.obs.Push(observed[i]);
+
+	ws.predicted.Merge(predicted);
+	// Keep one prediction before the oldest observation for interpolation
+	ws.predicted.TrimBefore(ws.obs.At(0).t - 3600);
+
+	m_generation++;
+}
+
+bool TideObservationPoller::Residuals(const std::string &stationId, std::vector<TideResidual> &out) const
+{
+	out.clear();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, WatchedStation>::const_iterator it = m_watched.find(stationId);
+	if (it == m_watched.end())
+		return false;
+
+	const WatchedStation &ws = it->second;
+	out.reserve(ws.obs.Size());
+
+	for (size_t i = 0; i < ws.obs.Size(); i++) {
+		const TideSample &s = ws.obs.At(i);
+		TideResidual r;
+		if (!ws.predicted.Interpolate(s.t, &r.predicted))
+			continue;
+		r.t = s.t;
+		r.observed = s.v;
+		r.residual = s.v - r.predicted;
+		out.push_back(r);
+	}
+	return !out.empty();
+}
+
+bool TideObservationPoller::Latest(const std::string &stationId, TideResidual &latest) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<std::string, WatchedStation>::const_iterator it = m_watched.find(stationId);
+	if (it == m_watched.end() || it->second.obs.Empty())
+		return false;
+
+	const WatchedStation &ws = it->second;
+	const TideSample &s = ws.obs.Last();
+	latest.t = s.t;
+	latest.observed = s.v;
+	if (ws.predicted.Interpolate(s.t, &latest.predicted))
+		latest.residual = s.v - latest.predicted;
+	else {
+		latest.predicted = NAN;
+		latest.residual = NAN;
+	}
+	return true;
+}
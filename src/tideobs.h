@@ -0,0 +1,109 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEOBS_H_
+#define _TIDEOBS_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tidefetch.h"
+#include "tideseries.h"
+
+/*
+ * Background polling of observed water levels (wlo) for a set of watched
+ * stations. Each station keeps its observations in a fixed-size ring
+ * buffer and only the predictions (wlp) overlapping that window, so memory
+ * stays bounded however long the session runs. Residuals (observed minus
+ * predicted, i.e. surge) are computed when asked for.
+ */
+
+struct TideResidual
+{
+	time_t t;
+	double observed;
+	double predicted;
+	double residual;
+};
+
+class TideObservationPoller
+{
+public:
+	TideObservationPoller(const std::string &baseUrl, const TideFetchFn &fetch,
+		size_t capacity = 1440, int intervalSecs = 60);
+	~TideObservationPoller();
+
+	void Watch(const std::string &stationId);
+	void Unwatch(const std::string &stationId);
+	bool IsWatched(const std::string &stationId) const;
+	std::vector<std::string> Watched() const;
+
+	void Start();
+	void Stop();
+	void PollNow();
+
+	// Observations with a prediction to compare against. Thread-safe copy.
+	bool Residuals(const std::string &stationId, std::vector<TideResidual> &out) const;
+	bool Latest(const std::string &stationId, TideResidual &latest) const;
+
+	// Incremented whenever new observations arrive.
+	unsigned Generation() const;
+
+private:
+	struct WatchedStation
+	{
+		WatchedStation(size_t capacity) : obs(capacity) {}
+		TideRingBuffer obs;
+		TideSeries predicted;
+	};
+
+	void Run();
+	void PollStation(const std::string &stationId);
+	std::string DataUrl(const std::string &stationId, TideSeriesKind kind, time_t from, time_t to) const;
+
+	std::string m_baseUrl;
+	TideFetchFn m_fetch;
+	size_t m_capacity;
+	int m_interval;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+	bool m_stop;
+	bool m_wake;
+	unsigned m_generation;
+	std::map<std::string, WatchedStation> m_watched;
+};
+
+#endif
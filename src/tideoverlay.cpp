@@ -0,0 +1,102 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "wx/wxprec.h"
+
+#ifndef WX_PRECOMP
+#include "wx/wx.h"
+#endif
+
+#include "tideoverlay.h"
+#include "tidehover.h"
+#include "bbox.h"
+#include "pidc.h"
+#include "tidetrace.h"
+
+#ifdef __OCPN__ANDROID__
+static void DrawLine(piDC &dc, double x1, double y1, double x2, double y2,
+	const wxColour &color, double width)
+{
+	dc.ConfigurePen();
+	dc.SetPen(wxPen(color, width));
+	dc.ConfigureBrush();
+	dc.SetBrush(*wxTRANSPARENT_BRUSH);
+	dc.DrawLine(x1, y1, x2, y2, false);
+}
+#endif
+
+int TideDrawStations(piDC &dc, PlugIn_ViewPort &vp, const TideStationStore &store,
+	const wxBitmap &icon, bool useMask, unsigned parts,
+	TideHoverGrid *grid, uint32_t tagBits)
+{
+	TIDE_TRACE_SCOPE("TideDrawStations");
+
+	if (store.Empty())
+		return 0;
+
+	const double *lats = store.Lats();
+	const double *lons = store.Lons();
+	int iconW = icon.IsOk() ? icon.GetWidth() : 20;
+	int iconH = icon.IsOk() ? icon.GetHeight() : 20;
+	int drawn = 0;
+
+	wxBoundingBox LLBBox(vp.lon_min, vp.lat_min, vp.lon_max, vp.lat_max);
+
+	for (size_t i = 0; i < store.Size(); i++) {
+
+		if (!LLBBox.PointInBox(lons[i], lats[i], 0))
+			continue;
+
+		wxPoint cpoint;
+		GetCanvasPixLL(&vp, &cpoint, lats[i], lons[i]);
+		int pixxc = cpoint.x;
+		int pixyc = cpoint.y;
+
+		if (parts & TOP_ICONS) {
+#ifdef __OCPN__ANDROID__
+			wxColour myColour = wxColour("YELLOW");
+			DrawLine(dc, pixxc, pixyc, pixxc + 20, pixyc + 20, myColour, 4);
+
+			// draw bounding rectangle //
+			DrawLine(dc, pixxc, pixyc, pixxc + 20, pixyc, myColour, 2);
+			DrawLine(dc, pixxc + 20, pixyc, pixxc + 20, pixyc + 20, myColour, 2);
+			DrawLine(dc, pixxc + 20, pixyc + 20, pixxc, pixyc + 20, myColour, 2);
+			DrawLine(dc, pixxc, pixyc + 20, pixxc, pixyc, myColour, 2);
+#else
+			dc.DrawBitmap(icon, pixxc, pixyc, useMask);
+#endif
+		}
+		if (grid)
+			grid->Add(pixxc + iconW / 2, pixyc + iconH / 2, (uint32_t)i | tagBits);
+
+		if (parts & TOP_LABELS)
+			dc.DrawText(wxString(store.Name(i), wxConvUTF8), pixxc, pixyc - 15);
+
+		drawn++;
+	}
+	return drawn;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEOVERLAY_H_
+#define _TIDEOVERLAY_H_
+
+#include <stdint.h>
+
+#include "tidestations.h"
+
+/*
+ * Station icons and names on the chart overlay. Shared by Dlg and the
+ * headless render benchmark in tools/, which times the parts separately.
+ */
+
+class piDC;
+class wxBitmap;
+class PlugIn_ViewPort;
+class TideHoverGrid;
+
+enum TideOverlayParts {
+	TOP_ICONS = 1 << 0,
+	TOP_LABELS = 1 << 1,
+	TOP_ALL = TOP_ICONS | TOP_LABELS
+};
+
+// Draws the stations of store that fall inside vp, each name 15px above
+// its icon. When grid is given every icon centre is added to it, tagged
+// with the station index or'ed with tagBits. Returns the stations drawn.
+int TideDrawStations(piDC &dc, PlugIn_ViewPort &vp, const TideStationStore &store,
+	const wxBitmap &icon, bool useMask, unsigned parts,
+	TideHoverGrid *grid = NULL, uint32_t tagBits = 0);
+
+#endif
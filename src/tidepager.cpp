@@ -0,0 +1,256 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidepager.h"
+#include "tidetrace.h"
+#include "tideseries.h"
+#include "tidetime.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "json/reader.h"
+
+TidePager::TidePager(const std::string &baseUrl, const std::string &stationId,
+	const std::string &seriesCode, time_t from, time_t to, int chunkDays)
+	: m_baseUrl(baseUrl), m_stationId(stationId), m_seriesCode(seriesCode),
+	m_from(from), m_to(to), m_created(time(NULL))
+{
+	if (chunkDays < 1)
+		chunkDays = 1;
+	const time_t step = (time_t)chunkDays * 86400;
+
+	for (time_t t = from; t < to; t += step) {
+		TideChunk chunk;
+		chunk.from = t;
+		chunk.to = t + step < to ? t + step : to;
+		chunk.state = TCS_PENDING;
+		m_chunks.push_back(chunk);
+	}
+}
+
+std::string TidePager::ChunkUrl(const TideChunk &chunk) const
+{
+	return m_baseUrl + "/stations/" + m_stationId + "/data?time-series-code=" + m_seriesCode +
+		"&from=" + TideFormatISO(chunk.from) + "&to=" + TideFormatISO(chunk.to);
+}
+
+bool TidePager::Run(const TideFetchFn &fetch, const TideChunkProgressFn &progress, int maxParallel)
+{
+	std::vector<size_t> pending;
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		if (m_chunks[i].state != TCS_DONE) {
+			m_chunks[i].state = TCS_PENDING;
+			m_chunks[i].error.clear();
+			pending.push_back(i);
+		}
+	}
+
+	const int total = (int)m_chunks.size();
+	int done = total - (int)pending.size();
+
+	if (pending.empty())
+		return true;
+
+	if (maxParallel <= 1 || pending.size() == 1) {
+		for (size_t n = 0; n < pending.size(); n++) {
+			TideChunk &chunk = m_chunks[pending[n]];
+			chunk.state = fetch(ChunkUrl(chunk), chunk.body, chunk.error) ? TCS_DONE : TCS_FAILED;
+			if (progress)
+				progress(++done, total, chunk);
+		}
+		return IsComplete();
+	}
+
+	// Workers pull chunk indices from a shared counter; finished indices are
+	// queued back so progress is reported on the calling thread.
+	std::atomic<size_t> next(0);
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<size_t> finished;
+
+	auto worker = [&]() {
+		for (;;) {
+			size_t n = next.fetch_add(1);
+			if (n >= pending.size())
+				break;
+			TideChunk &chunk = m_chunks[pending[n]];
+			std::string body, error;
+			bool ok = fetch(ChunkUrl(chunk), body, error);
+
+			std::lock_guard<std::mutex> lock(mtx);
+			chunk.body.swap(body);
+			chunk.error.swap(error);
+			chunk.state = ok ? TCS_DONE : TCS_FAILED;
+			finished.push_back(pending[n]);
+			cv.notify_one();
+		}
+	};
+
+	int nthreads = maxParallel < (int)pending.size() ? maxParallel : (int)pending.size();
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nthreads; i++)
+		threads.push_back(std::thread(worker));
+
+	size_t reported = 0;
+	while (reported < pending.size()) {
+		std::unique_lock<std::mutex> lock(mtx);
+		cv.wait(lock, [&]() { return !finished.empty(); });
+		size_t idx = finished.front();
+		finished.pop_front();
+		lock.unlock();
+
+		reported++;
+		if (progress)
+			progress(++done, total, m_chunks[idx]);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	return IsComplete();
+}
+
+bool TidePager::IsComplete() const
+{
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		if (m_chunks[i].state != TCS_DONE)
+			return false;
+	}
+	return true;
+}
+
+int TidePager::FailedCount() const
+{
+	int n = 0;
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		if (m_chunks[i].state == TCS_FAILED)
+			n++;
+	}
+	return n;
+}
+
+bool TidePager::Stitch(Json::Value &events, std::string &error) const
+{
+	TIDE_TRACE_SCOPE("TidePager::Stitch");
+
+	events = Json::Value(Json::arrayValue);
+
+	if (!IsComplete()) {
+		error = "Download incomplete";
+		return false;
+	}
+
+	Json::Reader reader;
+	std::string lastDate;
+
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		const std::string &body = m_chunks[i].body;
+		Json::Value page;
+		if (!reader.parse(body.data(), body.data() + body.size(), page, false) || !page.isArray()) {
+			error = "Unable to parse json";
+			return false;
+		}
+
+		// Chunk windows share their end points, so the server may return the
+		// same event at the end of one page and the start of the next. ISO
+		// dates compare correctly as strings.
+		for (Json::ArrayIndex k = 0; k < page.size(); k++) {
+			const std::string date = page[k]["eventDate"].asString();
+			if (!lastDate.empty() && date <= lastDate)
+				continue;
+			lastDate = date;
+			events.append(page[k]);
+		}
+	}
+
+	return true;
+}
+
+bool TidePager::Matches(const std::string &stationId, const std::string &seriesCode, time_t span) const
+{
+	return m_stationId == stationId && m_seriesCode == seriesCode && m_to - m_from == span;
+}
+
+int TideFetchSeries(const std::string &baseUrl, const std::vector<std::string> &stationIds,
+	const std::vector<int> &kinds, time_t from, time_t to,
+	const TideFetchFn &fetch, int maxParallel, TideSeriesStore &store)
+{
+	const size_t njobs = stationIds.size() * kinds.size();
+	if (njobs == 0)
+		return 0;
+
+	std::atomic<size_t> next(0);
+	std::atomic<int> loaded(0);
+	std::mutex storeMutex;
+
+	auto worker = [&]() {
+		for (;;) {
+			size_t n = next.fetch_add(1);
+			if (n >= njobs)
+				break;
+
+			const std::string &id = stationIds[n / kinds.size()];
+			TideSeriesKind kind = (TideSeriesKind)kinds[n % kinds.size()];
+
+			TidePager pager(baseUrl, id, TideSeriesCode(kind), from, to);
+			if (!pager.Run(fetch, TideChunkProgressFn(), 1))
+				continue;
+
+			Json::Value events;
+			std::string error;
+			if (!pager.Stitch(events, error))
+				continue;
+
+			std::vector<TideSample> samples;
+			TideSamplesFromJson(events, samples);
+			if (samples.empty())
+				continue;
+
+			std::lock_guard<std::mutex> lock(storeMutex);
+			store.Get(id, kind).Swap(samples);
+			loaded++;
+		}
+	};
+
+	if (maxParallel <= 1) {
+		worker();
+		return loaded;
+	}
+
+	int nthreads = maxParallel < (int)njobs ? maxParallel : (int)njobs;
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nthreads; i++)
+		threads.push_back(std::thread(worker));
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	return loaded;
+}
@@ -0,0 +1,106 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEPAGER_H_
+#define _TIDEPAGER_H_
+
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "json/value.h"
+
+#include "tidefetch.h"
+
+/*
+ * Splits a long IWLS data request into server-friendly windows, fetches
+ * them (concurrently when the transport allows it) and stitches the
+ * results back into a single, ordered, duplicate-free event series.
+ *
+ * Chunks that fail are kept as pending, so calling Run() again only
+ * fetches what is still missing.
+ */
+
+enum TideChunkState { TCS_PENDING = 0, TCS_DONE, TCS_FAILED };
+
+struct TideChunk
+{
+	time_t from;
+	time_t to;
+	TideChunkState state;
+	std::string body;
+	std::string error;
+};
+
+// Called on the thread that called Run(), once per finished chunk.
+typedef std::function<void(int done, int total, const TideChunk &chunk)> TideChunkProgressFn;
+
+class TidePager
+{
+public:
+	TidePager(const std::string &baseUrl, const std::string &stationId,
+		const std::string &seriesCode, time_t from, time_t to, int chunkDays = 7);
+
+	// fetch must be thread-safe when maxParallel > 1.
+	bool Run(const TideFetchFn &fetch, const TideChunkProgressFn &progress, int maxParallel = 3);
+
+	bool IsComplete() const;
+	int ChunkCount() const { return (int)m_chunks.size(); }
+	int FailedCount() const;
+
+	// Concatenates the chunks in time order, dropping events repeated at
+	// chunk boundaries. Only valid once IsComplete().
+	bool Stitch(Json::Value &events, std::string &error) const;
+
+	bool Matches(const std::string &stationId, const std::string &seriesCode, time_t span) const;
+
+	const std::string &StationId() const { return m_stationId; }
+	time_t Created() const { return m_created; }
+
+private:
+	std::string ChunkUrl(const TideChunk &chunk) const;
+
+	std::string m_baseUrl;
+	std::string m_stationId;
+	std::string m_seriesCode;
+	time_t m_from;
+	time_t m_to;
+	time_t m_created;
+	std::vector<TideChunk> m_chunks;
+};
+
+class TideSeriesStore;
+
+// Loads one series per (station, kind) for [from, to] into store, each one
+// paged as above, with up to maxParallel series in flight. Returns the
+// number of series loaded.
+int TideFetchSeries(const std::string &baseUrl, const std::vector<std::string> &stationIds,
+	const std::vector<int> &kinds, time_t from, time_t to,
+	const TideFetchFn &fetch, int maxParallel, TideSeriesStore &store);
+
+#endif
@@ -0,0 +1,135 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidepool.h"
+
+// The pool and queue index of the worker running on this thread, if any
+static thread_local TideThreadPool *t_pool = NULL;
+static thread_local int t_index = -1;
+
+TideThreadPool::TideThreadPool(int threads)
+	: m_queued(0), m_pending(0), m_next(0), m_stop(false)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 2;
+
+	for (int i = 0; i < threads; i++)
+		m_queues.push_back(new Queue);
+	for (int i = 0; i < threads; i++)
+		m_threads.push_back(std::thread(&TideThreadPool::WorkerLoop, this, i));
+}
+
+TideThreadPool::~TideThreadPool()
+{
+	Wait();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	for (size_t i = 0; i < m_queues.size(); i++)
+		delete m_queues[i];
+}
+
+void TideThreadPool::Submit(const Task &task)
+{
+	size_t q;
+	if (t_pool == this)
+		q = t_index;
+	else {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		q = m_next++ % m_queues.size();
+	}
+
+	// Counted before it is visible: a thief could otherwise run a nested
+	// task to completion, and m_pending reach zero, while its parent still
+	// runs, and Pop() could take m_queued below zero
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending++;
+		m_queued++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_queues[q]->mutex);
+		m_queues[q]->tasks.push_back(task);
+	}
+	m_wake.notify_one();
+}
+
+void TideThreadPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+bool TideThreadPool::Pop(int self, Task &task)
+{
+	const int n = (int)m_queues.size();
+	for (int i = 0; i < n; i++) {
+		Queue *q = m_queues[(self + i) % n];
+		std::lock_guard<std::mutex> lock(q->mutex);
+		if (q->tasks.empty())
+			continue;
+		if (i == 0) {
+			task.swap(q->tasks.back());
+			q->tasks.pop_back();
+		}
+		else {
+			task.swap(q->tasks.front());
+			q->tasks.pop_front();
+		}
+		m_queued--;
+		return true;
+	}
+	return false;
+}
+
+void TideThreadPool::WorkerLoop(int self)
+{
+	t_pool = this;
+	t_index = self;
+
+	for (;;) {
+		Task task;
+		if (Pop(self, task)) {
+			task();
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (--m_pending == 0)
+				m_idle.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_wake.wait(lock, [this]() { return m_stop || m_queued > 0; });
+		if (m_stop && m_queued == 0)
+			return;
+	}
+}
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEPOOL_H_
+#define _TIDEPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Each worker owns a deque: it takes its own newest task first and, when
+ * that is empty, steals the oldest task from another worker. Tasks
+ * submitted from inside a task go to the submitting worker's deque, so
+ * related work tends to stay on one thread.
+ */
+
+class TideThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	// threads <= 0 means one per core.
+	explicit TideThreadPool(int threads = 0);
+	~TideThreadPool();
+
+	void Submit(const Task &task);
+	// Blocks until every submitted task, including nested ones, has run.
+	void Wait();
+	int Size() const { return (int)m_threads.size(); }
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerLoop(int self);
+	bool Pop(int self, Task &task);
+
+	std::vector<Queue *> m_queues;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	std::atomic<size_t> m_queued;
+	size_t m_pending;
+	size_t m_next;
+	bool m_stop;
+};
+
+#endif
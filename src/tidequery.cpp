@@ -0,0 +1,496 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidequery.h"
+#include "tideextrema.h"
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "json/reader.h"
+#include "json/writer.h"
+
+enum TideQueryKind {
+	TQ_HEIGHT,
+	TQ_EXTREMES,
+	TQ_CURRENT
+};
+
+static const size_t MAX_QUERY_TIMES = 10000;
+// Times outside +-30000 years are rejected before any arithmetic on them
+static const Json::Int64 MAX_QUERY_SECONDS = 1000000000000LL;
+
+// Requests come from other plugins, so every field is type checked before
+// it is read: jsoncpp throws on a mismatched as*() call.
+static bool TimeValue(const Json::Value &v, time_t &t)
+{
+	if (!v.isInt64() || v.asInt64() > MAX_QUERY_SECONDS || v.asInt64() < -MAX_QUERY_SECONDS)
+		return false;
+	t = (time_t)v.asInt64();
+	return true;
+}
+
+static bool TimeField(const Json::Value &q, const char *name, time_t def, time_t &t)
+{
+	const Json::Value &v = q[name];
+	if (v.isNull()) {
+		t = def;
+		return true;
+	}
+	return TimeValue(v, t);
+}
+
+static bool NumberField(const Json::Value &q, const char *name, double def, double &d)
+{
+	const Json::Value &v = q[name];
+	if (v.isNull()) {
+		d = def;
+		return true;
+	}
+	if (!v.isNumeric())
+		return false;
+	d = v.asDouble();
+	return d == d;
+}
+
+static bool HasData(const TideQueryData &data, const std::string &id, TideQueryKind kind)
+{
+	if (kind == TQ_CURRENT)
+		return data.series && data.series->Find(id, TSK_WCS);
+	if (data.harmonics && data.harmonics->count(id))
+		return true;
+	if (data.series && data.series->Find(id, TSK_WLP))
+		return true;
+	if (kind == TQ_EXTREMES && data.saved) {
+		int i = data.saved->Find(id);
+		return i >= 0 && data.saved->EventCount(i) > 0;
+	}
+	return false;
+}
+
+// Where a query ended up: a station of one of the stores.
+struct QueryStation
+{
+	const TideStationStore *store;
+	int index;
+	double distance;
+};
+
+static bool FindStation(const TideQueryData &data, const Json::Value &q, TideQueryKind kind,
+	QueryStation &found, std::string &error)
+{
+	const TideStationStore *stores[2] = { NULL, NULL };
+	if (kind == TQ_CURRENT)
+		stores[0] = data.currents.get();
+	else {
+		stores[0] = data.ports.get();
+		stores[1] = data.saved.get();
+	}
+
+	found.store = NULL;
+	found.index = -1;
+	found.distance = 0;
+
+	if (q.isMember("station")) {
+		if (!q["station"].isString()) {
+			error = "station is not a string";
+			return false;
+		}
+		std::string id = q["station"].asString();
+		for (int k = 0; k < 2 && !found.store; k++) {
+			int i = stores[k] ? stores[k]->Find(id) : -1;
+			if (i >= 0) {
+				found.store = stores[k];
+				found.index = i;
+			}
+		}
+		if (!found.store) {
+			error = "unknown station " + id;
+			return false;
+		}
+		return true;
+	}
+
+	if (!q["lat"].isNumeric() || !q["lon"].isNumeric()) {
+		error = "query needs a station or lat and lon";
+		return false;
+	}
+
+	double lat = q["lat"].asDouble(), lon = q["lon"].asDouble();
+	double maxNm;
+	if (!NumberField(q, "max_nm", 30.0, maxNm)) {
+		error = "max_nm is not a number";
+		return false;
+	}
+	for (int k = 0; k < 2; k++) {
+		if (!stores[k])
+			continue;
+		const double *plat = stores[k]->Lats();
+		const double *plon = stores[k]->Lons();
+		for (size_t i = 0; i < stores[k]->Size(); i++) {
+			double d = TideDistanceNm(lat, lon, plat[i], plon[i]);
+			if (d > maxNm || (found.store && d >= found.distance))
+				continue;
+			if (!HasData(data, stores[k]->Id(i), kind))
+				continue;
+			found.store = stores[k];
+			found.index = (int)i;
+			found.distance = d;
+		}
+	}
+	if (!found.store) {
+		error = "no station with data within max_nm";
+		return false;
+	}
+	return true;
+}
+
+static bool QueryTimes(const Json::Value &q, time_t now, std::vector<time_t> &times, std::string &error)
+{
+	const Json::Value &list = q["times"];
+	if (list.isArray()) {
+		if (list.size() > MAX_QUERY_TIMES) {
+			error = "too many times";
+			return false;
+		}
+		for (Json::ArrayIndex i = 0; i < list.size(); i++) {
+			time_t t;
+			if (!TimeValue(list[i], t)) {
+				error = "times must be integer seconds";
+				return false;
+			}
+			times.push_back(t);
+		}
+		return true;
+	}
+	if (!list.isNull()) {
+		error = "times is not an array";
+		return false;
+	}
+
+	time_t from, to, step;
+	if (!TimeField(q, "from", now, from) || !TimeField(q, "to", from, to) ||
+			!TimeField(q, "step", 3600, step)) {
+		error = "from, to and step must be integer seconds";
+		return false;
+	}
+	if (step <= 0 || step > 366 * 86400 || to < from || (to - from) / step >= (time_t)MAX_QUERY_TIMES) {
+		error = "bad from, to or step";
+		return false;
+	}
+	for (time_t t = from; t <= to; t += step)
+		times.push_back(t);
+	return true;
+}
+
+static Json::Value Number(double v)
+{
+	return v == v ? Json::Value(v) : Json::Value(Json::nullValue);
+}
+
+static void AnswerHeight(const TideQueryData &data, const std::string &id,
+	const std::vector<time_t> &times, Json::Value &result)
+{
+	Json::Value &heights = result["heights"] = Json::Value(Json::arrayValue);
+	TideHarmonicsMap::const_iterator it;
+	const TideSeries *series;
+
+	if (data.harmonics && (it = data.harmonics->find(id)) != data.harmonics->end()) {
+		TidePredictor predictor(it->second);
+		result["source"] = "harmonics";
+		for (size_t k = 0; k < times.size(); k++)
+			heights.append(predictor.Height(times[k]));
+	}
+	else if (data.series && (series = data.series->Find(id, TSK_WLP)) != NULL) {
+		result["source"] = "prediction";
+		for (size_t k = 0; k < times.size(); k++) {
+			double v = NAN;
+			series->Interpolate(times[k], &v);
+			heights.append(Number(v));
+		}
+	}
+	else
+		result["error"] = "no height data for station";
+}
+
+static void AnswerExtremes(const TideQueryData &data, const std::string &id,
+	time_t from, time_t to, Json::Value &result)
+{
+	std::vector<TideExtremum> extrema;
+	TideHarmonicsMap::const_iterator it;
+	const TideSeries *series;
+	int saved;
+
+	if (data.harmonics && (it = data.harmonics->find(id)) != data.harmonics->end()) {
+		TideHarmonicCurve curve(it->second);
+		TideFindExtrema(curve, from, to, 900, extrema);
+		result["source"] = "harmonics";
+	}
+	else if (data.series && (series = data.series->Find(id, TSK_WLP)) != NULL) {
+		TideSeriesCurve curve(*series);
+		TideFindExtrema(curve, std::max(from, series->Begin()), std::min(to, series->End()), 900, extrema);
+		result["source"] = "prediction";
+	}
+	else if (data.saved && (saved = data.saved->Find(id)) >= 0 && data.saved->EventCount(saved)) {
+		TideSavedExtrema(*data.saved, saved, from, to, extrema);
+		result["source"] = "saved";
+	}
+	else {
+		result["error"] = "no height data for station";
+		return;
+	}
+
+	Json::Value &list = result["extremes"] = Json::Value(Json::arrayValue);
+	for (size_t k = 0; k < extrema.size(); k++) {
+		Json::Value e;
+		e["t"] = (Json::Int64)extrema[k].t;
+		e["height"] = extrema[k].height;
+		e["type"] = extrema[k].high ? "high" : "low";
+		list.append(e);
+	}
+}
+
+static void AnswerCurrent(const TideQueryData &data, const std::string &id,
+	const std::vector<time_t> &times, Json::Value &result)
+{
+	const TideSeries *speed = data.series ? data.series->Find(id, TSK_WCS) : NULL;
+	const TideSeries *dir = data.series ? data.series->Find(id, TSK_WCD) : NULL;
+	if (!speed) {
+		result["error"] = "no current data for station";
+		return;
+	}
+
+	result["source"] = "prediction";
+	Json::Value &speeds = result["speeds"] = Json::Value(Json::arrayValue);
+	Json::Value &dirs = result["directions"] = Json::Value(Json::arrayValue);
+	for (size_t k = 0; k < times.size(); k++) {
+		double s = NAN, d = NAN;
+		speed->Interpolate(times[k], &s);
+		if (dir)
+			dir->InterpolateAngle(times[k], &d);
+		speeds.append(Number(s));
+		dirs.append(Number(d));
+	}
+}
+
+static void AnswerOne(const TideQueryData &data, const Json::Value &q, time_t now, Json::Value &result)
+{
+	if (q.isMember("kind") && !q["kind"].isString()) {
+		result["error"] = "kind is not a string";
+		return;
+	}
+	std::string kindName = q.get("kind", "height").asString();
+	TideQueryKind kind;
+	if (kindName == "height")
+		kind = TQ_HEIGHT;
+	else if (kindName == "extremes")
+		kind = TQ_EXTREMES;
+	else if (kindName == "current")
+		kind = TQ_CURRENT;
+	else {
+		result["error"] = "unknown kind " + kindName;
+		return;
+	}
+	result["kind"] = kindName;
+
+	QueryStation station;
+	std::string error;
+	if (!FindStation(data, q, kind, station, error)) {
+		result["error"] = error;
+		return;
+	}
+
+	std::string id = station.store->Id(station.index);
+	result["station"] = id;
+	result["name"] = station.store->Name(station.index);
+	result["lat"] = station.store->Lat(station.index);
+	result["lon"] = station.store->Lon(station.index);
+	if (!q.isMember("station"))
+		result["distance_nm"] = station.distance;
+
+	if (kind == TQ_EXTREMES) {
+		time_t from, to;
+		if (!TimeField(q, "from", now, from) || !TimeField(q, "to", from + 86400, to) ||
+				to < from || to - from > 366 * 86400) {
+			result["error"] = "bad from or to";
+			return;
+		}
+		AnswerExtremes(data, id, from, to, result);
+		return;
+	}
+
+	std::vector<time_t> times;
+	if (!QueryTimes(q, now, times, error)) {
+		result["error"] = error;
+		return;
+	}
+	Json::Value &list = result["times"] = Json::Value(Json::arrayValue);
+	for (size_t k = 0; k < times.size(); k++)
+		list.append((Json::Int64)times[k]);
+
+	if (kind == TQ_HEIGHT)
+		AnswerHeight(data, id, times, result);
+	else
+		AnswerCurrent(data, id, times, result);
+}
+
+static void AnswerRequest(const std::string &request, const TideQueryData &data, time_t now,
+	Json::Value &reply)
+{
+	Json::Value root;
+	Json::Reader reader;
+
+	if (!reader.parse(request.data(), request.data() + request.size(), root, false) || !root.isObject()) {
+		reply["error"] = "request is not a JSON object";
+		return;
+	}
+	if (root.isMember("id"))
+		reply["id"] = root["id"];
+	const Json::Value &queries = root["queries"];
+	if (!queries.isArray()) {
+		reply["error"] = "request has no queries array";
+		return;
+	}
+
+	Json::Value &results = reply["results"] = Json::Value(Json::arrayValue);
+	for (Json::ArrayIndex i = 0; i < queries.size(); i++) {
+		Json::Value result(Json::objectValue);
+		if (queries[i].isObject())
+			AnswerOne(data, queries[i], now, result);
+		else
+			result["error"] = "query is not an object";
+		results.append(result);
+	}
+}
+
+std::string TideAnswerQuery(const std::string &request, const TideQueryData &data, time_t now)
+{
+	Json::Value reply(Json::objectValue);
+
+	// Fields are checked before use; this only keeps a missed one from
+	// taking the service thread, and OpenCPN with it, down
+	try {
+		AnswerRequest(request, data, now, reply);
+	}
+	catch (const Json::Exception &e) {
+		reply = Json::Value(Json::objectValue);
+		reply["error"] = std::string("bad request: ") + e.what();
+	}
+
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	builder["precision"] = 6;
+	builder["precisionType"] = "decimal";
+	return Json::writeString(builder, reply);
+}
+
+TideQueryService::TideQueryService()
+	: m_running(false), m_stop(false), m_pending(0)
+{
+}
+
+TideQueryService::~TideQueryService()
+{
+	Stop();
+}
+
+void TideQueryService::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running)
+		return;
+	m_stop = false;
+	m_running = true;
+	m_thread = std::thread(&TideQueryService::Run, this);
+}
+
+void TideQueryService::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+			return;
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+	m_running = false;
+}
+
+void TideQueryService::Submit(const std::string &request, const TideQueryData &data)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Job job;
+		job.request = request;
+		job.data = data;
+		m_jobs.push_back(job);
+		m_pending++;
+	}
+	m_cv.notify_one();
+}
+
+bool TideQueryService::TakeReply(std::string &reply)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_replies.empty())
+		return false;
+	reply.swap(m_replies.front());
+	m_replies.pop_front();
+	m_pending--;
+	return true;
+}
+
+size_t TideQueryService::Pending() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending;
+}
+
+void TideQueryService::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+		if (m_stop)
+			return;
+
+		Job job;
+		job.request.swap(m_jobs.front().request);
+		job.data = m_jobs.front().data;
+		m_jobs.pop_front();
+
+		lock.unlock();
+		std::string reply = TideAnswerQuery(job.request, job.data, time(NULL));
+		job.data = TideQueryData();
+		lock.lock();
+
+		m_replies.push_back(std::string());
+		m_replies.back().swap(reply);
+	}
+}
@@ -0,0 +1,124 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEQUERY_H_
+#define _TIDEQUERY_H_
+
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "harmonics.h"
+#include "tideseries.h"
+#include "tidestations.h"
+
+/*
+ * Tide queries from other plugins, sent as JSON through OpenCPN plugin
+ * messaging:
+ *
+ *   CANADIANTIDES_QUERY
+ *   { "id": "any", "queries": [
+ *       { "station": "5cebf1de3d0f4a073c4bb94f", "kind": "height",
+ *         "times": [1700000000, 1700003600] },
+ *       { "lat": 44.65, "lon": -63.57, "kind": "extremes",
+ *         "from": 1700000000, "to": 1700086400 },
+ *       { "lat": 45.2, "lon": -66.1, "kind": "current",
+ *         "from": 1700000000, "to": 1700021600, "step": 1800 } ] }
+ *
+ * kind is height (metres), extremes (highs and lows) or current (knots,
+ * degrees true). A position picks the nearest station that has data for
+ * the kind, within max_nm (default 30). times defaults to from..to every
+ * step seconds (at most 10000 times, step up to a year). Times are integer
+ * seconds since the epoch. Every query gets a result, in order, with an
+ * "error" member instead of data when it cannot be answered, including
+ * fields of the wrong type:
+ *
+ *   CANADIANTIDES_QUERY_REPLY
+ *   { "id": "any", "results": [ { "station": ..., "name": ..., "lat": ...,
+ *       "lon": ..., "distance_nm": ..., "source": "harmonics",
+ *       "times": [...], "heights": [...] }, ... ] }
+ *
+ * Answers only read TideQueryData, an immutable snapshot, so they are
+ * worked out on a background thread while the UI carries on.
+ */
+
+#define TIDE_QUERY_MESSAGE "CANADIANTIDES_QUERY"
+#define TIDE_QUERY_REPLY_MESSAGE "CANADIANTIDES_QUERY_REPLY"
+
+struct TideQueryData
+{
+	TideStationSnapshot ports;      // water level catalogue
+	TideStationSnapshot saved;
+	TideStationSnapshot currents;
+	std::shared_ptr<const TideHarmonicsMap> harmonics;
+	std::shared_ptr<const TideSeriesStore> series;
+};
+
+// Reply body for request, with now as the default start time.
+std::string TideAnswerQuery(const std::string &request, const TideQueryData &data, time_t now);
+
+class TideQueryService
+{
+public:
+	TideQueryService();
+	~TideQueryService();
+
+	void Start();
+	void Stop();
+
+	// Queues request to be answered against data.
+	void Submit(const std::string &request, const TideQueryData &data);
+	// Oldest finished reply, if any.
+	bool TakeReply(std::string &reply);
+	// Requests submitted and not yet taken as replies.
+	size_t Pending() const;
+
+private:
+	struct Job
+	{
+		std::string request;
+		TideQueryData data;
+	};
+
+	void Run();
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+	bool m_stop;
+	std::deque<Job> m_jobs;
+	std::deque<std::string> m_replies;
+	size_t m_pending;
+};
+
+#endif
@@ -0,0 +1,192 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideroute.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "tinyxml.h"
+
+static void ReadPoints(TiXmlElement *parent, const char *tag, std::vector<TideRoutePoint> &points)
+{
+	for (TiXmlElement *e = parent->FirstChildElement(tag); e; e = e->NextSiblingElement(tag)) {
+		TideRoutePoint p;
+		if (e->QueryDoubleAttribute("lat", &p.lat) != TIXML_SUCCESS
+			|| e->QueryDoubleAttribute("lon", &p.lon) != TIXML_SUCCESS)
+			continue;
+		TiXmlElement *name = e->FirstChildElement("name");
+		if (name && name->GetText())
+			p.name = name->GetText();
+		points.push_back(p);
+	}
+}
+
+bool TideLoadGpxRoute(const std::string &filename, std::vector<TideRoutePoint> &points,
+	std::string &error)
+{
+	points.clear();
+
+	TiXmlDocument doc;
+	if (!doc.LoadFile(filename.c_str())) {
+		error = "Unable to read " + filename;
+		return false;
+	}
+
+	TiXmlElement *root = doc.RootElement();
+	if (!root || root->ValueStr() != "gpx") {
+		error = filename + " is not a GPX file";
+		return false;
+	}
+
+	if (TiXmlElement *rte = root->FirstChildElement("rte"))
+		ReadPoints(rte, "rtept", points);
+	else if (TiXmlElement *trk = root->FirstChildElement("trk")) {
+		for (TiXmlElement *seg = trk->FirstChildElement("trkseg"); seg; seg = seg->NextSiblingElement("trkseg"))
+			ReadPoints(seg, "trkpt", points);
+	}
+	else
+		ReadPoints(root, "wpt", points);
+
+	for (size_t i = 0; i < points.size(); i++)
+		if (points[i].name.empty())
+			points[i].name = "WP" + std::to_string(i + 1);
+
+	if (points.size() < 2) {
+		error = filename + " has no route with two or more points";
+		return false;
+	}
+	return true;
+}
+
+TideRouteEvaluator::TideRouteEvaluator(int threads)
+	: m_pool(threads), m_maxDist(30)
+{
+}
+
+void TideRouteEvaluator::SetStations(const std::vector<TideRouteStation> &stations, double maxDistNm)
+{
+	m_stations = stations;
+	m_maxDist = maxDistNm;
+	AssignStations();
+}
+
+void TideRouteEvaluator::SetRoute(const std::vector<TideRoutePoint> &points, double sampleNm)
+{
+	m_points = points;
+	m_samples.clear();
+
+	double along = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		TideRouteSample s;
+		s.lat = points[i].lat;
+		s.lon = points[i].lon;
+		s.distNm = along;
+		s.leg = (int)i;
+		s.waypoint = (int)i;
+		s.station = -1;
+		s.eta = 0;
+		s.height = NAN;
+		m_samples.push_back(s);
+
+		if (i + 1 == points.size())
+			break;
+
+		// Legs are short enough that interpolating lat/lon is close to the
+		// rhumb line the boat actually sails
+		const TideRoutePoint &a = points[i];
+		const TideRoutePoint &b = points[i + 1];
+		double leg = TideDistanceNm(a.lat, a.lon, b.lat, b.lon);
+		int steps = sampleNm > 0 ? (int)ceil(leg / sampleNm) : 1;
+		for (int k = 1; k < steps; k++) {
+			double f = (double)k / steps;
+			s.lat = a.lat + (b.lat - a.lat) * f;
+			s.lon = a.lon + (b.lon - a.lon) * f;
+			s.distNm = along + leg * f;
+			s.waypoint = -1;
+			m_samples.push_back(s);
+		}
+		along += leg;
+	}
+
+	AssignStations();
+}
+
+void TideRouteEvaluator::AssignStations()
+{
+	for (size_t i = 0; i < m_samples.size(); i++) {
+		TideRouteSample &s = m_samples[i];
+		s.station = -1;
+		double best = m_maxDist;
+		for (size_t k = 0; k < m_stations.size(); k++) {
+			double d = TideDistanceNm(s.lat, s.lon, m_stations[k].lat, m_stations[k].lon);
+			if (d <= best) {
+				best = d;
+				s.station = (int)k;
+			}
+		}
+	}
+
+	m_order.clear();
+	for (size_t i = 0; i < m_samples.size(); i++)
+		if (m_samples[i].station >= 0)
+			m_order.push_back((uint32_t)i);
+	std::stable_sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+		return m_samples[a].station < m_samples[b].station;
+	});
+
+	// Long runs near one station are split so they still spread out
+	const size_t maxBatch = 256;
+	m_batches.clear();
+	for (size_t k = 0; k < m_order.size(); k++)
+		if (k == 0 || m_samples[m_order[k]].station != m_samples[m_order[k - 1]].station
+			|| k - m_batches.back() >= maxBatch)
+			m_batches.push_back(k);
+	m_batches.push_back(m_order.size());
+}
+
+void TideRouteEvaluator::Evaluate(time_t departure, double speedKn)
+{
+	double secsPerNm = speedKn > 0 ? 3600.0 / speedKn : 0;
+	for (size_t i = 0; i < m_samples.size(); i++) {
+		m_samples[i].eta = departure + (time_t)(m_samples[i].distNm * secsPerNm + 0.5);
+		m_samples[i].height = NAN;
+	}
+
+	// A predictor caches per-year factors, so each batch gets its own
+	for (size_t b = 0; b + 1 < m_batches.size(); b++) {
+		size_t begin = m_batches[b], end = m_batches[b + 1];
+		m_pool.Submit([this, begin, end]() {
+			TidePredictor predictor(m_stations[m_samples[m_order[begin]].station].harmonics);
+			for (size_t k = begin; k < end; k++) {
+				TideRouteSample &s = m_samples[m_order[k]];
+				s.height = predictor.Height(s.eta);
+			}
+		});
+	}
+	m_pool.Wait();
+}
@@ -0,0 +1,114 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEROUTE_H_
+#define _TIDEROUTE_H_
+
+#include <ctime>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "harmonics.h"
+#include "tidegeo.h"
+#include "tidepool.h"
+
+/*
+ * Predicted heights along a route.
+ *
+ * A route is sampled once: every waypoint plus points along each leg,
+ * each tied to the nearest station with harmonics. Planning a departure
+ * and speed then only moves the ETAs and recomputes heights, batched per
+ * station across a thread pool, so a new speed costs milliseconds.
+ */
+
+struct TideRoutePoint
+{
+	double lat;
+	double lon;
+	std::string name;
+};
+
+struct TideRouteStation
+{
+	std::string id;
+	std::string name;
+	double lat;
+	double lon;
+	TideHarmonics harmonics;
+};
+
+struct TideRouteSample
+{
+	double lat;
+	double lon;
+	double distNm;    // along the route from the first waypoint
+	int leg;          // index of the waypoint the leg starts from
+	int waypoint;     // waypoint index, or -1 inside a leg
+	int station;      // nearest station, or -1 if none is close enough
+	time_t eta;
+	double height;    // NaN without a station
+};
+
+// Reads the first <rte> of a GPX file, falling back to the first track or
+// to the waypoints.
+bool TideLoadGpxRoute(const std::string &filename, std::vector<TideRoutePoint> &points,
+	std::string &error);
+
+class TideRouteEvaluator
+{
+public:
+	// threads <= 0 means one per core.
+	explicit TideRouteEvaluator(int threads = 0);
+
+	void SetStations(const std::vector<TideRouteStation> &stations, double maxDistNm = 30);
+	// Samples every leg at most sampleNm apart.
+	void SetRoute(const std::vector<TideRoutePoint> &points, double sampleNm = 1);
+
+	void Evaluate(time_t departure, double speedKn);
+
+	const std::vector<TideRoutePoint> &Points() const { return m_points; }
+	const std::vector<TideRouteStation> &Stations() const { return m_stations; }
+	const std::vector<TideRouteSample> &Samples() const { return m_samples; }
+	TideThreadPool &Pool() { return m_pool; }
+	// Jobs Evaluate() submits to the pool.
+	size_t BatchCount() const { return m_batches.empty() ? 0 : m_batches.size() - 1; }
+
+private:
+	void AssignStations();
+
+	TideThreadPool m_pool;
+	std::vector<TideRouteStation> m_stations;
+	double m_maxDist;
+	std::vector<TideRoutePoint> m_points;
+	std::vector<TideRouteSample> m_samples;
+	// Sample indices grouped by station, one batch per station
+	std::vector<uint32_t> m_order;
+	std::vector<size_t> m_batches;
+};
+
+#endif
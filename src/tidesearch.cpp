@@ -0,0 +1,185 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidesearch.h"
+
+#include <algorithm>
+#include <utility>
+
+// Latin-1 supplement, U+00C0 to U+00FF, folded. Upper and lower case
+// halves share the table.
+static const char *s_latin1[32] = {
+	"a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+	"d", "n", "o", "o", "o", "o", "o", " ", "o", "u", "u", "u", "u", "y", "th", "ss"
+};
+
+std::string TideFoldName(const std::string &utf8)
+{
+	std::string out;
+	out.reserve(utf8.size());
+
+	for (size_t i = 0; i < utf8.size(); i++) {
+		unsigned char c = (unsigned char)utf8[i];
+		const char *fold = NULL;
+		std::string raw;
+
+		if (c < 0x80) {
+			if (c >= 'A' && c <= 'Z')
+				raw.assign(1, (char)(c - 'A' + 'a'));
+			else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+				raw.assign(1, (char)c);
+			else
+				fold = " ";
+		}
+		else if (c == 0xc3 && i + 1 < utf8.size()) {
+			unsigned char d = (unsigned char)utf8[++i];
+			fold = d == 0xb7 ? " " : d == 0xbf ? "y" : s_latin1[(d - 0x80) & 0x1f];
+		}
+		else if (c == 0xc5 && i + 1 < utf8.size() && ((unsigned char)utf8[i + 1] == 0x92 || (unsigned char)utf8[i + 1] == 0x93)) {
+			i++;
+			fold = "oe";
+		}
+		else {
+			// Anything else is kept as is, so it still matches itself
+			size_t len = c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+			raw = utf8.substr(i, len);
+			i += raw.size() - 1;
+		}
+
+		const std::string piece = fold ? std::string(fold) : raw;
+		if (piece == " ") {
+			if (!out.empty() && out[out.size() - 1] != ' ')
+				out += ' ';
+		}
+		else
+			out += piece;
+	}
+
+	if (!out.empty() && out[out.size() - 1] == ' ')
+		out.erase(out.size() - 1);
+	return out;
+}
+
+static inline uint32_t Trigram(const std::string &s, size_t i)
+{
+	return ((uint32_t)(unsigned char)s[i] << 16) | ((uint32_t)(unsigned char)s[i + 1] << 8)
+		| (uint32_t)(unsigned char)s[i + 2];
+}
+
+static bool StartsWord(const std::string &name, const std::string &query)
+{
+	for (size_t p = name.find(query); p != std::string::npos; p = name.find(query, p + 1))
+		if (p == 0 || name[p - 1] == ' ')
+			return true;
+	return false;
+}
+
+void TideSearchIndex::Build(const TideStationStore &store)
+{
+	std::vector<std::pair<std::string, uint32_t> > names(store.Size());
+	for (size_t i = 0; i < store.Size(); i++)
+		names[i] = std::make_pair(TideFoldName(store.Name(i)), (uint32_t)i);
+	std::sort(names.begin(), names.end());
+
+	m_folded.resize(names.size());
+	m_station.resize(names.size());
+	m_trigrams.clear();
+	for (size_t r = 0; r < names.size(); r++) {
+		m_folded[r].swap(names[r].first);
+		m_station[r] = names[r].second;
+
+		const std::string &name = m_folded[r];
+		for (size_t i = 0; i + 3 <= name.size(); i++) {
+			std::vector<uint32_t> &ranks = m_trigrams[Trigram(name, i)];
+			if (ranks.empty() || ranks.back() != r)
+				ranks.push_back((uint32_t)r);
+		}
+	}
+
+	m_valid = false;
+	m_query.clear();
+}
+
+void TideSearchIndex::Lookup(const std::string &folded)
+{
+	m_ranks.clear();
+
+	if (folded.size() < 3) {
+		for (size_t r = 0; r < m_folded.size(); r++)
+			if (folded.empty() || m_folded[r].find(folded) != std::string::npos)
+				m_ranks.push_back((uint32_t)r);
+		return;
+	}
+
+	// Candidates come from the rarest trigram of the query
+	const std::vector<uint32_t> *best = NULL;
+	for (size_t i = 0; i + 3 <= folded.size(); i++) {
+		std::unordered_map<uint32_t, std::vector<uint32_t> >::const_iterator it = m_trigrams.find(Trigram(folded, i));
+		if (it == m_trigrams.end())
+			return;
+		if (!best || it->second.size() < best->size())
+			best = &it->second;
+	}
+
+	for (size_t k = 0; k < best->size(); k++)
+		if (m_folded[(*best)[k]].find(folded) != std::string::npos)
+			m_ranks.push_back((*best)[k]);
+}
+
+const std::vector<uint32_t> &TideSearchIndex::Filter(const std::string &query)
+{
+	std::string folded = TideFoldName(query);
+
+	if (m_valid && folded == m_query)
+		return m_result;
+
+	if (m_valid && !m_query.empty() && folded.compare(0, m_query.size(), m_query) == 0) {
+		// A longer query can only match a subset of the last one
+		size_t n = 0;
+		for (size_t k = 0; k < m_ranks.size(); k++)
+			if (m_folded[m_ranks[k]].find(folded) != std::string::npos)
+				m_ranks[n++] = m_ranks[k];
+		m_ranks.resize(n);
+	}
+	else
+		Lookup(folded);
+
+	m_query = folded;
+	m_valid = true;
+
+	m_result.clear();
+	m_result.reserve(m_ranks.size());
+	for (size_t k = 0; k < m_ranks.size(); k++)
+		if (folded.empty() || StartsWord(m_folded[m_ranks[k]], folded))
+			m_result.push_back(m_station[m_ranks[k]]);
+	if (!folded.empty())
+		for (size_t k = 0; k < m_ranks.size(); k++)
+			if (!StartsWord(m_folded[m_ranks[k]], folded))
+				m_result.push_back(m_station[m_ranks[k]]);
+
+	return m_result;
+}
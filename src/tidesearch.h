@@ -0,0 +1,78 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDESEARCH_H_
+#define _TIDESEARCH_H_
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tidestations.h"
+
+/*
+ * Filter-as-you-type search over station names.
+ *
+ * Names are folded to lower case ASCII with accents removed, so "levis"
+ * finds "Lévis". Every trigram of a folded name points at the names
+ * containing it; a query looks up its rarest trigram and checks only
+ * those candidates. Typing more characters narrows the previous result
+ * rather than searching again.
+ */
+
+// Lower case, accent-free form of a UTF-8 name. Punctuation becomes a
+// single space.
+std::string TideFoldName(const std::string &utf8);
+
+class TideSearchIndex
+{
+public:
+	TideSearchIndex() : m_valid(false) {}
+
+	void Build(const TideStationStore &store);
+	size_t Size() const { return m_folded.size(); }
+
+	// Station indices whose name contains the query, names where it
+	// starts a word first, each group in alphabetical order. An empty
+	// query matches every station.
+	const std::vector<uint32_t> &Filter(const std::string &query);
+
+private:
+	void Lookup(const std::string &folded);
+
+	std::vector<std::string> m_folded;      // by alphabetical rank
+	std::vector<uint32_t> m_station;        // rank -> station index
+	std::unordered_map<uint32_t, std::vector<uint32_t> > m_trigrams;   // -> ranks
+
+	std::string m_query;
+	bool m_valid;
+	std::vector<uint32_t> m_ranks;
+	std::vector<uint32_t> m_result;
+};
+
+#endif
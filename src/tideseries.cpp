@@ -0,0 +1,210 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideseries.h"
+#include "tidetrace.h"
+#include "tidetime.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include "json/reader.h"
+
+static bool SampleBefore(const TideSample &a, const TideSample &b) { return a.t < b.t; }
+
+const char *TideSeriesCode(TideSeriesKind kind)
+{
+	switch (kind) {
+	case TSK_WLP: return "wlp";
+	case TSK_WLO: return "wlo";
+	case TSK_WLP_HILO: return "wlp-hilo";
+	case TSK_WCS: return "wcs1";
+	case TSK_WCD: return "wcd1";
+	default: return "";
+	}
+}
+
+void TideSeries::Merge(const std::vector<TideSample> &samples)
+{
+	if (samples.empty())
+		return;
+
+	// The common case is new data strictly after what we hold
+	if (m_samples.empty() || samples.front().t > m_samples.back().t) {
+		m_samples.insert(m_samples.end(), samples.begin(), samples.end());
+		return;
+	}
+
+	std::vector<TideSample> merged;
+	merged.reserve(m_samples.size() + samples.size());
+
+	size_t i = 0, j = 0;
+	while (i < m_samples.size() || j < samples.size()) {
+		if (j == samples.size() || (i < m_samples.size() && m_samples[i].t < samples[j].t))
+			merged.push_back(m_samples[i++]);
+		else {
+			if (i < m_samples.size() && m_samples[i].t == samples[j].t)
+				i++;
+			merged.push_back(samples[j++]);
+		}
+	}
+	m_samples.swap(merged);
+}
+
+void TideSeries::TrimBefore(time_t t)
+{
+	TideSample key;
+	key.t = t;
+	key.v = 0;
+	std::vector<TideSample>::iterator it = std::lower_bound(m_samples.begin(), m_samples.end(), key, SampleBefore);
+	m_samples.erase(m_samples.begin(), it);
+}
+
+bool TideSeries::Interpolate(time_t t, double *v) const
+{
+	if (m_samples.empty() || t < m_samples.front().t || t > m_samples.back().t)
+		return false;
+
+	TideSample key;
+	key.t = t;
+	key.v = 0;
+	std::vector<TideSample>::const_iterator hi = std::lower_bound(m_samples.begin(), m_samples.end(), key, SampleBefore);
+
+	if (hi->t == t || hi == m_samples.begin()) {
+		*v = hi->v;
+		return true;
+	}
+
+	std::vector<TideSample>::const_iterator lo = hi - 1;
+	double f = (double)(t - lo->t) / (double)(hi->t - lo->t);
+	*v = lo->v + f * (hi->v - lo->v);
+	return true;
+}
+
+bool TideSeries::InterpolateAngle(time_t t, double *deg) const
+{
+	if (m_samples.empty() || t < m_samples.front().t || t > m_samples.back().t)
+		return false;
+
+	TideSample key;
+	key.t = t;
+	key.v = 0;
+	std::vector<TideSample>::const_iterator hi = std::lower_bound(m_samples.begin(), m_samples.end(), key, SampleBefore);
+
+	if (hi->t == t || hi == m_samples.begin()) {
+		*deg = hi->v;
+		return true;
+	}
+
+	std::vector<TideSample>::const_iterator lo = hi - 1;
+	double diff = fmod(hi->v - lo->v + 540.0, 360.0) - 180.0;
+	double f = (double)(t - lo->t) / (double)(hi->t - lo->t);
+	*deg = fmod(lo->v + f * diff + 360.0, 360.0);
+	return true;
+}
+
+TideRingBuffer::TideRingBuffer(size_t capacity)
+	: m_buf(capacity ? capacity : 1), m_head(0), m_size(0)
+{
+}
+
+bool TideRingBuffer::Push(const TideSample &s)
+{
+	if (m_size && s.t <= Last().t)
+		return false;
+
+	if (m_size < m_buf.size()) {
+		m_buf[(m_head + m_size) % m_buf.size()] = s;
+		m_size++;
+	}
+	else {
+		m_buf[m_head] = s;
+		m_head = (m_head + 1) % m_buf.size();
+	}
+	return true;
+}
+
+TideSeries &TideSeriesStore::Get(const std::string &stationId, TideSeriesKind kind)
+{
+	return m_series[std::make_pair(stationId, (int)kind)];
+}
+
+const TideSeries *TideSeriesStore::Find(const std::string &stationId, TideSeriesKind kind) const
+{
+	std::map<std::pair<std::string, int>, TideSeries>::const_iterator it =
+		m_series.find(std::make_pair(stationId, (int)kind));
+	return it == m_series.end() ? NULL : &it->second;
+}
+
+void TideSeriesStore::Remove(const std::string &stationId)
+{
+	for (int k = 0; k < TSK_COUNT; k++)
+		m_series.erase(std::make_pair(stationId, k));
+}
+
+void TideSamplesFromJson(const Json::Value &events, std::vector<TideSample> &samples)
+{
+	samples.clear();
+	samples.reserve(events.size());
+	bool sorted = true;
+
+	for (Json::ArrayIndex i = 0; i < events.size(); i++) {
+		const Json::Value &e = events[i];
+		if (!e.isMember("value") || e["value"].isNull())
+			continue;
+
+		TideSample s;
+		if (!TideParseISO(e.get("eventDate", "").asString().c_str(), &s.t))
+			continue;
+		s.v = e["value"].asDouble();
+
+		if (!samples.empty() && s.t <= samples.back().t)
+			sorted = false;
+		samples.push_back(s);
+	}
+
+	if (!sorted)
+		std::stable_sort(samples.begin(), samples.end(), SampleBefore);
+}
+
+bool TideParseSeries(const char *begin, const char *end,
+	std::vector<TideSample> &samples, std::string &error)
+{
+	TIDE_TRACE_SCOPE("TideParseSeries");
+	Json::Value root;
+	Json::Reader reader;
+
+	samples.clear();
+
+	if (!reader.parse(begin, end, root, false) || !root.isArray()) {
+		error = "Unable to parse json";
+		return false;
+	}
+
+	TideSamplesFromJson(root, samples);
+	return true;
+}
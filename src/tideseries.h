@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDESERIES_H_
+#define _TIDESERIES_H_
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Typed time series as published by IWLS: one value per timestamp, kept
+ * sorted in a contiguous array so lookups are a binary search.
+ */
+
+enum TideSeriesKind {
+	TSK_WLP = 0,   // predicted water level
+	TSK_WLO,       // observed water level
+	TSK_WLP_HILO,  // predicted highs and lows
+	TSK_WCS,       // current speed, knots
+	TSK_WCD,       // current direction, degrees true the current sets to
+	TSK_COUNT
+};
+
+// IWLS time-series-code for a kind, e.g. "wlo".
+const char *TideSeriesCode(TideSeriesKind kind);
+
+struct TideSample
+{
+	time_t t;
+	double v;
+};
+
+class TideSeries
+{
+public:
+	TideSeries() {}
+
+	void Clear() { m_samples.clear(); }
+	void Swap(std::vector<TideSample> &samples) { m_samples.swap(samples); }
+
+	// Merges samples (sorted by time) into the series, replacing values
+	// at timestamps already present.
+	void Merge(const std::vector<TideSample> &samples);
+
+	// Drops samples before t.
+	void TrimBefore(time_t t);
+
+	// Linear interpolation; false outside the covered range.
+	bool Interpolate(time_t t, double *v) const;
+	// As Interpolate() for bearings in degrees, taking the short way
+	// round through north.
+	bool InterpolateAngle(time_t t, double *deg) const;
+
+	size_t Size() const { return m_samples.size(); }
+	bool Empty() const { return m_samples.empty(); }
+	const TideSample &operator[](size_t i) const { return m_samples[i]; }
+	const std::vector<TideSample> &Samples() const { return m_samples; }
+	time_t Begin() const { return m_samples.empty() ? 0 : m_samples.front().t; }
+	time_t End() const { return m_samples.empty() ? 0 : m_samples.back().t; }
+
+private:
+	std::vector<TideSample> m_samples;
+};
+
+/*
+ * Fixed-capacity series for live data: once full, each new sample
+ * overwrites the oldest one, so memory does not grow with session length.
+ */
+class TideRingBuffer
+{
+public:
+	explicit TideRingBuffer(size_t capacity = 1440);
+
+	// Appends s if newer than the last sample. Returns false otherwise.
+	bool Push(const TideSample &s);
+
+	size_t Size() const { return m_size; }
+	size_t Capacity() const { return m_buf.size(); }
+	bool Empty() const { return m_size == 0; }
+
+	// 0 is the oldest sample still held.
+	const TideSample &At(size_t i) const { return m_buf[(m_head + i) % m_buf.size()]; }
+	const TideSample &Last() const { return At(m_size - 1); }
+
+private:
+	std::vector<TideSample> m_buf;
+	size_t m_head;
+	size_t m_size;
+};
+
+// Series keyed by station id and kind.
+class TideSeriesStore
+{
+public:
+	TideSeries &Get(const std::string &stationId, TideSeriesKind kind);
+	const TideSeries *Find(const std::string &stationId, TideSeriesKind kind) const;
+	void Remove(const std::string &stationId);
+	void Clear() { m_series.clear(); }
+	void Swap(TideSeriesStore &other) { m_series.swap(other.m_series); }
+
+private:
+	std::map<std::pair<std::string, int>, TideSeries> m_series;
+};
+
+namespace Json { class Value; }
+
+// Parses an IWLS /data response body into samples sorted by time.
+// Entries without a value are skipped.
+bool TideParseSeries(const char *begin, const char *end,
+	std::vector<TideSample> &samples, std::string &error);
+void TideSamplesFromJson(const Json::Value &events, std::vector<TideSample> &samples);
+
+#endif
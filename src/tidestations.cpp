@@ -0,0 +1,337 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidestations.h"
+#include "tidegeo.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+TideStringPool::TideStringPool()
+	: m_count(0)
+{
+	m_slots.resize(64, 0);
+}
+
+void TideStringPool::Clear()
+{
+	m_chars.clear();
+	m_slots.assign(64, 0);
+	m_count = 0;
+}
+
+// FNV-1a
+uint32_t TideStringPool::Hash(const char *s, size_t n)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < n; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+void TideStringPool::Rehash(size_t slots)
+{
+	std::vector<uint32_t> old;
+	old.swap(m_slots);
+	m_slots.assign(slots, 0);
+
+	size_t mask = slots - 1;
+	for (size_t i = 0; i < old.size(); i++) {
+		if (!old[i])
+			continue;
+		const char *s = &m_chars[old[i] - 1];
+		size_t k = Hash(s, strlen(s)) & mask;
+		while (m_slots[k])
+			k = (k + 1) & mask;
+		m_slots[k] = old[i];
+	}
+}
+
+bool TideStringPool::Find(const std::string &s, uint32_t *offset) const
+{
+	size_t mask = m_slots.size() - 1;
+	for (size_t k = Hash(s.data(), s.size()) & mask; m_slots[k]; k = (k + 1) & mask) {
+		const char *p = &m_chars[m_slots[k] - 1];
+		if (strlen(p) == s.size() && !memcmp(p, s.data(), s.size())) {
+			*offset = m_slots[k] - 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t TideStringPool::Intern(const std::string &s)
+{
+	uint32_t offset;
+	if (Find(s, &offset))
+		return offset;
+
+	offset = (uint32_t)m_chars.size();
+	m_chars.insert(m_chars.end(), s.begin(), s.end());
+	m_chars.push_back(0);
+
+	if (++m_count * 2 > m_slots.size())
+		Rehash(m_slots.size() * 2);
+
+	size_t mask = m_slots.size() - 1;
+	size_t k = Hash(s.data(), s.size()) & mask;
+	while (m_slots[k])
+		k = (k + 1) & mask;
+	m_slots[k] = offset + 1;
+
+	return offset;
+}
+
+void TideStationStore::Clear()
+{
+	m_pool.Reset();
+	m_id.Reset();
+	m_name.Reset();
+	m_lat.Reset();
+	m_lon.Reset();
+	m_flags.Reset();
+	m_downloaded.Reset();
+	m_eventPage.Reset();
+	m_eventBegin.Reset();
+	m_eventCount.Reset();
+	m_pages.clear();
+	m_liveEvents = 0;
+	m_garbage = 0;
+}
+
+size_t TideStationStore::Add(const std::string &id, const std::string &name,
+	double lat, double lon, unsigned flags)
+{
+	m_id.Write().push_back(Intern(id));
+	m_name.Write().push_back(Intern(name));
+	m_lat.Write().push_back(lat);
+	m_lon.Write().push_back(lon);
+	m_flags.Write().push_back((uint8_t)flags);
+	m_downloaded.Write().push_back(0);
+	if (m_pages.empty())
+		m_pages.push_back(std::make_shared<EventPage>());
+	m_eventPage.Write().push_back(0);
+	m_eventBegin.Write().push_back(0);
+	m_eventCount.Write().push_back(0);
+	return m_id->size() - 1;
+}
+
+void TideStationStore::Remove(size_t i)
+{
+	m_garbage += (*m_eventCount)[i];
+	m_liveEvents -= (*m_eventCount)[i];
+
+	m_id.Write().erase(m_id->begin() + i);
+	m_name.Write().erase(m_name->begin() + i);
+	m_lat.Write().erase(m_lat->begin() + i);
+	m_lon.Write().erase(m_lon->begin() + i);
+	m_flags.Write().erase(m_flags->begin() + i);
+	m_downloaded.Write().erase(m_downloaded->begin() + i);
+	m_eventPage.Write().erase(m_eventPage->begin() + i);
+	m_eventBegin.Write().erase(m_eventBegin->begin() + i);
+	m_eventCount.Write().erase(m_eventCount->begin() + i);
+
+	if (m_garbage > m_liveEvents)
+		CompactEvents();
+}
+
+int TideStationStore::Find(const std::string &id) const
+{
+	uint32_t offset;
+	if (!m_pool->Find(id, &offset))
+		return -1;
+	const std::vector<uint32_t> &ids = *m_id;
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (ids[i] == offset)
+			return (int)i;
+	}
+	return -1;
+}
+
+int TideStationStore::FindName(const std::string &name) const
+{
+	uint32_t offset;
+	if (!m_pool->Find(name, &offset))
+		return -1;
+	const std::vector<uint32_t> &names = *m_name;
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == offset)
+			return (int)i;
+	}
+	return -1;
+}
+
+int TideStationStore::Nearest(double lat, double lon) const
+{
+	// Equirectangular distance is plenty to rank stations near a click
+	const double coslat = cos(lat * TIDE_DEG2RAD);
+	const double *plat = m_lat->data();
+	const double *plon = m_lon->data();
+
+	int best = -1;
+	double bestd = 0;
+	for (size_t i = 0, n = m_lat->size(); i < n; i++) {
+		double dy = plat[i] - lat;
+		double dx = (plon[i] - lon) * coslat;
+		double d = dx * dx + dy * dy;
+		if (best < 0 || d < bestd) {
+			best = (int)i;
+			bestd = d;
+		}
+	}
+	return best;
+}
+
+// Looks the string up before writing, so a copy that only reuses
+// existing strings keeps sharing the pool.
+uint32_t TideStationStore::Intern(const std::string &s)
+{
+	uint32_t offset;
+	if (m_pool->Find(s, &offset))
+		return offset;
+	return m_pool.Write().Intern(s);
+}
+
+void TideStationStore::SetEvents(size_t i, const std::vector<TideStationEvent> &events)
+{
+	std::vector<uint32_t> &count = m_eventCount.Write();
+	m_garbage += count[i];
+	m_liveEvents -= count[i];
+
+	// Append to the last page only while no other copy shares it,
+	// otherwise start a new one
+	if (m_pages.empty() || m_pages.back().use_count() > 1)
+		m_pages.push_back(std::make_shared<EventPage>());
+
+	EventPage &page = *m_pages.back();
+	m_eventPage.Write()[i] = (uint32_t)(m_pages.size() - 1);
+	m_eventBegin.Write()[i] = (uint32_t)page.size();
+	count[i] = (uint32_t)events.size();
+	page.insert(page.end(), events.begin(), events.end());
+	m_liveEvents += events.size();
+
+	// Every page beyond one per station holds nothing but garbage, so
+	// either test bounds the copying at the events written since the
+	// last compaction
+	if (m_garbage > m_liveEvents || m_pages.size() > count.size() + 16)
+		CompactEvents();
+}
+
+void TideStationStore::SetEvents(size_t i, const std::vector<TideStationEvent> &events,
+	const TideStringPool &labels)
+{
+	std::vector<TideStationEvent> copy(events);
+	for (size_t k = 0; k < copy.size(); k++)
+		copy[k].type = Intern(labels.Get(copy[k].type));
+	SetEvents(i, copy);
+}
+
+// Gathers the live events into one fresh page.
+void TideStationStore::CompactEvents()
+{
+	std::vector<uint32_t> &pageOf = m_eventPage.Write();
+	std::vector<uint32_t> &beginOf = m_eventBegin.Write();
+	const std::vector<uint32_t> &count = *m_eventCount;
+
+	std::shared_ptr<EventPage> events = std::make_shared<EventPage>();
+	events->reserve(m_liveEvents);
+	for (size_t i = 0; i < beginOf.size(); i++) {
+		const EventPage &page = *m_pages[pageOf[i]];
+		uint32_t begin = (uint32_t)events->size();
+		events->insert(events->end(), page.begin() + beginOf[i],
+			page.begin() + beginOf[i] + count[i]);
+		pageOf[i] = 0;
+		beginOf[i] = begin;
+	}
+	m_pages.assign(1, events);
+	m_garbage = 0;
+}
+
+size_t TideStationStore::MemoryUsed() const
+{
+	return m_pool->Bytes()
+		+ Size() * (5 * sizeof(uint32_t) + 2 * sizeof(double) + sizeof(uint8_t) + sizeof(int64_t))
+		+ (m_liveEvents + m_garbage) * sizeof(TideStationEvent);
+}
+
+void TideStationModel::Update(const std::function<void(TideStationStore &)> &change)
+{
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	std::shared_ptr<TideStationStore> next = std::make_shared<TideStationStore>(*Get());
+	change(*next);
+	std::atomic_store(&m_current, TideStationSnapshot(next));
+}
+
+void TideStationModel::Publish(const std::shared_ptr<TideStationStore> &store)
+{
+	std::lock_guard<std::mutex> lock(m_writeMutex);
+	std::atomic_store(&m_current, TideStationSnapshot(store));
+}
+
+int TideNearestTracker::Update(const TideStationSnapshot &store, double lat, double lon)
+{
+	if (m_radius >= 0 && store == m_store) {
+		double moved = TideDistanceNm(m_lat, m_lon, lat, lon);
+		if (moved <= m_radius) {
+			m_distance = TideDistanceNm(lat, lon, store->Lat(m_nearest), store->Lon(m_nearest));
+			return m_nearest;
+		}
+	}
+
+	m_store = store;
+	m_lat = lat;
+	m_lon = lon;
+	m_queries++;
+
+	int best = -1;
+	double bestd = 0, second = -1;
+	const double *plat = store->Lats();
+	const double *plon = store->Lons();
+	for (size_t i = 0; i < store->Size(); i++) {
+		double d = TideDistanceNm(lat, lon, plat[i], plon[i]);
+		if (best < 0 || d < bestd) {
+			second = best < 0 ? -1 : bestd;
+			best = (int)i;
+			bestd = d;
+		} else if (second < 0 || d < second) {
+			second = d;
+		}
+	}
+
+	m_nearest = best;
+	m_distance = bestd;
+	if (best < 0)
+		m_radius = -1;
+	else if (second < 0)
+		m_radius = 1e9;    // a lone station stays nearest everywhere
+	else
+		m_radius = (second - bestd) / 2;
+	return best;
+}
@@ -0,0 +1,231 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDESTATIONS_H_
+#define _TIDESTATIONS_H_
+
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Station lists in structure-of-arrays form.
+ *
+ * Each attribute is its own contiguous column, so a scan over positions
+ * touches only the coordinates. Strings live once in a shared pool and
+ * are referred to by offset, and the events of all stations sit in one
+ * flat array, each station owning a [begin, begin + count) range.
+ *
+ * The columns, the pool and the event arrays are shared between copies
+ * of a store and never modified once another copy can see them: a copy
+ * that writes a column takes its own copy of that column first, and
+ * changing a station's events starts a new array rather than touching the
+ * shared one. That makes a copy cheap and lets TideStationModel publish
+ * immutable versions.
+ */
+
+class TideStringPool
+{
+public:
+	TideStringPool();
+
+	// Offset of s in the pool, adding it if needed. Equal strings share
+	// one copy.
+	uint32_t Intern(const std::string &s);
+	bool Find(const std::string &s, uint32_t *offset) const;
+	const char *Get(uint32_t offset) const { return &m_chars[offset]; }
+
+	size_t Bytes() const { return m_chars.size(); }
+	void Clear();
+
+private:
+	static uint32_t Hash(const char *s, size_t n);
+	void Rehash(size_t slots);
+
+	std::vector<char> m_chars;       // NUL terminated strings
+	std::vector<uint32_t> m_slots;   // open addressing, offset + 1, 0 free
+	size_t m_count;
+};
+
+enum TideStationFlags {
+	TSF_NONE = 0,
+	TSF_CURRENTS = 1 << 0    // current station rather than water level
+};
+
+struct TideStationEvent
+{
+	int64_t t;       // UTC seconds, 0 when the server had no date
+	float height;    // metres, NaN when unknown
+	uint32_t type;   // pool offset of the event label
+};
+
+// A value shared between copies of its owner until one of them writes it.
+template <class T>
+class TideShared
+{
+public:
+	TideShared() : m_p(std::make_shared<T>()) {}
+
+	const T &operator*() const { return *m_p; }
+	const T *operator->() const { return m_p.get(); }
+	T &Write()
+	{
+		if (m_p.use_count() > 1)
+			m_p = std::make_shared<T>(*m_p);
+		return *m_p;
+	}
+	void Reset() { m_p = std::make_shared<T>(); }
+
+private:
+	std::shared_ptr<T> m_p;
+};
+
+class TideStationStore
+{
+public:
+	TideStationStore() : m_liveEvents(0), m_garbage(0) {}
+
+	size_t Size() const { return m_id->size(); }
+	bool Empty() const { return m_id->empty(); }
+	void Clear();
+
+	size_t Add(const std::string &id, const std::string &name, double lat, double lon,
+		unsigned flags = TSF_NONE);
+	// Keeps the order of the remaining stations. Pool strings are only
+	// released by Clear().
+	void Remove(size_t i);
+
+	int Find(const std::string &id) const;
+	int FindName(const std::string &name) const;
+	// Nearest station to lat, lon, or -1 when empty.
+	int Nearest(double lat, double lon) const;
+
+	const char *Id(size_t i) const { return m_pool->Get((*m_id)[i]); }
+	const char *Name(size_t i) const { return m_pool->Get((*m_name)[i]); }
+	double Lat(size_t i) const { return (*m_lat)[i]; }
+	double Lon(size_t i) const { return (*m_lon)[i]; }
+	unsigned Flags(size_t i) const { return (*m_flags)[i]; }
+	void SetFlags(size_t i, unsigned flags) { m_flags.Write()[i] = (uint8_t)flags; }
+	time_t Downloaded(size_t i) const { return (time_t)(*m_downloaded)[i]; }
+	void SetDownloaded(size_t i, time_t t) { m_downloaded.Write()[i] = t; }
+
+	const double *Lats() const { return m_lat->data(); }
+	const double *Lons() const { return m_lon->data(); }
+
+	void SetEvents(size_t i, const std::vector<TideStationEvent> &events);
+	// As above, with the event labels given as offsets into another pool.
+	void SetEvents(size_t i, const std::vector<TideStationEvent> &events,
+		const TideStringPool &labels);
+	size_t EventCount(size_t i) const { return (*m_eventCount)[i]; }
+	const TideStationEvent *Events(size_t i) const { return m_pages[(*m_eventPage)[i]]->data() + (*m_eventBegin)[i]; }
+
+	uint32_t Intern(const std::string &s);
+	const char *String(uint32_t offset) const { return m_pool->Get(offset); }
+	const TideStringPool &Strings() const { return *m_pool; }
+
+	size_t MemoryUsed() const;
+
+private:
+	void CompactEvents();
+
+	TideShared<TideStringPool> m_pool;
+
+	TideShared<std::vector<uint32_t> > m_id;
+	TideShared<std::vector<uint32_t> > m_name;
+	TideShared<std::vector<double> > m_lat;
+	TideShared<std::vector<double> > m_lon;
+	TideShared<std::vector<uint8_t> > m_flags;
+	TideShared<std::vector<int64_t> > m_downloaded;
+	TideShared<std::vector<uint32_t> > m_eventPage;
+	TideShared<std::vector<uint32_t> > m_eventBegin;
+	TideShared<std::vector<uint32_t> > m_eventCount;
+
+	typedef std::vector<TideStationEvent> EventPage;
+	std::vector<std::shared_ptr<EventPage> > m_pages;
+	size_t m_liveEvents;
+	size_t m_garbage;   // events no longer owned by any station
+};
+
+typedef std::shared_ptr<const TideStationStore> TideStationSnapshot;
+
+/*
+ * Holds the current version of a station store. Readers take a snapshot
+ * without locking and may keep it as long as they like; writers change a
+ * copy and swap it in, so a snapshot never changes under its reader.
+ */
+class TideStationModel
+{
+public:
+	TideStationModel() : m_current(std::make_shared<TideStationStore>()) {}
+
+	TideStationSnapshot Get() const { return std::atomic_load(&m_current); }
+
+	// Applies change to a copy of the current version and publishes it.
+	// Writers are serialised, so concurrent updates are not lost.
+	void Update(const std::function<void(TideStationStore &)> &change);
+	void Publish(const std::shared_ptr<TideStationStore> &store);
+
+private:
+	TideStationSnapshot m_current;
+	std::mutex m_writeMutex;
+};
+
+/*
+ * Nearest station to a moving position, such as own ship.
+ *
+ * A query also finds the runner-up, and the answer holds while the
+ * position stays within half the gap between the two: no other station
+ * can overtake the nearest before then. A fix stream only runs a real
+ * query when the vessel leaves that circle or the snapshot changes.
+ */
+class TideNearestTracker
+{
+public:
+	TideNearestTracker() : m_nearest(-1), m_lat(0), m_lon(0), m_radius(-1), m_distance(0), m_queries(0) {}
+
+	// Nearest station of store to lat, lon, or -1 when it is empty.
+	int Update(const TideStationSnapshot &store, double lat, double lon);
+	void Invalidate() { m_radius = -1; }
+
+	// Distance in nm from the last position to the nearest station.
+	double Distance() const { return m_distance; }
+	size_t Queries() const { return m_queries; }
+
+private:
+	TideStationSnapshot m_store;
+	int m_nearest;
+	double m_lat, m_lon;   // where the last query ran
+	double m_radius;       // nm, negative when nothing is cached
+	double m_distance;
+	size_t m_queries;
+};
+
+#endif
@@ -37,8 +37,120 @@
 
 #include "tidetable.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 
+
+TideEventList::TideEventList(wxWindow* parent, wxWindowID id)
+	: wxListCtrl(parent, id, wxDefaultPosition, wxSize(-1, -1),
+		wxLC_REPORT | wxLC_VIRTUAL | wxLC_HRULES | wxLC_VRULES),
+	m_events(NULL), m_count(0)
+{
+}
+
+static bool SameEvent(const TideStationStore &a, const TideStationEvent &ea,
+	const TideStationStore &b, const TideStationEvent &eb)
+{
+	if (ea.t != eb.t)
+		return false;
+	if (std::isnan(ea.height) != std::isnan(eb.height))
+		return false;
+	if (!std::isnan(ea.height) && ea.height != eb.height)
+		return false;
+	return strcmp(a.String(ea.type), b.String(eb.type)) == 0;
+}
+
+bool TideEventList::SetEvents(const TideStationSnapshot &store, int station)
+{
+	const TideStationEvent *events = NULL;
+	size_t count = 0;
+	std::string name;
+	if (store && station >= 0 && (size_t)station < store->Size()) {
+		count = store->EventCount(station);
+		if (count)
+			events = store->Events(station);
+		name = store->Name(station);
+	}
+
+	bool changed = !m_store || name != m_name;
+
+	// Rows that match what is already on screen are left alone, so a
+	// refresh of the same station repaints only what moved
+	size_t first = 0;
+	if (!changed) {
+		size_t common = (std::min)(count, m_count);
+		while (first < common && SameEvent(*store, events[first], *m_store, m_events[first]))
+			first++;
+	}
+
+	m_store = store;
+	m_events = events;
+	m_name = name;
+	size_t shown = m_count;
+	m_count = count;
+
+	if (changed) {
+		SetItemCount((long)m_count);
+		Refresh();
+		return true;
+	}
+
+	if (m_count != shown)
+		SetItemCount((long)m_count);
+	if (first < m_count)
+		RefreshItems((long)first, (long)m_count - 1);
+	return false;
+}
+
+wxString TideEventList::FormatTime(time_t t)
+{
+	wxDateTime myDateTime(t);
+	return myDateTime.Format(" %a %d-%b-%Y   %H:%M", wxDateTime::UTC);
+}
+
+wxString TideEventList::OnGetItemText(long item, long column) const
+{
+	if (item < 0 || (size_t)item >= m_count)
+		return wxEmptyString;
+
+	const TideStationEvent &ev = m_events[item];
+	switch (column) {
+	case 0:
+		return ev.t ? FormatTime((time_t)ev.t) : wxString("n/a");
+	case 1:
+		return wxString(m_store->String(ev.type), wxConvUTF8);
+	case 2:
+		return std::isnan(ev.height) ? wxString("n/a") : wxString::Format("%4.2f", ev.height);
+	}
+	return wxEmptyString;
+}
+
+// Sizes each column to the widest of its header and a spread of sample
+// rows, rather than measuring every row as wxLIST_AUTOSIZE does.
+void TideEventList::FitColumns()
+{
+	const size_t samples = 32;
+	size_t step = m_count > samples ? m_count / samples : 1;
+	int margin = GetCharWidth() * 2;
+
+	for (int c = 0; c < GetColumnCount(); c++) {
+		wxListItem col;
+		col.SetMask(wxLIST_MASK_TEXT);
+		GetColumn(c, col);
+
+		int w, h;
+		GetTextExtent(col.GetText(), &w, &h);
+		int width = w;
+		for (size_t r = 0; r < m_count; r += step) {
+			GetTextExtent(OnGetItemText((long)r, c), &w, &h);
+			width = (std::max)(width, w);
+		}
+		SetColumnWidth(c, width + margin);
+	}
+}
+
 /*!
  * TideTable type definition
  */
@@ -59,22 +171,6 @@ END_EVENT_TABLE()
  * RouteProp constructors
  */
 
- bool TideTable::instanceFlag = false;
-TideTable* TideTable::single = NULL;
-TideTable* TideTable::getInstance(wxWindow* parent, wxWindowID id, const wxString& title, const wxPoint& pos, const wxSize& size, long style)
-{
-    if(! instanceFlag)
-    {
-		single = new TideTable(parent, id, title, pos, size, style);
-        instanceFlag = true;
-        return single;
-    }
-    else
-    {
-        return single;
-    }
-}
-
 TideTable::TideTable()
 {
 }
@@ -101,11 +197,6 @@ TideTable::TideTable(wxWindow* parent, wxWindowID id, const wxString& caption, c
 TideTable::~TideTable()
 {
     
-    delete m_wpList;
-
-    // delete global print route selection dialog
-   
-    instanceFlag = false;
 }
 
 
@@ -126,8 +217,7 @@ void TideTable::CreateControls()
 	itemBoxSizer1->Add(m_pListSizer, 2, wxEXPAND | wxALL, 1);
 
 	//      Create the list control
-	m_wpList = new wxListCtrl(this, ID_LISTCTRL, wxDefaultPosition, wxSize(-1, -1),
-		wxLC_REPORT | wxLC_HRULES | wxLC_VRULES | wxLC_EDIT_LABELS);
+	m_wpList = new TideEventList(this, ID_LISTCTRL);
 
 	m_wpList->SetMinSize(wxSize(-1, 100));
 	m_pListSizer->Add(m_wpList, 1, wxEXPAND | wxALL, 6);
@@ -38,6 +38,7 @@
 #include <wx/filesys.h>
 #include <wx/clrpicker.h>
 #include "CanadianTidesgui_impl.h"
+#include "tidestations.h"
 
 #if wxCHECK_VERSION(2, 9, 0)
 #include <wx/dialog.h>
@@ -125,6 +126,33 @@
 
 class Dlg;
 
+/*!
+ * Virtual list over one station of a TideStationStore. Rows are
+ * formatted only when the control asks for them.
+ */
+
+class TideEventList: public wxListCtrl
+{
+public:
+	TideEventList(wxWindow* parent, wxWindowID id);
+
+	// Keeps the snapshot alive for as long as it is shown. Returns true
+	// when a different station replaced the one on screen.
+	bool SetEvents(const TideStationSnapshot &store, int station);
+	void FitColumns();
+
+	static wxString FormatTime(time_t t);
+
+protected:
+	wxString OnGetItemText(long item, long column) const;
+
+private:
+	TideStationSnapshot m_store;
+	const TideStationEvent *m_events;
+	size_t m_count;
+	std::string m_name;
+};
+
 /*!
  * RouteProp class declaration
  */
@@ -136,13 +164,7 @@ class TideTable: public wxDialog
 
 public:
     /// Constructors
-	static TideTable* getInstance(wxWindow* parent, wxWindowID id = SYMBOL_ROUTEPROP_IDNAME,
-                                   const wxString& caption = SYMBOL_ROUTEPROP_TITLE,
-                                   const wxPoint& pos = SYMBOL_ROUTEPROP_POSITION,
-                                   const wxSize& size = SYMBOL_ROUTEPROP_SIZE,
-                                   long style = SYMBOL_ROUTEPROP_STYLE );
 	~TideTable();
-    static bool getInstanceFlag(){ return instanceFlag; } 
     
     void CreateControls();
 	
@@ -151,7 +173,7 @@ public:
 	void OnRoutepropDeleteClick(wxCommandEvent& event);
 	void OnRoutepropDeleteAllClick(wxCommandEvent& event);
 
-    wxListCtrl    *m_wpList;
+    TideEventList *m_wpList;
     wxButton*     m_OKButton;
 	wxButton*     m_bDelete;
 	wxButton*     m_bDeleteAll;
@@ -172,9 +194,6 @@ public:
               const wxSize& size = SYMBOL_ROUTEPROP_SIZE,
               long style = SYMBOL_ROUTEPROP_STYLE );
     
-    static bool instanceFlag;
-	static TideTable *single;
-    
 };
 
 
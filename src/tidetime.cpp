@@ -0,0 +1,92 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidetime.h"
+
+#include <stdio.h>
+
+// Howard Hinnant's days_from_civil / civil_from_days.
+static long DaysFromCivil(int y, int m, int d)
+{
+	y -= m <= 2;
+	const long era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = (unsigned)(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long)doe - 719468;
+}
+
+static void CivilFromDays(long z, int *y, int *m, int *d)
+{
+	z += 719468;
+	const long era = (z >= 0 ? z : z - 146096) / 146097;
+	const unsigned doe = (unsigned)(z - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	*d = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*m = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*y = (int)(yoe + era * 400 + (*m <= 2));
+}
+
+time_t TideMakeTimeUTC(int year, int month, int day, int hour, int min, int sec)
+{
+	return (time_t)(DaysFromCivil(year, month, day) * 86400L + hour * 3600L + min * 60L + sec);
+}
+
+void TideSplitUTC(time_t t, int *year, int *month, int *day, int *hour, int *min, int *sec)
+{
+	long days = (long)(t / 86400);
+	long rem = (long)(t % 86400);
+	if (rem < 0) {
+		rem += 86400;
+		days--;
+	}
+	CivilFromDays(days, year, month, day);
+	*hour = (int)(rem / 3600);
+	*min = (int)(rem % 3600 / 60);
+	*sec = (int)(rem % 60);
+}
+
+bool TideParseISO(const char *s, time_t *t)
+{
+	int y, mo, d, h = 0, mi = 0, sec = 0;
+	int n = sscanf(s, "%4d-%2d-%2dT%2d:%2d:%2d", &y, &mo, &d, &h, &mi, &sec);
+	if (n < 5 || mo < 1 || mo > 12 || d < 1 || d > 31)
+		return false;
+	*t = TideMakeTimeUTC(y, mo, d, h, mi, sec);
+	return true;
+}
+
+std::string TideFormatISO(time_t t)
+{
+	int y, mo, d, h, mi, sec;
+	TideSplitUTC(t, &y, &mo, &d, &h, &mi, &sec);
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", y, mo, d, h, mi, sec);
+	return buf;
+}
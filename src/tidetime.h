@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDETIME_H_
+#define _TIDETIME_H_
+
+#include <ctime>
+#include <string>
+
+/*
+ * UTC helpers for IWLS timestamps ("2021-03-04T05:06:07Z"). These do not
+ * depend on the process time zone, so they are safe to call from worker
+ * threads where wxDateTime formatting is not.
+ */
+
+// Seconds since the epoch for a UTC calendar date and time.
+time_t TideMakeTimeUTC(int year, int month, int day, int hour, int min, int sec);
+
+// Parses "YYYY-MM-DDTHH:MM[:SS][.fff][Z]". Returns false on malformed input.
+bool TideParseISO(const char *s, time_t *t);
+
+// Formats as "YYYY-MM-DDTHH:MM:SSZ".
+std::string TideFormatISO(time_t t);
+
+void TideSplitUTC(time_t t, int *year, int *month, int *day, int *hour, int *min, int *sec);
+
+#endif
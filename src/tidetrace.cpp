@@ -0,0 +1,216 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tidetrace.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+#define TRACE_BUFFER_EVENTS 65536
+
+std::atomic<bool> g_tideTraceOn(false);
+
+namespace {
+
+struct TraceEvent
+{
+	const char *name;
+	int64_t begin;
+	int64_t end;
+};
+
+// Written only by the thread that owns it; count is published with
+// release so a reader sees every event below it, and a new epoch is
+// published with release after count is reset.
+struct TraceBuffer
+{
+	TraceBuffer(int tid) : tid(tid), count(0), dropped(0), epoch(0), owned(true) {}
+
+	int tid;
+	TraceEvent events[TRACE_BUFFER_EVENTS];
+	std::atomic<size_t> count;
+	std::atomic<size_t> dropped;
+	std::atomic<unsigned> epoch;
+	std::atomic<bool> owned;
+};
+
+std::mutex s_buffersMutex;
+std::vector<TraceBuffer *> s_buffers;
+std::atomic<unsigned> s_epoch(0);
+
+// Hands the buffer back for reuse by a later thread
+struct BufferOwner
+{
+	TraceBuffer *buffer;
+	BufferOwner() : buffer(NULL) {}
+	~BufferOwner()
+	{
+		if (buffer)
+			buffer->owned.store(false);
+	}
+};
+
+thread_local BufferOwner t_owner;
+
+TraceBuffer *ThreadBuffer()
+{
+	if (t_owner.buffer)
+		return t_owner.buffer;
+
+	std::lock_guard<std::mutex> lock(s_buffersMutex);
+	for (size_t i = 0; i < s_buffers.size(); i++) {
+		if (!s_buffers[i]->owned.load()) {
+			s_buffers[i]->owned.store(true);
+			t_owner.buffer = s_buffers[i];
+			return t_owner.buffer;
+		}
+	}
+	t_owner.buffer = new TraceBuffer((int)s_buffers.size() + 1);
+	s_buffers.push_back(t_owner.buffer);
+	return t_owner.buffer;
+}
+
+}
+
+int64_t TideTraceNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TideTraceRecord(const char *name, int64_t begin, int64_t end)
+{
+	TraceBuffer *b = ThreadBuffer();
+
+	// Start() only bumps the epoch, the owner empties its own buffer
+	unsigned epoch = s_epoch.load(std::memory_order_acquire);
+	if (b->epoch.load(std::memory_order_relaxed) != epoch) {
+		b->count.store(0, std::memory_order_relaxed);
+		b->dropped.store(0, std::memory_order_relaxed);
+		b->epoch.store(epoch, std::memory_order_release);
+	}
+
+	size_t n = b->count.load(std::memory_order_relaxed);
+	if (n == TRACE_BUFFER_EVENTS) {
+		b->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	TraceEvent &ev = b->events[n];
+	ev.name = name;
+	ev.begin = begin;
+	ev.end = end;
+	b->count.store(n + 1, std::memory_order_release);
+}
+
+void TideTraceStart()
+{
+	s_epoch.fetch_add(1, std::memory_order_release);
+	g_tideTraceOn.store(true);
+}
+
+void TideTraceStop()
+{
+	g_tideTraceOn.store(false);
+}
+
+static void WriteEscaped(std::ostream &out, const char *s)
+{
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			out << '\\' << *s;
+		else if ((unsigned char)*s >= 0x20)
+			out << *s;
+	}
+}
+
+// Events of b recorded in epoch. The epoch is read again after count, so
+// a count left over from an earlier trace is never used.
+static size_t EpochCount(const TraceBuffer *b, unsigned epoch)
+{
+	if (b->epoch.load(std::memory_order_acquire) != epoch)
+		return 0;
+	size_t n = b->count.load(std::memory_order_acquire);
+	if (b->epoch.load(std::memory_order_acquire) != epoch)
+		return 0;
+	return n;
+}
+
+bool TideTraceWrite(const std::string &filename, std::string &error)
+{
+	std::ofstream out(filename.c_str());
+	if (!out) {
+		error = "cannot write " + filename;
+		return false;
+	}
+
+	unsigned epoch = s_epoch.load(std::memory_order_acquire);
+	size_t dropped = 0;
+	bool first = true;
+	int64_t origin = -1;
+
+	std::lock_guard<std::mutex> lock(s_buffersMutex);
+
+	// Timestamps are relative to the first span, in microseconds
+	std::vector<size_t> counts(s_buffers.size());
+	for (size_t i = 0; i < s_buffers.size(); i++) {
+		TraceBuffer *b = s_buffers[i];
+		size_t n = counts[i] = EpochCount(b, epoch);
+		for (size_t k = 0; k < n; k++)
+			if (origin < 0 || b->events[k].begin < origin)
+				origin = b->events[k].begin;
+	}
+
+	out << "{\"traceEvents\":[";
+	char buf[96];
+	for (size_t i = 0; i < s_buffers.size(); i++) {
+		TraceBuffer *b = s_buffers[i];
+		size_t n = counts[i];
+		if (!n)
+			continue;
+		dropped += b->dropped.load(std::memory_order_relaxed);
+
+		for (size_t k = 0; k < n; k++) {
+			const TraceEvent &ev = b->events[k];
+			out << (first ? "\n" : ",\n") << "{\"name\":\"";
+			WriteEscaped(out, ev.name);
+			snprintf(buf, sizeof(buf), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				b->tid, (ev.begin - origin) / 1000.0, (ev.end - ev.begin) / 1000.0);
+			out << buf;
+			first = false;
+		}
+	}
+	out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":" << dropped << "}}\n";
+
+	if (!out) {
+		error = "cannot write " + filename;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDETRACE_H_
+#define _TIDETRACE_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+/*
+ * Scoped timing spans, written out as Chrome trace-event JSON (load the
+ * file in chrome://tracing or ui.perfetto.dev).
+ *
+ *   void Dlg::OnDownload(...) { TIDE_TRACE_SCOPE("OnDownload"); ... }
+ *
+ * Every thread appends to its own fixed size buffer without locking, so
+ * spans on worker threads cost the same as on the UI thread. While
+ * tracing is off a span is a single relaxed atomic load. Start, stop and
+ * write from one thread; spans still open on other threads when tracing
+ * stops are dropped.
+ */
+
+extern std::atomic<bool> g_tideTraceOn;
+
+inline bool TideTraceEnabled() { return g_tideTraceOn.load(std::memory_order_relaxed); }
+
+// Discards anything recorded so far and starts recording.
+void TideTraceStart();
+void TideTraceStop();
+
+// Writes the recorded spans. Spans that did not fit the buffers are
+// counted in the file's "dropped" metadata.
+bool TideTraceWrite(const std::string &filename, std::string &error);
+
+int64_t TideTraceNow();
+// Records a span; name must outlive the trace, normally a literal.
+void TideTraceRecord(const char *name, int64_t begin, int64_t end);
+
+class TideTraceScope
+{
+public:
+	explicit TideTraceScope(const char *name)
+		: m_name(TideTraceEnabled() ? name : NULL), m_begin(m_name ? TideTraceNow() : 0) {}
+	~TideTraceScope()
+	{
+		if (m_name && TideTraceEnabled())
+			TideTraceRecord(m_name, m_begin, TideTraceNow());
+	}
+
+private:
+	TideTraceScope(const TideTraceScope &);
+	TideTraceScope &operator=(const TideTraceScope &);
+
+	const char *m_name;
+	int64_t m_begin;
+};
+
+#define TIDE_TRACE_CONCAT2(a, b) a##b
+#define TIDE_TRACE_CONCAT(a, b) TIDE_TRACE_CONCAT2(a, b)
+#define TIDE_TRACE_SCOPE(name) TideTraceScope TIDE_TRACE_CONCAT(tideTraceScope, __LINE__)(name)
+
+#endif
@@ -0,0 +1,130 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "tideworker.h"
+
+TideWorker::TideWorker()
+	: m_running(false), m_stop(false), m_pending(0)
+{
+}
+
+TideWorker::~TideWorker()
+{
+	Stop();
+}
+
+void TideWorker::Start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running)
+		return;
+	m_stop = false;
+	m_running = true;
+	m_thread = std::thread(&TideWorker::Run, this);
+}
+
+void TideWorker::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+			return;
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_running = false;
+	m_jobs.clear();
+	m_finished.clear();
+	m_pending = 0;
+}
+
+void TideWorker::Submit(const Job &job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+		m_pending++;
+	}
+	m_cv.notify_one();
+}
+
+void TideWorker::Post(const Finish &step)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_finished.push_back(step);
+	m_pending++;
+}
+
+size_t TideWorker::RunFinished()
+{
+	std::deque<Finish> finished;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		finished.swap(m_finished);
+	}
+
+	// Unlocked, so a finish step may submit further jobs
+	for (size_t i = 0; i < finished.size(); i++) {
+		if (finished[i])
+			finished[i]();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_pending -= finished.size();
+	return finished.size();
+}
+
+size_t TideWorker::Pending() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending;
+}
+
+void TideWorker::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+		if (m_stop)
+			return;
+
+		Job job;
+		job.swap(m_jobs.front());
+		m_jobs.pop_front();
+
+		lock.unlock();
+		Finish finish = job();
+		job = Job();
+		lock.lock();
+
+		m_finished.push_back(Finish());
+		m_finished.back().swap(finish);
+	}
+}
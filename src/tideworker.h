@@ -0,0 +1,81 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _TIDEWORKER_H_
+#define _TIDEWORKER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+ * One background thread for slow dialog work: downloads and fits that
+ * would otherwise stall the UI. A job runs on the worker and returns the
+ * step that publishes its result; the owner calls RunFinished() from its
+ * own thread (a timer in the dialog) to run those steps, so results only
+ * ever touch the owner's state on the owner's thread.
+ */
+
+class TideWorker
+{
+public:
+	typedef std::function<void()> Finish;
+	typedef std::function<Finish()> Job;
+
+	TideWorker();
+	~TideWorker();
+
+	void Start();
+	// Waits for the running job; queued jobs and unrun results are dropped.
+	void Stop();
+
+	void Submit(const Job &job);
+	// From a running job: queues a step for the owner, such as progress.
+	// It runs before the job's own finish step.
+	void Post(const Finish &step);
+	// Runs the finish steps of completed jobs, oldest first. Returns how
+	// many ran.
+	size_t RunFinished();
+	// Jobs submitted whose finish step has not yet run.
+	size_t Pending() const;
+
+private:
+	void Run();
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+	bool m_running;
+	bool m_stop;
+	std::deque<Job> m_jobs;
+	std::deque<Finish> m_finished;
+	size_t m_pending;
+};
+
+#endif
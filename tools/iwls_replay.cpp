@@ -0,0 +1,504 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * iwls_replay: record/replay stand-in for the IWLS web api.
+ *
+ * Replay mode serves recorded responses from a cassette file on a loopback
+ * port, with optional latency, bandwidth throttling and error injection:
+ *
+ *   iwls_replay --cassette iwls.json --port 8642 --latency-ms 80 \
+ *               --rate-kbps 256 --error-rate 0.05
+ *
+ * Record mode forwards every request to the real server and appends
+ * successful answers to the cassette; errors are passed on to the client
+ * but not recorded (requires a build with libcurl):
+ *
+ *   iwls_replay --cassette iwls.json --record
+ *
+ * Point the plugin at it by setting ApiBaseUrl in the [Settings/CanadianTides_pi]
+ * section of opencpn.conf to http://127.0.0.1:8642/api/v1
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "json/reader.h"
+#include "json/writer.h"
+
+#include "tidefetch.h"
+
+#ifdef CANADIANTIDES_USE_ZLIB
+#include <zlib.h>
+#endif
+
+struct ReplayOptions
+{
+	std::string cassette;
+	std::string upstream;
+	int port;
+	bool record;
+	bool exact;
+	bool gzip;
+	int latencyMs;
+	int rateKbps;
+	double errorRate;
+	double dropRate;
+	unsigned seed;
+};
+
+struct Recording
+{
+	int status;
+	std::string contentType;
+	std::string body;
+};
+
+static std::atomic<bool> s_quit(false);
+
+static void OnSignal(int) { s_quit = true; }
+
+// Requests carry a "from"/"to" window computed from the clock, so by default
+// those are ignored when matching and the recording for the same station and
+// series is served whatever the dates.
+static std::string RequestKey(const std::string &target, bool exact)
+{
+	size_t q = target.find('?');
+	std::string path = target.substr(0, q);
+	if (q == std::string::npos)
+		return path;
+
+	std::vector<std::string> params;
+	std::stringstream ss(target.substr(q + 1));
+	std::string param;
+	while (std::getline(ss, param, '&')) {
+		if (param.empty())
+			continue;
+		std::string name = param.substr(0, param.find('='));
+		if (!exact && (name == "from" || name == "to"))
+			continue;
+		params.push_back(param);
+	}
+	std::sort(params.begin(), params.end());
+
+	std::string key = path;
+	for (size_t i = 0; i < params.size(); i++)
+		key += (i == 0 ? "?" : "&") + params[i];
+	return key;
+}
+
+class Cassette
+{
+public:
+	bool Load(const std::string &filename)
+	{
+		m_filename = filename;
+		std::ifstream in(filename.c_str(), std::ios::binary);
+		if (!in)
+			return false;
+
+		Json::Value root;
+		Json::Reader reader;
+		if (!reader.parse(in, root, false))
+			return false;
+
+		const Json::Value &entries = root["entries"];
+		for (Json::ArrayIndex i = 0; i < entries.size(); i++) {
+			Recording rec;
+			rec.status = entries[i].get("status", 200).asInt();
+			rec.contentType = entries[i].get("contentType", "application/json").asString();
+			rec.body = entries[i]["body"].asString();
+			m_entries[entries[i]["key"].asString()] = rec;
+		}
+		return true;
+	}
+
+	bool Find(const std::string &key, Recording &rec)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::map<std::string, Recording>::const_iterator it = m_entries.find(key);
+		if (it == m_entries.end())
+			return false;
+		rec = it->second;
+		return true;
+	}
+
+	void Add(const std::string &key, const Recording &rec)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[key] = rec;
+		SaveLocked();
+	}
+
+	size_t Size() const { return m_entries.size(); }
+
+private:
+	void SaveLocked()
+	{
+		Json::Value root;
+		Json::Value &entries = root["entries"];
+		entries = Json::Value(Json::arrayValue);
+		for (std::map<std::string, Recording>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+			Json::Value e;
+			e["key"] = it->first;
+			e["status"] = it->second.status;
+			e["contentType"] = it->second.contentType;
+			e["body"] = it->second.body;
+			entries.append(e);
+		}
+
+		std::string tmp = m_filename + ".tmp";
+		std::ofstream out(tmp.c_str(), std::ios::binary);
+		Json::StyledStreamWriter writer;
+		writer.write(out, root);
+		out.close();
+		rename(tmp.c_str(), m_filename.c_str());
+	}
+
+	std::string m_filename;
+	std::map<std::string, Recording> m_entries;
+	std::mutex m_mutex;
+};
+
+static bool Gzip(const std::string &in, std::string &out)
+{
+#ifdef CANADIANTIDES_USE_ZLIB
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	out.resize(deflateBound(&zs, (uLong)in.size()));
+	zs.next_in = (Bytef *)in.data();
+	zs.avail_in = (uInt)in.size();
+	zs.next_out = (Bytef *)&out[0];
+	zs.avail_out = (uInt)out.size();
+	int rc = deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	return rc == Z_STREAM_END;
+#else
+	(void)in;
+	(void)out;
+	return false;
+#endif
+}
+
+static bool SendAll(int fd, const char *data, size_t len, int rateKbps)
+{
+	// Throttle by sending slices sized for 50 ms of the configured rate
+	size_t slice = rateKbps > 0 ? std::max<size_t>(1, (size_t)rateKbps * 1024 / 20) : len;
+
+	while (len > 0) {
+		size_t n = std::min(slice, len);
+		ssize_t sent = send(fd, data, n, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		data += sent;
+		len -= (size_t)sent;
+		if (rateKbps > 0 && len > 0) {
+			// A throttled body would hold up the join at shutdown
+			if (s_quit)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	}
+	return true;
+}
+
+static void SendResponse(int fd, int status, const std::string &contentType,
+	const std::string &body, bool gzipped, int rateKbps)
+{
+	const char *reason = status == 200 ? "OK" : status == 404 ? "Not Found" :
+		status == 429 ? "Too Many Requests" : status >= 500 ? "Server Error" : "Error";
+
+	std::ostringstream hdr;
+	hdr << "HTTP/1.1 " << status << " " << reason << "\r\n"
+		<< "Content-Type: " << contentType << "\r\n"
+		<< "Content-Length: " << body.size() << "\r\n";
+	if (gzipped)
+		hdr << "Content-Encoding: gzip\r\n";
+	hdr << "Connection: close\r\n\r\n";
+
+	std::string h = hdr.str();
+	if (SendAll(fd, h.data(), h.size(), 0))
+		SendAll(fd, body.data(), body.size(), rateKbps);
+}
+
+static void HandleClient(int fd, const ReplayOptions &opt, Cassette &cassette, unsigned seed)
+{
+	std::string request;
+	char buf[4096];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < 65536) {
+		ssize_t n = recv(fd, buf, sizeof(buf), 0);
+		if (n <= 0)
+			break;
+		request.append(buf, (size_t)n);
+	}
+
+	std::istringstream line(request.substr(0, request.find("\r\n")));
+	std::string method, target;
+	line >> method >> target;
+
+	bool acceptGzip = request.find("gzip") != std::string::npos;
+
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> dice(0.0, 1.0);
+
+	if (opt.latencyMs > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(opt.latencyMs));
+
+	if (method != "GET") {
+		SendResponse(fd, 405, "text/plain", "Only GET is supported\n", false, 0);
+		close(fd);
+		return;
+	}
+
+	if (dice(rng) < opt.dropRate) {
+		std::cerr << "drop  " << target << std::endl;
+		close(fd);
+		return;
+	}
+
+	if (dice(rng) < opt.errorRate) {
+		int status = dice(rng) < 0.5 ? 500 : 429;
+		std::cerr << status << "   " << target << std::endl;
+		SendResponse(fd, status, "application/json", "{\"message\":\"injected error\"}", false, 0);
+		close(fd);
+		return;
+	}
+
+	std::string key = RequestKey(target, opt.exact);
+	Recording rec;
+	bool found = cassette.Find(key, rec);
+
+	if (!found && opt.record) {
+		TideFetchResult res = TideFetchUrl(opt.upstream + target, 30);
+		if (res.status == TF_OK && res.httpCode >= 200 && res.httpCode < 300) {
+			rec.status = (int)res.httpCode;
+			rec.contentType = "application/json";
+			rec.body.swap(res.body);
+			cassette.Add(key, rec);
+			found = true;
+			std::cerr << "rec   " << target << std::endl;
+		}
+		else if (res.httpCode) {
+			// Relayed so the client sees what upstream said, but a retry goes upstream again
+			std::cerr << res.httpCode << "   " << target << " (not recorded)" << std::endl;
+			SendResponse(fd, (int)res.httpCode, "application/json", res.body, false, 0);
+			close(fd);
+			return;
+		}
+		else {
+			std::cerr << "fail  " << target << ": " << res.error << std::endl;
+		}
+	}
+
+	if (!found) {
+		std::cerr << "miss  " << target << std::endl;
+		SendResponse(fd, 404, "application/json", "{\"message\":\"not recorded\"}", false, 0);
+		close(fd);
+		return;
+	}
+
+	std::string zipped;
+	bool gz = opt.gzip && acceptGzip && Gzip(rec.body, zipped);
+	SendResponse(fd, rec.status, rec.contentType, gz ? zipped : rec.body, gz, opt.rateKbps);
+	close(fd);
+}
+
+// Connection threads. Finished ones are joined when the next connection
+// arrives and the rest at shutdown, so none outlives the options and the
+// cassette they were handed.
+class ClientThreads
+{
+public:
+	~ClientThreads() { JoinAll(); }
+
+	void Start(int fd, const ReplayOptions &opt, Cassette &cassette, unsigned seed)
+	{
+		Reap();
+		m_threads.push_back(std::thread([this, fd, &opt, &cassette, seed]() {
+			HandleClient(fd, opt, cassette, seed);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_finished.push_back(std::this_thread::get_id());
+		}));
+	}
+
+	void JoinAll()
+	{
+		for (size_t i = 0; i < m_threads.size(); i++)
+			m_threads[i].join();
+		m_threads.clear();
+		m_finished.clear();
+	}
+
+private:
+	void Reap()
+	{
+		std::vector<std::thread::id> finished;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			finished.swap(m_finished);
+		}
+		for (size_t k = 0; k < finished.size(); k++) {
+			for (size_t i = 0; i < m_threads.size(); i++) {
+				if (m_threads[i].get_id() == finished[k]) {
+					m_threads[i].join();
+					m_threads.erase(m_threads.begin() + i);
+					break;
+				}
+			}
+		}
+	}
+
+	std::vector<std::thread> m_threads;   // only touched by the accept loop
+	std::mutex m_mutex;
+	std::vector<std::thread::id> m_finished;
+};
+
+static void Usage()
+{
+	std::cerr <<
+		"usage: iwls_replay --cassette FILE [options]\n"
+		"  --port N          listen on 127.0.0.1:N (default 8642)\n"
+		"  --record          forward misses upstream and record them\n"
+		"  --upstream URL    origin to record from (default https://api-iwls.dfo-mpo.gc.ca)\n"
+		"  --exact           match from/to query parameters too\n"
+		"  --gzip            gzip responses when the client accepts it\n"
+		"  --latency-ms N    delay before each response\n"
+		"  --rate-kbps N     throttle response bodies to N KiB/s\n"
+		"  --error-rate P    answer 500/429 with probability P\n"
+		"  --drop-rate P     close the connection with probability P\n"
+		"  --seed N          seed for error injection\n";
+}
+
+int main(int argc, char **argv)
+{
+	ReplayOptions opt;
+	opt.upstream = "https://api-iwls.dfo-mpo.gc.ca";
+	opt.port = 8642;
+	opt.record = false;
+	opt.exact = false;
+	opt.gzip = false;
+	opt.latencyMs = 0;
+	opt.rateKbps = 0;
+	opt.errorRate = 0.0;
+	opt.dropRate = 0.0;
+	opt.seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "--cassette" && hasValue) opt.cassette = argv[++i];
+		else if (a == "--port" && hasValue) opt.port = atoi(argv[++i]);
+		else if (a == "--upstream" && hasValue) opt.upstream = argv[++i];
+		else if (a == "--latency-ms" && hasValue) opt.latencyMs = atoi(argv[++i]);
+		else if (a == "--rate-kbps" && hasValue) opt.rateKbps = atoi(argv[++i]);
+		else if (a == "--error-rate" && hasValue) opt.errorRate = atof(argv[++i]);
+		else if (a == "--drop-rate" && hasValue) opt.dropRate = atof(argv[++i]);
+		else if (a == "--seed" && hasValue) opt.seed = (unsigned)atoi(argv[++i]);
+		else if (a == "--record") opt.record = true;
+		else if (a == "--exact") opt.exact = true;
+		else if (a == "--gzip") opt.gzip = true;
+		else {
+			Usage();
+			return 2;
+		}
+	}
+
+	if (opt.cassette.empty()) {
+		Usage();
+		return 2;
+	}
+
+	if (opt.record && !TideFetchAvailable()) {
+		std::cerr << "iwls_replay: built without libcurl, --record is not available" << std::endl;
+		return 1;
+	}
+
+	Cassette cassette;
+	if (!cassette.Load(opt.cassette) && !opt.record) {
+		std::cerr << "iwls_replay: cannot read " << opt.cassette << std::endl;
+		return 1;
+	}
+
+	int srv = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+	setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((unsigned short)opt.port);
+
+	if (bind(srv, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(srv, 64) != 0) {
+		std::cerr << "iwls_replay: cannot listen on port " << opt.port << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	// No SA_RESTART, so a signal interrupts accept() and ends the loop
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = OnSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	std::cerr << "iwls_replay: " << cassette.Size() << " recordings, serving http://127.0.0.1:"
+		<< opt.port << "/api/v1" << (opt.record ? " (recording)" : "") << std::endl;
+
+	ClientThreads clients;
+	unsigned n = 0;
+	while (!s_quit) {
+		int fd = accept(srv, NULL, NULL);
+		if (fd < 0)
+			continue;
+		clients.Start(fd, opt, cassette, opt.seed + n++);
+	}
+
+	close(srv);
+	clients.JoinAll();
+	return 0;
+}
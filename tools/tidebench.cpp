@@ -0,0 +1,449 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+/*
+ * tidebench: microbenchmarks of the plugin's hot paths on synthetic
+ * station sets, written as JSON so runs can be compared:
+ *
+ *   tidebench > before.json
+ *   tidebench --sizes 1000,100000 --filter xml --repeats 9
+ *
+ * Every case runs in batches of at least --min-time ms. The result holds
+ * the best and the median batch in nanoseconds per operation; n is the
+ * number of stations (or events, for events_json) in the data set.
+ * predict_week and extrema_month time one station per operation.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "json/reader.h"
+#include "json/value.h"
+#include "json/writer.h"
+
+#include "NavFunc.h"
+#include "harmonics.h"
+#include "tidecatalog.h"
+#include "tideextrema.h"
+#include "tidesearch.h"
+#include "tidestations.h"
+#include "tidetime.h"
+
+struct BenchOptions
+{
+	std::vector<int> sizes;
+	std::string filter;
+	std::string out;
+	std::string dir;
+	double minMs;
+	int repeats;
+	unsigned seed;
+};
+
+struct BenchResult
+{
+	double bestNs;
+	double medianNs;
+	long long iterations;
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+static void Usage()
+{
+	std::cerr <<
+		"usage: tidebench [options]\n"
+		"  --sizes N,N...    station counts (default 10,100,1000,10000,100000)\n"
+		"  --filter TEXT     only run cases whose name contains TEXT\n"
+		"  --min-time MS     shortest timed batch (default 50)\n"
+		"  --repeats N       timed batches per case (default 5)\n"
+		"  --seed N          synthetic data seed (default 1)\n"
+		"  --dir DIR         where the xml cases write (default .)\n"
+		"  --out FILE        write the JSON there instead of stdout\n";
+}
+
+// Runs op(iterations) until one batch takes minMs, then times repeats batches.
+static BenchResult Measure(const BenchOptions &opt, const std::function<void(long long)> &op)
+{
+	long long n = 1;
+	double ms = 0;
+	for (;;) {
+		BenchClock::time_point t0 = BenchClock::now();
+		op(n);
+		ms = std::chrono::duration<double, std::milli>(BenchClock::now() - t0).count();
+		if (ms >= opt.minMs || n >= (1LL << 40))
+			break;
+		n = ms > 0 ? std::max(n * 2, (long long)(n * opt.minMs * 1.2 / ms)) : n * 100;
+	}
+
+	std::vector<double> perOp;
+	perOp.push_back(ms * 1e6 / n);
+	for (int r = 1; r < opt.repeats; r++) {
+		BenchClock::time_point t0 = BenchClock::now();
+		op(n);
+		perOp.push_back(std::chrono::duration<double, std::nano>(BenchClock::now() - t0).count() / n);
+	}
+	std::sort(perOp.begin(), perOp.end());
+
+	BenchResult res = { perOp.front(), perOp[perOp.size() / 2], n };
+	return res;
+}
+
+// Keeps results alive so the timed loops are not optimised away
+static volatile double s_sink;
+
+struct Dataset
+{
+	TideStationStore store;
+	std::vector<TideHarmonics> harmonics;
+	std::vector<double> qlat, qlon;
+	std::string stationsJson;
+	std::string eventsJson;
+};
+
+static void BuildDataset(int n, unsigned seed, Dataset &d)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> lat(43.0, 50.0), lon(-70.0, -55.0), unit(0.0, 1.0);
+	time_t from = TideMakeTimeUTC(2021, 3, 1, 0, 0, 0);
+
+	TideStringPool labels;
+	uint32_t flag = labels.Intern("1");
+	std::vector<TideStationEvent> events;
+
+	Json::Value list(Json::arrayValue);
+	for (int i = 0; i < n; i++) {
+		std::string id = "5cebf1de3d0f4a073c4b" + std::to_string(100000 + i);
+		std::string name = "Station " + std::to_string(i) + " Harbour";
+		double la = lat(rng), lo = lon(rng);
+		size_t k = d.store.Add(id, name, la, lo);
+		d.store.SetDownloaded(k, from);
+
+		// A week of highs and lows, as getHWLW saves them
+		events.clear();
+		for (int e = 0; e < 28; e++) {
+			TideStationEvent ev = { (int64_t)(from + e * 22357), (float)(2.5 + 2 * sin(e * 0.5 + i)), flag };
+			events.push_back(ev);
+		}
+		d.store.SetEvents(k, events, labels);
+
+		Json::Value s;
+		s["id"] = id;
+		s["code"] = std::to_string(i);
+		s["officialName"] = name;
+		s["latitude"] = la;
+		s["longitude"] = lo;
+		s["type"] = "PERMANENT";
+		list.append(s);
+	}
+
+	for (int q = 0; q < 4096; q++) {
+		d.qlat.push_back(lat(rng));
+		d.qlon.push_back(lon(rng));
+	}
+
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	d.stationsJson = Json::writeString(builder, list);
+
+	Json::Value ev(Json::arrayValue);
+	for (int e = 0; e < n; e++) {
+		Json::Value v;
+		v["eventDate"] = TideFormatISO(from + e * 22357);
+		v["qcFlagCode"] = e % 50 ? "1" : "4";
+		v["value"] = 2.5 + 2 * sin(e * 0.5);
+		v["timeSeriesId"] = "5d9dd7cc33a9f593161c3ffc";
+		ev.append(v);
+	}
+	d.eventsJson = Json::writeString(builder, ev);
+
+	// Harmonics from their own stream, so the stations above stay the same
+	std::mt19937 hrng(seed + 1);
+	const char *names[] = { "M2", "S2", "N2", "K2", "K1", "O1", "P1", "M4" };
+	for (int i = 0; i < n; i++) {
+		TideHarmonics h;
+		h.stationId = d.store.Id(i);
+		h.name = d.store.Name(i);
+		h.z0 = 2 * unit(hrng);
+		h.fitted = 0;
+		for (size_t k = 0; k < sizeof(names) / sizeof(names[0]); k++) {
+			TideConstituent c = { TideConstituentIndex(names[k]), 1.5 * unit(hrng) / (k + 1), 360 * unit(hrng) };
+			h.constituents.push_back(c);
+		}
+		d.harmonics.push_back(h);
+	}
+}
+
+// Linear great circle scan, how station lookup worked before TideStationStore::Nearest
+static int ScanNearest(const TideStationStore &store, double lat, double lon)
+{
+	int best = -1;
+	double bestDist = 1e30;
+	for (size_t i = 0; i < store.Size(); i++) {
+		double d = DistGreatCircle(lat, lon, store.Lat(i), store.Lon(i));
+		if (d < bestDist) {
+			bestDist = d;
+			best = (int)i;
+		}
+	}
+	return best;
+}
+
+static bool ParseSizes(const char *s, std::vector<int> &sizes)
+{
+	sizes.clear();
+	while (*s) {
+		char *end;
+		long v = strtol(s, &end, 10);
+		if (end == s || v < 1)
+			return false;
+		sizes.push_back((int)v);
+		s = *end == ',' ? end + 1 : end;
+		if (*end && *end != ',')
+			return false;
+	}
+	return !sizes.empty();
+}
+
+int main(int argc, char **argv)
+{
+	BenchOptions opt;
+	int defaults[] = { 10, 100, 1000, 10000, 100000 };
+	opt.sizes.assign(defaults, defaults + 5);
+	opt.dir = ".";
+	opt.minMs = 50;
+	opt.repeats = 5;
+	opt.seed = 1;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "--sizes" && hasValue) {
+			if (!ParseSizes(argv[++i], opt.sizes)) {
+				Usage();
+				return 2;
+			}
+		}
+		else if (a == "--filter" && hasValue) opt.filter = argv[++i];
+		else if (a == "--min-time" && hasValue) opt.minMs = std::max(1.0, atof(argv[++i]));
+		else if (a == "--repeats" && hasValue) opt.repeats = std::max(1, atoi(argv[++i]));
+		else if (a == "--seed" && hasValue) opt.seed = (unsigned)atoi(argv[++i]);
+		else if (a == "--dir" && hasValue) opt.dir = argv[++i];
+		else if (a == "--out" && hasValue) opt.out = argv[++i];
+		else {
+			Usage();
+			return 2;
+		}
+	}
+
+	Json::Value cases(Json::arrayValue);
+	bool failed = false;
+
+	auto run = [&](const std::string &name, int n, const std::function<void(long long)> &op) {
+		if (!opt.filter.empty() && name.find(opt.filter) == std::string::npos)
+			return;
+		BenchResult r = Measure(opt, op);
+		Json::Value c;
+		c["name"] = name;
+		c["n"] = n;
+		c["iterations"] = (Json::Int64)r.iterations;
+		c["best_ns"] = r.bestNs;
+		c["median_ns"] = r.medianNs;
+		cases.append(c);
+		fprintf(stderr, "%-20s %8d %14.1f ns/op\n", name.c_str(), n, r.medianNs);
+	};
+
+	// Size independent kernels
+	run("navfunc_greatcircle", 1, [](long long iters) {
+		double sum = 0;
+		for (long long i = 0; i < iters; i++)
+			sum += DistGreatCircle(44.6 + (i & 255) * 1e-3, -63.5, 47.5, -52.7 + (i & 127) * 1e-3);
+		s_sink = sum;
+	});
+	run("navfunc_mercator", 1, [](long long iters) {
+		double sum = 0, dist, brg;
+		for (long long i = 0; i < iters; i++) {
+			DistanceBearingMercator(44.6 + (i & 255) * 1e-3, -63.5, 47.5, -52.7 + (i & 127) * 1e-3, &dist, &brg);
+			sum += dist + brg;
+		}
+		s_sink = sum;
+	});
+	run("time_format_iso", 1, [](long long iters) {
+		size_t sum = 0;
+		for (long long i = 0; i < iters; i++)
+			sum += TideFormatISO((time_t)(1614556800 + i * 97)).size();
+		s_sink = (double)sum;
+	});
+	run("time_parse_iso", 1, [](long long iters) {
+		time_t t, sum = 0;
+		for (long long i = 0; i < iters; i++) {
+			TideParseISO((i & 1) ? "2021-03-04T05:06:07Z" : "2021-11-30T23:59Z", &t);
+			sum += t;
+		}
+		s_sink = (double)sum;
+	});
+
+	for (size_t s = 0; s < opt.sizes.size(); s++) {
+		int n = opt.sizes[s];
+		Dataset d;
+		BuildDataset(n, opt.seed, d);
+
+		run("nearest", n, [&](long long iters) {
+			long long sum = 0;
+			for (long long i = 0; i < iters; i++)
+				sum += d.store.Nearest(d.qlat[i & 4095], d.qlon[i & 4095]);
+			s_sink = (double)sum;
+		});
+		run("nearest_scan", n, [&](long long iters) {
+			long long sum = 0;
+			for (long long i = 0; i < iters; i++)
+				sum += ScanNearest(d.store, d.qlat[i & 4095], d.qlon[i & 4095]);
+			s_sink = (double)sum;
+		});
+		run("find_id", n, [&](long long iters) {
+			long long sum = 0;
+			for (long long i = 0; i < iters; i++)
+				sum += d.store.Find(d.store.Id((size_t)(i * 7919) % d.store.Size()));
+			s_sink = (double)sum;
+		});
+		run("stations_json", n, [&](long long iters) {
+			for (long long i = 0; i < iters; i++) {
+				TideStationStore store;
+				std::string error;
+				if (!TideParseStationList(d.stationsJson.data(), d.stationsJson.data() + d.stationsJson.size(),
+						store, TSF_NONE, error) || store.Size() != d.store.Size())
+					failed = true;
+			}
+		});
+		run("events_json", n, [&](long long iters) {
+			for (long long i = 0; i < iters; i++) {
+				Json::Reader reader;
+				Json::Value value;
+				TideStringPool labels;
+				std::vector<TideStationEvent> events;
+				if (!reader.parse(d.eventsJson, value, false))
+					failed = true;
+				TideEventsFromJson(value, labels, events);
+				if (events.size() != (size_t)n)
+					failed = true;
+			}
+		});
+
+		run("search_build", n, [&](long long iters) {
+			size_t sum = 0;
+			for (long long i = 0; i < iters; i++) {
+				TideSearchIndex index;
+				index.Build(d.store);
+				sum += index.Size();
+			}
+			s_sink = (double)sum;
+		});
+		TideSearchIndex index;
+		index.Build(d.store);
+		run("search_filter", n, [&](long long iters) {
+			size_t sum = 0;
+			for (long long i = 0; i < iters; i++)
+				sum += index.Filter((i & 1) ? "station 12" : "sta").size();
+			s_sink = (double)sum;
+		});
+
+		// Per station: a week of heights at 15 minutes, a month of highs and lows
+		time_t from = TideMakeTimeUTC(2021, 3, 1, 0, 0, 0);
+		run("predict_week", n, [&](long long iters) {
+			std::vector<double> heights(7 * 24 * 4);
+			double sum = 0;
+			for (long long i = 0; i < iters; i++) {
+				TidePredictor predictor(d.harmonics[(size_t)i % d.harmonics.size()]);
+				predictor.Heights(from, 900, heights.size(), heights.data());
+				sum += heights.back();
+			}
+			s_sink = sum;
+		});
+		run("extrema_month", n, [&](long long iters) {
+			std::vector<TideExtremum> extrema;
+			size_t sum = 0;
+			for (long long i = 0; i < iters; i++) {
+				TideHarmonicCurve curve(d.harmonics[(size_t)i % d.harmonics.size()]);
+				extrema.clear();
+				TideFindExtrema(curve, from, from + 30 * 86400, 900, extrema);
+				sum += extrema.size();
+			}
+			s_sink = (double)sum;
+		});
+
+		std::string filename = opt.dir + "/tidebench-" + std::to_string(n) + ".xml";
+		run("xml_save", n, [&](long long iters) {
+			for (long long i = 0; i < iters; i++)
+				if (!TideSaveEventsXml(filename, d.store, TideEventsXmlFormat()))
+					failed = true;
+		});
+		run("xml_load", n, [&](long long iters) {
+			for (long long i = 0; i < iters; i++) {
+				TideStationStore loaded;
+				std::string error;
+				if (!TideLoadEventsXml(filename, loaded, TideEventsXmlFormat(), error) ||
+						loaded.Size() != d.store.Size()) {
+					std::cerr << "tidebench: " << filename << ": " << error << std::endl;
+					failed = true;
+					return;
+				}
+			}
+		});
+		remove(filename.c_str());
+	}
+
+	Json::Value root;
+	root["benchmark"] = "tidebench";
+	root["time"] = TideFormatISO(time(NULL));
+	root["seed"] = opt.seed;
+	root["min_time_ms"] = opt.minMs;
+	root["repeats"] = opt.repeats;
+	root["cases"] = cases;
+
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "  ";
+	std::string text = Json::writeString(builder, root) + "\n";
+	if (opt.out.empty())
+		std::cout << text;
+	else {
+		std::ofstream out(opt.out.c_str());
+		out << text;
+		if (!out) {
+			std::cerr << "tidebench: cannot write " << opt.out << std::endl;
+			return 1;
+		}
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,398 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * tidecli: the plugin's data, network and prediction code without a GUI.
+ *
+ *   tidecli stations --region ATL
+ *   tidecli fetch --region ATL --days 7 --saved tidalevents.xml
+ *   tidecli fit --station 5cebf1de3d0f4a073c4bb94f --harmonics harmonics.xml
+ *   tidecli predict --harmonics harmonics.xml --station 5cebf1de3d0f4a073c4bb94f --extremes
+ *   tidecli export --harmonics harmonics.xml --year 2025 --format json --out tables
+ *
+ * The files are the ones the plugin keeps in its data directory, so they
+ * can be prepared here and copied across. --api points at another server,
+ * such as iwls_replay.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "json/value.h"
+
+#include "harmonics.h"
+#include "tidealmanac.h"
+#include "tidecatalog.h"
+#include "tideextrema.h"
+#include "tidefetch.h"
+#include "tidepager.h"
+#include "tidepool.h"
+#include "tidestations.h"
+#include "tidetime.h"
+#include "tidetrace.h"
+
+struct CliOptions
+{
+	std::string api;
+	std::string region;
+	std::vector<std::string> stations;
+	std::string saved;
+	std::string harmonics;
+	std::string out;
+	std::string format;
+	std::string trace;
+	time_t from;
+	int days;
+	int hours;
+	int step;
+	int year;
+	int threads;
+	bool currents;
+	bool extremes;
+};
+
+static void Usage()
+{
+	std::cerr <<
+		"usage: tidecli [--api URL] [--threads N] [--trace FILE] COMMAND [options]\n"
+		"  stations --region R [--currents]\n"
+		"        list the stations of a CHS region as CSV\n"
+		"  fetch (--region R | --station ID...) [--days N] [--saved FILE]\n"
+		"        download highs and lows into a tidalevents.xml\n"
+		"  fit --station ID... [--harmonics FILE]\n"
+		"        fit harmonics to 30 days of predictions and add them to FILE\n"
+		"  predict --harmonics FILE --station ID [--from ISO] [--hours N] [--step S] [--extremes]\n"
+		"        heights, or highs and lows, from cached harmonics\n"
+		"  export --harmonics FILE --year Y [--station ID...] [--format csv|json] [--out DIR]\n"
+		"        year tables, downloading stations without harmonics\n"
+		"  --trace FILE\n"
+		"        write the spans traced while the command runs as Chrome trace JSON\n";
+}
+
+static TideFetchFn Fetcher()
+{
+	if (!TideFetchAvailable()) {
+		std::cerr << "tidecli: built without libcurl, downloads are not available" << std::endl;
+		exit(1);
+	}
+	return TideUrlFetcher(10);
+}
+
+static bool FetchStationList(const CliOptions &opt, TideSeriesKind kind, TideStationStore &store)
+{
+	std::string body, error;
+	if (!Fetcher()(TideStationsUrl(opt.api, opt.region, TideSeriesCode(kind)), body, error) ||
+		!TideParseStationList(body.data(), body.data() + body.size(), store,
+			kind == TSK_WCS ? TSF_CURRENTS : TSF_NONE, error)) {
+		std::cerr << "tidecli: " << error << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static int Stations(const CliOptions &opt)
+{
+	TideStationStore store;
+	if (!FetchStationList(opt, opt.currents ? TSK_WCS : TSK_WLP_HILO, store))
+		return 1;
+
+	printf("id,name,latitude,longitude\n");
+	for (size_t i = 0; i < store.Size(); i++)
+		printf("%s,\"%s\",%.5f,%.5f\n", store.Id(i), store.Name(i), store.Lat(i), store.Lon(i));
+	return 0;
+}
+
+static int Fetch(const CliOptions &opt)
+{
+	TideStationStore catalogue;
+	if (!opt.region.empty() && !FetchStationList(opt, TSK_WLP_HILO, catalogue))
+		return 1;
+
+	std::vector<std::string> ids = opt.stations;
+	if (ids.empty())
+		for (size_t i = 0; i < catalogue.Size(); i++)
+			ids.push_back(catalogue.Id(i));
+	if (ids.empty()) {
+		std::cerr << "tidecli: no stations to fetch" << std::endl;
+		return 1;
+	}
+
+	// One station per task, each paged one window at a time
+	TideFetchFn fetch = Fetcher();
+	time_t now = time(NULL);
+	std::vector<Json::Value> events(ids.size());
+	std::vector<std::string> errors(ids.size());
+	{
+		TideThreadPool pool(opt.threads > 0 ? opt.threads : 4);
+		for (size_t k = 0; k < ids.size(); k++) {
+			pool.Submit([&, k]() {
+				TidePager pager(opt.api, ids[k], TideSeriesCode(TSK_WLP_HILO), now, now + (time_t)opt.days * 86400);
+				if (!pager.Run(fetch, TideChunkProgressFn(), 1) || !pager.Stitch(events[k], errors[k]))
+					errors[k] = "download failed";
+			});
+		}
+		pool.Wait();
+	}
+
+	TideStationStore saved;
+	std::string error;
+	if (!opt.saved.empty())
+		TideLoadEventsXml(opt.saved, saved, TideEventsXmlFormat(), error);
+
+	int failed = 0;
+	std::vector<TideStationEvent> list;
+	for (size_t k = 0; k < ids.size(); k++) {
+		if (!errors[k].empty()) {
+			std::cerr << "tidecli: " << ids[k] << ": " << errors[k] << std::endl;
+			failed++;
+			continue;
+		}
+
+		int c = catalogue.Find(ids[k]);
+		int i = saved.Find(ids[k]);
+		if (i < 0)
+			i = (int)saved.Add(ids[k], c >= 0 ? catalogue.Name(c) : ids[k],
+				c >= 0 ? catalogue.Lat(c) : NAN, c >= 0 ? catalogue.Lon(c) : NAN);
+		list.clear();
+		TideStringPool labels;
+		TideEventsFromJson(events[k], labels, list);
+		saved.SetEvents(i, list, labels);
+		saved.SetDownloaded(i, now);
+	}
+
+	std::string filename = opt.saved.empty() ? "tidalevents.xml" : opt.saved;
+	if (!TideSaveEventsXml(filename, saved, TideEventsXmlFormat())) {
+		std::cerr << "tidecli: cannot write " << filename << std::endl;
+		return 1;
+	}
+	std::cerr << ids.size() - failed << " of " << ids.size() << " stations saved to " << filename << std::endl;
+	return failed ? 1 : 0;
+}
+
+static int Fit(const CliOptions &opt)
+{
+	if (opt.stations.empty()) {
+		Usage();
+		return 2;
+	}
+
+	std::string filename = opt.harmonics.empty() ? "harmonics.xml" : opt.harmonics;
+	TideHarmonicsMap sets;
+	TideLoadHarmonics(filename, sets);
+
+	// A month of hourly predictions separates the main constituents
+	time_t now = time(NULL);
+	TideSeriesStore store;
+	std::vector<int> kinds(1, TSK_WLP);
+	TideFetchSeries(opt.api, opt.stations, kinds, now - 30 * 86400, now, Fetcher(), 3, store);
+
+	int fitted = 0;
+	for (size_t k = 0; k < opt.stations.size(); k++) {
+		const TideSeries *series = store.Find(opt.stations[k], TSK_WLP);
+		TideHarmonics h;
+		h.stationId = opt.stations[k];
+		h.name = sets.count(h.stationId) ? sets[h.stationId].name : h.stationId;
+		std::string error = "download failed";
+		if (!series || !TideFitHarmonics(series->Samples(), h, error)) {
+			std::cerr << "tidecli: " << opt.stations[k] << ": " << error << std::endl;
+			continue;
+		}
+		sets[h.stationId] = h;
+		fitted++;
+	}
+
+	if (fitted && !TideSaveHarmonics(filename, sets)) {
+		std::cerr << "tidecli: cannot write " << filename << std::endl;
+		return 1;
+	}
+	return fitted == (int)opt.stations.size() ? 0 : 1;
+}
+
+static bool LoadHarmonics(const CliOptions &opt, TideHarmonicsMap &sets)
+{
+	if (opt.harmonics.empty() || !TideLoadHarmonics(opt.harmonics, sets)) {
+		std::cerr << "tidecli: cannot read harmonics from '" << opt.harmonics << "'" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static int Predict(const CliOptions &opt)
+{
+	TideHarmonicsMap sets;
+	if (opt.stations.size() != 1 || !LoadHarmonics(opt, sets))
+		return 2;
+
+	TideHarmonicsMap::const_iterator it = sets.find(opt.stations[0]);
+	if (it == sets.end()) {
+		std::cerr << "tidecli: no harmonics for " << opt.stations[0] << std::endl;
+		return 1;
+	}
+
+	time_t to = opt.from + (time_t)opt.hours * 3600;
+	if (opt.extremes) {
+		TideHarmonicCurve curve(it->second);
+		std::vector<TideExtremum> extrema;
+		TideFindExtrema(curve, opt.from, to, 900, extrema);
+		printf("time,type,height\n");
+		for (size_t k = 0; k < extrema.size(); k++)
+			printf("%s,%s,%.3f\n", TideFormatISO(extrema[k].t).c_str(),
+				extrema[k].high ? "high" : "low", extrema[k].height);
+		return 0;
+	}
+
+	size_t n = (size_t)((to - opt.from) / opt.step) + 1;
+	std::vector<double> heights(n);
+	TidePredictor predictor(it->second);
+	predictor.Heights(opt.from, opt.step, n, heights.data());
+	printf("time,height\n");
+	for (size_t k = 0; k < n; k++)
+		printf("%s,%.3f\n", TideFormatISO(opt.from + (time_t)k * opt.step).c_str(), heights[k]);
+	return 0;
+}
+
+static int Export(const CliOptions &opt)
+{
+	TideHarmonicsMap sets;
+	if (!LoadHarmonics(opt, sets))
+		return 2;
+
+	TideAlmanacRequest request;
+	request.year = opt.year;
+	request.format = opt.format == "json" ? TAF_JSON : TAF_CSV;
+	request.outputDir = opt.out.empty() ? "." : opt.out;
+	request.harmonics = &sets;
+	request.baseUrl = opt.api;
+	request.threads = opt.threads;
+	if (TideFetchAvailable())
+		request.fetch = TideUrlFetcher(10);
+
+	if (opt.stations.empty()) {
+		for (TideHarmonicsMap::const_iterator it = sets.begin(); it != sets.end(); ++it) {
+			TideAlmanacStation s = { it->first, it->second.name };
+			request.stations.push_back(s);
+		}
+	}
+	for (size_t k = 0; k < opt.stations.size(); k++) {
+		TideAlmanacStation s = { opt.stations[k], sets.count(opt.stations[k]) ? sets[opt.stations[k]].name : opt.stations[k] };
+		request.stations.push_back(s);
+	}
+
+	TideAlmanacResult result;
+	int written = TideWriteAlmanac(request, result);
+	for (size_t k = 0; k < result.errors.size(); k++)
+		std::cerr << "tidecli: " << result.errors[k] << std::endl;
+	std::cerr << written << " of " << request.stations.size() << " tables written to " << request.outputDir << std::endl;
+	return written == (int)request.stations.size() ? 0 : 1;
+}
+
+static int Run(const std::string &command, const CliOptions &opt)
+{
+	if (command == "stations" && !opt.region.empty()) return Stations(opt);
+	if (command == "fetch" && (!opt.region.empty() || !opt.stations.empty())) return Fetch(opt);
+	if (command == "fit") return Fit(opt);
+	if (command == "predict") return Predict(opt);
+	if (command == "export" && opt.year > 0) return Export(opt);
+
+	Usage();
+	return 2;
+}
+
+int main(int argc, char **argv)
+{
+	CliOptions opt;
+	opt.api = IWLS_API_BASE_URL;
+	opt.from = time(NULL);
+	opt.from -= opt.from % 3600;
+	opt.days = 7;
+	opt.hours = 48;
+	opt.step = 3600;
+	opt.year = 0;
+	opt.threads = 0;
+	opt.currents = false;
+	opt.extremes = false;
+	opt.format = "csv";
+
+	std::string command;
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "--api" && hasValue) opt.api = argv[++i];
+		else if (a == "--region" && hasValue) opt.region = argv[++i];
+		else if (a == "--station" && hasValue) opt.stations.push_back(argv[++i]);
+		else if (a == "--saved" && hasValue) opt.saved = argv[++i];
+		else if (a == "--harmonics" && hasValue) opt.harmonics = argv[++i];
+		else if (a == "--out" && hasValue) opt.out = argv[++i];
+		else if (a == "--format" && hasValue) opt.format = argv[++i];
+		else if (a == "--days" && hasValue) opt.days = atoi(argv[++i]);
+		else if (a == "--hours" && hasValue) opt.hours = atoi(argv[++i]);
+		else if (a == "--step" && hasValue) opt.step = atoi(argv[++i]);
+		else if (a == "--year" && hasValue) opt.year = atoi(argv[++i]);
+		else if (a == "--trace" && hasValue) opt.trace = argv[++i];
+		else if (a == "--threads" && hasValue) opt.threads = atoi(argv[++i]);
+		else if (a == "--currents") opt.currents = true;
+		else if (a == "--extremes") opt.extremes = true;
+		else if (a == "--from" && hasValue) {
+			if (!TideParseISO(argv[++i], &opt.from)) {
+				std::cerr << "tidecli: bad time " << argv[i] << std::endl;
+				return 2;
+			}
+		}
+		else if (command.empty() && a[0] != '-') command = a;
+		else {
+			Usage();
+			return 2;
+		}
+	}
+
+	if (opt.days <= 0 || opt.hours <= 0 || opt.step <= 0) {
+		Usage();
+		return 2;
+	}
+
+	if (!opt.trace.empty())
+		TideTraceStart();
+
+	int rc = Run(command, opt);
+
+	if (!opt.trace.empty()) {
+		TideTraceStop();
+		std::string error;
+		if (!TideTraceWrite(opt.trace, error)) {
+			std::cerr << "tidecli: " << error << std::endl;
+			if (!rc)
+				rc = 1;
+		}
+	}
+	return rc;
+}
@@ -0,0 +1,1627 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+/*
+ * tidecore_test: behaviour checks of the GUI-free core, run by ctest.
+ *
+ *   tidecore_test              run every case
+ *   tidecore_test pool_nested  run the cases whose name contains the text
+ *   tidecore_test --list
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <math.h>
+#include <mutex>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "harmonics.h"
+#include "tidecatalog.h"
+#include "tidecurrents.h"
+#include "tidedeparture.h"
+#include "tideexpiry.h"
+#include "tideextrema.h"
+#include "tidefetch.h"
+#include "tidefield.h"
+#include "tidegeo.h"
+#include "tidehover.h"
+#include "tidelevels.h"
+#include "tideobs.h"
+#include "tidepager.h"
+#include "tideroute.h"
+#include "tidesearch.h"
+#include "tideseries.h"
+#include "tidestations.h"
+#include "tidetime.h"
+#include "tidepool.h"
+#include "tideworker.h"
+
+struct TestCase
+{
+	const char *name;
+	void (*run)();
+};
+
+static std::vector<TestCase> &Tests()
+{
+	static std::vector<TestCase> tests;
+	return tests;
+}
+
+struct TestRegistrar
+{
+	TestRegistrar(const char *name, void (*run)())
+	{
+		TestCase t = { name, run };
+		Tests().push_back(t);
+	}
+};
+
+#define TIDE_TEST(name) \
+	static void name(); \
+	static TestRegistrar name##_registrar(#name, name); \
+	static void name()
+
+static int s_failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			s_failures++; \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(a, b, tol) \
+	do { \
+		double a_ = (a), b_ = (b); \
+		if (!(fabs(a_ - b_) <= (tol))) { \
+			fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %g vs %g\n", \
+				__FILE__, __LINE__, #a, #b, a_, b_); \
+			s_failures++; \
+		} \
+	} while (0)
+
+// Counts every allocation in the process, for the no-allocation checks
+static std::atomic<size_t> s_allocations(0);
+
+void *operator new(size_t n)
+{
+	s_allocations++;
+	void *p = malloc(n ? n : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+// TideThreadPool
+
+TIDE_TEST(pool_nested_wait)
+{
+	// Parents outlive their children, so thieves finish the nested tasks
+	// first; Wait() must still hold out for the parents
+	for (int round = 0; round < 50; round++) {
+		TideThreadPool pool(4);
+		std::atomic<int> children(0), parents(0);
+		for (int p = 0; p < 8; p++) {
+			pool.Submit([&pool, &children, &parents]() {
+				for (int c = 0; c < 20; c++)
+					pool.Submit([&children]() { children++; });
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				parents++;
+			});
+		}
+		pool.Wait();
+		CHECK(parents == 8);
+		CHECK(children == 160);
+	}
+}
+
+TIDE_TEST(pool_idle_after_wait)
+{
+	TideThreadPool pool(2);
+	std::atomic<int> n(0);
+	for (int i = 0; i < 1000; i++)
+		pool.Submit([&n]() { n++; });
+	pool.Wait();
+	CHECK(n == 1000);
+
+	// An idle pool must not spin: give the workers time and check they
+	// still pick up new work
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	pool.Submit([&n]() { n++; });
+	pool.Wait();
+	CHECK(n == 1001);
+}
+
+// TidePager
+
+// Answers like IWLS: an event every 15 minutes over the closed interval
+// [from, to], so neighbouring chunks share their boundary event.
+static bool FakeIwls(const std::string &url, std::string &body, std::string &error)
+{
+	size_t f = url.find("&from="), t = url.find("&to=");
+	time_t from, to;
+	if (f == std::string::npos || t == std::string::npos
+		|| !TideParseISO(url.substr(f + 6, t - f - 6).c_str(), &from)
+		|| !TideParseISO(url.substr(t + 4).c_str(), &to)) {
+		error = "bad url";
+		return false;
+	}
+	body = "[";
+	for (time_t e = (from + 899) / 900 * 900; e <= to; e += 900) {
+		if (body.size() > 1)
+			body += ",";
+		body += "{\"eventDate\":\"" + TideFormatISO(e) + "\",\"value\":" + std::to_string((e / 900) % 100) + "}";
+	}
+	body += "]";
+	return true;
+}
+
+TIDE_TEST(pager_stitch_dedup)
+{
+	const time_t from = 1700000100 / 900 * 900;
+	const time_t to = from + 20 * 86400;
+	TidePager pager("http://x", "s", "wlp", from, to, 7);
+	CHECK(pager.ChunkCount() == 3);
+
+	int reports = 0;
+	CHECK(pager.Run(FakeIwls, [&reports](int, int, const TideChunk &) { reports++; }, 3));
+	CHECK(reports == 3);
+
+	Json::Value events;
+	std::string error;
+	CHECK(pager.Stitch(events, error));
+	CHECK(events.size() == (Json::ArrayIndex)((to - from) / 900 + 1));
+
+	std::vector<TideSample> samples;
+	TideSamplesFromJson(events, samples);
+	CHECK(samples.size() == events.size());
+	bool regular = !samples.empty() && samples.front().t == from && samples.back().t == to;
+	for (size_t i = 1; i < samples.size(); i++)
+		regular = regular && samples[i].t - samples[i - 1].t == 900;
+	CHECK(regular);
+}
+
+TIDE_TEST(pager_retries_failed_only)
+{
+	const time_t from = 1700000100 / 900 * 900;
+	TidePager pager("http://x", "s", "wlp", from, from + 21 * 86400, 7);
+
+	std::mutex mutex;
+	std::map<std::string, int> calls;
+	bool failSecond = true;
+	TideFetchFn fetch = [&](const std::string &url, std::string &body, std::string &error) {
+		std::lock_guard<std::mutex> lock(mutex);
+		calls[url]++;
+		if (failSecond && url.find(TideFormatISO(from + 7 * 86400) + "&to") != std::string::npos) {
+			error = "HTTP 503";
+			return false;
+		}
+		return FakeIwls(url, body, error);
+	};
+
+	CHECK(!pager.Run(fetch, TideChunkProgressFn(), 3));
+	CHECK(pager.FailedCount() == 1);
+	Json::Value events;
+	std::string error;
+	CHECK(!pager.Stitch(events, error));
+
+	failSecond = false;
+	CHECK(pager.Run(fetch, TideChunkProgressFn(), 3));
+	CHECK(calls.size() == 3);
+	int total = 0;
+	for (std::map<std::string, int>::const_iterator it = calls.begin(); it != calls.end(); ++it)
+		total += it->second;
+	CHECK(total == 4);
+	CHECK(pager.Stitch(events, error));
+	CHECK(events.size() == (Json::ArrayIndex)(21 * 96 + 1));
+}
+
+TIDE_TEST(gunzip_bodies)
+{
+	// gzip of {"value":1.25} and a newline
+	static const unsigned char gz[] = {
+		0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xab, 0x56,
+		0x2a, 0x4b, 0xcc, 0x29, 0x4d, 0x55, 0xb2, 0x32, 0xd4, 0x33, 0x32, 0xad,
+		0xe5, 0x02, 0x00, 0x98, 0xed, 0x9c, 0xd2, 0x0f, 0x00, 0x00, 0x00
+	};
+	std::string body((const char *)gz, sizeof(gz));
+#ifdef CANADIANTIDES_USE_ZLIB
+	CHECK(TideGunzip(body));
+	CHECK(body == "{\"value\":1.25}\n");
+#else
+	CHECK(!TideGunzip(body));
+#endif
+
+	std::string plain = "[{\"id\":\"a\"}]";
+	body = plain;
+	CHECK(TideGunzip(body) && body == plain);
+	body.clear();
+	CHECK(TideGunzip(body) && body.empty());
+
+	body.assign((const char *)gz, sizeof(gz) - 12);
+	CHECK(!TideGunzip(body));
+}
+
+// Observations
+
+TIDE_TEST(ring_wraps_at_capacity)
+{
+	TideRingBuffer ring(4);
+	for (int k = 1; k <= 10; k++) {
+		TideSample s = { (time_t)(k * 60), (double)k };
+		CHECK(ring.Push(s));
+		CHECK(ring.Size() == (size_t)std::min(k, 4));
+	}
+	CHECK(ring.Capacity() == 4);
+	for (size_t i = 0; i < ring.Size(); i++)
+		CHECK(ring.At(i).t == (time_t)((7 + i) * 60) && ring.At(i).v == 7 + i);
+	CHECK(ring.Last().t == 600);
+
+	// Not newer than the last sample: refused, nothing moves
+	TideSample old = { 600, -1 };
+	CHECK(!ring.Push(old));
+	old.t = 60;
+	CHECK(!ring.Push(old));
+	CHECK(ring.Size() == 4 && ring.At(0).t == 420 && ring.Last().v == 10);
+}
+
+// Predictions every 15 minutes on a slope, observations every minute a
+// constant 0.3 m above them, so the residuals only come out right if the
+// predictions are interpolated to each observation.
+static double FakePredicted(time_t t)
+{
+	return 2.0 + (double)(t % 86400) / 36000.0;
+}
+
+static bool FakeObservations(const std::string &url, std::string &body, std::string &error)
+{
+	size_t f = url.find("&from="), t = url.find("&to=");
+	time_t from, to;
+	if (f == std::string::npos || t == std::string::npos
+		|| !TideParseISO(url.substr(f + 6, t - f - 6).c_str(), &from)
+		|| !TideParseISO(url.substr(t + 4).c_str(), &to)) {
+		error = "bad url";
+		return false;
+	}
+	bool observed = url.find("time-series-code=wlo") != std::string::npos;
+	time_t step = observed ? 60 : 900;
+	char buf[32];
+	body = "[";
+	for (time_t e = (from + step - 1) / step * step; e <= to; e += step) {
+		double v = FakePredicted(e) + (observed ? 0.3 : 0.0);
+		snprintf(buf, sizeof(buf), "%.6f", v);
+		if (body.size() > 1)
+			body += ",";
+		body += "{\"eventDate\":\"" + TideFormatISO(e) + "\",\"value\":" + buf + "}";
+	}
+	body += "]";
+	return true;
+}
+
+TIDE_TEST(poller_residuals_interpolate)
+{
+	std::atomic<int> fetches(0);
+	TideFetchFn fetch = [&fetches](const std::string &url, std::string &body, std::string &error) {
+		fetches++;
+		return FakeObservations(url, body, error);
+	};
+
+	// Six hours of backfill into room for 100 observations
+	TideObservationPoller poller("http://x", fetch, 100);
+	poller.Watch("s");
+	poller.Start();
+	for (int wait = 0; wait < 500 && poller.Generation() == 0; wait++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	poller.Stop();
+	CHECK(poller.Generation() > 0);
+	CHECK(fetches >= 2);    // observations, then predictions
+
+	std::vector<TideResidual> residuals;
+	CHECK(poller.Residuals("s", residuals));
+	CHECK(residuals.size() == 100);
+	bool minutes = true, values = true;
+	for (size_t i = 0; i < residuals.size(); i++) {
+		const TideResidual &r = residuals[i];
+		minutes = minutes && r.t % 60 == 0 && (i == 0 || r.t == residuals[i - 1].t + 60);
+		values = values && fabs(r.predicted - FakePredicted(r.t)) < 1e-5
+			&& fabs(r.residual - 0.3) < 1e-5 && fabs(r.observed - r.predicted - r.residual) < 1e-9;
+	}
+	CHECK(minutes);
+	CHECK(values);
+	// The ring kept the newest observations
+	CHECK(!residuals.empty() && time(NULL) - residuals.back().t < 120);
+
+	TideResidual latest;
+	CHECK(poller.Latest("s", latest));
+	CHECK(!residuals.empty() && latest.t == residuals.back().t);
+	CHECK_NEAR(latest.residual, 0.3, 1e-5);
+
+	CHECK(!poller.Residuals("other", residuals));
+	poller.Unwatch("s");
+	CHECK(!poller.Residuals("s", residuals));
+}
+
+// Station store
+
+TIDE_TEST(pool_intern_dedup)
+{
+	TideStringPool pool;
+	std::vector<uint32_t> offsets;
+	for (int i = 0; i < 5000; i++)
+		offsets.push_back(pool.Intern("station " + std::to_string(i)));
+	size_t bytes = pool.Bytes();
+
+	bool same = true, text = true;
+	for (int i = 0; i < 5000; i++) {
+		std::string s = "station " + std::to_string(i);
+		uint32_t found;
+		same = same && pool.Intern(s) == offsets[i] && pool.Find(s, &found) && found == offsets[i];
+		text = text && s == pool.Get(offsets[i]);
+	}
+	CHECK(same);
+	CHECK(text);
+	CHECK(pool.Bytes() == bytes);
+
+	uint32_t found;
+	CHECK(!pool.Find("station 5000", &found));
+	uint32_t empty = pool.Intern("");
+	CHECK(pool.Intern("") == empty);
+	CHECK(*pool.Get(empty) == 0);
+}
+
+static std::vector<TideStationEvent> Events(int64_t t0, size_t n, uint32_t type)
+{
+	std::vector<TideStationEvent> events(n);
+	for (size_t k = 0; k < n; k++) {
+		events[k].t = t0 + (int64_t)k * 3600;
+		events[k].height = (float)k;
+		events[k].type = type;
+	}
+	return events;
+}
+
+static bool HasEvents(const TideStationStore &store, size_t i, int64_t t0, size_t n)
+{
+	if (store.EventCount(i) != n)
+		return false;
+	const TideStationEvent *ev = store.Events(i);
+	for (size_t k = 0; k < n; k++)
+		if (ev[k].t != t0 + (int64_t)k * 3600 || ev[k].height != (float)k)
+			return false;
+	return true;
+}
+
+TIDE_TEST(store_copy_on_write)
+{
+	TideStationStore a;
+	uint32_t high = a.Intern("High");
+	for (int i = 0; i < 3; i++) {
+		size_t k = a.Add("id" + std::to_string(i), "Name " + std::to_string(i), 44 + i, -63);
+		a.SetEvents(k, Events(1000 * i, 10 + i, high));
+	}
+
+	TideStationStore b(a);
+	const TideStationEvent *before = a.Events(1);
+	b.SetEvents(1, Events(50000, 4, high));
+	CHECK(a.Events(1) == before);
+	CHECK(HasEvents(a, 1, 1000, 11));
+	CHECK(HasEvents(b, 1, 50000, 4));
+	// Untouched stations still share the original array
+	CHECK(b.Events(0) == a.Events(0));
+
+	// Enough edits to compact b several times over
+	for (int round = 0; round < 40; round++)
+		b.SetEvents(round % 3, Events(100000 * round, 5 + round % 7, high));
+	for (int i = 0; i < 3; i++)
+		CHECK(HasEvents(a, i, 1000 * i, 10 + i));
+	for (int i = 0; i < 3; i++) {
+		int round = 37 + i;
+		CHECK(HasEvents(b, round % 3, 100000 * round, 5 + round % 7));
+	}
+
+	b.Remove(0);
+	CHECK(b.Size() == 2 && a.Size() == 3);
+	CHECK(b.Find("id0") < 0 && b.Find("id2") == 1);
+	CHECK(HasEvents(b, 1, 100000 * 38, 5 + 38 % 7));
+	CHECK(std::string(b.Name(1)) == "Name 2");
+	CHECK(std::string(a.String(a.Events(2)[0].type)) == "High");
+}
+
+TIDE_TEST(store_columns_copy_on_write)
+{
+	TideStationStore a;
+	uint32_t high = a.Intern("High");
+	for (int i = 0; i < 3; i++)
+		a.SetEvents(a.Add("id" + std::to_string(i), "Name " + std::to_string(i), 44 + i, -63), Events(0, 4, high));
+
+	// Writes that leave the positions and names alone keep sharing them
+	TideStationStore b(a);
+	b.SetDownloaded(1, 1234);
+	b.SetEvents(2, Events(0, 2, b.Intern("High")));
+	CHECK(b.Lats() == a.Lats() && b.Lons() == a.Lons());
+	CHECK(&b.Strings() == &a.Strings());
+	CHECK(a.Downloaded(1) == 0 && b.Downloaded(1) == 1234);
+	CHECK(a.EventCount(2) == 4 && b.EventCount(2) == 2);
+
+	// A new string or station copies only what it changes
+	b.Add("id3", "Name 3", 50, -60);
+	CHECK(&b.Strings() != &a.Strings() && b.Lats() != a.Lats());
+	CHECK(a.Size() == 3 && a.Find("id3") < 0 && b.Find("id3") == 3);
+	CHECK(std::string(a.Name(2)) == "Name 2" && std::string(b.Name(3)) == "Name 3");
+}
+
+TIDE_TEST(store_events_from_other_pool)
+{
+	TideStringPool labels;
+	std::vector<TideStationEvent> events = Events(0, 3, labels.Intern("Low"));
+	events[1].type = labels.Intern("High");
+
+	TideStationStore store;
+	store.Add("x", "X", 0, 0);
+	store.SetEvents(0, events, labels);
+	CHECK(std::string(store.String(store.Events(0)[0].type)) == "Low");
+	CHECK(std::string(store.String(store.Events(0)[1].type)) == "High");
+}
+
+// tidalevents.xml
+
+// The plugin's display form, "DD/MM/YYYY HH:MM" in UTC
+static std::string DisplayTime(time_t t)
+{
+	int year, month, day, hour, min, sec;
+	TideSplitUTC(t, &year, &month, &day, &hour, &min, &sec);
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%02d/%02d/%04d %02d:%02d", day, month, year, hour, min);
+	return buf;
+}
+
+static bool ParseDisplayTime(const char *s, time_t *t)
+{
+	int year, month, day, hour, min;
+	if (sscanf(s, "%d/%d/%d %d:%d", &day, &month, &year, &hour, &min) != 5)
+		return false;
+	*t = TideMakeTimeUTC(year, month, day, hour, min, 0);
+	return true;
+}
+
+static std::string ReadFile(const std::string &filename)
+{
+	std::string text;
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return text;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		text.append(buf, n);
+	fclose(f);
+	return text;
+}
+
+TIDE_TEST(events_xml_round_trip)
+{
+	const time_t t0 = TideMakeTimeUTC(2024, 3, 9, 4, 30, 0);
+	TideStationStore saved;
+	uint32_t high = saved.Intern("High"), low = saved.Intern("Low");
+	for (int i = 0; i < 2; i++) {
+		size_t k = saved.Add("5cebf1de3d0f4a073c4bb94" + std::to_string(i), "Port " + std::to_string(i),
+			44.5 + i, -63.25 - i);
+		saved.SetDownloaded(k, t0 - 86400 * (i + 1));
+		std::vector<TideStationEvent> events = Events(t0 + i * 600, 4, high);
+		events[1].type = low;
+		events[1].height = 0.25f;
+		events[3].t = 0;               // no date from the server
+		events[2].height = NAN;
+		saved.SetEvents(k, events);
+	}
+
+	TideEventsXmlFormat format;
+	format.eventTime = DisplayTime;
+	format.parseEventTime = ParseDisplayTime;
+	const std::string filename = "tidecore_test-events.xml";
+	CHECK(TideSaveEventsXml(filename, saved, format));
+
+	// The file keeps both the display form and the ISO time
+	std::string text = ReadFile(filename);
+	CHECK(text.find("DownloadDate=\"2024-03-08T04:30:00Z\"") != std::string::npos);
+	CHECK(text.find("DateTime=\"09/03/2024 04:30\"") != std::string::npos);
+	CHECK(text.find("Time=\"2024-03-09T04:30:00Z\"") != std::string::npos);
+	CHECK(text.find("DateTime=\"n/a\"") != std::string::npos);
+	CHECK(text.find("Height=\"0.25\"") != std::string::npos);
+
+	TideStationStore loaded;
+	std::string error;
+	CHECK(TideLoadEventsXml(filename, loaded, format, error));
+	CHECK(loaded.Size() == 2);
+	for (size_t i = 0; i < loaded.Size() && i < 2; i++) {
+		CHECK(std::string(loaded.Id(i)) == saved.Id(i));
+		CHECK(std::string(loaded.Name(i)) == saved.Name(i));
+		CHECK_NEAR(loaded.Lat(i), saved.Lat(i), 1e-5);
+		CHECK_NEAR(loaded.Lon(i), saved.Lon(i), 1e-5);
+		CHECK(loaded.Downloaded(i) == saved.Downloaded(i));
+		CHECK(loaded.EventCount(i) == saved.EventCount(i));
+		for (size_t k = 0; k < loaded.EventCount(i) && k < saved.EventCount(i); k++) {
+			const TideStationEvent &a = saved.Events(i)[k], &b = loaded.Events(i)[k];
+			CHECK(b.t == a.t);
+			CHECK(std::string(loaded.String(b.type)) == saved.String(a.type));
+			if (a.height != a.height)
+				CHECK(b.height != b.height);
+			else
+				CHECK_NEAR(b.height, a.height, 0.005);
+		}
+	}
+
+	// Files from before the Time attribute fall back to DateTime
+	FILE *f = fopen(filename.c_str(), "w");
+	if (f) {
+		fputs("<?xml version=\"1.0\" encoding=\"utf-8\" ?>\n<TidalEventDataSet>\n"
+			"<Port Name=\"Old\" DownloadDate=\"2024-03-01T00:00:00Z\" Id=\"old\" Latitude=\"45\" Longitude=\"-64\">\n"
+			"<TidalEvent Event=\"High\" DateTime=\"09/03/2024 04:30\" Height=\"3.10\" />\n"
+			"</Port>\n</TidalEventDataSet>\n", f);
+		fclose(f);
+	}
+	CHECK(TideLoadEventsXml(filename, loaded, format, error));
+	CHECK(loaded.Size() == 1 && loaded.EventCount(0) == 1);
+	if (loaded.Size() == 1 && loaded.EventCount(0) == 1) {
+		CHECK(loaded.Events(0)[0].t == t0);
+		CHECK(loaded.Downloaded(0) == TideMakeTimeUTC(2024, 3, 1, 0, 0, 0));
+	}
+	// Without a parser for the display form the time is unknown
+	CHECK(TideLoadEventsXml(filename, loaded, TideEventsXmlFormat(), error));
+	CHECK(loaded.EventCount(0) == 1 && loaded.Events(0)[0].t == 0);
+	remove(filename.c_str());
+}
+
+// Station search
+
+TIDE_TEST(fold_accents)
+{
+	CHECK(TideFoldName("L\xc3\xa9vis") == "levis");
+	CHECK(TideFoldName("\xc3\x8ele-aux-Coudres") == "ile aux coudres");
+	CHECK(TideFoldName("Baie-Comeau (Qu\xc3\xa9""bec)") == "baie comeau quebec");
+	CHECK(TideFoldName("  Saint--Fran\xc3\xa7ois  ") == "saint francois");
+	CHECK(TideFoldName("C\xc5\x93ur") == "coeur");
+	CHECK(TideFoldName("STRA\xc3\x9f""E") == "strasse");
+	// Outside Latin-1 is kept, so it still matches itself
+	CHECK(TideFoldName("\xe2\x80\x94") == "\xe2\x80\x94");
+}
+
+static std::vector<uint32_t> BruteSearch(const TideStationStore &store, const std::string &query)
+{
+	std::string q = TideFoldName(query);
+	std::vector<std::pair<std::string, uint32_t> > names;
+	for (size_t i = 0; i < store.Size(); i++)
+		names.push_back(std::make_pair(TideFoldName(store.Name(i)), (uint32_t)i));
+	std::sort(names.begin(), names.end());
+
+	std::vector<uint32_t> words, others;
+	for (size_t k = 0; k < names.size(); k++) {
+		const std::string &n = names[k].first;
+		size_t p = n.find(q);
+		if (p == std::string::npos)
+			continue;
+		bool word = q.empty();
+		for (; p != std::string::npos && !word; p = n.find(q, p + 1))
+			word = p == 0 || n[p - 1] == ' ';
+		(word ? words : others).push_back(names[k].second);
+	}
+	words.insert(words.end(), others.begin(), others.end());
+	return words;
+}
+
+TIDE_TEST(search_narrowing_matches_brute_force)
+{
+	static const char *const parts[] = {
+		"Saint", "Sainte", "Pointe", "Baie", "Anse", "Port", "Cap", "\xc3\x8ele",
+		"L\xc3\xa9vis", "Qu\xc3\xa9""bec", "Rimouski", "Trois", "Rivi\xc3\xa8res",
+		"Fran\xc3\xa7ois", "Comeau", "Harbour", "Cove", "Au", "Aux", "Coudres"
+	};
+	const size_t nparts = sizeof(parts) / sizeof(parts[0]);
+
+	TideStationStore store;
+	unsigned seed = 12345;
+	for (int i = 0; i < 2000; i++) {
+		std::string name;
+		int words = 1 + i % 3;
+		for (int w = 0; w < words; w++) {
+			seed = seed * 1103515245u + 12345u;
+			name += (w ? (seed & 0x10000 ? "-" : " ") : "") + std::string(parts[(seed >> 8) % nparts]);
+		}
+		store.Add("id" + std::to_string(i), name, 0, 0);
+	}
+
+	TideSearchIndex index;
+	index.Build(store);
+
+	// Typing, backspacing and retyping, as a user would
+	static const char *const typed[] = {
+		"", "s", "sa", "sai", "sain", "saint", "saint ", "saint l", "saint le", "saint l",
+		"saint ", "saint", "sain", "a", "au", "aux", "aux ", "aux c", "Aux Co", "ile",
+		"\xc3\xae", "\xc3\xaele", "vis", "l\xc3\xa9v", "zzz", "zzzz", "cove", "ove", ""
+	};
+	bool same = true;
+	for (size_t k = 0; k < sizeof(typed) / sizeof(typed[0]); k++) {
+		if (index.Filter(typed[k]) != BruteSearch(store, typed[k])) {
+			fprintf(stderr, "search differs for \"%s\"\n", typed[k]);
+			same = false;
+		}
+	}
+	CHECK(same);
+}
+
+// TideWorker
+
+TIDE_TEST(worker_finish_on_owner)
+{
+	TideWorker worker;
+	worker.Start();
+	std::thread::id owner = std::this_thread::get_id();
+	std::thread::id ranOn;
+	int finished = 0;
+	for (int i = 0; i < 5; i++) {
+		worker.Submit([&finished, &ranOn]() -> TideWorker::Finish {
+			std::thread::id self = std::this_thread::get_id();
+			return [&finished, &ranOn, self]() {
+				ranOn = self;
+				finished++;
+			};
+		});
+	}
+	CHECK(worker.Pending() == 5);
+	for (int wait = 0; wait < 1000 && worker.Pending(); wait++) {
+		worker.RunFinished();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(finished == 5);
+	CHECK(ranOn != owner);
+	CHECK(worker.Pending() == 0);
+
+	// Posted steps come before the job's own finish step
+	std::vector<int> order;
+	worker.Submit([&worker, &order]() -> TideWorker::Finish {
+		for (int i = 0; i < 3; i++)
+			worker.Post([&order, i]() { order.push_back(i); });
+		return [&order]() { order.push_back(3); };
+	});
+	for (int wait = 0; wait < 1000 && worker.Pending(); wait++) {
+		worker.RunFinished();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	CHECK(order.size() == 4);
+	for (size_t i = 0; i < order.size(); i++)
+		CHECK(order[i] == (int)i);
+	CHECK(worker.Pending() == 0);
+	worker.Stop();
+}
+
+// Harmonic fit
+
+static TideHarmonics MakeHarmonics(const char *const *names, const double *amp, const double *phase, size_t n)
+{
+	TideHarmonics h;
+	h.z0 = 2.5;
+	h.fitted = 0;
+	for (size_t i = 0; i < n; i++) {
+		TideConstituent c;
+		c.index = TideConstituentIndex(names[i]);
+		c.amplitude = amp[i];
+		c.phase = phase[i];
+		h.constituents.push_back(c);
+	}
+	return h;
+}
+
+static void Sample(const TideHarmonics &h, time_t from, int hours, std::vector<TideSample> &samples)
+{
+	TidePredictor p(h);
+	samples.clear();
+	for (int i = 0; i <= hours; i++) {
+		TideSample s;
+		s.t = from + (time_t)i * 3600;
+		s.v = p.Height(s.t);
+		samples.push_back(s);
+	}
+}
+
+static const TideConstituent *FindConstituent(const TideHarmonics &h, const char *name)
+{
+	int index = TideConstituentIndex(name);
+	for (size_t i = 0; i < h.constituents.size(); i++)
+		if (h.constituents[i].index == index)
+			return &h.constituents[i];
+	return NULL;
+}
+
+static double PhaseError(double a, double b)
+{
+	double d = fmod(fabs(a - b), 360.0);
+	return d > 180 ? 360 - d : d;
+}
+
+TIDE_TEST(fit_round_trip)
+{
+	// T2 is still inferred from S2 over this record, so it keeps the
+	// equilibrium ratio
+	static const char *const names[] = { "M2", "S2", "N2", "K1", "O1", "K2", "P1", "M4", "T2" };
+	static const double amp[] = { 1.60, 0.45, 0.32, 0.28, 0.21, 0.12, 0.09, 0.05, 0.45 * 0.0592 };
+	static const double phase[] = { 110, 150, 85, 200, 175, 147, 196, 30, 150 };
+	TideHarmonics truth = MakeHarmonics(names, amp, phase, 9);
+
+	// Half a year and a bit resolves K2 from S2 and P1 from K1
+	std::vector<TideSample> samples;
+	Sample(truth, 1700000000, 190 * 24, samples);
+
+	TideHarmonics fit;
+	std::string error;
+	CHECK(TideFitHarmonics(samples, fit, error));
+	CHECK_NEAR(fit.z0, truth.z0, 1e-3);
+	for (size_t i = 0; i < 9; i++) {
+		const TideConstituent *c = FindConstituent(fit, names[i]);
+		CHECK(c != NULL);
+		if (!c)
+			continue;
+		CHECK_NEAR(c->amplitude, amp[i], 2e-3);
+		CHECK_NEAR(PhaseError(c->phase, phase[i]), 0, 0.5);
+	}
+}
+
+TIDE_TEST(fit_infers_short_record)
+{
+	// K2, P1 and T2 at their equilibrium ratios to S2 and K1, as the
+	// inference assumes; 720 hours cannot separate any of those pairs
+	static const char *const names[] = { "M2", "S2", "K1", "O1", "K2", "P1", "T2" };
+	static const double amp[] = { 1.60, 0.45, 0.30, 0.21, 0.45 * 0.2717, 0.30 * 0.3309, 0.45 * 0.0592 };
+	static const double phase[] = { 110, 150, 200, 175, 150, 200, 150 };
+	TideHarmonics truth = MakeHarmonics(names, amp, phase, 7);
+
+	std::vector<TideSample> samples;
+	Sample(truth, 1700000000, 720, samples);
+
+	TideHarmonics fit;
+	std::string error;
+	CHECK(TideFitHarmonics(samples, fit, error));
+	for (size_t i = 0; i < 7; i++) {
+		const TideConstituent *c = FindConstituent(fit, names[i]);
+		CHECK(c != NULL);
+		if (!c)
+			continue;
+		CHECK_NEAR(c->amplitude, amp[i], 5e-3);
+		CHECK_NEAR(PhaseError(c->phase, phase[i]), 0, 1.0);
+	}
+	CHECK(FindConstituent(fit, "SA") == NULL);
+	CHECK(FindConstituent(fit, "SSA") == NULL);
+
+	// And predicts months past the record
+	TidePredictor a(truth), b(fit);
+	double worst = 0;
+	for (time_t t = 1700000000 + 90 * 86400; t < 1700000000 + 120 * 86400; t += 1800)
+		worst = std::max(worst, fabs(a.Height(t) - b.Height(t)));
+	CHECK_NEAR(worst, 0, 0.01);
+}
+
+// Extrema
+
+static TideHarmonics MixedTide()
+{
+	static const char *const names[] = { "M2", "S2", "N2", "K1", "O1", "M4" };
+	static const double amp[] = { 1.10, 0.35, 0.22, 0.40, 0.30, 0.12 };
+	static const double phase[] = { 110, 150, 85, 200, 175, 40 };
+	return MakeHarmonics(names, amp, phase, 6);
+}
+
+TIDE_TEST(extrema_match_brute_force)
+{
+	TideHarmonics h = MixedTide();
+	TideHarmonicCurve curve(h);
+	const time_t from = 1700000000, to = from + 30 * 86400;
+
+	std::vector<TideExtremum> extrema;
+	TideFindExtrema(curve, from, to, 900, extrema);
+
+	// Every minute: each sign change of the slope is one extremum
+	TidePredictor p(h);
+	size_t turns = 0;
+	double prev = p.Height(from), slope = 0;
+	for (time_t t = from + 60; t < to; t += 60) {
+		double v = p.Height(t);
+		double s = v - prev;
+		if (slope != 0 && (s > 0) != (slope > 0))
+			turns++;
+		if (s != 0)
+			slope = s;
+		prev = v;
+	}
+	CHECK(extrema.size() == turns);
+
+	// Each one is the true turning point to a few seconds
+	double worstT = 0, worstH = 0;
+	for (size_t i = 0; i < extrema.size(); i++) {
+		const TideExtremum &e = extrema[i];
+		time_t best = e.t;
+		double bestH = p.Height(best);
+		for (time_t t = e.t - 600; t <= e.t + 600; t++) {
+			double v = p.Height(t);
+			if (e.high ? v > bestH : v < bestH) {
+				bestH = v;
+				best = t;
+			}
+		}
+		worstT = std::max(worstT, fabs((double)(best - e.t)));
+		worstH = std::max(worstH, fabs(bestH - e.height));
+		if (i > 0)
+			CHECK(e.high != extrema[i - 1].high);
+	}
+	CHECK_NEAR(worstT, 0, 5);
+	CHECK_NEAR(worstH, 0, 1e-4);
+}
+
+TIDE_TEST(extrema_chunked_match_single)
+{
+	TideHarmonics h = MixedTide();
+	TideHarmonicCurve curve(h);
+	const time_t from = 1700000000, to = from + 60 * 86400;
+
+	std::vector<TideExtremum> single;
+	TideFindExtrema(curve, from, to, 900, single);
+
+	std::vector<TideExtremaJob> jobs(1);
+	jobs[0].curve = &curve;
+	jobs[0].from = from;
+	jobs[0].to = to;
+	TideSolveExtrema(jobs, 4, 5 * 86400 + 123);
+
+	const std::vector<TideExtremum> &chunked = jobs[0].extrema;
+	CHECK(chunked.size() == single.size());
+	for (size_t i = 0; i < chunked.size() && i < single.size(); i++) {
+		CHECK(chunked[i].high == single[i].high);
+		CHECK(std::abs((long)(chunked[i].t - single[i].t)) <= 1);
+	}
+}
+
+TIDE_TEST(extrema_series_curve)
+{
+	// Hourly samples of the same tide, as a wlp download would give
+	TideHarmonics h = MixedTide();
+	const time_t from = 1700000000, to = from + 10 * 86400;
+	std::vector<TideSample> samples;
+	Sample(h, from, 10 * 24, samples);
+	TideSeries series;
+	series.Swap(samples);
+
+	TideHarmonicCurve exact(h);
+	TideSeriesCurve sampled(series);
+	std::vector<TideExtremum> a, b;
+	TideFindExtrema(exact, from + 3600, to - 3600, 900, a);
+	TideFindExtrema(sampled, from + 3600, to - 3600, 900, b);
+
+	CHECK(a.size() == b.size());
+	for (size_t i = 0; i < a.size() && i < b.size(); i++) {
+		CHECK(a[i].high == b[i].high);
+		CHECK_NEAR((double)(a[i].t - b[i].t), 0, 600);
+		CHECK_NEAR(a[i].height, b[i].height, 0.02);
+	}
+}
+
+// Nearest station tracking
+
+TIDE_TEST(tracker_matches_brute_force)
+{
+	std::shared_ptr<TideStationStore> store = std::make_shared<TideStationStore>();
+	unsigned seed = 777;
+	for (int i = 0; i < 1000; i++) {
+		seed = seed * 1103515245u + 12345u;
+		double lat = 43.0 + (seed >> 8) % 60000 / 10000.0;
+		seed = seed * 1103515245u + 12345u;
+		double lon = -70.0 + (seed >> 8) % 100000 / 10000.0;
+		store->Add("id" + std::to_string(i), "S", lat, lon);
+	}
+	TideStationSnapshot snapshot = store;
+
+	// An hour of 10 Hz fixes at 8 knots, turning slowly
+	TideNearestTracker tracker;
+	double lat = 45.0, lon = -65.0, course = 30;
+	size_t fixes = 36000, wrong = 0;
+	for (size_t f = 0; f < fixes; f++) {
+		double step = 8.0 / 36000.0 / 60.0;    // degrees of latitude per fix
+		course += 0.01;
+		lat += step * cos(course * TIDE_DEG2RAD);
+		lon += step * sin(course * TIDE_DEG2RAD) / cos(lat * TIDE_DEG2RAD);
+
+		int got = tracker.Update(snapshot, lat, lon);
+		int best = -1;
+		double bestd = 0;
+		for (size_t i = 0; i < store->Size(); i++) {
+			double d = TideDistanceNm(lat, lon, store->Lat(i), store->Lon(i));
+			if (best < 0 || d < bestd) {
+				best = (int)i;
+				bestd = d;
+			}
+		}
+		if (got != best)
+			wrong++;
+	}
+	CHECK(wrong == 0);
+	// Most fixes are answered from the cached circle
+	CHECK(tracker.Queries() > 0 && tracker.Queries() < fixes / 20);
+
+	// A new snapshot always queries again
+	size_t before = tracker.Queries();
+	tracker.Update(std::make_shared<TideStationStore>(*store), lat, lon);
+	CHECK(tracker.Queries() == before + 1);
+}
+
+// Hover lookup
+
+TIDE_TEST(hover_grid_matches_brute_force)
+{
+	const int width = 800, height = 600, cell = 24;
+	TideHoverGrid grid;
+	grid.Reset(width, height, cell);
+
+	// Near the cell size apart, so lookups often cross into a neighbour
+	std::vector<int> xs, ys;
+	unsigned seed = 4242;
+	for (int i = 0; i < 600; i++) {
+		seed = seed * 1103515245u + 12345u;
+		int x = (int)((seed >> 8) % width);
+		seed = seed * 1103515245u + 12345u;
+		int y = (int)((seed >> 8) % height);
+		grid.Add(x, y, (uint32_t)i);
+		xs.push_back(x);
+		ys.push_back(y);
+	}
+	// Off the canvas, ignored
+	grid.Add(-1, 10, 9000);
+	grid.Add(10, height, 9001);
+	CHECK(grid.Size() == xs.size());
+
+	size_t wrong = 0;
+	for (int y = -2 * cell; y < height + 2 * cell; y += 3) {
+		for (int x = -2 * cell; x < width + 2 * cell; x += 5) {
+			long best = -1;
+			for (size_t i = 0; i < xs.size(); i++) {
+				long dx = xs[i] - x, dy = ys[i] - y, d = dx * dx + dy * dy;
+				if (d <= (long)cell * cell && (best < 0 || d < best))
+					best = d;
+			}
+			uint32_t tag;
+			bool found = grid.Find(x, y, tag);
+			if (found != (best >= 0))
+				wrong++;
+			else if (found) {
+				long dx = xs[tag] - x, dy = ys[tag] - y;
+				if (dx * dx + dy * dy != best)
+					wrong++;
+			}
+		}
+	}
+	CHECK(wrong == 0);
+
+	// One icon: found from the next cell, up to exactly the cell size
+	grid.Reset(width, height, cell);
+	grid.Add(cell * 5 - 1, cell * 5, 7);
+	uint32_t tag = 0;
+	CHECK(grid.Find(cell * 5 + 3, cell * 5 + 2, tag) && tag == 7);
+	CHECK(grid.Find(cell * 6 - 1, cell * 5, tag));
+	CHECK(!grid.Find(cell * 6, cell * 5, tag));
+	CHECK(!grid.Find(cell * 5 - 1, cell * 4 - 1, tag));
+
+	// Icons on the edge are found from just off the canvas, not from far off
+	grid.Reset(width, height, cell);
+	grid.Add(0, 0, 1);
+	grid.Add(width - 1, height - 1, 2);
+	CHECK(grid.Find(-10, -10, tag) && tag == 1);
+	CHECK(grid.Find(width + 5, height + 5, tag) && tag == 2);
+	CHECK(!grid.Find(-cell - 1, 0, tag));
+	CHECK(!grid.Find(width + cell, height - 1, tag));
+	CHECK(!grid.Find(100000, 100000, tag));
+}
+
+// Expiry
+
+static std::vector<TideStationEvent> EventsAt(const int64_t *times, size_t n)
+{
+	std::vector<TideStationEvent> events(n);
+	for (size_t k = 0; k < n; k++) {
+		events[k].t = times[k];
+		events[k].height = (float)k;
+		events[k].type = 0;
+	}
+	return events;
+}
+
+TIDE_TEST(expiry_trims_per_station)
+{
+	const time_t now = 1700000000, keep = 3600;
+	const int64_t a[] = { now - 7200, now - 1800, now + 3600 };   // loses one
+	const int64_t b[] = { now - 10000, now - 9000 };              // loses all
+	const int64_t c[] = { now + 1000, now + 5000 };               // not due
+	const int64_t d[] = { now + 100 };
+
+	TideStationModel model;
+	model.Update([&](TideStationStore &store) {
+		store.SetEvents(store.Add("a", "A", 44, -63), EventsAt(a, 3));
+		store.SetEvents(store.Add("b", "B", 45, -63), EventsAt(b, 2));
+		store.SetEvents(store.Add("c", "C", 46, -63), EventsAt(c, 2));
+		store.SetEvents(store.Add("d", "D", 47, -63), EventsAt(d, 1));
+		store.Add("e", "E", 48, -63);                             // no events
+	});
+
+	TideExpiryTrimmer trimmer(model, keep);
+	trimmer.Rebuild();
+	CHECK(trimmer.NextDue() == 1);
+
+	// d is reloaded with an older event; its first heap entry goes stale
+	const int64_t d2[] = { now - 5000, now + 200 };
+	model.Update([&](TideStationStore &store) { store.SetEvents(store.Find("d"), EventsAt(d2, 2)); });
+	trimmer.Schedule("d");
+
+	TideStationSnapshot before = model.Get();
+	CHECK(trimmer.TrimDue(now) == 4);
+	CHECK(trimmer.Generation() == 1);
+
+	TideStationSnapshot after = model.Get();
+	CHECK(after != before);
+	CHECK(after->Size() == 3);
+	CHECK(after->Find("b") < 0 && after->Find("e") < 0);
+	int ia = after->Find("a"), ic = after->Find("c"), id = after->Find("d");
+	CHECK(ia >= 0 && ic >= 0 && id >= 0);
+	if (ia < 0 || ic < 0 || id < 0)
+		return;
+	CHECK(after->EventCount(ia) == 2 && after->Events(ia)[0].t == now - 1800);
+	CHECK(after->EventCount(ic) == 2);
+	CHECK(after->EventCount(id) == 1 && after->Events(id)[0].t == now + 200);
+
+	// a is rescheduled for when its oldest kept event passes keep
+	CHECK(trimmer.NextDue() == now - 1800 + keep + 1);
+	CHECK(trimmer.TrimDue(now - 1800 + keep) == 0);
+	CHECK(trimmer.Generation() == 1);
+	CHECK(trimmer.TrimDue(now - 1800 + keep + 1) == 1);
+	CHECK(model.Get()->EventCount(model.Get()->Find("a")) == 1);
+	CHECK(trimmer.Generation() == 2);
+
+	// Reaching d's stale entry does nothing; its live one is later
+	before = model.Get();
+	CHECK(trimmer.TrimDue(now + 100 + keep + 1) == 0);
+	CHECK(model.Get() == before);
+	CHECK(trimmer.Generation() == 2);
+	CHECK(trimmer.NextDue() == now + 200 + keep + 1);
+}
+
+// Level playback
+
+TIDE_TEST(levels_no_allocation)
+{
+	TideHarmonics h = MixedTide();
+	const time_t from = 1700000000;
+	const size_t n = 300;
+
+	std::vector<TideSeries> series(n / 2);
+	std::vector<const TideSeries *> sources(n, NULL);
+	std::vector<const TideHarmonics *> harmonics(n, NULL);
+	for (size_t i = 0; i < n; i++) {
+		if (i < n / 2) {
+			std::vector<TideSample> samples;
+			Sample(h, from, 14 * 24, samples);
+			series[i].Swap(samples);
+			sources[i] = &series[i];
+		}
+		else
+			harmonics[i] = &h;
+	}
+
+	TideLevelBatch levels;
+	levels.SetSources(sources, harmonics);
+	std::vector<uint32_t> visible;
+	visible.reserve(n);
+	for (uint32_t i = 0; i < n; i++)
+		visible.push_back(i);
+
+	// One frame first, which prepares the predictors' year
+	levels.Evaluate(from, visible.data(), visible.size());
+
+	size_t allocations = s_allocations;
+	for (int frame = 0; frame < 1000; frame++) {
+		// Play forward, with a scrub back every hundred frames
+		time_t t = from + (time_t)(frame % 100 == 99 ? frame / 2 : frame) * 900;
+		levels.Evaluate(t, visible.data(), visible.size());
+	}
+	CHECK(s_allocations == allocations);
+
+	// The series and harmonic stations agree with their sources
+	TidePredictor p(h);
+	time_t t = from + 5 * 86400 + 1234;
+	levels.Evaluate(t, visible.data(), visible.size());
+	double v;
+	CHECK(series[0].Interpolate(t, &v));
+	CHECK_NEAR(levels.Height(0), v, 1e-9);
+	CHECK_NEAR(levels.Height(n - 1), p.Height(t), 1e-9);
+	CHECK(levels.Trend(n - 1) == (p.Rate(t) >= 0 ? 1 : -1));
+	CHECK(levels.Trend(0) != 0);
+}
+
+// Current arrows
+
+TIDE_TEST(current_arrows_by_index)
+{
+	TideStationStore stations;
+	stations.Add("east", "East", 44, -63);
+	stations.Add("none", "None", 44, -62);
+	stations.Add("north", "North", 44, -61);
+
+	TideSeriesStore store;
+	std::vector<TideSample> speed(2), dir(2);
+	speed[0].t = dir[0].t = 1000;
+	speed[1].t = dir[1].t = 2000;
+	speed[0].v = speed[1].v = 2;
+	dir[0].v = dir[1].v = 90;
+	store.Get("east", TSK_WCS).Merge(speed);
+	store.Get("east", TSK_WCD).Merge(dir);
+	dir[0].v = dir[1].v = 0;
+	store.Get("north", TSK_WCS).Merge(speed);
+	store.Get("north", TSK_WCD).Merge(dir);
+
+	std::vector<TideCurrentSeries> series;
+	TideResolveCurrents(store, stations, series);
+	CHECK(series.size() == 3);
+	CHECK(series[0].speed == store.Find("east", TSK_WCS) && series[0].dir == store.Find("east", TSK_WCD));
+	CHECK(!series[1].speed && !series[1].dir);
+
+	TideArrowStyle style = { 10, 8, 60, 0.3f };
+	std::vector<uint32_t> index;
+	index.push_back(2);
+	index.push_back(1);
+	index.push_back(0);
+	std::vector<float> px(3, 100), py(3, 200);
+	px[2] = 300;
+	std::vector<TideCurrentArrow> arrows;
+	TideBuildCurrentArrows(series, index, px, py, 1500, 0, style, arrows);
+
+	// North then east; the station without series is skipped
+	CHECK(arrows.size() == 2);
+	if (arrows.size() == 2) {
+		CHECK_NEAR(arrows[0].x[0], 100, 1e-4);
+		CHECK_NEAR(arrows[0].y[0], 210, 1e-4);
+		CHECK_NEAR(arrows[0].y[1], 190, 1e-4);
+		CHECK_NEAR(arrows[1].x[0], 290, 1e-4);
+		CHECK_NEAR(arrows[1].x[1], 310, 1e-4);
+		CHECK_NEAR(arrows[1].y[1], 200, 1e-4);
+		CHECK_NEAR(arrows[1].speed, 2, 1e-6);
+	}
+
+	// Outside the data
+	TideBuildCurrentArrows(series, index, px, py, 5000, 0, style, arrows);
+	CHECK(arrows.empty());
+}
+
+// Height field
+
+TIDE_TEST(field_recomputes_only_moved_stations)
+{
+	// Stations 0.5 degrees apart along 45N, 10 nm reach
+	std::vector<double> lat, lon, heights;
+	for (int i = 0; i < 5; i++) {
+		lat.push_back(45.0);
+		lon.push_back(-64.0 + 0.5 * i);
+		heights.push_back(1.0 + i);
+	}
+	TideHeightField field;
+	field.SetStations(lat, lon, 10);
+	field.SetCellSize(0.05, 45);
+	field.SetHeights(heights);
+
+	const std::vector<TideFieldCell> &first = field.Update(44.7, 45.3, -64.3, -61.7);
+	size_t visible = first.size();
+	CHECK(visible > 0);
+	CHECK(field.Recomputed() == visible);
+
+	// Same heights, and changes under the tolerance
+	field.SetHeights(heights);
+	field.Update(44.7, 45.3, -64.3, -61.7);
+	CHECK(field.Recomputed() == 0);
+	heights[2] += 0.001;
+	field.SetHeights(heights);
+	field.Update(44.7, 45.3, -64.3, -61.7);
+	CHECK(field.Recomputed() == 0);
+
+	// A pan only computes the cells coming into view, and panning back none
+	field.Update(44.7, 45.3, -64.2, -61.6);
+	size_t fresh = field.Recomputed();
+	CHECK(fresh > 0 && fresh < visible / 4);
+	field.Update(44.7, 45.3, -64.3, -61.7);
+	CHECK(field.Recomputed() == 0);
+
+	// Moving one station recomputes exactly the cells within its reach
+	const std::vector<TideFieldCell> &cells = field.Update(44.7, 45.3, -64.3, -61.7);
+	std::vector<float> before;
+	for (size_t i = 0; i < cells.size(); i++)
+		before.push_back(cells[i].value);
+	size_t inReach = 0;
+	for (size_t i = 0; i < cells.size(); i++) {
+		double clat = cells[i].lat + field.CellHeight() / 2, clon = cells[i].lon + field.CellWidth() / 2;
+		double dy = (lat[2] - clat) * 60, dx = (lon[2] - clon) * 60 * cos(clat * M_PI / 180);
+		if (dx * dx + dy * dy <= 100)
+			inReach++;
+	}
+	CHECK(inReach > 0);
+
+	heights[2] += 1.0;
+	field.SetHeights(heights);
+	const std::vector<TideFieldCell> &after = field.Update(44.7, 45.3, -64.3, -61.7);
+	CHECK(field.Recomputed() == inReach);
+	size_t changed = 0;
+	for (size_t i = 0; i < after.size() && i < before.size(); i++) {
+		if (after[i].value == before[i] || (after[i].value != after[i].value && before[i] != before[i]))
+			continue;
+		changed++;
+		CHECK(fabs(after[i].lon + field.CellWidth() / 2 - lon[2]) < 0.25);
+	}
+	CHECK(changed == inReach);
+}
+
+// Route evaluation
+
+TIDE_TEST(route_matches_single_thread)
+{
+	static const char *const names[] = { "M2", "K1" };
+	static const double ampA[] = { 1.2, 0.3 }, phaseA[] = { 40, 100 };
+	static const double ampB[] = { 0.8, 0.5 }, phaseB[] = { 220, 10 };
+	std::vector<TideRouteStation> stations(3);
+	stations[0].id = "a";
+	stations[0].lat = 44.0;
+	stations[0].lon = -63.0;
+	stations[0].harmonics = MakeHarmonics(names, ampA, phaseA, 2);
+	stations[1].id = "b";
+	stations[1].lat = 44.0;
+	stations[1].lon = -62.0;
+	stations[1].harmonics = MakeHarmonics(names, ampB, phaseB, 2);
+	stations[2] = stations[0];
+	stations[2].id = "far";
+	stations[2].lat = 50.0;
+	stations[2].lon = -50.0;
+
+	// East between the two stations, then north out of reach of both
+	std::vector<TideRoutePoint> points(3);
+	points[0].lat = 44.0;
+	points[0].lon = -63.0;
+	points[1].lat = 44.0;
+	points[1].lon = -62.0;
+	points[2].lat = 44.6;
+	points[2].lon = -62.0;
+
+	const double sampleNm = 0.05, maxDist = 30;
+	TideRouteEvaluator route(4);
+	route.SetStations(stations, maxDist);
+	route.SetRoute(points, sampleNm);
+
+	const std::vector<TideRouteSample> &samples = route.Samples();
+	double leg0 = TideDistanceNm(44.0, -63.0, 44.0, -62.0), leg1 = TideDistanceNm(44.0, -62.0, 44.6, -62.0);
+	CHECK(samples.size() == (size_t)(ceil(leg0 / sampleNm) + ceil(leg1 / sampleNm) + 1));
+
+	int waypoints = 0, unassigned = 0;
+	bool legs = true, spacing = true, nearest = true;
+	std::vector<int> perStation(stations.size(), 0);
+	for (size_t i = 0; i < samples.size(); i++) {
+		const TideRouteSample &s = samples[i];
+		if (s.waypoint >= 0) {
+			waypoints++;
+			legs = legs && s.leg == s.waypoint && s.lat == points[s.waypoint].lat;
+			double along = s.waypoint == 0 ? 0 : s.waypoint == 1 ? leg0 : leg0 + leg1;
+			CHECK_NEAR(s.distNm, along, 1e-9);
+		}
+		if (i > 0) {
+			double step = s.distNm - samples[i - 1].distNm;
+			spacing = spacing && step > 0 && step <= sampleNm + 1e-9;
+			legs = legs && (s.leg == samples[i - 1].leg || s.leg == samples[i - 1].leg + 1);
+		}
+
+		int best = -1;
+		double bestd = maxDist;
+		for (size_t k = 0; k < stations.size(); k++) {
+			double d = TideDistanceNm(s.lat, s.lon, stations[k].lat, stations[k].lon);
+			if (d <= bestd) {
+				best = (int)k;
+				bestd = d;
+			}
+		}
+		nearest = nearest && s.station == best;
+		if (s.station < 0)
+			unassigned++;
+		else
+			perStation[s.station]++;
+	}
+	CHECK(waypoints == 3);
+	CHECK(legs);
+	CHECK(spacing);
+	CHECK(nearest);
+	CHECK(unassigned > 0 && perStation[2] == 0);
+
+	// More than 256 samples near a station are split across jobs
+	CHECK(perStation[0] > 256 && perStation[1] > 256);
+	size_t batches = 0;
+	for (size_t k = 0; k < perStation.size(); k++)
+		batches += (perStation[k] + 255) / 256;
+	CHECK(route.BatchCount() == batches);
+
+	const time_t departure = 1700000000;
+	const double speed = 6.5;
+	route.Evaluate(departure, speed);
+	TidePredictor a(stations[0].harmonics), b(stations[1].harmonics);
+	size_t wrong = 0;
+	for (size_t i = 0; i < samples.size(); i++) {
+		const TideRouteSample &s = samples[i];
+		if (s.eta != departure + (time_t)(s.distNm * 3600.0 / speed + 0.5))
+			wrong++;
+		if (s.station < 0)
+			wrong += s.height == s.height;
+		else if (fabs(s.height - (s.station == 0 ? a : b).Height(s.eta)) > 1e-9)
+			wrong++;
+	}
+	CHECK(wrong == 0);
+}
+
+// Departure windows
+
+static bool WindowBefore(const TideDepartureWindow &a, const TideDepartureWindow &b)
+{
+	if (a.margin != b.margin)
+		return a.margin > b.margin;
+	return a.end - a.begin > b.end - b.begin;
+}
+
+TIDE_TEST(departure_windows_exact)
+{
+	// z0 2.5 m with M2 and S2, so the highs differ between spring and neap
+	static const char *const names[] = { "M2", "S2" };
+	static const double amp[] = { 1.0, 0.4 };
+	static const double phase[] = { 30, 80 };
+	TideRouteStation station;
+	station.id = "a";
+	station.name = "A";
+	station.lat = 44.0;
+	station.lon = -63.0;
+	station.harmonics = MakeHarmonics(names, amp, phase, 2);
+
+	// Under a nautical mile east of the station
+	std::vector<TideRoutePoint> points(2);
+	points[0].lat = 44.0;
+	points[0].lon = -63.0;
+	points[1].lat = 44.0;
+	points[1].lon = -62.98;
+
+	TideRouteEvaluator route(4);
+	route.SetStations(std::vector<TideRouteStation>(1, station));
+	route.SetRoute(points);
+
+	TideDepartureRequest request;
+	request.from = 1700000000;
+	request.to = request.from + 3 * 86400;
+	request.step = 600;
+	request.speedKn = 6;
+	request.minHeight = 3.0;
+	request.maxFoulKn = NAN;
+	request.currents = NULL;
+
+	std::vector<TideDepartureWindow> windows;
+	std::vector<int> missing;
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(missing.empty());
+
+	// The same search by hand, one departure at a time
+	std::vector<time_t> offsets;
+	for (size_t i = 0; i < route.Samples().size(); i++)
+		if (route.Samples()[i].waypoint >= 0)
+			offsets.push_back((time_t)(route.Samples()[i].distNm * 3600.0 / request.speedKn + 0.5));
+	CHECK(offsets.size() == 2 && offsets[1] > 0);
+
+	TidePredictor predictor(station.harmonics);
+	std::vector<TideDepartureWindow> expected;
+	bool open = false;
+	for (time_t t = request.from; t <= request.to; t += request.step) {
+		double spare = HUGE_VAL;
+		for (size_t w = 0; w < offsets.size(); w++)
+			spare = std::min(spare, predictor.Height(t + offsets[w]) - request.minHeight);
+		if (spare < 0) {
+			open = false;
+			continue;
+		}
+		if (!open) {
+			TideDepartureWindow window = { t, t, t, spare };
+			expected.push_back(window);
+			open = true;
+		}
+		TideDepartureWindow &window = expected.back();
+		window.end = t;
+		if (spare > window.margin) {
+			window.margin = spare;
+			window.best = t;
+		}
+	}
+	std::stable_sort(expected.begin(), expected.end(), WindowBefore);
+
+	// One window around each of about six high waters
+	CHECK(expected.size() >= 5 && expected.size() <= 7);
+	CHECK(windows.size() == expected.size());
+	for (size_t k = 0; k < windows.size() && k < expected.size(); k++) {
+		CHECK(windows[k].begin == expected[k].begin);
+		CHECK(windows[k].end == expected[k].end);
+		CHECK(windows[k].best == expected[k].best);
+		CHECK_NEAR(windows[k].margin, expected[k].margin, 1e-6);
+		CHECK(windows[k].margin >= 0 && windows[k].margin <= 2.5 + 1.4 - 3.0 + 1e-9);
+		if (k > 0)
+			CHECK(windows[k].margin <= windows[k - 1].margin);
+	}
+
+	// Currents only: a foul current over 1 kn closes the window, fair or
+	// cross currents do not. Without heights there is no margin, so the
+	// longest window comes first.
+	TideSeriesStore currents;
+	std::vector<TideSample> speed, direction;
+	const int foul[] = { 5, 6, 12, 20, 21, 22 };
+	for (int j = -6; j < 40; j++) {
+		TideSample kn = { request.from + j * 600, 0.5 }, dir = { kn.t, 270 };   // against the course
+		if (std::find(foul, foul + 6, j) != foul + 6)
+			kn.v = 3;
+		else if (j == 15 || j == 16) {
+			kn.v = 3;
+			dir.v = 90;    // with the course
+		}
+		else if (j == 2) {
+			kn.v = 3;
+			dir.v = 0;     // across it
+		}
+		speed.push_back(kn);
+		direction.push_back(dir);
+	}
+	currents.Get("c", TSK_WCS).Merge(speed);
+	currents.Get("c", TSK_WCD).Merge(direction);
+	for (size_t k = 0; k < speed.size(); k++)
+		speed[k].v = 0;
+	currents.Get("calm", TSK_WCS).Merge(speed);
+	currents.Get("calm", TSK_WCD).Merge(direction);
+
+	request.to = request.from + 29 * 600;
+	request.minHeight = NAN;
+	request.maxFoulKn = 1.0;
+	request.currents = &currents;
+	request.currentStations.push_back("c");
+	request.currentStations.push_back("calm");
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(missing.empty());
+
+	const int runs[][2] = { { 13, 19 }, { 23, 29 }, { 0, 4 }, { 7, 11 } };
+	CHECK(windows.size() == 4);
+	for (size_t k = 0; k < windows.size() && k < 4; k++) {
+		CHECK(windows[k].begin == request.from + runs[k][0] * 600);
+		CHECK(windows[k].end == request.from + runs[k][1] * 600);
+		CHECK(windows[k].best == windows[k].begin);
+		CHECK(windows[k].margin != windows[k].margin);
+	}
+}
+
+TIDE_TEST(departure_missing_data_fails)
+{
+	static const char *const names[] = { "M2" };
+	static const double amp[] = { 1.0 };
+	static const double phase[] = { 0 };
+	TideRouteStation station;
+	station.id = "a";
+	station.name = "A";
+	station.lat = 44.0;
+	station.lon = -63.0;
+	station.harmonics = MakeHarmonics(names, amp, phase, 1);
+
+	// The second waypoint is 60 nm from the only station
+	std::vector<TideRoutePoint> points(2);
+	points[0].lat = 44.0;
+	points[0].lon = -63.0;
+	points[1].lat = 45.0;
+	points[1].lon = -63.0;
+
+	TideRouteEvaluator route(2);
+	route.SetStations(std::vector<TideRouteStation>(1, station));
+	route.SetRoute(points);
+	route.Evaluate(1700000000, 6);
+
+	TideDepartureRequest request;
+	request.from = 1700000000;
+	request.to = request.from + 7 * 86400;
+	request.step = 600;
+	request.speedKn = 6;
+	request.minHeight = 2.0;
+	request.maxFoulKn = NAN;
+	request.currents = NULL;
+
+	std::vector<TideDepartureWindow> windows;
+	std::vector<int> missing;
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(windows.empty());
+	CHECK(missing.size() == 1 && missing[0] == 1);
+
+	// A current limit without current data fails at both waypoints
+	request.minHeight = NAN;
+	request.maxFoulKn = 1.0;
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(windows.empty());
+	CHECK(missing.size() == 2);
+
+	// Nothing to check is not a week-long window
+	request.maxFoulKn = NAN;
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(windows.empty());
+	CHECK(missing.empty());
+
+	// With the station near both ends, z0 + 1 m of M2 clears 2 m around
+	// each high water
+	points[1].lat = 44.2;
+	route.SetRoute(points);
+	request.minHeight = 2.0;
+	TideFindDepartureWindows(route, request, windows, missing);
+	CHECK(missing.empty());
+	CHECK(windows.size() > 10);
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+	if (filter && strcmp(filter, "--list") == 0) {
+		for (size_t i = 0; i < Tests().size(); i++)
+			printf("%s\n", Tests()[i].name);
+		return 0;
+	}
+
+	int run = 0;
+	for (size_t i = 0; i < Tests().size(); i++) {
+		const TestCase &t = Tests()[i];
+		if (filter && !strstr(t.name, filter))
+			continue;
+		int before = s_failures;
+		t.run();
+		printf("%-32s %s\n", t.name, s_failures == before ? "ok" : "FAILED");
+		run++;
+	}
+	if (!run) {
+		fprintf(stderr, "tidecore_test: no case matches %s\n", filter);
+		return 2;
+	}
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  CanadianTides Plugin
+ * Author:   Mike Rossiter
+ *
+ ***************************************************************************
+ *   Copyright (C) 2019 by Mike Rossiter                                   *
+ *   $EMAIL$                                                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * tidequery_harness: drives TideQueryService the way other plugins do,
+ * by injecting CANADIANTIDES_QUERY messages, against a synthetic data
+ * set. Requests are read one JSON object per line and each reply is
+ * printed as a CANADIANTIDES_QUERY_REPLY line:
+ *
+ *   tidequery_harness --demo
+ *   tidequery_harness --stations 2000 --repeat 100 < requests.jsonl
+ *
+ * Station ids are wl0, wl1... for water levels (even ones have
+ * harmonics, odd ones a prediction series) and wc0, wc1... for currents.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json/reader.h"
+
+#include "tidequery.h"
+
+static void Usage()
+{
+	std::cerr <<
+		"usage: tidequery_harness [options] [< requests.jsonl]\n"
+		"  --stations N      synthetic water level stations (default 200)\n"
+		"  --requests FILE   read requests from FILE instead of stdin\n"
+		"  --demo            inject a built-in batch instead\n"
+		"  --check           inject malformed requests, fail unless each query is refused\n"
+		"  --repeat N        inject every request N times, print the first reply\n"
+		"  --seed N          seed for the synthetic data\n";
+}
+
+static void AddConstituent(TideHarmonics &h, const char *name, double amplitude, double phase)
+{
+	TideConstituent c;
+	c.index = TideConstituentIndex(name);
+	c.amplitude = amplitude;
+	c.phase = phase;
+	if (c.index >= 0)
+		h.constituents.push_back(c);
+}
+
+// Stations scattered over the Maritimes, with data covering the next week.
+static void BuildData(int count, unsigned seed, time_t now, TideQueryData &data)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> lat(43.0, 48.0), lon(-67.0, -59.0), unit(0.0, 1.0);
+
+	std::shared_ptr<TideStationStore> ports = std::make_shared<TideStationStore>();
+	std::shared_ptr<TideStationStore> currents = std::make_shared<TideStationStore>();
+	std::shared_ptr<TideHarmonicsMap> harmonics = std::make_shared<TideHarmonicsMap>();
+	std::shared_ptr<TideSeriesStore> series = std::make_shared<TideSeriesStore>();
+
+	for (int i = 0; i < count; i++) {
+		std::string id = "wl" + std::to_string(i);
+		ports->Add(id, "Station " + std::to_string(i), lat(rng), lon(rng));
+
+		TideHarmonics h;
+		h.stationId = id;
+		h.name = "Station " + std::to_string(i);
+		h.z0 = 1 + unit(rng);
+		h.fitted = now;
+		AddConstituent(h, "M2", 0.5 + 2 * unit(rng), 360 * unit(rng));
+		AddConstituent(h, "S2", 0.1 + 0.4 * unit(rng), 360 * unit(rng));
+		AddConstituent(h, "N2", 0.1 + 0.3 * unit(rng), 360 * unit(rng));
+		AddConstituent(h, "K1", 0.1 + 0.2 * unit(rng), 360 * unit(rng));
+		AddConstituent(h, "O1", 0.05 + 0.2 * unit(rng), 360 * unit(rng));
+
+		if (i % 2 == 0) {
+			(*harmonics)[id] = h;
+			continue;
+		}
+		TidePredictor predictor(h);
+		std::vector<TideSample> samples(7 * 96);
+		for (size_t k = 0; k < samples.size(); k++) {
+			samples[k].t = now - now % 900 + (time_t)k * 900;
+			samples[k].v = predictor.Height(samples[k].t);
+		}
+		series->Get(id, TSK_WLP).Swap(samples);
+	}
+
+	for (int i = 0; i < std::max(1, count / 10); i++) {
+		std::string id = "wc" + std::to_string(i);
+		currents->Add(id, "Current " + std::to_string(i), lat(rng), lon(rng), TSF_CURRENTS);
+		double peak = 0.5 + 3 * unit(rng), set = 360 * unit(rng);
+		std::vector<TideSample> speed(7 * 96), dir(7 * 96);
+		for (size_t k = 0; k < speed.size(); k++) {
+			time_t t = now - now % 900 + (time_t)k * 900;
+			double s = peak * sin(2 * 3.14159265358979323846 * (double)t / 44714.0);
+			speed[k].t = dir[k].t = t;
+			speed[k].v = fabs(s);
+			dir[k].v = s >= 0 ? set : fmod(set + 180, 360);
+		}
+		series->Get(id, TSK_WCS).Swap(speed);
+		series->Get(id, TSK_WCD).Swap(dir);
+	}
+
+	data.ports = ports;
+	data.saved = std::make_shared<TideStationStore>();
+	data.currents = currents;
+	data.harmonics = harmonics;
+	data.series = series;
+}
+
+static void DemoRequests(time_t now, std::vector<std::string> &requests)
+{
+	std::string t = std::to_string((long long)now);
+	requests.push_back("{\"id\":\"demo-1\",\"queries\":["
+		"{\"station\":\"wl0\",\"kind\":\"height\",\"from\":" + t + ",\"to\":" + std::to_string((long long)now + 6 * 3600) + ",\"step\":3600},"
+		"{\"station\":\"wl1\",\"kind\":\"height\",\"times\":[" + t + "]},"
+		"{\"lat\":44.65,\"lon\":-63.57,\"kind\":\"extremes\"},"
+		"{\"lat\":45.2,\"lon\":-66.1,\"kind\":\"current\",\"step\":1800,\"max_nm\":200},"
+		"{\"station\":\"nowhere\",\"kind\":\"height\"}]}");
+	requests.push_back("{\"id\":\"demo-2\",\"queries\":[{\"lat\":44.65,\"lon\":-63.57,\"kind\":\"height\","
+		"\"from\":" + t + ",\"to\":" + std::to_string((long long)now + 86400) + ",\"step\":900}]}");
+	requests.push_back("not json");
+}
+
+// Requests with fields of the wrong type or range. Each used to throw out
+// of jsoncpp on the service thread and terminate the process.
+static void MalformedRequests(std::vector<std::string> &requests)
+{
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"times\":[\"abc\"]}]}");
+	requests.push_back("{\"queries\":[{\"station\":{\"a\":1}}]}");
+	requests.push_back("{\"queries\":[{\"lat\":44.5,\"lon\":-63.6,\"step\":1e12}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"kind\":7}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"from\":\"now\"}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"kind\":\"extremes\",\"to\":1.5}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"from\":-9223372036854775807,\"to\":9223372036854775807}]}");
+	requests.push_back("{\"queries\":[{\"lat\":44.5,\"lon\":-63.6,\"max_nm\":\"far\"}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"times\":{\"0\":1}}]}");
+	requests.push_back("{\"queries\":[{\"station\":\"wl0\",\"times\":[18446744073709551615]}]}");
+	requests.push_back("{\"queries\":[[]]}");
+}
+
+// True when the reply, or every query in it, carries an error.
+static bool Refused(const std::string &reply)
+{
+	Json::Value root;
+	Json::Reader reader;
+	if (!reader.parse(reply, root, false) || !root.isObject())
+		return false;
+	if (root.isMember("error"))
+		return true;
+	const Json::Value &results = root["results"];
+	if (!results.isArray() || results.empty())
+		return false;
+	for (Json::ArrayIndex i = 0; i < results.size(); i++)
+		if (!results[i].isObject() || !results[i].isMember("error"))
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int stations = 200;
+	int repeat = 1;
+	unsigned seed = 1;
+	bool demo = false;
+	bool check = false;
+	std::string file;
+
+	for (int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (a == "--stations" && hasValue) stations = atoi(argv[++i]);
+		else if (a == "--requests" && hasValue) file = argv[++i];
+		else if (a == "--repeat" && hasValue) repeat = std::max(1, atoi(argv[++i]));
+		else if (a == "--seed" && hasValue) seed = (unsigned)atoi(argv[++i]);
+		else if (a == "--demo") demo = true;
+		else if (a == "--check") check = true;
+		else {
+			Usage();
+			return 2;
+		}
+	}
+
+	time_t now = time(NULL);
+	TideQueryData data;
+	BuildData(std::max(1, stations), seed, now, data);
+
+	std::vector<std::string> requests;
+	if (check)
+		MalformedRequests(requests);
+	else if (demo)
+		DemoRequests(now, requests);
+	else {
+		std::ifstream in;
+		if (!file.empty()) {
+			in.open(file.c_str());
+			if (!in) {
+				std::cerr << "tidequery_harness: cannot read " << file << std::endl;
+				return 1;
+			}
+		}
+		std::istream &src = file.empty() ? std::cin : in;
+		std::string line;
+		while (std::getline(src, line))
+			if (!line.empty())
+				requests.push_back(line);
+	}
+
+	TideQueryService service;
+	service.Start();
+
+	std::vector<double> latencies;
+	int accepted = 0;
+	for (size_t r = 0; r < requests.size(); r++) {
+		for (int k = 0; k < repeat; k++) {
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			service.Submit(requests[r], data);
+
+			// The plugin polls from a timer; here we spin until the answer is in
+			std::string reply;
+			while (!service.TakeReply(reply))
+				std::this_thread::yield();
+			latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count());
+
+			if (k == 0)
+				std::cout << TIDE_QUERY_REPLY_MESSAGE << " " << reply << std::endl;
+			if (check && k == 0 && !Refused(reply)) {
+				std::cerr << "tidequery_harness: accepted " << requests[r] << std::endl;
+				accepted++;
+			}
+		}
+	}
+	service.Stop();
+
+	if (!latencies.empty()) {
+		std::sort(latencies.begin(), latencies.end());
+		std::cerr << latencies.size() << " requests, latency us p50 " << latencies[latencies.size() / 2]
+			<< " p99 " << latencies[latencies.size() * 99 / 100]
+			<< " max " << latencies.back() << std::endl;
+	}
+	return accepted ? 1 : 0;
+}